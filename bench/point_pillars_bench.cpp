@@ -0,0 +1,307 @@
+#define _USE_MATH_DEFINES
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <vector>
+
+#include "geometry.h"
+#include "pillars.h"
+#include "point_codec.h"
+#include "synthetic_scene.h"
+#include "target.h"
+
+// Micro benchmarks of the native kernels on ray cast synthetic scenes. Run with
+// --benchmark_out=results.json --benchmark_out_format=json to keep numbers
+// for comparison across releases and machines.
+
+namespace
+{
+const uint64_t kSeed = 42;
+
+// Share of the rays of the default lidar that return, the others point above
+// the horizon or hit the ground beyond the maximum range.
+const float kReturnRate = 0.9f;
+
+// A frame of about nbPoints points from the 64 beams of the default lidar,
+// whose azimuth resolution is adapted to the number of points.
+SyntheticFrame lidarFrame(size_t nbPoints, int nbObjects)
+{
+  LidarParameters lidar;
+  lidar.azimuthResolution = static_cast<float>(
+      2 * M_PI * lidar.beams * kReturnRate / static_cast<double>(nbPoints));
+  SceneParameters scene;
+  scene.objectCounts = {nbObjects - 2 * (nbObjects / 3), nbObjects / 3,
+                        nbObjects / 3};
+  return generateScene(lidar, scene, kSeed);
+}
+
+// Objects only, without ray casting.
+std::vector<BoundingBox3D> sceneObjects(int nbObjects, bool mixedClasses)
+{
+  LidarParameters lidar;
+  lidar.beams = 0;
+  SceneParameters scene;
+  scene.objectCounts = {nbObjects};
+  if (mixedClasses)
+  {
+    scene.objectCounts = {nbObjects - 2 * (nbObjects / 3), nbObjects / 3,
+                          nbObjects / 3};
+  }
+  return generateScene(lidar, scene, kSeed).objects;
+}
+
+// The anchors of config.py.
+TargetParameters targetParameters()
+{
+  const float anchors[4][5] = {{3.9f, 1.6f, 1.56f, -1.0f, 0.0f},
+                               {3.9f, 1.6f, 1.56f, -1.0f, 1.5708f},
+                               {0.8f, 0.6f, 1.73f, -0.6f, 0.0f},
+                               {0.8f, 0.6f, 1.73f, -0.6f, 1.5708f}};
+  TargetParameters parameters;
+  for (const auto &anchor : anchors)
+  {
+    BoundingBox3D anchorBox = {};
+    anchorBox.length = anchor[0];
+    anchorBox.width = anchor[1];
+    anchorBox.height = anchor[2];
+    anchorBox.z = anchor[3];
+    anchorBox.yaw = anchor[4];
+    anchorBox.base_yaw = anchor[4];
+    anchorBox.classId = -1;
+    parameters.anchors.emplace_back(anchorBox);
+  }
+  parameters.nbClasses = 3;
+  return parameters;
+}
+
+// Box pairs from the objects of a scene, each object paired with a copy moved
+// by offset along x and turned by 0.3 rad.
+std::vector<std::pair<BoundingBox3D, BoundingBox3D>> boxPairs(float offset)
+{
+  std::vector<std::pair<BoundingBox3D, BoundingBox3D>> pairs;
+  for (const auto &box : sceneObjects(256, true))
+  {
+    BoundingBox3D moved = box;
+    moved.x += offset;
+    moved.yaw += 0.3f;
+    pairs.emplace_back(box, moved);
+  }
+  return pairs;
+}
+} // namespace
+
+// Arguments: points, pillar size in cm, maxPillars, maxPointsPerPillar. The
+// number of points is approximate, the "points" counter has the actual one.
+// The z range of the original PointPillars KITTI setup keeps the ground
+// points.
+static void BM_CreatePillars(benchmark::State &state)
+{
+  const float step = state.range(1) / 100.0f;
+  const int maxPillars = static_cast<int>(state.range(2));
+  const int maxPointsPerPillar = static_cast<int>(state.range(3));
+  const SyntheticFrame scene = lidarFrame(state.range(0), 20);
+  const size_t nbPoints = scene.points.size() / scene.nbChannels;
+
+  std::vector<float> tensor(static_cast<size_t>(maxPillars) *
+                            maxPointsPerPillar * pillarFeatureCount(4));
+  std::vector<int> indices(static_cast<size_t>(maxPillars) * 3);
+  int nbPillars = 0;
+  for (auto _ : state)
+  {
+    nbPillars = createPillarsFromPoints(
+        scene.points.data(), nbPoints, 4, maxPointsPerPillar, maxPillars, step,
+        step, 0.0f, 80.64f, -40.32f, 40.32f, -3.0f, 1.0f, -1.0f,
+        tensor.data(), indices.data());
+    benchmark::DoNotOptimize(nbPillars);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * nbPoints);
+  state.counters["points"] = nbPoints;
+  state.counters["pillars"] = nbPillars;
+}
+BENCHMARK(BM_CreatePillars)
+    ->ArgNames({"points", "step_cm", "maxPillars", "maxPointsPerPillar"})
+    ->ArgsProduct({{20000, 120000, 2000000}, {16, 32}, {12000, 30000}, {32, 100}})
+    ->Unit(benchmark::kMillisecond);
+
+// Argument: points, approximate as for BM_CreatePillars. The "ratio" counter
+// is the encoded size relative to the raw float32 points.
+static void BM_EncodePoints(benchmark::State &state)
+{
+  const SyntheticFrame scene = lidarFrame(state.range(0), 20);
+  const size_t nbPoints = scene.points.size() / scene.nbChannels;
+
+  std::vector<uint8_t> encoded;
+  for (auto _ : state)
+  {
+    encoded.clear();
+    encodePoints(scene.points.data(), nbPoints, encoded);
+    benchmark::DoNotOptimize(encoded.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * nbPoints);
+  state.SetBytesProcessed(state.iterations() * nbPoints * 4 * sizeof(float));
+  state.counters["points"] = nbPoints;
+  state.counters["ratio"] =
+      static_cast<double>(encoded.size()) / (nbPoints * 4 * sizeof(float));
+}
+BENCHMARK(BM_EncodePoints)
+    ->ArgName("points")
+    ->Arg(20000)
+    ->Arg(120000)
+    ->Arg(2000000)
+    ->Unit(benchmark::kMillisecond);
+
+// Argument: points, approximate as for BM_CreatePillars.
+static void BM_DecodePoints(benchmark::State &state)
+{
+  const SyntheticFrame scene = lidarFrame(state.range(0), 20);
+  const size_t nbPoints = scene.points.size() / scene.nbChannels;
+  std::vector<uint8_t> encoded;
+  encodePoints(scene.points.data(), nbPoints, encoded);
+
+  PointDecodeBuffer buffer;
+  for (auto _ : state)
+  {
+    decodePoints(encoded.data(), encoded.size(), buffer);
+    benchmark::DoNotOptimize(buffer.points.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * nbPoints);
+  state.SetBytesProcessed(state.iterations() * nbPoints * 4 * sizeof(float));
+  state.counters["points"] = nbPoints;
+}
+BENCHMARK(BM_DecodePoints)
+    ->ArgName("points")
+    ->Arg(20000)
+    ->Arg(120000)
+    ->Arg(2000000)
+    ->Unit(benchmark::kMillisecond);
+
+// Arguments: objects, 0 for cars only or 1 for cars, pedestrians and cyclists.
+static void BM_CreatePillarsTarget(benchmark::State &state)
+{
+  const std::vector<BoundingBox3D> objects =
+      sceneObjects(static_cast<int>(state.range(0)), state.range(1) != 0);
+  const size_t nbObjects = objects.size();
+  const TargetParameters parameters = targetParameters();
+
+  std::vector<float> target(parameters.targetSize(nbObjects));
+  for (auto _ : state)
+  {
+    const TargetStatistics statistics =
+        createTarget(objects, parameters, target.data());
+    benchmark::DoNotOptimize(statistics.positives);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * nbObjects);
+}
+BENCHMARK(BM_CreatePillarsTarget)
+    ->ArgNames({"objects", "mixed"})
+    ->ArgsProduct({{1, 8, 32, 64}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+
+// Argument: distance between the boxes of a pair in cm, 0 overlapping
+// heavily, 150 partially and 1000 disjoint.
+static void BM_Iou(benchmark::State &state)
+{
+  const auto pairs = boxPairs(state.range(0) / 100.0f);
+  for (auto _ : state)
+  {
+    for (const auto &pair : pairs)
+    {
+      benchmark::DoNotOptimize(iou(pair.first, pair.second));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * pairs.size());
+}
+BENCHMARK(BM_Iou)->ArgName("offset_cm")->Arg(0)->Arg(150)->Arg(1000);
+
+static void BM_BoxOverlap(benchmark::State &state)
+{
+  const auto pairs = boxPairs(state.range(0) / 100.0f);
+  std::vector<std::pair<PreparedBox, PreparedBox>> prepared;
+  for (const auto &pair : pairs)
+  {
+    prepared.emplace_back(prepareBox(pair.first), prepareBox(pair.second));
+  }
+  const auto metric = static_cast<IouMetric>(state.range(1));
+  for (auto _ : state)
+  {
+    for (const auto &pair : prepared)
+    {
+      benchmark::DoNotOptimize(boxOverlap(pair.first, pair.second, metric));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * prepared.size());
+}
+BENCHMARK(BM_BoxOverlap)
+    ->ArgNames({"offset_cm", "metric"})
+    ->ArgsProduct({{0, 150, 1000}, {0, 1, 2, 3}});
+
+static void BM_SutherlandHodgmanClip(benchmark::State &state)
+{
+  const auto pairs = boxPairs(state.range(0) / 100.0f);
+  std::vector<std::pair<Polyline2D, Polyline2D>> polygons;
+  for (const auto &pair : pairs)
+  {
+    polygons.emplace_back(boundingBox3DToTopDown(pair.first),
+                          boundingBox3DToTopDown(pair.second));
+  }
+  for (auto _ : state)
+  {
+    for (const auto &pair : polygons)
+    {
+      const Polyline2D clipped = sutherlandHodgmanClip(pair.first, pair.second);
+      benchmark::DoNotOptimize(clipped.data());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * polygons.size());
+}
+BENCHMARK(BM_SutherlandHodgmanClip)->ArgName("offset_cm")->Arg(0)->Arg(150);
+
+static void BM_Clip(benchmark::State &state)
+{
+  const auto pairs = boxPairs(state.range(0) / 100.0f);
+  std::vector<std::pair<Polyline2D, Polyline2D>> polygons;
+  for (const auto &pair : pairs)
+  {
+    polygons.emplace_back(boundingBox3DToTopDown(pair.first),
+                          boundingBox3DToTopDown(pair.second));
+  }
+  for (auto _ : state)
+  {
+    for (const auto &pair : polygons)
+    {
+      // Against the first edge of the clipper only.
+      const Polyline2D clipped =
+          clip(pair.first, pair.second[0].x, pair.second[0].y,
+               pair.second[1].x, pair.second[1].y);
+      benchmark::DoNotOptimize(clipped.data());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * polygons.size());
+}
+BENCHMARK(BM_Clip)->ArgName("offset_cm")->Arg(0)->Arg(150);
+
+static void BM_IntersectionArea(benchmark::State &state)
+{
+  const auto pairs = boxPairs(state.range(0) / 100.0f);
+  std::vector<std::pair<Rectangle2D, Rectangle2D>> rectangles;
+  for (const auto &pair : pairs)
+  {
+    rectangles.emplace_back(prepareBox(pair.first).corners,
+                            prepareBox(pair.second).corners);
+  }
+  for (auto _ : state)
+  {
+    for (const auto &pair : rectangles)
+    {
+      benchmark::DoNotOptimize(intersectionArea(pair.first, pair.second));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * rectangles.size());
+}
+BENCHMARK(BM_IntersectionArea)->ArgName("offset_cm")->Arg(0)->Arg(150);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,15 @@
+# Fails if the shared library LIBRARY exports a global operator new or delete,
+# which would replace the allocator of every process loading it. Run by ctest
+# with NM and LIBRARY set.
+execute_process(COMMAND ${NM} -D --defined-only ${LIBRARY}
+    OUTPUT_VARIABLE symbols
+    RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${NM} failed on ${LIBRARY}")
+endif()
+string(REGEX MATCHALL "[^\n]* _Z(nw|na|dl|da)[^\n]*" allocator "${symbols}")
+if(allocator)
+    string(REPLACE ";" "\n" allocator "${allocator}")
+    message(FATAL_ERROR "${LIBRARY} exports the global allocator:\n${allocator}")
+endif()
+message(STATUS "${LIBRARY} exports no allocator")
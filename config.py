@@ -13,6 +13,9 @@ class GridParameters:
     z_min = -1.0
     z_max = 3.0
 
+    # points closer to the sensor (m) are dropped, a negative distance keeps all
+    min_distance = -1.0
+
     # derived parameters
     Xn_f = float(x_max - x_min) / x_step
     Yn_f = float(y_max - y_min) / y_step
@@ -38,6 +41,24 @@ class DataParameters:
     nb_classes = len(np.unique(list(classes.values())))
     assert nb_classes == np.max(np.unique(list(classes.values()))) + 1, 'Starting class indexing at zero.'
 
+    # global augmentation of training samples: rotation (rad), scale range, probability of mirroring along y and
+    # standard deviation of the translation (m) along x, y, z
+    augmentation_max_yaw = np.pi / 4
+    augmentation_scale = (0.95, 1.05)
+    augmentation_flip_probability = 0.5
+    augmentation_translation_std = (0.2, 0.2, 0.2)
+    # ground truth sampling (see create_gt_database.py): training samples are filled up to this number of objects
+    # per class id with objects of other frames
+    gt_sample_counts = [15, 10, 10, 0]
+    # per object augmentation of training samples: every box is rotated around its center (rad) and moved with this
+    # standard deviation (m) along x, y, z, unless it would collide with another box
+    object_noise_max_yaw = np.pi / 20
+    object_noise_translation_std = (0.25, 0.25, 0.25)
+    # objects with fewer lidar points inside their box get no target
+    min_object_points = 1
+    # KITTI evaluation: label type and the overlap a detection needs for a match, in BEV and 3D
+    evaluation_min_overlaps = {"Car": 0.7, "Pedestrian": 0.5, "Cyclist": 0.5}
+
     def __init__(self):
         super(DataParameters, self).__init__()
 
@@ -56,10 +77,17 @@ class NetworkParameters:
                             [0.8, 0.6, 1.73, -0.6, 0],
                             [0.8, 0.6, 1.73, -0.6, 1.5708],
                             ], dtype=np.float32).tolist()
+    # class id each anchor is matched against, -1 matches every class
+    anchor_class_ids = [-1, -1, -1, -1]
     nb_dims = 3
 
     positive_iou_threshold = 0.6
     negative_iou_threshold = 0.3
+    angle_threshold = 0.3   # anchors closer than this (rad) to the object yaw are rotated onto it
+    # per class overrides of the thresholds above indexed by class id, e.g. [0.6, 0.5] / [0.45, 0.35] for
+    # cars and pedestrians as in the original pillars paper; classes without entry use the global values
+    positive_iou_thresholds = []
+    negative_iou_thresholds = []
     batch_size = 4
     total_training_epochs = 160
     iters_to_decay = 101040.    # 15 * 4 * ceil(6733. / 4) --> every 15 epochs on 6733 kitti samples, cf. pillar paper
@@ -0,0 +1,23 @@
+import argparse
+import os
+from glob import glob
+
+from config import Parameters
+from point_pillars import buildGtDatabase
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Extracts the points of every labeled object of a KITTI split into a "
+                                                 "ground truth database for copy-paste augmentation")
+    parser.add_argument("data_root", help="directory containing velodyne, label_2 and calib")
+    parser.add_argument("output", help="database file to write")
+    parser.add_argument("--min-points", type=int, default=5, help="objects with fewer points are skipped")
+    args = parser.parse_args()
+
+    lidar_files = sorted(glob(os.path.join(args.data_root, "velodyne", "*.bin")))
+    label_files = sorted(glob(os.path.join(args.data_root, "label_2", "*.txt")))
+    calibration_files = sorted(glob(os.path.join(args.data_root, "calib", "*.txt")))
+    assert len(lidar_files) == len(label_files) == len(calibration_files), "Input dirs require equal number of files."
+
+    count = buildGtDatabase(args.output, lidar_files, label_files, calibration_files, Parameters.classes,
+                            args.min_points)
+    print("Wrote %d objects of %d frames to %s" % (count, len(lidar_files), args.output))
@@ -4,6 +4,7 @@ from typing import List
 from config import Parameters
 from readers import DataReader
 from processors import DataProcessor
+from point_pillars import evaluateKitti, EvaluationClass, checkOccupancy
 
 
 class BBox(tuple):
@@ -78,7 +79,8 @@ def generate_bboxes_from_pred(occ, pos, siz, ang, hdg, clf, anchor_dims, occ_thr
         bb_length = np.exp(siz[value][0]) * real_anchors[i][0]
         bb_width = np.exp(siz[value][1]) * real_anchors[i][1]
         bb_height = np.exp(siz[value][2]) * real_anchors[i][2]
-        bb_yaw = -np.arcsin(np.clip(ang[value], -1, 1)) + real_anchors[i][4]
+        # yaw of the not oriented box, the heading tells whether it has to be flipped around
+        bb_yaw = np.arcsin(np.clip(ang[value], -1, 1)) + real_anchors[i][4]
         bb_heading = np.round(hdg[value])
         bb_cls = np.argmax(clf[value])
         bb_conf = occ[value]
@@ -118,17 +120,49 @@ class GroundTruthGenerator(DataProcessor):
         return label_transformed
 
 
-def focal_loss_checker(y_true, y_pred, n_occs=-1):
-    y_true = np.stack(np.where(y_true == 1))
-    if n_occs == -1:
-        n_occs = y_true.shape[1]
-    occ_thr = np.sort(y_pred.flatten())[-n_occs]
-    y_pred = np.stack(np.where(y_pred >= occ_thr))
-    p = 0
-    for gt in range(y_true.shape[1]):
-        for pr in range(y_pred.shape[1]):
-            if np.all(y_true[:, gt] == y_pred[:, pr]):
-                p += 1
-                break
-    print("#matched gt: ", p, " #unmatched gt: ", y_true.shape[1] - p, " #unmatched pred: ", y_pred.shape[1] - p,
-          " occupancy threshold: ", occ_thr)
+def oriented_yaw(box: BBox):
+    """ yaw in [-pi, pi] of the box after applying its heading """
+    yaw = box.yaw + np.pi * box.heading
+    return (yaw + np.pi) % (2 * np.pi) - np.pi
+
+
+def evaluate_kitti(set_boxes, label_files: List[str], calibration_files: List[str], params: Parameters,
+                   threads: int = 0):
+    """ KITTI AP_R40 (BEV, 3D) and orientation similarity per class for easy, moderate and hard """
+    assert len(set_boxes) == len(label_files) == len(calibration_files)
+    detections = [np.array([[box.x, box.y, box.z, box.length, box.width, box.height, oriented_yaw(box), box.cls,
+                             box.conf] for box in boxes], dtype=np.float32).reshape(-1, 9) for boxes in set_boxes]
+    classes = [EvaluationClass(name, params.classes[name], min_overlap)
+               for name, min_overlap in params.evaluation_min_overlaps.items()]
+    return evaluateKitti(label_files, calibration_files, detections, classes, threads)
+
+
+def focal_loss_checker(y_true, y_pred, n_occs=-1, thresholds=(0.3, 0.5, 0.7)):
+    """ Matches the n_occs highest predicted occupancies (as many as there are positives if -1) against the target,
+    returns the native OccupancyCheck with the precision and recall counts of the thresholds """
+    check = checkOccupancy(y_true, y_pred, n_occs, list(thresholds))
+    print("#matched gt: ", check.matched, " #unmatched gt: ", check.unmatchedTargets, " #unmatched pred: ",
+          check.unmatchedPredictions, " occupancy threshold: ", check.threshold)
+    return check
+
+
+def focal_loss_summary(y_true, y_pred, n_occs=-1, thresholds=(0.3, 0.5, 0.7)):
+    """ Sums the OccupancyCheck counts of the frames of y_true and y_pred (see focal_loss_checker), prints the matches
+    and the precision and recall of the thresholds over all frames """
+    thresholds = sorted(thresholds)
+    matched, unmatched_targets, unmatched_predictions, target_positives = 0, 0, 0, 0
+    true_positives = np.zeros(len(thresholds), dtype=np.int64)
+    predicted_positives = np.zeros(len(thresholds), dtype=np.int64)
+    for target, predicted in zip(y_true, y_pred):
+        check = checkOccupancy(target, predicted, n_occs, thresholds)
+        matched += check.matched
+        unmatched_targets += check.unmatchedTargets
+        unmatched_predictions += check.unmatchedPredictions
+        target_positives += check.targetPositives
+        true_positives += check.truePositives
+        predicted_positives += check.predictedPositives
+    print("#matched gt: ", matched, " #unmatched gt: ", unmatched_targets, " #unmatched pred: ",
+          unmatched_predictions)
+    for threshold, tp, predicted in zip(thresholds, true_positives, predicted_positives):
+        print("occupancy >= %.2f: precision %6.2f recall %6.2f" %
+              (threshold, 100 * tp / max(predicted, 1), 100 * tp / max(target_positives, 1)))
@@ -0,0 +1,23 @@
+import argparse
+import os
+from glob import glob
+
+from point_pillars import PointEncoding, writeKittiShard
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Packs a KITTI split (velodyne, label_2, calib) into one shard file")
+    parser.add_argument("data_root", help="directory containing velodyne and optionally label_2 and calib")
+    parser.add_argument("output", help="shard file to write")
+    parser.add_argument("--compress", action="store_true",
+                        help="store points quantised to millimetres and compressed")
+    args = parser.parse_args()
+
+    lidar_files = sorted(glob(os.path.join(args.data_root, "velodyne", "*.bin")))
+    label_files = sorted(glob(os.path.join(args.data_root, "label_2", "*.txt")))
+    calibration_files = sorted(glob(os.path.join(args.data_root, "calib", "*.txt")))
+    assert len(label_files) in (0, len(lidar_files)), "Input dirs require equal number of files."
+    assert len(calibration_files) in (0, len(lidar_files)), "Input dirs require equal number of files."
+
+    encoding = PointEncoding.Compressed if args.compress else PointEncoding.Raw
+    writeKittiShard(args.output, lidar_files, label_files, calibration_files, encoding)
+    print("Wrote %d samples to %s" % (len(lidar_files), args.output))
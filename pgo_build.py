@@ -0,0 +1,104 @@
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+from glob import glob
+
+SOURCE_DIR = os.path.dirname(os.path.abspath(__file__))
+
+
+def run(command, **kwargs):
+    print("+ " + " ".join(command), flush=True)
+    subprocess.check_call(command, **kwargs)
+
+
+def build(args, pgo, lto):
+    run(["cmake", "-S", SOURCE_DIR, "-B", args.build_dir,
+         "-DCMAKE_BUILD_TYPE=Release",
+         "-DPYTHON_EXECUTABLE=" + sys.executable,
+         "-DPOINT_PILLARS_PYTHON=" + ("OFF" if args.no_python else "ON"),
+         "-DPOINT_PILLARS_BENCHMARKS=" + ("OFF" if args.no_benchmarks else "ON"),
+         "-DPOINT_PILLARS_PGO=" + pgo,
+         "-DPOINT_PILLARS_PGO_DIR=" + args.profile_dir,
+         "-DPOINT_PILLARS_LTO=" + lto])
+    run(["cmake", "--build", args.build_dir, "--config", "Release", "--parallel", str(os.cpu_count())])
+
+
+def training_workload(frames):
+    """Pillars, targets and overlaps of augmented synthetic scenes with the parameters of config.py."""
+    import numpy as np
+    from config import Parameters
+    from point_pillars import Augmentation, IouMetric, SceneParameters, boxIouMatrix, createPillars, \
+        createPillarsTarget, generateScene, pointsInBoxes
+
+    params = Parameters()
+    anchors = np.array(params.anchor_dims, dtype=np.float32)
+    rng = np.random.RandomState(0)
+    scene = SceneParameters()
+    for seed in range(frames):
+        scene.objectCounts = rng.randint(2, 30, 3).tolist()
+        points, boxes, class_ids = generateScene(scene=scene, seed=seed)
+        augmentation = Augmentation(yaw=rng.uniform(-params.augmentation_max_yaw, params.augmentation_max_yaw),
+                                    scale=rng.uniform(*params.augmentation_scale),
+                                    flipY=bool(rng.rand() < params.augmentation_flip_probability),
+                                    translation=rng.normal(0, params.augmentation_translation_std).tolist())
+        createPillars(points, params.max_points_per_pillar, params.max_pillars, params.x_step, params.y_step,
+                      params.x_min, params.x_max, params.y_min, params.y_max, params.z_min, params.z_max,
+                      augmentation=augmentation)
+
+        # the target takes the box centers, the scenes the bottoms
+        centers = boxes.copy()
+        centers[:, 2] += boxes[:, 5] / 2
+        createPillarsTarget(centers[:, 0:3], centers[:, 3:6], centers[:, 6], class_ids, anchors[:, 0:3],
+                            anchors[:, 3], anchors[:, 4], params.positive_iou_threshold,
+                            params.negative_iou_threshold, params.angle_threshold, params.nb_classes,
+                            params.downscaling_factor, params.x_step, params.y_step, params.x_min, params.x_max,
+                            params.y_min, params.y_max, params.z_min, params.z_max,
+                            anchorClassIds=params.anchor_class_ids, augmentation=augmentation)
+        pointsInBoxes(points, boxes)
+        for metric in (IouMetric.Bev, IouMetric.Iou3D):
+            boxIouMatrix(centers, centers, metric)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Builds point_pillars with profile guided and link time "
+                                                 "optimization: an instrumented build runs the benchmarks and "
+                                                 "synthetic scenes, then everything is rebuilt with their profile")
+    parser.add_argument("--build-dir", default=os.path.join(SOURCE_DIR, "build-pgo"))
+    parser.add_argument("--profile-dir", help="defaults to pgo-profiles in the build directory")
+    parser.add_argument("--frames", type=int, default=50, help="synthetic scenes of the training workload")
+    parser.add_argument("--no-python", action="store_true",
+                        help="only the C library and the benchmarks, trained by the benchmarks")
+    parser.add_argument("--no-benchmarks", action="store_true",
+                        help="without Google Benchmark, trained by the synthetic scenes only")
+    parser.add_argument("--no-lto", action="store_true")
+    parser.add_argument("--llvm-profdata", default="llvm-profdata", help="merges the profiles of Clang builds")
+    parser.add_argument("--workload", action="store_true", help=argparse.SUPPRESS)
+    args = parser.parse_args()
+
+    if args.workload:
+        training_workload(args.frames)
+        sys.exit(0)
+
+    assert not (args.no_python and args.no_benchmarks), "The training workload needs the module or the benchmarks."
+    args.build_dir = os.path.abspath(args.build_dir)
+    args.profile_dir = os.path.abspath(args.profile_dir or os.path.join(args.build_dir, "pgo-profiles"))
+
+    # profiles of earlier sources would be matched against the current ones
+    shutil.rmtree(args.profile_dir, ignore_errors=True)
+    build(args, "GENERATE", "OFF")
+
+    if not args.no_benchmarks:
+        run([os.path.join(args.build_dir, "point_pillars_bench")])
+    if not args.no_python:
+        env = dict(os.environ, PYTHONPATH=os.pathsep.join([args.build_dir, SOURCE_DIR]))
+        run([sys.executable, os.path.abspath(__file__), "--workload", "--frames", str(args.frames)], env=env)
+
+    raw_profiles = glob(os.path.join(args.profile_dir, "*.profraw"))
+    if raw_profiles:
+        run([args.llvm_profdata, "merge", "-o", os.path.join(args.profile_dir, "point_pillars.profdata")] +
+            raw_profiles)
+
+    build(args, "USE", "OFF" if args.no_lto else "ON")
+    print("Optimized build in %s" % args.build_dir)
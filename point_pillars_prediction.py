@@ -3,7 +3,7 @@ from glob import glob
 import numpy as np
 import tensorflow as tf
 from processors import SimpleDataGenerator
-from inference_utils import generate_bboxes_from_pred, GroundTruthGenerator, focal_loss_checker, rotational_nms
+from inference_utils import generate_bboxes_from_pred, rotational_nms, evaluate_kitti, focal_loss_summary
 from readers import KittiDataReader
 from config import Parameters
 from network import build_point_pillar_graph
@@ -45,13 +45,13 @@ if __name__ == "__main__":
     print('Scene 1: Boxes after NMS with iou_thr: ', len(nms_boxes[0]))
 
     # Do all the further operations on predicted_boxes array, which contains the predicted bounding boxes
-    gt_gen = GroundTruthGenerator(data_reader, label_files, calibration_files, network_format=False)
-    gt_gen0 = GroundTruthGenerator(data_reader, label_files, calibration_files, network_format=True)
-    for seq_boxes, gt_label, gt0 in zip(nms_boxes, gt_gen, gt_gen0):
-        print("---------- New Scenario ---------- ")
-        focal_loss_checker(gt0[0], occupancy[0], n_occs=-1)
-        print("---------- ------------ ---------- ")
-        for gt in gt_label:
-            print(gt)
-        for pred in seq_boxes:
-            print(pred)
+    print("AP_R40 (easy, moderate, hard)")
+    for result in evaluate_kitti(nms_boxes, label_files[:len(nms_boxes)], calibration_files[:len(nms_boxes)], params):
+        print("%-12s BEV %6.2f %6.2f %6.2f | 3D %6.2f %6.2f %6.2f | AOS %6.2f %6.2f %6.2f" %
+              ((result.name,) + tuple(result.bev) + tuple(result.iou3D) + tuple(result.orientation)))
+
+    print("Occupancy of all frames")
+    target_occupancy = [eval_gen.make_ground_truth_from_files(label_file, calibration_file)[0]
+                        for label_file, calibration_file in zip(label_files[:loop_range],
+                                                                calibration_files[:loop_range])]
+    focal_loss_summary(target_occupancy, occupancy.reshape((-1,) + occupancy.shape[-3:]))
@@ -1,8 +1,23 @@
+import json
+import os
+import subprocess
+import sys
+import tempfile
 import unittest
 import numpy as np
 import tensorflow as tf
 
-from point_pillars import createPillars, createPillarsTarget, select
+from point_pillars import createPillars, createPillarsFromFile, createPillarsFromShard, createPillarsTarget, Shard, \
+    writeKittiShard, compressPoints, decompressPoints, PointEncoding, VoxelCache, select, AssignmentMode, boxIouMatrix, IouMetric, \
+    Pipeline, PipelineParameters, Augmentation, buildGtDatabase, GtDatabase, sampleGroundTruth, pointsInBoxes, \
+    transformObjects, evaluateKitti, EvaluationClass, checkOccupancy, generateScene, LidarParameters, SceneParameters, \
+    setInstrumentationEnabled, resetInstrumentation, instrumentationReport, allocationTracking, setTracingEnabled, \
+    clearTrace, chromeTrace, TraceSpan, setFrameArenaCapacity, frameArenaCapacity, cpuTarget, \
+    supportedCpuTargets, ObjectNoiseRange, augmentBoxes, targetFormatVersion
+from config import Parameters
+from inference_utils import BBox, evaluate_kitti
+from processors import DataProcessor
+from readers import KittiDataReader
 
 
 class PointPillarsTest(unittest.TestCase):
@@ -30,6 +45,514 @@ class PointPillarsTest(unittest.TestCase):
         arr, = session.run([feature_map])
         assert (arr.shape == (504, 504, 7))
 
+    def test_pillar_creation_from_file(self):
+        points = self.arr.astype(np.float32)
+        with tempfile.TemporaryDirectory() as directory:
+            path = os.path.join(directory, "000000.bin")
+            points.tofile(path)
+            pillars, indices = createPillarsFromFile(path, 100, 12000, 0.16, 0.16, 0, 80.64, -40.32, 40.32, -3, 1)
+
+        expected_pillars, expected_indices = createPillars(points, 100, 12000, 0.16, 0.16, 0, 80.64, -40.32, 40.32,
+                                                           -3, 1)
+        assert np.array_equal(pillars, expected_pillars)
+        assert np.array_equal(indices, expected_indices)
+
+    def test_instrumentation(self):
+        setInstrumentationEnabled(True)
+        resetInstrumentation()
+        try:
+            _, indices = createPillars(self.arr, 10, 1000, 0.16, 0.16, 0, 80.64, -40.32, 40.32, -3, 1)
+            createPillarsTarget(np.array([[20, 0, -1]], dtype=np.float32), np.array([[3.9, 1.6, 1.56]], dtype=np.float32),
+                                np.array([0], dtype=np.float32), np.array([0], dtype=np.int32),
+                                np.array([[3.9, 1.6, 1.56]], dtype=np.float32), np.array([-1], dtype=np.float32),
+                                np.array([0], dtype=np.float32), 0.6, 0.45, 0.3, 1, 2, 0.16, 0.16, 0, 80.64, -40.32,
+                                40.32, -3, 1)
+        finally:
+            setInstrumentationEnabled(False)
+
+        report = instrumentationReport()
+        stages = {stage.name: stage for stage in report.stages}
+        assert all(stage.calls == 1 and sum(stage.histogram) == 1
+                   for name, stage in stages.items() if name.startswith(("pillars", "target")))
+        assert stages["target.iou"].totalNanoseconds > 0
+        assert stages["pillars"].totalNanoseconds >= stages["pillars.grouping"].totalNanoseconds
+        if allocationTracking():
+            assert stages["target"].allocations >= stages["target.assignment"].allocations > 0
+            assert stages["target"].peakBytes >= stages["target.assignment"].peakBytes > 0
+        else:
+            assert all(stage.allocatedBytes == 0 for stage in report.stages)
+        counters = report.counters
+        assert counters["pointsInRange"] + counters["pointsOutOfRange"] == len(self.arr)
+        assert counters["pillars"] == 1000 and counters["pillarsDropped"] > 0
+
+        # nothing is recorded while switched off
+        createPillars(self.arr, 10, 1000, 0.16, 0.16, 0, 80.64, -40.32, 40.32, -3, 1)
+        assert instrumentationReport().counters == counters
+
+    def test_frame_arena(self):
+        tensor, indices = createPillars(self.arr, 10, 1000, 0.16, 0.16, 0, 80.64, -40.32, 40.32, -3, 1)
+        setFrameArenaCapacity(64 << 20)
+        setInstrumentationEnabled(True)
+        resetInstrumentation()
+        try:
+            assert frameArenaCapacity() == 64 << 20
+            reservedTensor, reservedIndices = createPillars(self.arr, 10, 1000, 0.16, 0.16, 0, 80.64, -40.32, 40.32,
+                                                            -3, 1)
+        finally:
+            setInstrumentationEnabled(False)
+            setFrameArenaCapacity(0)
+        np.testing.assert_array_equal(reservedTensor, tensor)
+        np.testing.assert_array_equal(reservedIndices, indices)
+        if allocationTracking():
+            # all temporaries fit into the reserved arena
+            stages = {stage.name: stage for stage in instrumentationReport().stages}
+            assert stages["pillars"].allocations == 0
+
+    def test_cpu_dispatch(self):
+        targets = supportedCpuTargets()
+        assert targets[0] == "baseline" and cpuTarget() == targets[-1]
+
+        # every variant computes the same pillars
+        tensor, _ = createPillars(self.arr, 10, 1000, 0.16, 0.16, 0, 80.64, -40.32, 40.32, -3, 1)
+        script = "import sys; import numpy as np; from point_pillars import createPillars, cpuTarget; " \
+                 "tensor, _ = createPillars(np.load(sys.argv[1]), 10, 1000, 0.16, 0.16, 0, 80.64, -40.32, 40.32, -3, 1); " \
+                 "np.save(sys.argv[2], tensor); print(cpuTarget())"
+        with tempfile.TemporaryDirectory() as directory:
+            points = os.path.join(directory, "points.npy")
+            output = os.path.join(directory, "tensor.npy")
+            np.save(points, self.arr)
+            for target in targets:
+                environment = dict(os.environ, POINT_PILLARS_CPU_TARGET=target)
+                selected = subprocess.check_output([sys.executable, "-c", script, points, output], env=environment)
+                assert selected.decode().strip() == target
+                np.testing.assert_array_equal(np.load(output), tensor)
+
+            environment = dict(os.environ, POINT_PILLARS_CPU_TARGET="sse2")
+            assert subprocess.run([sys.executable, "-c", "import point_pillars"], env=environment,
+                                  stderr=subprocess.DEVNULL).returncode != 0
+
+    def test_tracing(self):
+        clearTrace()
+        setTracingEnabled(True)
+        try:
+            with TraceSpan("frame"):
+                createPillars(self.arr, 10, 1000, 0.16, 0.16, 0, 80.64, -40.32, 40.32, -3, 1)
+        finally:
+            setTracingEnabled(False)
+
+        events = json.loads(chromeTrace())["traceEvents"]
+        spans = [event for event in events if event["ph"] in "BE"]
+        assert [event["name"] for event in spans[:3]] == ["frame", "pillars", "pillars.filter"]
+        assert spans[-1]["name"] == "frame" and spans[-1]["ph"] == "E"
+        assert sum(event["ph"] == "B" for event in spans) == sum(event["ph"] == "E" for event in spans)
+        assert all(a["ts"] <= b["ts"] for a, b in zip(spans, spans[1:]))
+
+        clearTrace()
+        assert json.loads(chromeTrace())["traceEvents"] == []
+
+    def test_shard_round_trip(self):
+        points = self.arr.astype(np.float32)
+        with tempfile.TemporaryDirectory() as directory:
+            lidar_files = []
+            for i in range(3):
+                lidar_files.append(os.path.join(directory, "%06d.bin" % i))
+                points[i * 1000:].tofile(lidar_files[-1])
+            shard_path = os.path.join(directory, "test.shard")
+            writeKittiShard(shard_path, lidar_files)
+
+            shard = Shard(shard_path)
+            assert len(shard) == 3
+            assert np.array_equal(shard.points(2), points[2000:])
+            pillars, indices = createPillarsFromShard(shard, [2, 0], 100, 12000, 0.16, 0.16, 0, 80.64, -40.32, 40.32,
+                                                      -3, 1)
+            expected_pillars, _ = createPillars(points, 100, 12000, 0.16, 0.16, 0, 80.64, -40.32, 40.32, -3, 1)
+            assert pillars.shape[0] == 2
+            assert np.array_equal(pillars[1], expected_pillars[0])
+            del shard
+
+            # a failing input leaves no shard behind, not even one of the samples before it
+            broken_path = os.path.join(directory, "broken.shard")
+            with self.assertRaises(RuntimeError):
+                writeKittiShard(broken_path, lidar_files + [os.path.join(directory, "missing.bin")])
+            assert not os.path.exists(broken_path)
+
+    def test_point_compression(self):
+        points = self.arr.astype(np.float32)
+        data = compressPoints(points)
+        assert len(data) < points.nbytes
+        decoded = decompressPoints(data)
+        assert decoded.shape == points.shape
+        assert np.abs(decoded[:, :3] - points[:, :3]).max() <= 0.0005
+        assert np.abs(decoded[:, 3] - points[:, 3]).max() <= 1e-4
+
+        # Off the millimetre grid the error is the quantisation plus the float32 rounding of the decoded value.
+        scattered = np.random.uniform(-100, 100, size=(100000, 4)).astype(np.float32)
+        scattered[:, 3] = np.random.rand(len(scattered))
+        decoded_scattered = decompressPoints(compressPoints(scattered))
+        error = np.abs(decoded_scattered[:, :3].astype(np.float64) - scattered[:, :3])
+        assert (error <= 0.0005 + np.spacing(np.abs(decoded_scattered[:, :3])) / 2).all()
+        assert np.abs(decoded_scattered[:, 3] - scattered[:, 3]).max() <= 0.5 / 65535 + 1e-7
+
+        with tempfile.TemporaryDirectory() as directory:
+            lidar_file = os.path.join(directory, "000000.bin")
+            points.tofile(lidar_file)
+            shard_path = os.path.join(directory, "test.shard")
+            writeKittiShard(shard_path, [lidar_file], encoding=PointEncoding.Compressed)
+            assert np.array_equal(Shard(shard_path).points(0), decoded)
+
+    def test_voxel_cache(self):
+        points = self.arr.astype(np.float32)
+        with tempfile.TemporaryDirectory() as directory:
+            lidar_file = os.path.join(directory, "000000.bin")
+            points.tofile(lidar_file)
+            pillars, indices = createPillarsFromFile(lidar_file, 100, 12000, 0.16, 0.16, 0, 80.64, -40.32, 40.32, -3, 1)
+
+            cache = VoxelCache(directory, "grid 0.16")
+            key = cache.key([lidar_file])
+            assert cache.loadPillars(key) is None
+            cache.storePillars(key, pillars, indices)
+            cached_pillars, cached_indices = cache.loadPillars(key)
+            assert np.array_equal(cached_pillars, pillars)
+            assert np.array_equal(cached_indices, indices)
+
+            assert VoxelCache(directory, "grid 0.2").loadPillars(key) is None
+            points[0, 0] += 1
+            points.tofile(lidar_file)
+            assert cache.key([lidar_file]) != key
+
+        # the cache parameters of the generators cover the target format and the minimum distance
+        processor = DataProcessor()
+        parameters = processor.cache_parameters()
+        assert parameters.startswith("(%d, " % targetFormatVersion)
+        processor.min_distance = 2.5
+        assert processor.cache_parameters() != parameters
+
+    def test_pipeline(self):
+        points = self.arr.astype(np.float32)
+        with tempfile.TemporaryDirectory() as directory:
+            lidar_files = []
+            for i in range(5):
+                lidar_files.append(os.path.join(directory, "%06d.bin" % i))
+                points[i * 1000:].tofile(lidar_files[-1])
+
+            parameters = PipelineParameters()
+            parameters.maxPillars = 12000
+            parameters.maxPointsPerPillar = 100
+            parameters.target.zMin = -3
+            parameters.target.zMax = 1
+            parameters.batchSize = 2
+            parameters.nbWorkers = 3
+            pipeline = Pipeline(parameters, lidar_files)
+            assert len(pipeline) == 2
+
+            batches = list(pipeline)
+            assert len(batches) == 2
+            pillars, indices = batches[1]
+            expected_pillars, expected_indices = createPillarsFromFile(lidar_files[3], 100, 12000, 0.16, 0.16, 0,
+                                                                       80.64, -40.32, 40.32, -3, 1)
+            assert pillars.shape == (2, 12000, 100, 9)
+            assert np.array_equal(pillars[1], expected_pillars[0])
+            assert np.array_equal(indices[1], expected_indices[0])
+            # The next iteration continues with the following epoch.
+            assert len(list(pipeline)) == 2
+            del pipeline
+
+    def test_labeled_pipeline(self):
+        points = self.arr.astype(np.float32)
+        processor = DataProcessor()
+        with tempfile.TemporaryDirectory() as directory:
+            lidar_files, label_files, calibration_files = [], [], []
+            for i in range(2):
+                lidar_files.append(os.path.join(directory, "%06d.bin" % i))
+                label_files.append(os.path.join(directory, "%06d.txt" % i))
+                calibration_files.append(os.path.join(directory, "calib%06d.txt" % i))
+                points[i * 1000:].tofile(lidar_files[-1])
+                # identity calibration, i.e. camera and lidar coordinates coincide
+                with open(calibration_files[-1], "w") as f:
+                    f.write("Tr_velo_to_cam: 1 0 0 0 0 1 0 0 0 0 1 0\n")
+            car = "Car 0.00 0 0 0 0 0 0 2.0 4.0 8.0 10.0 -10.0 -2.0 1.5708\n"
+            # no point has a fractional x, so the pedestrian box is empty and dropped by minObjectPoints
+            pedestrian = "Pedestrian 0.00 0 0 0 0 0 0 1.8 0.6 0.8 30.5 5.5 -1.0 1.5708\n"
+            with open(label_files[0], "w") as f:
+                f.write(car + pedestrian)
+            with open(label_files[1], "w") as f:
+                f.write("")
+            car_file = os.path.join(directory, "car.txt")
+            with open(car_file, "w") as f:
+                f.write(car)
+
+            parameters = processor.pipeline_parameters(batch_size=2, workers=2)
+            assert parameters.minObjectPoints == 1
+            pipeline = Pipeline(parameters, lidar_files, label_files, calibration_files, processor.classes)
+            (pillars, indices), outputs = next(iter(pipeline))
+            del pipeline
+
+            # the arrays own the batch and outlive the pipeline
+            assert len(outputs) == 6 and all(output.base is not None for output in outputs)
+            expected_pillars, expected_indices = processor.make_point_pillars(points[1000:])
+            assert np.array_equal(pillars[1], expected_pillars[0]) and np.array_equal(indices[1], expected_indices[0])
+            expected = processor.make_ground_truth_from_files(car_file, calibration_files[0])
+            assert (expected[0] == 1).sum() > 0
+            for output, expected_output in zip(outputs, expected):
+                assert output.shape[1:] == expected_output.shape and output.dtype == expected_output.dtype
+                assert np.array_equal(output[0], expected_output)
+                # the unlabeled sample has an all zero target
+                assert not output[1].any()
+
+            # ground truth sampling fills up the empty sample, the noise and sampling only depend on the seed
+            db_path = os.path.join(directory, "gt.bin")
+            assert buildGtDatabase(db_path, lidar_files[:1], [car_file], calibration_files[:1], {"Car": 0}) == 1
+            batches = []
+            for workers in (1, 3):
+                parameters = processor.pipeline_parameters(batch_size=2, workers=workers, gt_database=db_path,
+                                                           seed=7)
+                parameters.groundTruthCounts = [1]
+                object_noise = ObjectNoiseRange()
+                object_noise.maxYaw, object_noise.translationStd = 0.2, [0.25, 0.25, 0.0]
+                parameters.objectNoise = object_noise
+                pipeline = Pipeline(parameters, lidar_files, label_files, calibration_files, processor.classes)
+                batches.append(next(iter(pipeline)))
+                del pipeline
+            (pillars, _), outputs = batches[0]
+            assert (outputs[0][1] == 1).sum() > 0
+            assert np.array_equal(pillars, batches[1][0][0])
+            for output, other in zip(outputs, batches[1][1]):
+                assert np.array_equal(output, other)
+
+    def test_gt_database(self):
+        points = self.arr.astype(np.float32)
+        with tempfile.TemporaryDirectory() as directory:
+            lidar_file = os.path.join(directory, "000000.bin")
+            label_file = os.path.join(directory, "000000.txt")
+            calibration_file = os.path.join(directory, "calib.txt")
+            points.tofile(lidar_file)
+            # identity calibration, i.e. camera and lidar coordinates coincide
+            with open(calibration_file, "w") as f:
+                f.write("Tr_velo_to_cam: 1 0 0 0 0 1 0 0 0 0 1 0\n")
+            with open(label_file, "w") as f:
+                f.write("Car 0.00 0 0 0 0 0 0 2.0 4.0 8.0 10.0 -10.0 -2.0 1.5708\n")
+                f.write("Pedestrian 0.00 0 0 0 0 0 0 1.8 0.6 0.8 40.0 -40.0 1.0 1.5708\n")
+            db_path = os.path.join(directory, "gt.bin")
+            assert buildGtDatabase(db_path, [lidar_file], [label_file], [calibration_file], {"Car": 0}) == 1
+
+            database = GtDatabase(db_path)
+            assert len(database) == 1 and database.classId(0) == 0
+            car = database.points(0)
+            assert np.all(np.abs(car[:, 0] - 10) <= 4) and np.all(np.abs(car[:, 1] + 10) <= 2)
+            assert np.all((car[:, 2] >= -2) & (car[:, 2] < 0))
+
+            # the pasted car hides the scene points inside and behind it, seen from the origin
+            background = np.array([[20, -20, -1, 0.1], [20, -20, 5, 0.2], [5, -5, -1, 0.3], [10, 10, -1, 0.4],
+                                   [10, -10, -1, 0.5]], dtype=np.float32)
+            scene, boxes, class_ids = sampleGroundTruth(database, background, np.zeros((0, 7)), np.zeros(0), [1])
+            assert boxes.shape == (1, 7) and list(class_ids) == [0]
+            assert np.array_equal(scene, np.r_[background[1:4], car])
+            scene, _, _ = sampleGroundTruth(database, points, np.zeros((0, 7)), np.zeros(0), [1])
+            assert len(points) - len(car) > len(scene) - len(car) > 0
+            # an overlapping scene box blocks the paste
+            _, boxes, _ = sampleGroundTruth(database, points, database.box(0)[np.newaxis], np.array([1]), [1])
+            assert boxes.shape == (1, 7)
+            del database
+
+    def test_points_in_boxes(self):
+        points = self.arr.astype(np.float32)
+        boxes = np.array([[10, -10, -2, 8, 4, 2, 0.3],
+                          [12, -9, -1, 4, 4, 1, -1.2],
+                          [-50, 60, -3, 20, 3, 5, 2.5]], dtype=np.float32)
+        box_ids, counts = pointsInBoxes(points, boxes)
+
+        inside = np.zeros((len(boxes), len(points)), dtype=bool)
+        for b, (x, y, z, length, width, height, yaw) in enumerate(boxes):
+            dx, dy = points[:, 0] - x, points[:, 1] - y
+            along = dx * np.cos(yaw) + dy * np.sin(yaw)
+            across = -dx * np.sin(yaw) + dy * np.cos(yaw)
+            inside[b] = (np.abs(along) <= length / 2) & (np.abs(across) <= width / 2) & \
+                        (points[:, 2] >= z) & (points[:, 2] < z + height)
+        assert np.array_equal(counts, inside.sum(axis=1))
+        assert np.array_equal(box_ids, np.where(inside.any(axis=0), inside.argmax(axis=0), -1))
+
+        # a translation moves the points of its box only
+        moved, moved_boxes = transformObjects(points, boxes[:1], [Augmentation(translation=[1.0, 2.0, 0.0])])
+        assert np.allclose(moved_boxes[0, :2], [11, -8])
+        assert np.allclose(moved[box_ids == 0, :2], points[box_ids == 0, :2] + [1, 2])
+        assert np.array_equal(moved[~inside[0]], points[~inside[0]])
+
+    def test_synthetic_scene(self):
+        points, boxes, class_ids = generateScene(seed=3)
+        assert points.shape[1] == 4 and len(points) > 200000
+        assert boxes.shape == (len(class_ids), 7) and set(class_ids) == {0, 1, 2}
+        # objects stand on the ground, all returns are on the ground or, up to
+        # the range noise, on an object
+        assert np.allclose(boxes[:, 2], -1.73)
+        box_ids, counts = pointsInBoxes(points, boxes + [0, 0, -0.1, 0.2, 0.2, 0.2, 0])
+        assert np.all(np.abs(points[box_ids < 0, 2] + 1.73) < 0.2)
+        near = np.hypot(boxes[:, 0], boxes[:, 1]) < 30
+        assert np.all(counts[near] > 0)
+        assert np.all((points[:, 3] >= 0) & (points[:, 3] <= 1))
+
+        again, _, _ = generateScene(seed=3)
+        assert np.array_equal(points, again)
+
+        lidar, scene = LidarParameters(), SceneParameters()
+        lidar.beams, lidar.dropProbability = 32, 0.5
+        scene.objectCounts, scene.colors = [100], True
+        colored, boxes, class_ids = generateScene(lidar, scene, seed=3)
+        assert colored.shape[1] == 7 and len(colored) < len(points) / 3
+        assert len(boxes) == 100 and np.all(class_ids == 0)
+
+    def test_native_kitti_labels(self):
+        # calibration of KITTI training frame 000000, Tr_velo_to_cam is the sixth line as readers.py expects
+        calibration = ("P0: 7.215377e+02 0 6.095593e+02 0 0 7.215377e+02 1.728540e+02 0 0 0 1 0\n"
+                       "P1: 7.215377e+02 0 6.095593e+02 -3.875744e+02 0 7.215377e+02 1.728540e+02 0 0 0 1 0\n"
+                       "P2: 7.215377e+02 0 6.095593e+02 4.485728e+01 0 7.215377e+02 1.728540e+02 2.163791e-01 0 0 1 "
+                       "2.745884e-03\n"
+                       "P3: 7.215377e+02 0 6.095593e+02 -3.395242e+02 0 7.215377e+02 1.728540e+02 2.199936e+00 0 0 1 "
+                       "2.729905e-03\n"
+                       "R0_rect: 9.999239e-01 9.837760e-03 -7.445048e-03 -9.869795e-03 9.999421e-01 -4.278459e-03 "
+                       "7.402527e-03 4.351614e-03 9.999631e-01\n"
+                       "Tr_velo_to_cam: 7.533745e-03 -9.999714e-01 -6.166020e-04 -4.069766e-03 1.480249e-02 "
+                       "7.280733e-04 -9.998902e-01 -7.631618e-02 9.998621e-01 7.523790e-03 1.480755e-02 -2.717806e-01\n"
+                       "Tr_imu_to_velo: 9.999976e-01 7.553071e-04 -2.035826e-03 -8.086759e-01 -7.854027e-04 "
+                       "9.998898e-01 -1.482298e-02 3.195559e-01 2.024406e-03 1.482454e-02 9.998881e-01 -7.997231e-01\n")
+        label = ("Car 0.00 0 -1.58 587.01 173.33 614.12 200.12 1.65 1.67 3.64 -0.65 1.71 46.70 -1.59\n"
+                 "Pedestrian 0.00 0 0.21 423.17 173.67 433.17 193.03 1.60 0.59 0.66 -5.38 1.69 28.67 0.03\n"
+                 "Van 0.00 1 2.95 0.00 177.42 184.12 232.61 2.12 1.86 4.63 -9.35 1.84 20.07 2.51\n"
+                 "DontCare -1 -1 -10 503.89 169.71 590.61 190.13 -1 -1 -1 -1000 -1000 -1000 -10\n")
+
+        processor = DataProcessor()
+        with tempfile.TemporaryDirectory() as directory:
+            label_file, calibration_file = os.path.join(directory, "label.txt"), os.path.join(directory, "calib.txt")
+            with open(label_file, "w") as f:
+                f.write(label)
+            with open(calibration_file, "w") as f:
+                f.write(calibration)
+
+            labels = KittiDataReader.read_label(label_file)
+            R, t = KittiDataReader.read_calibration(calibration_file)
+            expected = processor.make_ground_truth(processor.transform_labels_into_lidar_coordinates(labels, R, t))
+
+            target, statistics = processor.make_target_from_files(label_file, calibration_file)
+            from_bytes, _ = processor.make_target_from_files(label.encode(), calibration.encode())
+            ground_truth = processor.make_ground_truth_from_files(label_file, calibration_file)
+
+        # DontCare is dropped, the van is mapped onto class 3
+        assert target.shape[0] == len(labels) == 3 and list(statistics.objectIds) == [0, 1, 2]
+        assert np.array_equal(target, from_bytes)
+        assert (expected[0] == 1).sum() > 0
+        # the rotation is inverted in double instead of single precision
+        for native, python in zip(ground_truth, expected):
+            assert native.shape == python.shape
+            assert np.allclose(native, python, atol=1e-5)
+        assert np.array_equal(ground_truth[0], expected[0])
+
+    def test_kitti_evaluation(self):
+        # identity calibration, i.e. camera and lidar coordinates coincide
+        calibration = b"Tr_velo_to_cam: 1 0 0 0 0 1 0 0 0 0 1 0\n"
+        label = b"Car 0.00 0 0 0 0 100 80 1.5 1.6 3.9 10.0 -10.0 -2.0 1.5708\n"
+        car = [10.0, -10.0, -2.0, 3.9, 1.6, 1.5, 0.0, 0, 0.9]
+        classes = [EvaluationClass("Car", 0, 0.7)]
+        # enough frames to reach all 40 recall positions
+        labels, calibrations = [label] * 100, [calibration] * 100
+
+        result, = evaluateKitti(labels, calibrations, [np.array([car])] * 100, classes)
+        assert list(result.groundTruth) == [100, 100, 100]
+        assert np.allclose(result.bev, 100) and np.allclose(result.iou3D, 100) and np.allclose(result.orientation, 100)
+        # a better scored false positive per frame halves the precision
+        false_positive = [30.0, 5.0, -2.0, 3.9, 1.6, 1.5, 0.0, 0, 0.95]
+        result, = evaluateKitti(labels, calibrations, [np.array([car, false_positive])] * 100, classes, threads=2)
+        assert np.allclose(result.bev, 50) and np.allclose(result.iou3D, 50)
+        result, = evaluateKitti(labels, calibrations, [np.zeros((0, 9))] * 100, classes)
+        assert np.allclose(result.bev, 0)
+
+        # decoded boxes are not oriented, their heading turns them around
+        for heading, orientation in ((1, 100), (0, 0)):
+            box = BBox(10.0, -10.0, -2.0, 3.9, 1.6, 1.5, np.pi, heading, 0, 0.9)
+            result = evaluate_kitti([[box]] * 100, labels, calibrations, Parameters())[0]
+            assert result.name == "Car" and np.allclose(result.bev, 100)
+            assert np.allclose(result.orientation, orientation, atol=1e-3)
+
+    def test_occupancy_check(self):
+        target = (np.random.rand(252, 252, 4) < 0.01).astype(np.float32)
+        predicted = np.random.rand(252, 252, 4).astype(np.float32)
+        check = checkOccupancy(target, predicted, thresholds=[0.9, 0.5])
+
+        positives = int(target.sum())
+        threshold = np.sort(predicted.flatten())[-positives]
+        matched = int(np.sum((target == 1) & (predicted >= threshold)))
+        assert check.threshold == threshold and check.matched == matched
+        assert check.unmatchedTargets == positives - matched
+        assert check.unmatchedPredictions == np.sum(predicted >= threshold) - matched
+        assert list(check.thresholds) == [np.float32(0.5), np.float32(0.9)]
+        for t, tp, predicted_count in zip(check.thresholds, check.truePositives, check.predictedPositives):
+            assert tp == np.sum((target == 1) & (predicted >= t)) and predicted_count == np.sum(predicted >= t)
+
+    def test_augmented_pillar_creation(self):
+        points = self.arr.astype(np.float32)
+        augmentation = Augmentation(flipY=True, translation=[0.5, -2.0, 0.25])
+        pillars, indices = createPillars(points, 100, 12000, 0.16, 0.16, 0, 80.64, -40.32, 40.32, -3, 1,
+                                         augmentation=augmentation)
+
+        moved = points.copy()
+        moved[:, 1] *= -1
+        moved[:, :3] += np.array([0.5, -2.0, 0.25], dtype=np.float32)
+        expected_pillars, expected_indices = createPillars(moved, 100, 12000, 0.16, 0.16, 0, 80.64, -40.32, 40.32,
+                                                           -3, 1)
+        assert np.array_equal(pillars, expected_pillars)
+        assert np.array_equal(indices, expected_indices)
+
+    def test_rgb_pillar_creation(self):
+        points = self.arr.astype(np.float32)
+        coloured = np.c_[points, np.random.uniform(0.01, 1, size=(len(points), 3))].astype(np.float32)
+        grid = (100, 12000, 0.16, 0.16, 0, 80.64, -40.32, 40.32, -3, 1)
+        in_range = (points[:, 0] >= 0) & (points[:, 0] < 80.64) & (points[:, 1] >= -40.32) & \
+                   (points[:, 1] < 40.32) & (points[:, 2] >= -3) & (points[:, 2] < 1)
+        # Without a minimum distance every point in range is kept, as RGB points always were. With one, RGB
+        # points are filtered like the ones without colour.
+        for min_distance in (-1, 0, 5):
+            pillars, indices = createPillars(coloured, *grid, minDistance=min_distance)
+            plain_pillars, plain_indices = createPillars(points, *grid, minDistance=min_distance)
+            assert pillars.shape[-1] == 12
+            assert np.array_equal(pillars[..., :9], plain_pillars)
+            assert np.array_equal(indices, plain_indices)
+
+            kept = in_range & ~((min_distance > 0) & (np.sum(points[:, :2] ** 2, axis=1) < min_distance ** 2))
+            written = pillars[0][np.any(pillars[0, :, :, 9:] != 0, axis=-1)]
+            assert sorted(map(tuple, written[:, [0, 1, 2, 3, 9, 10, 11]])) == \
+                sorted(map(tuple, coloured[kept]))
+
+    @staticmethod
+    def test_augmented_pillar_target():
+        # the yaw of the first box, -3.0 flipped and rotated by 0.5, leaves [-pi, pi] and is wrapped
+        boxes = np.array([[30, 5, -0.8, 3.9, 1.6, 1.56, -3.0],
+                          [45, -8, -0.8, 4.2, 1.7, 1.5, 2.9]], dtype=np.float32)
+        augmentation = Augmentation(yaw=0.5, scale=1.05, flipY=True, translation=[1.0, -0.5, 0.1])
+
+        moved = augmentBoxes(boxes, augmentation)
+        cos, sin = 1.05 * np.cos(0.5), 1.05 * np.sin(0.5)
+        x, y = boxes[:, 0], -boxes[:, 1]
+        assert np.allclose(moved[:, 0], cos * x - sin * y + 1.0, atol=1e-4)
+        assert np.allclose(moved[:, 1], sin * x + cos * y - 0.5, atol=1e-4)
+        assert np.allclose(moved[:, 2], 1.05 * boxes[:, 2] + 0.1, atol=1e-5)
+        assert np.allclose(moved[:, 3:6], 1.05 * boxes[:, 3:6], atol=1e-5)
+        assert np.allclose(moved[:, 6], [3.5 - 2 * np.pi, -2.4], atol=1e-5)
+
+        anchors = np.array([[3.9, 1.6, 1.56], [3.9, 1.6, 1.56]], dtype=np.float32)
+
+        def create_target(boxes, **kwargs):
+            return createPillarsTarget(boxes[:, 0:3], boxes[:, 3:6], boxes[:, 6], np.zeros(2, dtype=np.int32),
+                                       anchors, np.full(2, -1, dtype=np.float32),
+                                       np.array([0, np.pi / 2], dtype=np.float32),
+                                       0.6, 0.45, 0.3, 1, 2, 0.16, 0.16, 0, 80.64, -40.32, 40.32, -3, 1, **kwargs)
+
+        target, statistics = create_target(boxes, augmentation=augmentation)
+        expected_target, expected_statistics = create_target(moved)
+        assert np.array_equal(target, expected_target)
+        assert statistics.positives == expected_statistics.positives == 5
+        assert statistics.forcedMatches == expected_statistics.forcedMatches == 1
+        assert list(statistics.bestAnchorIds) == list(expected_statistics.bestAnchorIds) == [0, 0]
+        # both boxes face backwards relative to the anchors
+        assert (target[..., 8][target[..., 0] == 1] == 1).all()
+
     @staticmethod
     def test_pillar_target_creation():
 
@@ -37,34 +560,169 @@ class PointPillarsTest(unittest.TestCase):
         posn = np.array([[50, 10, 0], [20, 0, 0], [30, 5, 0]], dtype=np.float32)
         yaws = np.array([0, 0, 90], dtype=np.float32)
 
-        target = createPillarsTarget(posn,
-                                     dims,
-                                     yaws,
-                                     np.array([1, 1, 2], dtype=np.int32),
-                                     dims[[0, 2]],
-                                     np.array([0, 0], dtype=np.float32),
-                                     np.array([0, 90], dtype=np.float32),
-                                     0.5,
-                                     0.4,
-                                     10,
-                                     2,
-                                     0.1,
-                                     0.1,
-                                     0,
-                                     80,
-                                     -40,
-                                     40,
-                                     -3,
-                                     1,
-                                     True)
+        target, statistics = createPillarsTarget(posn,
+                                                 dims,
+                                                 yaws,
+                                                 np.array([1, 1, 2], dtype=np.int32),
+                                                 dims[[0, 2]],
+                                                 np.array([0, 0], dtype=np.float32),
+                                                 np.array([0, 90], dtype=np.float32),
+                                                 0.5,
+                                                 0.4,
+                                                 10,
+                                                 2,
+                                                 0.1,
+                                                 0.1,
+                                                 0,
+                                                 80,
+                                                 -40,
+                                                 40,
+                                                 -3,
+                                                 1,
+                                                 True)
 
         assert target.shape == (3, 400, 400, 2, 10)
         assert (target[..., 0] == 1).sum() == 83
+        assert statistics.positives == (target[..., 0] == 1).sum()
+        assert statistics.ignored == (target[..., 0] == -1).sum()
+        assert len(statistics.bestIou) == 3
 
         selected = target[..., 0:1].argmax(axis=0)
         target = select(target, selected)
         assert (target.shape == (400, 400, 2, 10))
 
+    @staticmethod
+    def test_pillar_target_class_anchors():
+
+        # car, pedestrian and cyclist, with anchors for cars and pedestrians only
+        dims = np.array([[3.9, 1.6, 1.56], [0.8, 0.6, 1.73], [1.76, 0.6, 1.73]], dtype=np.float32)
+        posn = np.array([[20, 0, 0], [30.1, 5.1, 0], [40, -5, 0]], dtype=np.float32)
+
+        def create_target(**kwargs):
+            return createPillarsTarget(posn, dims,
+                                       np.zeros(3, dtype=np.float32),
+                                       np.array([0, 1, 2], dtype=np.int32),
+                                       dims[:2], np.zeros(2, dtype=np.float32), np.zeros(2, dtype=np.float32),
+                                       0.6, 0.3, 0.3, 3, 2, 0.16, 0.16, 0, 80.64, -40.32, 40.32, -1, 3,
+                                       anchorClassIds=[0, 1], **kwargs)
+
+        target, statistics = create_target()
+        assert target.shape == (3, 252, 252, 2, 10)
+        # pairs of object and anchor of different classes stay negative
+        assert (target[0, ..., 1, 0] == 0).all() and (target[1, ..., 0, 0] == 0).all()
+        assert (target[0, ..., 0, 0] == 1).sum() == 10
+        assert (target[1, ..., 1, 0] == 1).sum() == 1
+        # the cyclist has no anchor and no target
+        assert statistics.unassigned == 1 and statistics.forcedMatches == 0
+        assert list(statistics.bestAnchorIds) == [0, 1, -1]
+        assert (target[2] == 0).all()
+
+        # a lower positive threshold for pedestrians only
+        target, statistics = create_target(classPositiveThresholds=[0.6, 0.3])
+        assert (target[0, ..., 0, 0] == 1).sum() == 10
+        assert (target[1, ..., 1, 0] == 1).sum() == 4
+        assert statistics.positives == 14
+
+    @staticmethod
+    def test_pillar_target_center_assignment():
+
+        dims = np.array([[3.7, 1.6, 1.4], [0.8, 0.6, 1.7]], dtype=np.float32)
+        posn = np.array([[50, 10, 0], [30, 5, 0]], dtype=np.float32)
+
+        def create_target(positive_threshold=0.6, **kwargs):
+            return createPillarsTarget(posn, dims,
+                                       np.array([0, 0], dtype=np.float32),
+                                       np.array([0, 1], dtype=np.int32),
+                                       dims, np.array([0, 0], dtype=np.float32),
+                                       np.array([0, 0], dtype=np.float32),
+                                       positive_threshold, 0.3, 0.3, 2, 2, 0.16, 0.16, 0, 80.64, -40.32, 40.32, -1, 3,
+                                       classAssignmentModes=[AssignmentMode.Iou, AssignmentMode.Center], **kwargs)
+
+        target, statistics = create_target()
+        assert target.shape == (2, 252, 252, 2, 10)
+        # Only the anchor best fitting the pedestrian is scored by its center distance. Its center lies at 0.75
+        # and 0.625 cells from the corner of its cell, so the weights of the four surrounding cells exceed 0.5.
+        assert (target[1, ..., 0, 0] == 1).sum() == 0
+        assert (target[1, ..., 1, 0] == 1).sum() == 4
+        assert statistics.positives == (target[..., 0] == 1).sum()
+
+        # the weight thresholds are separate from the IoU thresholds
+        target, _ = create_target(centerPositiveThreshold=0.8)
+        assert (target[1, ..., 1, 0] == 1).sum() == 1
+        target, _ = create_target(positive_threshold=0.9)
+        assert (target[0, ..., 0, 0] == 1).sum() == 1
+        assert (target[1, ..., 1, 0] == 1).sum() == 4
+
+    @staticmethod
+    def test_pillar_target_forced_match():
+
+        # The object faces along y and lies midway between the anchor cells 62/63 in x and 126/127 in y.
+        posn = np.array([[20, 0.16, -1]], dtype=np.float32)
+
+        def create_target(dims, positive_threshold=0.6, **kwargs):
+            dims = np.array([dims], dtype=np.float32)
+            return createPillarsTarget(posn, dims, np.array([np.pi / 2], dtype=np.float32), np.zeros(1, dtype=np.int32),
+                                       dims[[0, 0]], np.full(2, -1, dtype=np.float32),
+                                       np.array([0, np.pi / 2], dtype=np.float32),
+                                       positive_threshold, 0.3, 0.3, 1, 2, 0.16, 0.16, 0, 80.64, -40.32, 40.32, -1, 3,
+                                       **kwargs)
+
+        # A box smaller than the cell spacing overlaps no anchor. Its forced match falls back to the anchor aligned
+        # with it, with a finite encoding, and ignores the surrounding cells.
+        target, statistics = create_target([0.2, 0.1, 0.1])
+        assert statistics.forcedMatches == 1 and statistics.bestIou[0] == 0
+        assert list(statistics.bestAnchorIds) == [1]
+        assert (target[0, ..., 0, 0] == 0).all()
+        assert np.argwhere(target[0, ..., 1, 0] == 1).tolist() == [[62, 126]]
+        assert (target[0, ..., 1, 0] == -1).sum() == (target[0, 60:65, 124:129, 1, 0] == -1).sum() == 24
+        assert np.isfinite(target).all()
+
+        # otherwise the best overlapping anchor is forced
+        target, statistics = create_target([3.9, 1.6, 1.56], positive_threshold=0.99)
+        assert statistics.forcedMatches == 1 and abs(statistics.bestIou[0] - 0.759) < 1e-3
+        assert list(statistics.bestAnchorIds) == [1]
+        assert (target[0, ..., 0] == 1).sum() == 1
+
+        # Center assignment scores the aligned anchor only. The weights of the four cells around the center are 0.70,
+        # the ones of the next eight 0.17.
+        dims = [0.8, 0.6, 1.73]
+        center = dict(classAssignmentModes=[AssignmentMode.Center])
+        target, statistics = create_target(dims, **center)
+        assert statistics.forcedMatches == 0 and list(statistics.bestAnchorIds) == [1]
+        assert (target[0, ..., 0, 0] == 0).all()
+        assert np.argwhere(target[0, ..., 1, 0] == 1).tolist() == [[62, 126], [62, 127], [63, 126], [63, 127]]
+        assert (target[0, ..., 1, 0] == -1).sum() == 8
+        target, _ = create_target(dims, centerNegativeThreshold=0.2, **center)
+        assert (target[0, ..., 1, 0] == 1).sum() == 4 and (target[0, ..., 1, 0] == -1).sum() == 0
+
+        target, statistics = create_target(dims, centerPositiveThreshold=0.8, **center)
+        assert statistics.forcedMatches == 1 and list(statistics.bestAnchorIds) == [1]
+        assert np.argwhere(target[0, ..., 1, 0] == 1).tolist() == [[62, 126]]
+        assert (target[0, ..., 1, 0] == -1).sum() == (target[0, 60:65, 124:129, 1, 0] == -1).sum() == 24
+
+    @staticmethod
+    def test_box_iou_matrix():
+
+        boxes = np.array([[0, 0, 0, 4, 2, 2, 0.3],
+                          [0, 0, 1, 4, 2, 2, 0.3],
+                          [10, 0, 0, 4, 2, 2, 0]], dtype=np.float32)
+
+        iou_bev = boxIouMatrix(boxes, boxes, IouMetric.Bev)
+        iou_3d = boxIouMatrix(boxes, boxes, IouMetric.Iou3D)
+        giou_3d = boxIouMatrix(boxes, boxes, IouMetric.GIou3D)
+
+        assert iou_3d.shape == (3, 3)
+        assert np.allclose(np.diag(iou_3d), 1)
+        assert np.isclose(iou_bev[0, 1], 1)
+        assert np.isclose(iou_3d[0, 1], 1 / 3)
+        assert iou_3d[0, 2] == 0 and giou_3d[0, 2] < 0
+
+        # zero area boxes overlap nothing, even themselves
+        empty = np.array([[0, 0, 0, 0, 0, 0, 0], [0, 0, 0, 4, 0, 2, 0]], dtype=np.float32)
+        for metric in (IouMetric.Bev, IouMetric.Iou3D):
+            overlaps = boxIouMatrix(empty, np.r_[empty, boxes[:1]], metric)
+            assert np.array_equal(overlaps, np.zeros((2, 3), dtype=np.float32))
+
 
 if __name__ == "__main__":
     unittest.main()
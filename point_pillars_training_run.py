@@ -7,12 +7,12 @@ from glob import glob
 from config import Parameters
 from loss import PointPillarNetworkLoss
 from network import build_point_pillar_graph
-from processors import SimpleDataGenerator
-from readers import KittiDataReader
+from processors import PipelineDataGenerator
 
 tf.get_logger().setLevel("ERROR")
 
 DATA_ROOT = "../training"  # TODO make main arg
+GT_DATABASE = os.path.join(DATA_ROOT, "gt_database.bin")  # written by create_gt_database.py, optional
 MODEL_ROOT = "./logs"
 
 os.environ["CUDA_DEVICE_ORDER"] = "PCI_BUS_ID"
@@ -31,16 +31,16 @@ if __name__ == "__main__":
 
     pillar_net.compile(optimizer, loss=loss.losses())
 
-    data_reader = KittiDataReader()
-
     lidar_files = sorted(glob(os.path.join(DATA_ROOT, "velodyne", "*.bin")))
     label_files = sorted(glob(os.path.join(DATA_ROOT, "label_2", "*.txt")))
     calibration_files = sorted(glob(os.path.join(DATA_ROOT, "calib", "*.txt")))
     assert len(lidar_files) == len(label_files) == len(calibration_files), "Input dirs require equal number of files."
     validation_len = int(0.3*len(label_files))
     
-    training_gen = SimpleDataGenerator(data_reader, params.batch_size, lidar_files[:-validation_len], label_files[:-validation_len], calibration_files[:-validation_len])
-    validation_gen = SimpleDataGenerator(data_reader, params.batch_size, lidar_files[-validation_len:], label_files[-validation_len:], calibration_files[-validation_len:])
+    # Batches are prepared by native worker threads, one per core unless workers is given.
+    training_gen = PipelineDataGenerator(params.batch_size, lidar_files[:-validation_len], label_files[:-validation_len], calibration_files[:-validation_len], augment=True,
+                                         gt_database=GT_DATABASE if os.path.exists(GT_DATABASE) else None)
+    validation_gen = PipelineDataGenerator(params.batch_size, lidar_files[-validation_len:], label_files[-validation_len:], calibration_files[-validation_len:], workers=4, shuffle=False)
 
     log_dir = MODEL_ROOT
     epoch_to_decay = int(
@@ -55,13 +55,12 @@ if __name__ == "__main__":
     ]
 
     try:
-        pillar_net.fit(training_gen,
-                       validation_data = validation_gen,
+        pillar_net.fit(training_gen(),
+                       validation_data = validation_gen(),
                        steps_per_epoch=len(training_gen),
+                       validation_steps=len(validation_gen),
                        callbacks=callbacks,
-                       use_multiprocessing=True,
-                       epochs=int(params.total_training_epochs),
-                       workers=6)
+                       epochs=int(params.total_training_epochs))
     except KeyboardInterrupt:
         model_str = "interrupted_%s.h5" % time.strftime("%Y%m%d-%H%M%S")
         pillar_net.save(os.path.join(log_dir, model_str))
@@ -1,3 +1,4 @@
+import os
 from typing import List
 import numpy as np
 import tensorflow as tf
@@ -5,8 +6,10 @@ import tensorflow as tf
 from tensorflow.python.keras.utils.data_utils import Sequence
 
 from config import Parameters
-from point_pillars import createPillars, createPillarsTarget
-from readers import DataReader, Label3D
+from point_pillars import createPillars, createPillarsFromFiles, createPillarsFromShard, createPillarsTarget, \
+    createPillarsTargetFromKitti, createPillarsTargetFromShard, Shard, VoxelCache, Pipeline, PipelineParameters, \
+    TargetParameters, AugmentationRange, ObjectNoiseRange, targetFormatVersion
+from readers import DataReader, KittiDataReader, Label3D
 from sklearn.utils import shuffle
 import sys
 
@@ -60,7 +63,38 @@ class DataProcessor(Parameters):
                                          self.y_max,
                                          self.z_min,
                                          self.z_max,
-                                         False)
+                                         False,
+                                         self.min_distance)
+
+        return pillars, indices
+
+    def make_point_pillars_from_files(self, lidar_files: List[str], cache: VoxelCache = None):
+        if cache is not None:
+            pillars, indices = [], []
+            for lidar_file in lidar_files:
+                key = cache.key([lidar_file])
+                cached = cache.loadPillars(key)
+                if cached is None:
+                    cached = self.make_point_pillars_from_files([lidar_file])
+                    cache.storePillars(key, *cached)
+                pillars.append(cached[0])
+                indices.append(cached[1])
+            return np.concatenate(pillars, axis=0), np.concatenate(indices, axis=0)
+
+        # Velodyne files are memory mapped and voxelized without going through numpy.
+        pillars, indices = createPillarsFromFiles(lidar_files,
+                                                  self.max_points_per_pillar,
+                                                  self.max_pillars,
+                                                  self.x_step,
+                                                  self.y_step,
+                                                  self.x_min,
+                                                  self.x_max,
+                                                  self.y_min,
+                                                  self.y_max,
+                                                  self.z_min,
+                                                  self.z_max,
+                                                  False,
+                                                  self.min_distance)
 
         return pillars, indices
 
@@ -72,11 +106,7 @@ class DataProcessor(Parameters):
         labels = list(filter(lambda x: x.classification in self.classes, labels))
 
         if len(labels) == 0:
-            pX, pY = int(self.Xn / self.downscaling_factor), int(self.Yn / self.downscaling_factor)
-            a = int(self.anchor_dims.shape[0])
-            return np.zeros((pX, pY, a), dtype='float32'), np.zeros((pX, pY, a, self.nb_dims), dtype='float32'), \
-                   np.zeros((pX, pY, a, self.nb_dims), dtype='float32'), np.zeros((pX, pY, a), dtype='float32'), \
-                   np.zeros((pX, pY, a, self.nb_classes), dtype='float64')
+            return self.empty_ground_truth()
 
         # For each label file, generate these properties except for the Don't care class
         target_positions = np.array([label.centroid for label in labels], dtype=np.float32)
@@ -87,28 +117,188 @@ class DataProcessor(Parameters):
         assert np.all(target_yaw >= -np.pi) & np.all(target_yaw <= np.pi)
         assert len(target_positions) == len(target_dimension) == len(target_yaw) == len(target_class)
 
-        target, pos, neg = createPillarsTarget(target_positions,
-                                               target_dimension,
-                                               target_yaw,
-                                               target_class,
-                                               self.anchor_dims,
-                                               self.anchor_z,
-                                               self.anchor_yaw,
-                                               self.positive_iou_threshold,
-                                               self.negative_iou_threshold,
-                                               self.nb_classes,
-                                               self.downscaling_factor,
-                                               self.x_step,
-                                               self.y_step,
-                                               self.x_min,
-                                               self.x_max,
-                                               self.y_min,
-                                               self.y_max,
-                                               self.z_min,
-                                               self.z_max,
-                                               False)
-        self.pos_cnt += pos
-        self.neg_cnt += neg
+        target, statistics = createPillarsTarget(target_positions,
+                                                 target_dimension,
+                                                 target_yaw,
+                                                 target_class,
+                                                 self.anchor_dims,
+                                                 self.anchor_z,
+                                                 self.anchor_yaw,
+                                                 self.positive_iou_threshold,
+                                                 self.negative_iou_threshold,
+                                                 self.angle_threshold,
+                                                 self.nb_classes,
+                                                 self.downscaling_factor,
+                                                 self.x_step,
+                                                 self.y_step,
+                                                 self.x_min,
+                                                 self.x_max,
+                                                 self.y_min,
+                                                 self.y_max,
+                                                 self.z_min,
+                                                 self.z_max,
+                                                 False,
+                                                 anchorClassIds=self.anchor_class_ids,
+                                                 classPositiveThresholds=self.positive_iou_thresholds,
+                                                 classNegativeThresholds=self.negative_iou_thresholds)
+        return self.split_target(target, statistics)
+
+    def make_ground_truth_from_files(self, label_file: str, calibration_file: str, cache: VoxelCache = None):
+        """ Same as make_ground_truth, but parses and transforms the KITTI label and calibration natively """
+
+        if cache is not None:
+            key = cache.key([label_file, calibration_file])
+            cached = cache.loadTarget(key)
+            if cached is None:
+                cached = self.make_target_from_files(label_file, calibration_file)
+                cache.storeTarget(key, *cached)
+            target, statistics = cached
+        else:
+            target, statistics = self.make_target_from_files(label_file, calibration_file)
+
+        if target.shape[0] == 0:
+            return self.empty_ground_truth()
+
+        return self.split_target(target, statistics)
+
+    def make_target_from_files(self, label_file: str, calibration_file: str):
+        return createPillarsTargetFromKitti(label_file,
+                                            calibration_file,
+                                            self.classes,
+                                            self.anchor_dims,
+                                            self.anchor_z,
+                                            self.anchor_yaw,
+                                            self.positive_iou_threshold,
+                                            self.negative_iou_threshold,
+                                            self.angle_threshold,
+                                            self.nb_classes,
+                                            self.downscaling_factor,
+                                            self.x_step,
+                                            self.y_step,
+                                            self.x_min,
+                                            self.x_max,
+                                            self.y_min,
+                                            self.y_max,
+                                            self.z_min,
+                                            self.z_max,
+                                            False,
+                                            anchorClassIds=self.anchor_class_ids,
+                                            classPositiveThresholds=self.positive_iou_thresholds,
+                                            classNegativeThresholds=self.negative_iou_thresholds)
+
+    def make_point_pillars_from_shard(self, shard: Shard, samples: List[int]):
+        pillars, indices = createPillarsFromShard(shard,
+                                                  samples,
+                                                  self.max_points_per_pillar,
+                                                  self.max_pillars,
+                                                  self.x_step,
+                                                  self.y_step,
+                                                  self.x_min,
+                                                  self.x_max,
+                                                  self.y_min,
+                                                  self.y_max,
+                                                  self.z_min,
+                                                  self.z_max,
+                                                  False,
+                                                  self.min_distance)
+
+        return pillars, indices
+
+    def make_ground_truth_from_shard(self, shard: Shard, sample: int):
+        """ Same as make_ground_truth_from_files, reading the pre-parsed label and calibration of a shard sample """
+
+        target, statistics = createPillarsTargetFromShard(shard,
+                                                          sample,
+                                                          self.classes,
+                                                          self.anchor_dims,
+                                                          self.anchor_z,
+                                                          self.anchor_yaw,
+                                                          self.positive_iou_threshold,
+                                                          self.negative_iou_threshold,
+                                                          self.angle_threshold,
+                                                          self.nb_classes,
+                                                          self.downscaling_factor,
+                                                          self.x_step,
+                                                          self.y_step,
+                                                          self.x_min,
+                                                          self.x_max,
+                                                          self.y_min,
+                                                          self.y_max,
+                                                          self.z_min,
+                                                          self.z_max,
+                                                          False,
+                                                          anchorClassIds=self.anchor_class_ids,
+                                                          classPositiveThresholds=self.positive_iou_thresholds,
+                                                          classNegativeThresholds=self.negative_iou_thresholds)
+        if target.shape[0] == 0:
+            return self.empty_ground_truth()
+
+        return self.split_target(target, statistics)
+
+    def cache_parameters(self):
+        """ Everything the pillar and target outputs depend on apart from the input files, see VoxelCache """
+        return repr((targetFormatVersion, self.x_min, self.x_max, self.x_step, self.y_min, self.y_max, self.y_step,
+                     self.z_min, self.z_max, self.min_distance, self.max_points_per_pillar, self.max_pillars,
+                     sorted(self.classes.items()), self.nb_classes,
+                     self.anchor_dims.tolist(), self.anchor_z.tolist(), self.anchor_yaw.tolist(),
+                     list(self.anchor_class_ids), self.positive_iou_threshold, self.negative_iou_threshold,
+                     self.angle_threshold, list(self.positive_iou_thresholds), list(self.negative_iou_thresholds),
+                     self.downscaling_factor))
+
+    def pipeline_parameters(self, batch_size: int, workers: int = 0, prefetch: int = 0, shuffle: bool = False,
+                            seed: int = 0, augment: bool = False, gt_database: str = None):
+        """ Pillar and target parameters of the native Pipeline, workers and prefetch of 0 pick defaults """
+        target = TargetParameters()
+        target.setAnchors(self.anchor_dims, self.anchor_z, self.anchor_yaw, list(self.anchor_class_ids))
+        target.positiveThreshold = self.positive_iou_threshold
+        target.negativeThreshold = self.negative_iou_threshold
+        target.angleThreshold = self.angle_threshold
+        target.nbClasses = self.nb_classes
+        target.downscalingFactor = self.downscaling_factor
+        target.xStep, target.yStep = self.x_step, self.y_step
+        target.xMin, target.xMax = self.x_min, self.x_max
+        target.yMin, target.yMax = self.y_min, self.y_max
+        target.zMin, target.zMax = self.z_min, self.z_max
+        target.classPositiveThresholds = list(self.positive_iou_thresholds)
+        target.classNegativeThresholds = list(self.negative_iou_thresholds)
+
+        parameters = PipelineParameters()
+        parameters.maxPointsPerPillar = self.max_points_per_pillar
+        parameters.maxPillars = self.max_pillars
+        parameters.minDistance = self.min_distance
+        parameters.target = target
+        parameters.batchSize = batch_size
+        parameters.nbWorkers = workers
+        parameters.prefetch = prefetch
+        parameters.shuffle = shuffle
+        parameters.seed = seed
+        parameters.minObjectPoints = self.min_object_points
+        if augment:
+            augmentation = AugmentationRange()
+            augmentation.maxYaw = self.augmentation_max_yaw
+            augmentation.minScale, augmentation.maxScale = self.augmentation_scale
+            augmentation.flipProbability = self.augmentation_flip_probability
+            augmentation.translationStd = list(self.augmentation_translation_std)
+            parameters.augmentation = augmentation
+            object_noise = ObjectNoiseRange()
+            object_noise.maxYaw = self.object_noise_max_yaw
+            object_noise.translationStd = list(self.object_noise_translation_std)
+            parameters.objectNoise = object_noise
+        if gt_database is not None:
+            parameters.groundTruthDatabase = gt_database
+            parameters.groundTruthCounts = list(self.gt_sample_counts)
+        return parameters
+
+    def empty_ground_truth(self):
+        pX, pY = int(self.Xn / self.downscaling_factor), int(self.Yn / self.downscaling_factor)
+        a = int(self.anchor_dims.shape[0])
+        return np.zeros((pX, pY, a), dtype='float32'), np.zeros((pX, pY, a, self.nb_dims), dtype='float32'), \
+               np.zeros((pX, pY, a, self.nb_dims), dtype='float32'), np.zeros((pX, pY, a), dtype='float32'), \
+               np.zeros((pX, pY, a), dtype='float32'), np.zeros((pX, pY, a, self.nb_classes), dtype='float64')
+
+    def split_target(self, target: np.ndarray, statistics):
+        self.pos_cnt += statistics.positives
+        self.neg_cnt += statistics.negatives
 
         # return a merged target view for all objects in the ground truth and get categorical labels
         sel = select_best_anchors(target)
@@ -121,8 +311,13 @@ class SimpleDataGenerator(DataProcessor, Sequence):
     """ Multiprocessing-safe data generator for training, validation or testing, without fancy augmentation """
 
     def __init__(self, data_reader: DataReader, batch_size: int, lidar_files: List[str], label_files: List[str] = None,
-                 calibration_files: List[str] = None):
+                 calibration_files: List[str] = None, cache_dir: str = None):
         super(SimpleDataGenerator, self).__init__()
+        # Pillars and targets of KITTI files are cached in cache_dir when set.
+        self.cache = None
+        if cache_dir is not None and isinstance(data_reader, KittiDataReader):
+            os.makedirs(cache_dir, exist_ok=True)
+            self.cache = VoxelCache(cache_dir, self.cache_parameters())
         self.data_reader = data_reader
         self.batch_size = batch_size
         self.lidar_files = lidar_files
@@ -151,25 +346,38 @@ class SimpleDataGenerator(DataProcessor, Sequence):
         heading = []
         classification = []
 
-        for i in file_ids:
-            lidar = self.data_reader.read_lidar(self.lidar_files[i])
-            # For each file, dividing the space into a x-y grid to create pillars
-            # Voxels are the pillar ids
-            pillars_, voxels_ = self.make_point_pillars(lidar)
-
+        native_kitti = isinstance(self.data_reader, KittiDataReader)
+        cache = self.cache
+        if native_kitti:
+            pillars_, voxels_ = self.make_point_pillars_from_files([self.lidar_files[i] for i in file_ids], cache)
             pillars.append(pillars_)
             voxels.append(voxels_)
 
+        for i in file_ids:
+            if not native_kitti:
+                lidar = self.data_reader.read_lidar(self.lidar_files[i])
+                # For each file, dividing the space into a x-y grid to create pillars
+                # Voxels are the pillar ids
+                pillars_, voxels_ = self.make_point_pillars(lidar)
+
+                pillars.append(pillars_)
+                voxels.append(voxels_)
+
             if self.label_files is not None:
-                label = self.data_reader.read_label(self.label_files[i])
-                R, t = self.data_reader.read_calibration(self.calibration_files[i])
-                # Labels are transformed into the lidar coordinate bounding boxes
-                # Label has 7 values, centroid, dimensions and yaw value.
-                label_transformed = self.transform_labels_into_lidar_coordinates(label, R, t)
-                # These definitions can be found in point_pillars.cpp file
-                # We are splitting a 10 dim vector that contains this information.
-                occupancy_, position_, size_, angle_, heading_, classification_ = self.make_ground_truth(
-                    label_transformed)
+                if native_kitti:
+                    # Labels are parsed and transformed into lidar coordinates natively.
+                    occupancy_, position_, size_, angle_, heading_, classification_ = \
+                        self.make_ground_truth_from_files(self.label_files[i], self.calibration_files[i], cache)
+                else:
+                    label = self.data_reader.read_label(self.label_files[i])
+                    R, t = self.data_reader.read_calibration(self.calibration_files[i])
+                    # Labels are transformed into the lidar coordinate bounding boxes
+                    # Label has 7 values, centroid, dimensions and yaw value.
+                    label_transformed = self.transform_labels_into_lidar_coordinates(label, R, t)
+                    # These definitions can be found in point_pillars.cpp file
+                    # We are splitting a 10 dim vector that contains this information.
+                    occupancy_, position_, size_, angle_, heading_, classification_ = self.make_ground_truth(
+                        label_transformed)
 
                 occupancy.append(occupancy_)
                 position.append(position_)
@@ -197,3 +405,78 @@ class SimpleDataGenerator(DataProcessor, Sequence):
         if self.label_files is not None:
             self.lidar_files, self.label_files, self.calibration_files = \
                 shuffle(self.lidar_files, self.label_files, self.calibration_files)
+
+
+class ShardDataGenerator(DataProcessor, Sequence):
+    """ Data generator reading samples from a shard written by writeKittiShard (see kitti_to_shard.py) """
+
+    def __init__(self, shard_path: str, batch_size: int, samples: List[int] = None, labels: bool = True):
+        super(ShardDataGenerator, self).__init__()
+        self.shard_path = shard_path
+        self.batch_size = batch_size
+        self.labels = labels
+        # The shard is mapped lazily so that every worker process gets its own mapping.
+        self.shard = None
+        self.samples = list(range(len(Shard(shard_path)))) if samples is None else list(samples)
+
+    def __len__(self):
+        return len(self.samples) // self.batch_size
+
+    def __getitem__(self, batch_id: int):
+        if self.shard is None:
+            self.shard = Shard(self.shard_path)
+
+        samples = self.samples[batch_id * self.batch_size:(batch_id + 1) * self.batch_size]
+        pillars, voxels = self.make_point_pillars_from_shard(self.shard, samples)
+        if not self.labels:
+            return [pillars, voxels]
+
+        ground_truth = [self.make_ground_truth_from_shard(self.shard, sample) for sample in samples]
+        occupancy, position, size, angle, heading, classification = [np.array(x) for x in zip(*ground_truth)]
+        return [pillars, voxels], [occupancy, position, size, angle, heading, classification]
+
+    def __getstate__(self):
+        state = self.__dict__.copy()
+        state["shard"] = None
+        return state
+
+    def on_epoch_end(self):
+        if self.labels:
+            self.samples = shuffle(self.samples)
+
+
+class PipelineDataGenerator(DataProcessor):
+    """ Batches of KITTI files or of a shard prepared by the native Pipeline in background threads, i.e. without
+        use_multiprocessing. Batches are the same as the ones of SimpleDataGenerator and ShardDataGenerator; with
+        augment, points and labels are rotated, scaled, mirrored and moved as configured in DataParameters, and with
+        gt_database objects of other frames are pasted into the samples """
+
+    def __init__(self, batch_size: int, lidar_files: List[str] = None, label_files: List[str] = None,
+                 calibration_files: List[str] = None, shard_path: str = None, samples: List[int] = None,
+                 labels: bool = True, workers: int = 0, prefetch: int = 0, shuffle: bool = True, seed: int = 0,
+                 augment: bool = False, gt_database: str = None):
+        super(PipelineDataGenerator, self).__init__()
+        assert (lidar_files is None) != (shard_path is None), "Either lidar files or a shard are required"
+
+        if shard_path is not None:
+            parameters = self.pipeline_parameters(batch_size, workers, prefetch, shuffle and labels, seed, augment,
+                                                  gt_database)
+            self.pipeline = Pipeline.fromShard(parameters, shard_path, samples or [], self.classes, labels)
+        else:
+            labels = label_files is not None
+            parameters = self.pipeline_parameters(batch_size, workers, prefetch, shuffle and labels, seed, augment,
+                                                  gt_database)
+            self.pipeline = Pipeline(parameters, lidar_files, label_files or [], calibration_files or [], self.classes)
+
+    def __len__(self):
+        return len(self.pipeline)
+
+    def __iter__(self):
+        """ Batches of one epoch, every call continues with the next epoch """
+        return iter(self.pipeline)
+
+    def __call__(self):
+        """ Endless generator over all epochs, for Model.fit with steps_per_epoch=len(generator) """
+        while True:
+            for batch in self.pipeline:
+                yield batch
@@ -0,0 +1,124 @@
+#include "allocation_tracking.h"
+
+#ifdef POINT_PILLARS_ALLOCATION_TRACKING
+#include <cstdlib>
+#include <new>
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#else
+#include <malloc.h>
+#endif
+#endif
+
+namespace
+{
+thread_local AllocationCounters counters = {0, 0, 0, 0};
+
+#ifdef POINT_PILLARS_ALLOCATION_TRACKING
+// Sizes come from the allocator rather than from a header in front of the
+// block, so that blocks allocated by the operator new of another library,
+// e.g. strings built inside the standard library, can still be freed here.
+size_t blockSize(void *block)
+{
+#if defined(__APPLE__)
+  return malloc_size(block);
+#elif defined(_WIN32)
+  return _msize(block);
+#else
+  return malloc_usable_size(block);
+#endif
+}
+
+void *allocate(size_t size)
+{
+  void *block = std::malloc(size > 0 ? size : 1);
+  if (block == nullptr)
+  {
+    throw std::bad_alloc();
+  }
+  const size_t allocated = blockSize(block);
+  counters.bytes += allocated;
+  counters.allocations += 1;
+  counters.live += allocated;
+  if (counters.live > counters.peak)
+  {
+    counters.peak = counters.live;
+  }
+  return block;
+}
+
+void release(void *block)
+{
+  if (block == nullptr)
+  {
+    return;
+  }
+  counters.live -= blockSize(block);
+  std::free(block);
+}
+#endif
+} // namespace
+
+AllocationCounters &threadAllocations()
+{
+  return counters;
+}
+
+#ifdef POINT_PILLARS_ALLOCATION_TRACKING
+void *operator new(size_t size)
+{
+  return allocate(size);
+}
+
+void *operator new[](size_t size)
+{
+  return allocate(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+  try
+  {
+    return allocate(size);
+  }
+  catch (const std::bad_alloc &)
+  {
+    return nullptr;
+  }
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+  return operator new(size, std::nothrow);
+}
+
+void operator delete(void *block) noexcept
+{
+  release(block);
+}
+
+void operator delete[](void *block) noexcept
+{
+  release(block);
+}
+
+void operator delete(void *block, size_t) noexcept
+{
+  release(block);
+}
+
+void operator delete[](void *block, size_t) noexcept
+{
+  release(block);
+}
+
+void operator delete(void *block, const std::nothrow_t &) noexcept
+{
+  release(block);
+}
+
+void operator delete[](void *block, const std::nothrow_t &) noexcept
+{
+  release(block);
+}
+#endif
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+// Allocation accounting for the instrumentation, compiled in with
+// POINT_PILLARS_ALLOCATION_TRACKING (CMake option of the same name). It
+// replaces operator new and delete of the native code and counts per thread;
+// without the switch nothing is replaced and the stage timers skip the
+// accounting at compile time. Memory handed out by numpy, e.g. the arrays
+// returned to Python, is not counted.
+#ifdef POINT_PILLARS_ALLOCATION_TRACKING
+const bool kAllocationTracking = true;
+#else
+const bool kAllocationTracking = false;
+#endif
+
+struct AllocationCounters
+{
+  uint64_t bytes;
+  uint64_t allocations;
+  // Bytes currently allocated and their maximum since the last reset by a
+  // stage timer. Blocks freed here but allocated by another library count
+  // as released, so both may become negative.
+  int64_t live;
+  int64_t peak;
+};
+
+// The counters of the calling thread.
+AllocationCounters &threadAllocations();
@@ -0,0 +1,155 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <new>
+
+namespace
+{
+const size_t kMinimumBlockSize = 64 * 1024;
+
+std::atomic<size_t> reservedCapacity{0};
+thread_local int frameDepth = 0;
+
+char *alignUp(char *pointer, size_t alignment)
+{
+  const auto address = reinterpret_cast<uintptr_t>(pointer);
+  return reinterpret_cast<char *>((address + alignment - 1) &
+                                  ~static_cast<uintptr_t>(alignment - 1));
+}
+} // namespace
+
+Arena::Arena(size_t capacity)
+{
+  reserve(capacity);
+}
+
+Arena::~Arena()
+{
+  for (const auto &block : blocks_)
+  {
+    ::operator delete(block.data);
+  }
+}
+
+void *Arena::allocate(size_t size, size_t alignment)
+{
+  char *begin = alignUp(cursor_, alignment);
+  if (cursor_ == nullptr || begin + size > end_)
+  {
+    grow(size + alignment);
+    begin = alignUp(cursor_, alignment);
+  }
+  cursor_ = begin + size;
+  return begin;
+}
+
+void Arena::grow(size_t size)
+{
+  size_t blockSize = kMinimumBlockSize;
+  if (!blocks_.empty())
+  {
+    previous_ += cursor_ - blocks_.back().data;
+    blockSize = std::max(blockSize, 2 * blocks_.back().size);
+  }
+  blockSize = std::max(blockSize, size);
+  blocks_.push_back({static_cast<char *>(::operator new(blockSize)), blockSize});
+  cursor_ = blocks_.back().data;
+  end_ = cursor_ + blockSize;
+}
+
+void Arena::reset()
+{
+  // Replaces the blocks of a frame that had to grow by one that fits it.
+  size_t total = 0;
+  for (const auto &block : blocks_)
+  {
+    total += block.size;
+  }
+  const size_t reserved = reservedCapacity.load(std::memory_order_relaxed);
+  if (blocks_.size() > 1 || total < reserved)
+  {
+    for (const auto &block : blocks_)
+    {
+      ::operator delete(block.data);
+    }
+    blocks_.clear();
+    cursor_ = nullptr;
+    end_ = nullptr;
+    grow(std::max(total, reserved));
+  }
+  else if (!blocks_.empty())
+  {
+    cursor_ = blocks_.back().data;
+  }
+  previous_ = 0;
+}
+
+void Arena::reserve(size_t capacity)
+{
+  if (capacity <= this->capacity())
+  {
+    return;
+  }
+  if (used() == 0)
+  {
+    for (const auto &block : blocks_)
+    {
+      ::operator delete(block.data);
+    }
+    blocks_.clear();
+    grow(capacity);
+    previous_ = 0;
+  }
+  else
+  {
+    // In the middle of a frame, the next reset merges the blocks.
+    grow(capacity - this->capacity());
+  }
+}
+
+size_t Arena::capacity() const
+{
+  size_t total = 0;
+  for (const auto &block : blocks_)
+  {
+    total += block.size;
+  }
+  return total;
+}
+
+size_t Arena::used() const
+{
+  return blocks_.empty() ? 0 : previous_ + (cursor_ - blocks_.back().data);
+}
+
+Arena &frameArena()
+{
+  thread_local Arena arena(reservedCapacity.load(std::memory_order_relaxed));
+  return arena;
+}
+
+void setFrameArenaCapacity(size_t capacity)
+{
+  reservedCapacity.store(capacity, std::memory_order_relaxed);
+  frameArena().reserve(capacity);
+}
+
+size_t frameArenaCapacity()
+{
+  return reservedCapacity.load(std::memory_order_relaxed);
+}
+
+FrameScope::FrameScope()
+{
+  ++frameDepth;
+}
+
+FrameScope::~FrameScope()
+{
+  if (--frameDepth == 0)
+  {
+    frameArena().reset();
+  }
+}
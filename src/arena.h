@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Monotonic allocator for the temporaries of a frame. Allocations only move a
+// cursor forward and are released all at once by reset(), which keeps a
+// single block as large as everything the last frame needed, so that a
+// thread stops touching the heap for its temporaries after the first frame.
+class Arena
+{
+public:
+  explicit Arena(size_t capacity = 0);
+  ~Arena();
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  void *allocate(size_t size, size_t alignment);
+  void reset();
+  // Makes sure that the next frames can allocate at least the given number
+  // of bytes without growing.
+  void reserve(size_t capacity);
+
+  size_t capacity() const;
+  size_t used() const;
+
+private:
+  struct Block
+  {
+    char *data;
+    size_t size;
+  };
+
+  void grow(size_t size);
+
+  std::vector<Block> blocks_;
+  char *cursor_ = nullptr;
+  char *end_ = nullptr;
+  // Bytes handed out by the blocks before the current one.
+  size_t previous_ = 0;
+};
+
+// The arena of the calling thread.
+Arena &frameArena();
+
+// Capacity reserved by the arenas of all threads, applied immediately to the
+// arena of the calling thread and to the others when they next reset.
+void setFrameArenaCapacity(size_t capacity);
+size_t frameArenaCapacity();
+
+// Marks the lifetime of the temporaries of a frame. Scopes nest, the arena of
+// the thread is reset when the outermost one ends, so that a pipeline sample
+// running several kernels only resets once.
+class FrameScope
+{
+public:
+  FrameScope();
+  ~FrameScope();
+  FrameScope(const FrameScope &) = delete;
+  FrameScope &operator=(const FrameScope &) = delete;
+};
+
+// Standard allocator on top of the arena of the constructing thread. Memory
+// is only reclaimed at the end of the frame, containers using it must not
+// outlive their FrameScope.
+template <class T>
+class ArenaAllocator
+{
+public:
+  typedef T value_type;
+
+  ArenaAllocator() : arena_(&frameArena()) {}
+  template <class U>
+  ArenaAllocator(const ArenaAllocator<U> &other) : arena_(other.arena())
+  {
+  }
+
+  T *allocate(size_t n)
+  {
+    return static_cast<T *>(arena_->allocate(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T *, size_t) {}
+
+  Arena *arena() const { return arena_; }
+
+private:
+  Arena *arena_;
+};
+
+template <class T, class U>
+bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b)
+{
+  return a.arena() == b.arena();
+}
+
+template <class T, class U>
+bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b)
+{
+  return !(a == b);
+}
+
+template <class T>
+using FrameVector = std::vector<T, ArenaAllocator<T>>;
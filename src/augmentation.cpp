@@ -0,0 +1,68 @@
+#define _USE_MATH_DEFINES
+#include "augmentation.h"
+
+#include <random>
+
+namespace
+{
+// Uniform in [0, 1) from the upper 53 bits.
+double uniform(std::mt19937_64 &engine)
+{
+  return (engine() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Box-Muller, the first uniform is moved into (0, 1] to avoid log(0).
+double normal(std::mt19937_64 &engine)
+{
+  const double u1 = 1.0 - uniform(engine);
+  const double u2 = uniform(engine);
+  return std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * M_PI * u2);
+}
+} // namespace
+
+BoundingBox3D AugmentationTransform::apply(const BoundingBox3D &box) const
+{
+  BoundingBox3D augmented = box;
+  apply(augmented.x, augmented.y, augmented.z);
+  augmented.length *= scale_;
+  augmented.width *= scale_;
+  augmented.height *= scale_;
+
+  float yaw = flip_ * box.yaw + yaw_;
+  while (yaw < -M_PI)
+    yaw += 2 * M_PI;
+  while (yaw > M_PI)
+    yaw -= 2 * M_PI;
+  augmented.yaw = yaw;
+  return augmented;
+}
+
+std::vector<BoundingBox3D> augmentBoxes(const std::vector<BoundingBox3D> &boxes,
+                                        const Augmentation &augmentation)
+{
+  const AugmentationTransform transform(augmentation);
+  std::vector<BoundingBox3D> augmented;
+  augmented.reserve(boxes.size());
+  for (const auto &box : boxes)
+  {
+    augmented.emplace_back(transform.apply(box));
+  }
+  return augmented;
+}
+
+Augmentation sampleAugmentation(const AugmentationRange &range, uint64_t seed)
+{
+  std::mt19937_64 engine(seed);
+  Augmentation augmentation;
+  augmentation.yaw =
+      static_cast<float>((2 * uniform(engine) - 1) * range.maxYaw);
+  augmentation.scale = static_cast<float>(
+      range.minScale + uniform(engine) * (range.maxScale - range.minScale));
+  augmentation.flipY = uniform(engine) < range.flipProbability;
+  for (int i = 0; i < 3; ++i)
+  {
+    augmentation.translation[i] =
+        static_cast<float>(normal(engine) * range.translationStd[i]);
+  }
+  return augmentation;
+}
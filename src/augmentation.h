@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "geometry.h"
+
+// Global augmentation of a sample. Points and boxes are mirrored along y
+// (y -> -y) if flipY is set, rotated by yaw around the z axis, scaled
+// uniformly around the origin and translated, in this order.
+struct Augmentation
+{
+  float yaw = 0.0f;
+  float scale = 1.0f;
+  bool flipY = false;
+  std::array<float, 3> translation = {{0.0f, 0.0f, 0.0f}};
+
+  bool identity() const
+  {
+    return yaw == 0.0f && scale == 1.0f && !flipY && translation[0] == 0.0f &&
+           translation[1] == 0.0f && translation[2] == 0.0f;
+  }
+};
+
+// Affine matrix of an augmentation, computed once per sample so that the
+// point loops only multiply and add.
+class AugmentationTransform
+{
+public:
+  explicit AugmentationTransform(const Augmentation &augmentation)
+      : flip_(augmentation.flipY ? -1.0f : 1.0f),
+        cos_(std::cos(augmentation.yaw) * augmentation.scale),
+        sin_(std::sin(augmentation.yaw) * augmentation.scale),
+        scale_(augmentation.scale), yaw_(augmentation.yaw),
+        tx_(augmentation.translation[0]), ty_(augmentation.translation[1]),
+        tz_(augmentation.translation[2])
+  {
+  }
+
+  void apply(float &x, float &y, float &z) const
+  {
+    const float flippedY = flip_ * y;
+    const float rotatedX = cos_ * x - sin_ * flippedY + tx_;
+    y = sin_ * x + cos_ * flippedY + ty_;
+    x = rotatedX;
+    z = scale_ * z + tz_;
+  }
+
+  // Moves the center, scales the dimensions and turns the yaw, which stays
+  // within [-pi, pi].
+  BoundingBox3D apply(const BoundingBox3D &box) const;
+
+private:
+  float flip_;
+  float cos_;
+  float sin_;
+  float scale_;
+  float yaw_;
+  float tx_;
+  float ty_;
+  float tz_;
+};
+
+std::vector<BoundingBox3D> augmentBoxes(const std::vector<BoundingBox3D> &boxes,
+                                        const Augmentation &augmentation);
+
+// Ranges augmentations are drawn from. The defaults leave samples untouched.
+struct AugmentationRange
+{
+  // Rotation uniform in [-maxYaw, maxYaw].
+  float maxYaw = 0.0f;
+  // Scale uniform in [minScale, maxScale].
+  float minScale = 1.0f;
+  float maxScale = 1.0f;
+  float flipProbability = 0.0f;
+  // Standard deviation of the normal distributed translation along x, y, z.
+  std::array<float, 3> translationStd = {{0.0f, 0.0f, 0.0f}};
+};
+
+// Draws an augmentation which only depends on the range and the seed. The
+// random numbers are derived from the raw engine output, so they are the same
+// with every standard library.
+Augmentation sampleAugmentation(const AugmentationRange &range, uint64_t seed);
@@ -0,0 +1,96 @@
+#include "cpu_dispatch.h"
+
+#include <cstdlib>
+#include <stdexcept>
+
+namespace
+{
+const CpuTarget kTargets[] = {CpuTarget::Baseline, CpuTarget::Sse42,
+                              CpuTarget::Avx2, CpuTarget::Avx512};
+
+CpuTarget detect()
+{
+#ifdef POINT_PILLARS_CPU_DISPATCH
+  // Also checks that the operating system saves the wider registers.
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl") &&
+      __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512dq") &&
+      __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+      __builtin_cpu_supports("bmi") && __builtin_cpu_supports("bmi2"))
+  {
+    return CpuTarget::Avx512;
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+      __builtin_cpu_supports("bmi") && __builtin_cpu_supports("bmi2"))
+  {
+    return CpuTarget::Avx2;
+  }
+  if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+  {
+    return CpuTarget::Sse42;
+  }
+#endif
+  return CpuTarget::Baseline;
+}
+
+CpuTarget select()
+{
+  const CpuTarget detected = detectedCpuTarget();
+  const char *requested = std::getenv("POINT_PILLARS_CPU_TARGET");
+  if (requested == nullptr || *requested == '\0')
+  {
+    return detected;
+  }
+  for (const CpuTarget target : kTargets)
+  {
+    if (cpuTargetName(target) == std::string(requested))
+    {
+      // Targets beyond the CPU fall back to the detected one.
+      return target < detected ? target : detected;
+    }
+  }
+  throw std::runtime_error(
+      std::string("Unknown POINT_PILLARS_CPU_TARGET ") + requested +
+      ", expected baseline, sse4.2, avx2 or avx512");
+}
+} // namespace
+
+CpuTarget cpuTarget()
+{
+  static const CpuTarget target = select();
+  return target;
+}
+
+CpuTarget detectedCpuTarget()
+{
+  static const CpuTarget target = detect();
+  return target;
+}
+
+const char *cpuTargetName(CpuTarget target)
+{
+  switch (target)
+  {
+  case CpuTarget::Sse42:
+    return "sse4.2";
+  case CpuTarget::Avx2:
+    return "avx2";
+  case CpuTarget::Avx512:
+    return "avx512";
+  default:
+    return "baseline";
+  }
+}
+
+std::vector<std::string> supportedCpuTargets()
+{
+  std::vector<std::string> names;
+  for (const CpuTarget target : kTargets)
+  {
+    if (target <= detectedCpuTarget())
+    {
+      names.emplace_back(cpuTargetName(target));
+    }
+  }
+  return names;
+}
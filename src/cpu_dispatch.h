@@ -0,0 +1,81 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Runtime selection of the instruction set the hot kernels run with, so that
+// one build runs on the whole fleet. Each kernel is compiled once per target
+// within its translation unit, and the best target supported by the CPU is
+// picked on first use (the module does so at import). The environment
+// variable POINT_PILLARS_CPU_TARGET (baseline, sse4.2, avx2 or avx512)
+// lowers the selection, e.g. to compare targets in tests.
+//
+// The variants only exist for x86 with GCC or Clang. On aarch64, NEON is
+// part of the baseline and there is a single variant. Floating point
+// contraction is switched off for the module (-ffp-contract=off), so that
+// all variants produce bit identical results.
+enum class CpuTarget
+{
+  Baseline = 0,
+  Sse42 = 1,
+  Avx2 = 2,
+  Avx512 = 3,
+};
+
+// The target the kernels run with. Throws for an unknown override.
+CpuTarget cpuTarget();
+// The best target supported by the CPU and the build.
+CpuTarget detectedCpuTarget();
+const char *cpuTargetName(CpuTarget target);
+// Names of the targets that can be selected on this machine.
+std::vector<std::string> supportedCpuTargets();
+
+#if (defined(__GNUC__) || defined(__clang__)) &&                              \
+    (defined(__x86_64__) || defined(__i386__))
+#define POINT_PILLARS_CPU_DISPATCH 1
+// flatten inlines everything the kernel calls within its translation unit
+// into the variant, so that the hot loops are generated for the target while
+// calls into other translation units keep running baseline code.
+#define POINT_PILLARS_TARGET_SSE42                                            \
+  __attribute__((target("sse4.2,popcnt"), flatten))
+#define POINT_PILLARS_TARGET_AVX2                                             \
+  __attribute__((target("avx2,fma,bmi,bmi2"), flatten))
+#define POINT_PILLARS_TARGET_AVX512                                           \
+  __attribute__((target("avx512f,avx512vl,avx512bw,avx512dq,avx2,fma,bmi,"   \
+                        "bmi2"),                                              \
+                 flatten))
+
+// Defines kernel##Sse42, kernel##Avx2 and kernel##Avx512, copies of the
+// kernel compiled for those targets. The parameters and arguments are passed
+// in parentheses.
+#define POINT_PILLARS_KERNEL_VARIANTS(result, kernel, parameters, arguments)  \
+  POINT_PILLARS_TARGET_SSE42 result kernel##Sse42 parameters                  \
+  {                                                                           \
+    return kernel arguments;                                                  \
+  }                                                                           \
+  POINT_PILLARS_TARGET_AVX2 result kernel##Avx2 parameters                    \
+  {                                                                           \
+    return kernel arguments;                                                  \
+  }                                                                           \
+  POINT_PILLARS_TARGET_AVX512 result kernel##Avx512 parameters                \
+  {                                                                           \
+    return kernel arguments;                                                  \
+  }
+
+// Returns the result of the variant of the selected target.
+#define POINT_PILLARS_DISPATCH(kernel, arguments)                             \
+  switch (cpuTarget())                                                        \
+  {                                                                           \
+  case CpuTarget::Avx512:                                                     \
+    return kernel##Avx512 arguments;                                          \
+  case CpuTarget::Avx2:                                                       \
+    return kernel##Avx2 arguments;                                            \
+  case CpuTarget::Sse42:                                                      \
+    return kernel##Sse42 arguments;                                           \
+  default:                                                                    \
+    return kernel arguments;                                                  \
+  }
+#else
+#define POINT_PILLARS_KERNEL_VARIANTS(result, kernel, parameters, arguments)
+#define POINT_PILLARS_DISPATCH(kernel, arguments) return kernel arguments;
+#endif
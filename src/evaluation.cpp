@@ -0,0 +1,453 @@
+#include "evaluation.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace
+{
+const float kMinHeight[kNbDifficulties] = {40.0f, 25.0f, 25.0f};
+const int kMaxOcclusion[kNbDifficulties] = {0, 1, 2};
+const float kMaxTruncation[kNbDifficulties] = {0.15f, 0.3f, 0.5f};
+// Recall positions, the first one (recall 0) is not part of AP_R40.
+const int kNbSamplePoints = 41;
+
+// Per object state for one class and difficulty, as in the official tool:
+// counted, ignored (neither missed nor false positive) or not considered.
+enum : int8_t
+{
+  Counted = 0,
+  Ignored = 1,
+  Skipped = -1,
+};
+
+struct PreparedFrame
+{
+  // Yaws of the ground truth in lidar coordinates.
+  std::vector<float> yaws;
+  // Row major (detections, ground truth) overlaps.
+  std::vector<float> bev;
+  std::vector<float> iou3D;
+};
+
+struct Statistics
+{
+  int truePositives = 0;
+  int falsePositives = 0;
+  int falseNegatives = 0;
+  double similarity = 0.0;
+};
+
+std::string lower(std::string text)
+{
+  std::transform(text.begin(), text.end(), text.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return text;
+}
+
+// Runs function(item) for all items on nbThreads threads and rethrows the
+// first error.
+template <typename Function>
+void parallelFor(size_t nbItems, int nbThreads, const Function &function)
+{
+  std::atomic<size_t> next(0);
+  std::exception_ptr error;
+  std::mutex errorMutex;
+  const auto work = [&]() {
+    for (size_t item = next++; item < nbItems; item = next++)
+    {
+      try
+      {
+        function(item);
+      }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (!error)
+        {
+          error = std::current_exception();
+        }
+        next = nbItems;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 1; i < nbThreads && static_cast<size_t>(i) < nbItems; ++i)
+  {
+    threads.emplace_back(work);
+  }
+  work();
+  for (auto &thread : threads)
+  {
+    thread.join();
+  }
+  if (error)
+  {
+    std::rethrow_exception(error);
+  }
+}
+
+// The label boxes keep z at the bottom, the overlaps expect the center.
+PreparedBox prepareLabelBox(BoundingBox3D box)
+{
+  box.z += 0.5f * box.height;
+  return prepareBox(box);
+}
+
+PreparedFrame prepareFrame(const EvaluationFrame &frame)
+{
+  if (frame.scores.size() != frame.detections.size())
+  {
+    throw std::runtime_error("One score per detection expected");
+  }
+
+  // Every label is converted, so that the boxes line up with the labels.
+  std::map<std::string, int> types;
+  for (const auto &label : frame.labels)
+  {
+    types.emplace(label.type, 0);
+  }
+  const std::vector<BoundingBox3D> groundTruth =
+      kittiLabelsToLidar(frame.labels, frame.calibration, types);
+
+  PreparedFrame prepared;
+  std::vector<PreparedBox> gtBoxes;
+  for (const auto &box : groundTruth)
+  {
+    prepared.yaws.push_back(box.yaw);
+    gtBoxes.emplace_back(prepareLabelBox(box));
+  }
+
+  // Both metrics share the footprint intersection, so it is computed once
+  // per pair.
+  const size_t nbGt = gtBoxes.size();
+  prepared.bev.assign(frame.detections.size() * nbGt, 0.0f);
+  prepared.iou3D.assign(frame.detections.size() * nbGt, 0.0f);
+  for (size_t d = 0; d < frame.detections.size(); ++d)
+  {
+    const PreparedBox detection = prepareLabelBox(frame.detections[d]);
+    for (size_t g = 0; g < nbGt; ++g)
+    {
+      const PreparedBox &gt = gtBoxes[g];
+      const float dx = detection.x - gt.x;
+      const float dy = detection.y - gt.y;
+      const float reach = detection.radius + gt.radius;
+      if (dx * dx + dy * dy >= reach * reach)
+      {
+        continue;
+      }
+      const float area = intersectionArea(detection.corners, gt.corners);
+      prepared.bev[d * nbGt + g] =
+          area / (detection.area + gt.area - area);
+
+      const float overlapHeight =
+          std::max(0.0f, std::min(detection.zMax, gt.zMax) -
+                             std::max(detection.zMin, gt.zMin));
+      const float volume = area * overlapHeight;
+      const float unionVolume =
+          detection.area * (detection.zMax - detection.zMin) +
+          gt.area * (gt.zMax - gt.zMin) - volume;
+      prepared.iou3D[d * nbGt + g] = unionVolume > 0 ? volume / unionVolume : 0;
+    }
+  }
+  return prepared;
+}
+
+void classify(const EvaluationFrame &frame, const EvaluationClass &evaluated,
+              int difficulty, std::vector<int8_t> &gtStates,
+              std::vector<int8_t> &detectionStates, size_t &nbCounted)
+{
+  const std::string name = lower(evaluated.name);
+  gtStates.resize(frame.labels.size());
+  for (size_t g = 0; g < frame.labels.size(); ++g)
+  {
+    const KittiLabel &label = frame.labels[g];
+    const std::string type = lower(label.type);
+    const bool sameClass = type == name;
+    const bool neighbour = (name == "car" && type == "van") ||
+                           (name == "pedestrian" && type == "person_sitting");
+    const bool outside = label.occluded > kMaxOcclusion[difficulty] ||
+                         label.truncated > kMaxTruncation[difficulty] ||
+                         label.bbox[3] - label.bbox[1] <= kMinHeight[difficulty];
+    if (sameClass && !outside)
+    {
+      gtStates[g] = Counted;
+      ++nbCounted;
+    }
+    else
+    {
+      gtStates[g] = (sameClass || neighbour) ? Ignored : Skipped;
+    }
+  }
+
+  detectionStates.resize(frame.detections.size());
+  for (size_t d = 0; d < frame.detections.size(); ++d)
+  {
+    detectionStates[d] =
+        static_cast<int>(frame.detections[d].classId) == evaluated.classId
+            ? Counted
+            : Skipped;
+  }
+}
+
+// compute_statistics_jit of the official tool. Without computeFalsePositives
+// every ground truth is matched to the best scored detection and the scores
+// of the true positives are appended to matchedScores. Otherwise detections
+// below threshold are dropped and ground truth is matched to the detection of
+// the highest overlap.
+Statistics computeStatistics(const float *overlaps, const float *scores,
+                             const EvaluationFrame &frame,
+                             const PreparedFrame &prepared,
+                             const std::vector<int8_t> &gtStates,
+                             const std::vector<int8_t> &detectionStates,
+                             float minOverlap, float threshold,
+                             bool computeFalsePositives,
+                             std::vector<float> *matchedScores,
+                             std::vector<char> &assigned)
+{
+  const float noDetection = -10000000.0f;
+  const size_t nbGt = gtStates.size();
+  const size_t nbDetections = detectionStates.size();
+  assigned.assign(nbDetections, 0);
+
+  Statistics statistics;
+  for (size_t g = 0; g < nbGt; ++g)
+  {
+    if (gtStates[g] == Skipped)
+    {
+      continue;
+    }
+
+    int match = -1;
+    float valid = noDetection;
+    float maxOverlap = 0.0f;
+    bool matchIgnored = false;
+    for (size_t d = 0; d < nbDetections; ++d)
+    {
+      if (detectionStates[d] == Skipped || assigned[d] ||
+          (computeFalsePositives && scores[d] < threshold))
+      {
+        continue;
+      }
+      const float overlap = overlaps[d * nbGt + g];
+      if (overlap <= minOverlap)
+      {
+        continue;
+      }
+      if (!computeFalsePositives)
+      {
+        if (scores[d] > valid)
+        {
+          match = static_cast<int>(d);
+          valid = scores[d];
+        }
+      }
+      else if ((overlap > maxOverlap || matchIgnored) &&
+               detectionStates[d] == Counted)
+      {
+        maxOverlap = overlap;
+        match = static_cast<int>(d);
+        valid = 1.0f;
+        matchIgnored = false;
+      }
+      else if (valid == noDetection && detectionStates[d] == Ignored)
+      {
+        match = static_cast<int>(d);
+        valid = 1.0f;
+        matchIgnored = true;
+      }
+    }
+
+    if (valid == noDetection)
+    {
+      statistics.falseNegatives += gtStates[g] == Counted;
+    }
+    else if (gtStates[g] == Ignored || detectionStates[match] == Ignored)
+    {
+      assigned[match] = 1;
+    }
+    else
+    {
+      ++statistics.truePositives;
+      if (matchedScores != nullptr)
+      {
+        matchedScores->push_back(scores[match]);
+      }
+      statistics.similarity +=
+          (1.0 + std::cos(prepared.yaws[g] - frame.detections[match].yaw)) /
+          2.0;
+      assigned[match] = 1;
+    }
+  }
+
+  if (computeFalsePositives)
+  {
+    for (size_t d = 0; d < nbDetections; ++d)
+    {
+      statistics.falsePositives += !assigned[d] &&
+                                   detectionStates[d] == Counted &&
+                                   scores[d] >= threshold;
+    }
+  }
+  return statistics;
+}
+
+// Scores at which the recall passes the sample points, get_thresholds of the
+// official tool.
+std::vector<float> recallThresholds(std::vector<float> scores,
+                                    size_t nbGroundTruth)
+{
+  std::sort(scores.begin(), scores.end(), std::greater<float>());
+  std::vector<float> thresholds;
+  double currentRecall = 0.0;
+  for (size_t i = 0; i < scores.size(); ++i)
+  {
+    const double leftRecall = static_cast<double>(i + 1) / nbGroundTruth;
+    const double rightRecall = i + 1 < scores.size()
+                                   ? static_cast<double>(i + 2) / nbGroundTruth
+                                   : leftRecall;
+    if (rightRecall - currentRecall < currentRecall - leftRecall &&
+        i + 1 < scores.size())
+    {
+      continue;
+    }
+    thresholds.push_back(scores[i]);
+    currentRecall += 1.0 / (kNbSamplePoints - 1);
+  }
+  return thresholds;
+}
+
+// Average precision and orientation similarity of one class, difficulty and
+// metric, in percent.
+std::pair<float, float>
+averagePrecision(const std::vector<EvaluationFrame> &frames,
+                 const std::vector<PreparedFrame> &prepared,
+                 const std::vector<std::vector<int8_t>> &gtStates,
+                 const std::vector<std::vector<int8_t>> &detectionStates,
+                 size_t nbGroundTruth, float minOverlap, bool bev,
+                 int nbThreads)
+{
+  if (nbGroundTruth == 0)
+  {
+    return std::make_pair(0.0f, 0.0f);
+  }
+  const auto overlaps = [&](size_t f) {
+    return bev ? prepared[f].bev.data() : prepared[f].iou3D.data();
+  };
+
+  std::vector<std::vector<float>> frameScores(frames.size());
+  parallelFor(frames.size(), nbThreads, [&](size_t f) {
+    std::vector<char> assigned;
+    computeStatistics(overlaps(f), frames[f].scores.data(), frames[f],
+                      prepared[f], gtStates[f], detectionStates[f], minOverlap,
+                      0.0f, false, &frameScores[f], assigned);
+  });
+  std::vector<float> scores;
+  for (const auto &matched : frameScores)
+  {
+    scores.insert(scores.end(), matched.begin(), matched.end());
+  }
+  const std::vector<float> thresholds = recallThresholds(scores, nbGroundTruth);
+
+  // Statistics per frame and threshold, summed in frame order afterwards so
+  // that the result does not depend on the scheduling.
+  const size_t nbThresholds = thresholds.size();
+  std::vector<Statistics> statistics(frames.size() * nbThresholds);
+  parallelFor(frames.size(), nbThreads, [&](size_t f) {
+    std::vector<char> assigned;
+    for (size_t t = 0; t < nbThresholds; ++t)
+    {
+      statistics[f * nbThresholds + t] = computeStatistics(
+          overlaps(f), frames[f].scores.data(), frames[f], prepared[f],
+          gtStates[f], detectionStates[f], minOverlap, thresholds[t], true,
+          nullptr, assigned);
+    }
+  });
+
+  std::vector<double> precision(kNbSamplePoints, 0.0);
+  std::vector<double> orientation(kNbSamplePoints, 0.0);
+  for (size_t t = 0; t < nbThresholds && t < precision.size(); ++t)
+  {
+    Statistics sum;
+    for (size_t f = 0; f < frames.size(); ++f)
+    {
+      const Statistics &frame = statistics[f * nbThresholds + t];
+      sum.truePositives += frame.truePositives;
+      sum.falsePositives += frame.falsePositives;
+      sum.similarity += frame.similarity;
+    }
+    const int predicted = sum.truePositives + sum.falsePositives;
+    precision[t] = predicted > 0 ? double(sum.truePositives) / predicted : 0;
+    orientation[t] = predicted > 0 ? sum.similarity / predicted : 0;
+  }
+  // Interpolated precision: the best precision at this recall or higher.
+  for (int t = kNbSamplePoints - 2; t >= 0; --t)
+  {
+    precision[t] = std::max(precision[t], precision[t + 1]);
+    orientation[t] = std::max(orientation[t], orientation[t + 1]);
+  }
+
+  double ap = 0.0;
+  double aos = 0.0;
+  for (int t = 1; t < kNbSamplePoints; ++t)
+  {
+    ap += precision[t];
+    aos += orientation[t];
+  }
+  return std::make_pair(static_cast<float>(ap / (kNbSamplePoints - 1) * 100),
+                        static_cast<float>(aos / (kNbSamplePoints - 1) * 100));
+}
+} // namespace
+
+std::vector<ClassAveragePrecision>
+evaluateKitti(const std::vector<EvaluationFrame> &frames,
+              const std::vector<EvaluationClass> &classes, int nbThreads)
+{
+  if (nbThreads <= 0)
+  {
+    nbThreads =
+        std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  }
+
+  std::vector<PreparedFrame> prepared(frames.size());
+  parallelFor(frames.size(), nbThreads,
+              [&](size_t f) { prepared[f] = prepareFrame(frames[f]); });
+
+  std::vector<ClassAveragePrecision> results;
+  std::vector<std::vector<int8_t>> gtStates(frames.size());
+  std::vector<std::vector<int8_t>> detectionStates(frames.size());
+  for (const auto &evaluated : classes)
+  {
+    ClassAveragePrecision result;
+    result.name = evaluated.name;
+    for (int difficulty = 0; difficulty < kNbDifficulties; ++difficulty)
+    {
+      size_t nbGroundTruth = 0;
+      for (size_t f = 0; f < frames.size(); ++f)
+      {
+        classify(frames[f], evaluated, difficulty, gtStates[f],
+                 detectionStates[f], nbGroundTruth);
+      }
+      result.groundTruth[difficulty] = nbGroundTruth;
+
+      const auto bev =
+          averagePrecision(frames, prepared, gtStates, detectionStates,
+                           nbGroundTruth, evaluated.minOverlap, true, nbThreads);
+      const auto iou3D = averagePrecision(frames, prepared, gtStates,
+                                          detectionStates, nbGroundTruth,
+                                          evaluated.minOverlap, false, nbThreads);
+      result.bev[difficulty] = bev.first;
+      result.orientation[difficulty] = bev.second;
+      result.iou3D[difficulty] = iou3D.first;
+    }
+    results.push_back(result);
+  }
+  return results;
+}
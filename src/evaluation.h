@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "geometry.h"
+#include "kitti.h"
+
+// Average precision as in the KITTI object detection benchmark, with the 40
+// recall positions of the current leaderboard (AP_R40). The ground truth
+// difficulties follow the benchmark:
+//
+//   easy      bbox height >= 40 px, fully visible,        truncation <= 15%
+//   moderate  bbox height >= 25 px, at most partly occl., truncation <= 30%
+//   hard      bbox height >= 25 px, at most largely occl., truncation <= 50%
+//
+// Ground truth outside a difficulty does not count as missed, detections
+// matched to it are not counted as false positives. Van ground truth is
+// treated that way for Car, Person_sitting for Pedestrian.
+//
+// Unlike the official tool, detections are lidar boxes without an image
+// bounding box, so they are never dropped for their projected height, and
+// the orientation similarity (AOS) is taken over the BEV matches with the
+// difference of the yaws instead of 2D box matches with the alpha angles.
+
+const int kNbDifficulties = 3;
+
+// Ground truth and detections of one frame. Detections are in lidar
+// coordinates with z at the bottom of the box, like the boxes returned by
+// kittiLabelsToLidar, and their classId is the predicted class.
+struct EvaluationFrame
+{
+  std::vector<KittiLabel> labels;
+  KittiCalibration calibration;
+  std::vector<BoundingBox3D> detections;
+  std::vector<float> scores;
+};
+
+struct EvaluationClass
+{
+  // Label type of the ground truth, e.g. Car.
+  std::string name;
+  // Class id of the detections.
+  int classId;
+  // Overlap a detection needs for a match, for BEV and 3D (0.7 for cars and
+  // 0.5 for pedestrians and cyclists in the benchmark).
+  float minOverlap;
+};
+
+// In percent, indexed by difficulty (easy, moderate, hard).
+struct ClassAveragePrecision
+{
+  std::string name;
+  std::array<float, kNbDifficulties> bev;
+  std::array<float, kNbDifficulties> iou3D;
+  std::array<float, kNbDifficulties> orientation;
+  // Ground truth objects of the class within each difficulty.
+  std::array<size_t, kNbDifficulties> groundTruth;
+};
+
+// Evaluates the detections of all frames. The overlaps of a frame are
+// computed once for all classes and difficulties, frames are distributed over
+// nbThreads threads (0 uses one per hardware thread). The result does not
+// depend on the number of threads.
+std::vector<ClassAveragePrecision>
+evaluateKitti(const std::vector<EvaluationFrame> &frames,
+              const std::vector<EvaluationClass> &classes, int nbThreads = 0);
@@ -0,0 +1,414 @@
+#define _USE_MATH_DEFINES
+#include "geometry.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "cpu_dispatch.h"
+
+// Returns x-value of point of intersection of two lines
+float xIntersect(float x1, float y1, float x2, float y2, float x3, float y3,
+                 float x4, float y4)
+{
+  float num = (x1 * y2 - y1 * x2) * (x3 - x4) - (x1 - x2) * (x3 * y4 - y3 * x4);
+  float den = (x1 - x2) * (y3 - y4) - (y1 - y2) * (x3 - x4);
+  return num / den;
+}
+
+// Returns y-value of point of intersection of two lines
+float yIntersect(float x1, float y1, float x2, float y2, float x3, float y3,
+                 float x4, float y4)
+{
+  float num = (x1 * y2 - y1 * x2) * (y3 - y4) - (y1 - y2) * (x3 * y4 - y3 * x4);
+  float den = (x1 - x2) * (y3 - y4) - (y1 - y2) * (x3 - x4);
+  return num / den;
+}
+
+// Returns area of polygon using the shoelace method
+float polygonArea(const Point2D *polygon, size_t size)
+{
+  float area = 0.0;
+
+  size_t j = size - 1;
+  for (size_t i = 0; i < size; i++)
+  {
+    area += (polygon[j].x + polygon[i].x) * (polygon[j].y - polygon[i].y);
+    j = i; // j is previous vertex to i
+  }
+
+  return std::abs(area / 2.0); // Return absolute value
+}
+
+float polygonArea(const Polyline2D &polygon)
+{
+  return polygonArea(polygon.data(), polygon.size());
+}
+
+Rectangle2D footprintOffsets(float length, float width, float cosYaw,
+                             float sinYaw)
+{
+  const float halfLength = 0.5 * length;
+  const float halfWidth = 0.5 * width;
+  return {{{-halfLength * cosYaw - halfWidth * sinYaw,
+            -halfLength * sinYaw + halfWidth * cosYaw},
+           {halfLength * cosYaw - halfWidth * sinYaw,
+            halfLength * sinYaw + halfWidth * cosYaw},
+           {halfLength * cosYaw + halfWidth * sinYaw,
+            halfLength * sinYaw - halfWidth * cosYaw},
+           {-halfLength * cosYaw + halfWidth * sinYaw,
+            -halfLength * sinYaw - halfWidth * cosYaw}}};
+}
+
+Rectangle2D translated(const Rectangle2D &offsets, float x, float y)
+{
+  Rectangle2D rectangle = offsets;
+  for (auto &point : rectangle)
+  {
+    point.x += x;
+    point.y += y;
+  }
+  return rectangle;
+}
+
+Polyline2D boundingBox3DToTopDown(const BoundingBox3D &box1)
+{
+  const auto box = translated(footprintOffsets(box1.length, box1.width,
+                                               std::cos(box1.yaw),
+                                               std::sin(box1.yaw)),
+                              box1.x, box1.y);
+  return Polyline2D(box.begin(), box.end());
+}
+
+// This functions clips all the edges w.r.t one Clip edge of clipping area
+// Returns a clipped polygon...
+Polyline2D clip(const Polyline2D &poly_points, float x1, float y1, float x2,
+                float y2)
+{
+  Polyline2D new_points;
+
+  for (size_t i = 0; i < poly_points.size(); i++)
+  {
+    // (ix,iy),(kx,ky) are the co-ordinate values of the points
+    // i and k form a line in polygon
+    size_t k = (i + 1) % poly_points.size();
+    float ix = poly_points[i].x, iy = poly_points[i].y;
+    float kx = poly_points[k].x, ky = poly_points[k].y;
+
+    // Calculating position of first point w.r.t. clipper line
+    float i_pos = (x2 - x1) * (iy - y1) - (y2 - y1) * (ix - x1);
+
+    // Calculating position of second point w.r.t. clipper line
+    float k_pos = (x2 - x1) * (ky - y1) - (y2 - y1) * (kx - x1);
+
+    // Case 1 : When both points are inside
+    if (i_pos < 0 && k_pos < 0)
+    {
+      // Only second point is added
+      new_points.push_back({kx, ky});
+    }
+
+    // Case 2: When only first point is outside
+    else if (i_pos >= 0 && k_pos < 0)
+    {
+      // Point of intersection with edge
+      // and the second point is added
+      new_points.push_back({xIntersect(x1, y1, x2, y2, ix, iy, kx, ky),
+                            yIntersect(x1, y1, x2, y2, ix, iy, kx, ky)});
+      new_points.push_back({kx, ky});
+
+    }
+
+    // Case 3: When only second point is outside
+    else if (i_pos < 0 && k_pos >= 0)
+    {
+      // Only point of intersection with edge is added
+      new_points.push_back({xIntersect(x1, y1, x2, y2, ix, iy, kx, ky),
+                            yIntersect(x1, y1, x2, y2, ix, iy, kx, ky)});
+
+    }
+    // Case 4: When both points are outside
+    else
+    {
+      // No points are added
+    }
+  }
+
+  return new_points;
+}
+
+// Implements Sutherland–Hodgman algorithm
+// Returns a polygon with the intersection between two polygons.
+Polyline2D sutherlandHodgmanClip(const Polyline2D &poly_points_vector,
+                                 const Polyline2D &clipper_points)
+{
+  Polyline2D clipped_poly_points_vector = poly_points_vector;
+  for (size_t i = 0; i < clipper_points.size(); i++)
+  {
+    size_t k =
+        (i + 1) % clipper_points.size(); // i and k are two consecutive indexes
+
+    // We pass the current array of vertices, and the end points of the selected
+    // clipper line
+    clipped_poly_points_vector =
+        clip(clipped_poly_points_vector, clipper_points[i].x,
+             clipper_points[i].y, clipper_points[k].x, clipper_points[k].y);
+  }
+  return clipped_poly_points_vector;
+}
+
+namespace
+{
+// Every clip edge adds at most one vertex to a convex polygon, so clipping a
+// rectangle by another one never exceeds eight vertices. The spare capacity
+// only guards against numerically degenerate input.
+constexpr size_t kMaxClipVertices = 16;
+
+struct ClipPolygon
+{
+  Point2D points[kMaxClipVertices];
+  size_t size = 0;
+
+  void push(float x, float y)
+  {
+    if (size < kMaxClipVertices)
+    {
+      points[size++] = {x, y};
+    }
+  }
+};
+
+// Same case analysis as clip(), writing into a fixed size buffer.
+void clip(const ClipPolygon &poly_points, float x1, float y1, float x2,
+          float y2, ClipPolygon &new_points)
+{
+  new_points.size = 0;
+  for (size_t i = 0; i < poly_points.size; i++)
+  {
+    size_t k = (i + 1) % poly_points.size;
+    float ix = poly_points.points[i].x, iy = poly_points.points[i].y;
+    float kx = poly_points.points[k].x, ky = poly_points.points[k].y;
+
+    float i_pos = (x2 - x1) * (iy - y1) - (y2 - y1) * (ix - x1);
+    float k_pos = (x2 - x1) * (ky - y1) - (y2 - y1) * (kx - x1);
+
+    if (i_pos < 0 && k_pos < 0)
+    {
+      new_points.push(kx, ky);
+    }
+    else if (i_pos >= 0 && k_pos < 0)
+    {
+      new_points.push(xIntersect(x1, y1, x2, y2, ix, iy, kx, ky),
+                      yIntersect(x1, y1, x2, y2, ix, iy, kx, ky));
+      new_points.push(kx, ky);
+    }
+    else if (i_pos < 0 && k_pos >= 0)
+    {
+      new_points.push(xIntersect(x1, y1, x2, y2, ix, iy, kx, ky),
+                      yIntersect(x1, y1, x2, y2, ix, iy, kx, ky));
+    }
+  }
+}
+
+float cross(const Point2D &o, const Point2D &a, const Point2D &b)
+{
+  return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+float intersectionAreaKernel(const Rectangle2D &rectangle,
+                             const Rectangle2D &clipper)
+{
+  ClipPolygon buffers[2];
+  std::copy(rectangle.begin(), rectangle.end(), buffers[0].points);
+  buffers[0].size = rectangle.size();
+
+  int current = 0;
+  for (size_t i = 0; i < clipper.size(); i++)
+  {
+    size_t k = (i + 1) % clipper.size();
+    clip(buffers[current], clipper[i].x, clipper[i].y, clipper[k].x,
+         clipper[k].y, buffers[1 - current]);
+    current = 1 - current;
+    if (buffers[current].size == 0)
+    {
+      return 0;
+    }
+  }
+  return polygonArea(buffers[current].points, buffers[current].size);
+}
+
+POINT_PILLARS_KERNEL_VARIANTS(float, intersectionAreaKernel,
+                              (const Rectangle2D &rectangle,
+                               const Rectangle2D &clipper),
+                              (rectangle, clipper))
+} // namespace
+
+float intersectionArea(const Rectangle2D &rectangle,
+                       const Rectangle2D &clipper)
+{
+  POINT_PILLARS_DISPATCH(intersectionAreaKernel, (rectangle, clipper))
+}
+
+float enclosingArea(const Rectangle2D &rectangle1,
+                    const Rectangle2D &rectangle2)
+{
+  // Andrew's monotone chain over the eight corners.
+  Point2D points[8];
+  std::copy(rectangle1.begin(), rectangle1.end(), points);
+  std::copy(rectangle2.begin(), rectangle2.end(), points + 4);
+  std::sort(points, points + 8, [](const Point2D &a, const Point2D &b)
+            { return a.x < b.x || (a.x == b.x && a.y < b.y); });
+
+  Point2D hull[16];
+  size_t size = 0;
+  for (size_t i = 0; i < 8; ++i)
+  {
+    while (size >= 2 && cross(hull[size - 2], hull[size - 1], points[i]) <= 0)
+      size--;
+    hull[size++] = points[i];
+  }
+  for (size_t i = 7, lower = size + 1; i-- > 0;)
+  {
+    while (size >= lower && cross(hull[size - 2], hull[size - 1], points[i]) <= 0)
+      size--;
+    hull[size++] = points[i];
+  }
+  // The first point is repeated at the end of the chain.
+  return polygonArea(hull, size - 1);
+}
+
+float iou(const BoundingBox3D &box1, const BoundingBox3D &box2)
+{
+  const auto box_as_vector = translated(
+      footprintOffsets(box1.length, box1.width, std::cos(box1.yaw),
+                       std::sin(box1.yaw)),
+      box1.x, box1.y);
+  const auto box_as_vector_2 = translated(
+      footprintOffsets(box2.length, box2.width, std::cos(box2.yaw),
+                       std::sin(box2.yaw)),
+      box2.x, box2.y);
+
+  float area_poly1 = polygonArea(box_as_vector.data(), box_as_vector.size());
+  float area_poly2 = polygonArea(box_as_vector_2.data(), box_as_vector_2.size());
+  float area_overlap = intersectionArea(box_as_vector, box_as_vector_2);
+
+  const float area_union = area_poly1 + area_poly2 - area_overlap;
+  return area_union > 0 ? area_overlap / area_union : 0;
+}
+
+PreparedBox prepareBox(const BoundingBox3D &box)
+{
+  PreparedBox prepared;
+  prepared.corners = translated(footprintOffsets(box.length, box.width,
+                                                 std::cos(box.yaw),
+                                                 std::sin(box.yaw)),
+                                box.x, box.y);
+  prepared.area =
+      polygonArea(prepared.corners.data(), prepared.corners.size());
+  prepared.x = box.x;
+  prepared.y = box.y;
+  prepared.z = box.z;
+  prepared.zMin = box.z - 0.5f * box.height;
+  prepared.zMax = box.z + 0.5f * box.height;
+  prepared.radius = 0.5f * std::sqrt(box.length * box.length +
+                                     box.width * box.width);
+  return prepared;
+}
+
+namespace
+{
+float boxOverlapKernel(const PreparedBox &box1, const PreparedBox &box2,
+                       IouMetric metric)
+{
+  const float dx = box1.x - box2.x;
+  const float dy = box1.y - box2.y;
+  // Footprints whose circumscribed circles do not touch cannot intersect.
+  const bool disjoint = dx * dx + dy * dy >=
+                        (box1.radius + box2.radius) * (box1.radius + box2.radius);
+  const float overlapArea =
+      disjoint ? 0 : intersectionAreaKernel(box1.corners, box2.corners);
+
+  if (metric == IouMetric::Bev)
+  {
+    // Zero area boxes overlap nothing, as for the volumes below.
+    const float unionArea = box1.area + box2.area - overlapArea;
+    return unionArea > 0 ? overlapArea / unionArea : 0;
+  }
+
+  const float height1 = box1.zMax - box1.zMin;
+  const float height2 = box2.zMax - box2.zMin;
+  const float overlapHeight =
+      std::max(0.0f, std::min(box1.zMax, box2.zMax) -
+                         std::max(box1.zMin, box2.zMin));
+  const float overlapVolume = overlapArea * overlapHeight;
+  const float unionVolume =
+      box1.area * height1 + box2.area * height2 - overlapVolume;
+  const float iou3D = unionVolume > 0 ? overlapVolume / unionVolume : 0;
+
+  if (metric == IouMetric::Iou3D)
+  {
+    return iou3D;
+  }
+
+  const float enclosingHeight =
+      std::max(box1.zMax, box2.zMax) - std::min(box1.zMin, box2.zMin);
+  if (metric == IouMetric::GIou3D)
+  {
+    const float enclosingVolume =
+        enclosingArea(box1.corners, box2.corners) * enclosingHeight;
+    return enclosingVolume > 0
+               ? iou3D - (enclosingVolume - unionVolume) / enclosingVolume
+               : iou3D;
+  }
+
+  // DIoU, the enclosing diagonal is taken from the axis aligned bounds of all
+  // corners.
+  float xMin = box1.corners[0].x, xMax = xMin;
+  float yMin = box1.corners[0].y, yMax = yMin;
+  for (const auto *corners : {&box1.corners, &box2.corners})
+  {
+    for (const auto &corner : *corners)
+    {
+      xMin = std::min(xMin, corner.x);
+      xMax = std::max(xMax, corner.x);
+      yMin = std::min(yMin, corner.y);
+      yMax = std::max(yMax, corner.y);
+    }
+  }
+  const float dz = box1.z - box2.z;
+  const float diagonal = (xMax - xMin) * (xMax - xMin) +
+                         (yMax - yMin) * (yMax - yMin) +
+                         enclosingHeight * enclosingHeight;
+  return diagonal > 0 ? iou3D - (dx * dx + dy * dy + dz * dz) / diagonal
+                      : iou3D;
+}
+
+POINT_PILLARS_KERNEL_VARIANTS(float, boxOverlapKernel,
+                              (const PreparedBox &box1, const PreparedBox &box2,
+                               IouMetric metric),
+                              (box1, box2, metric))
+} // namespace
+
+float boxOverlap(const PreparedBox &box1, const PreparedBox &box2,
+                 IouMetric metric)
+{
+  POINT_PILLARS_DISPATCH(boxOverlapKernel, (box1, box2, metric))
+}
+
+float boxOverlap(const BoundingBox3D &box1, const BoundingBox3D &box2,
+                 IouMetric metric)
+{
+  return boxOverlap(prepareBox(box1), prepareBox(box2), metric);
+}
+
+void boxOverlapMatrix(const PreparedBox *boxes1, size_t nbBoxes1,
+                      const PreparedBox *boxes2, size_t nbBoxes2,
+                      IouMetric metric, float *overlaps)
+{
+  for (size_t i = 0; i < nbBoxes1; ++i)
+  {
+    for (size_t j = 0; j < nbBoxes2; ++j)
+    {
+      *overlaps++ = boxOverlap(boxes1[i], boxes2[j], metric);
+    }
+  }
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+struct BoundingBox3D
+{
+  float x;
+  float y;
+  float z;
+  float length;
+  float width;
+  float height;
+  float yaw;
+  // For anchors only!
+  float base_yaw = 0.0;
+  float classId;
+};
+
+struct Point2D
+{
+  float x;
+  float y;
+};
+
+typedef std::vector<Point2D> Polyline2D;
+
+// Corners of a rotated rectangle in clockwise order.
+typedef std::array<Point2D, 4> Rectangle2D;
+
+// Returns x-value of point of intersection of two lines
+float xIntersect(float x1, float y1, float x2, float y2, float x3, float y3,
+                 float x4, float y4);
+
+// Returns y-value of point of intersection of two lines
+float yIntersect(float x1, float y1, float x2, float y2, float x3, float y3,
+                 float x4, float y4);
+
+// Returns area of polygon using the shoelace method
+float polygonArea(const Point2D *polygon, size_t size);
+float polygonArea(const Polyline2D &polygon);
+
+// Corners of a length x width rectangle rotated by the given yaw, relative to
+// its center and in clockwise order. The sine and cosine are passed in so
+// that callers can share them across boxes of equal orientation.
+Rectangle2D footprintOffsets(float length, float width, float cosYaw,
+                             float sinYaw);
+
+// Moves the corner offsets of a footprint to the given center.
+Rectangle2D translated(const Rectangle2D &offsets, float x, float y);
+
+// Construct bounding box in 2D, coordinates are returned in clockwise order
+Polyline2D boundingBox3DToTopDown(const BoundingBox3D &box1);
+
+// This functions clips all the edges w.r.t one Clip edge of clipping area
+// Returns a clipped polygon...
+Polyline2D clip(const Polyline2D &poly_points, float x1, float y1, float x2,
+                float y2);
+
+// Implements Sutherland–Hodgman algorithm
+// Returns a polygon with the intersection between two polygons.
+Polyline2D sutherlandHodgmanClip(const Polyline2D &poly_points_vector,
+                                 const Polyline2D &clipper_points);
+
+// Area of the intersection of two rotated rectangles. Same algorithm as
+// sutherlandHodgmanClip, but working on fixed size buffers on the stack so
+// that it can run in hot loops without touching the heap.
+float intersectionArea(const Rectangle2D &rectangle,
+                       const Rectangle2D &clipper);
+
+// Area of the convex hull of two rotated rectangles.
+float enclosingArea(const Rectangle2D &rectangle1,
+                    const Rectangle2D &rectangle2);
+
+// Calculates the IOU between two bounding boxes.
+float iou(const BoundingBox3D &box1, const BoundingBox3D &box2);
+
+enum class IouMetric
+{
+  // Intersection over union of the top down footprints.
+  Bev = 0,
+  // Footprint intersection times the overlap of the vertical extents.
+  Iou3D = 1,
+  // Generalized IoU, penalized by the empty volume of the enclosing shape
+  // (convex hull of both footprints times the joint vertical extent).
+  GIou3D = 2,
+  // Distance IoU, penalized by the squared center distance relative to the
+  // squared diagonal of the axis aligned box enclosing both boxes.
+  DIou3D = 3,
+};
+
+// A box with its footprint and vertical extent resolved, so that it can be
+// compared against many others. The z coordinate is the center of the box.
+struct PreparedBox
+{
+  Rectangle2D corners;
+  float area;
+  float x;
+  float y;
+  float z;
+  float zMin;
+  float zMax;
+  // Radius of the circumscribed circle of the footprint.
+  float radius;
+};
+
+PreparedBox prepareBox(const BoundingBox3D &box);
+
+// Overlap of two boxes according to the given metric.
+float boxOverlap(const PreparedBox &box1, const PreparedBox &box2,
+                 IouMetric metric);
+float boxOverlap(const BoundingBox3D &box1, const BoundingBox3D &box2,
+                 IouMetric metric);
+
+// Writes the row major (nbBoxes1, nbBoxes2) matrix of the overlaps of all
+// pairs of boxes.
+void boxOverlapMatrix(const PreparedBox *boxes1, size_t nbBoxes1,
+                      const PreparedBox *boxes2, size_t nbBoxes2,
+                      IouMetric metric, float *overlaps);
@@ -0,0 +1,434 @@
+#include "gt_database.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <type_traits>
+
+#include "arena.h"
+#include "kitti.h"
+
+namespace
+{
+const char kGtDatabaseMagic[8] = {'P', 'P', 'G', 'T', 'D', 'B', '\0', '\0'};
+
+static_assert(std::is_trivially_copyable<GtDatabaseHeader>::value &&
+                  std::is_trivially_copyable<GtObject>::value,
+              "database records are written as raw bytes");
+static_assert(sizeof(GtDatabaseHeader) == 24 && sizeof(GtObject) == 48,
+              "database records must not contain padding");
+
+bool inside(uint64_t offset, uint64_t size, uint64_t fileSize)
+{
+  return offset <= fileSize && size <= fileSize - offset;
+}
+
+void write(std::ofstream &file, const std::string &path, const void *data,
+           size_t size)
+{
+  file.write(static_cast<const char *>(data), size);
+  if (!file)
+  {
+    throw std::runtime_error("Could not write " + path);
+  }
+}
+
+// A pasted box as seen from the sensor at the origin.
+struct Occluder
+{
+  float x;
+  float y;
+  float z;
+  float cosYaw;
+  float sinYaw;
+  float halfExtents[3];
+  // Points closer to the sensor in BEV cannot be hidden by the box.
+  float minRangeSquared;
+};
+
+Occluder prepareOccluder(const BoundingBox3D &box)
+{
+  Occluder occluder;
+  occluder.x = box.x;
+  occluder.y = box.y;
+  occluder.z = box.z + 0.5f * box.height;
+  occluder.cosYaw = std::cos(box.yaw);
+  occluder.sinYaw = std::sin(box.yaw);
+  occluder.halfExtents[0] = 0.5f * box.length;
+  occluder.halfExtents[1] = 0.5f * box.width;
+  occluder.halfExtents[2] = 0.5f * box.height;
+  const float minRange =
+      std::hypot(box.x, box.y) -
+      std::hypot(occluder.halfExtents[0], occluder.halfExtents[1]);
+  occluder.minRangeSquared = minRange > 0 ? minRange * minRange : 0.0f;
+  return occluder;
+}
+
+// Whether the ray from the sensor to the point passes through the box, i.e.
+// the point lies within the azimuth and elevation footprint of the box and
+// beyond its near surface (points inside the box included). Slab test of the
+// segment in box coordinates.
+bool occluded(const Occluder &occluder, const float *point)
+{
+  if (point[0] * point[0] + point[1] * point[1] < occluder.minRangeSquared)
+  {
+    return false;
+  }
+  const float sensor[3] = {
+      -occluder.x * occluder.cosYaw - occluder.y * occluder.sinYaw,
+      occluder.x * occluder.sinYaw - occluder.y * occluder.cosYaw,
+      -occluder.z};
+  const float dx = point[0] - occluder.x;
+  const float dy = point[1] - occluder.y;
+  const float target[3] = {dx * occluder.cosYaw + dy * occluder.sinYaw,
+                           -dx * occluder.sinYaw + dy * occluder.cosYaw,
+                           point[2] - occluder.z};
+  float enter = 0.0f;
+  float leave = 1.0f;
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    const float half = occluder.halfExtents[axis];
+    const float direction = target[axis] - sensor[axis];
+    if (direction == 0.0f)
+    {
+      if (std::abs(sensor[axis]) > half)
+      {
+        return false;
+      }
+      continue;
+    }
+    float t0 = (-half - sensor[axis]) / direction;
+    float t1 = (half - sensor[axis]) / direction;
+    if (t0 > t1)
+    {
+      std::swap(t0, t1);
+    }
+    enter = std::max(enter, t0);
+    leave = std::min(leave, t1);
+    if (enter > leave)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+} // namespace
+
+size_t buildGtDatabase(const std::string &path,
+                       const std::vector<std::string> &lidarFiles,
+                       const std::vector<std::string> &labelFiles,
+                       const std::vector<std::string> &calibrationFiles,
+                       const std::map<std::string, int> &classIds,
+                       size_t minPoints)
+{
+  if (labelFiles.size() != lidarFiles.size() ||
+      calibrationFiles.size() != lidarFiles.size())
+  {
+    throw std::runtime_error(
+        "Label and calibration files have to be given for every velodyne file");
+  }
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file)
+  {
+    throw std::runtime_error("Could not create " + path);
+  }
+  // Placeholder, rewritten once the index offset is known.
+  GtDatabaseHeader header = {};
+  write(file, path, &header, sizeof(header));
+  uint64_t offset = sizeof(header);
+
+  std::vector<GtObject> objects;
+  std::vector<float> points;
+  std::vector<int32_t> boxIds;
+  std::vector<uint32_t> counts;
+  for (size_t frame = 0; frame < lidarFiles.size(); ++frame)
+  {
+    const MappedFile lidar(lidarFiles[frame]);
+    if (lidar.size() % (4 * sizeof(float)) != 0)
+    {
+      throw std::runtime_error(lidarFiles[frame] +
+                               " is not a KITTI velodyne file");
+    }
+    const auto *framePoints = reinterpret_cast<const float *>(lidar.data());
+    const size_t nbPoints = lidar.size() / (4 * sizeof(float));
+
+    const std::vector<BoundingBox3D> boxes = kittiLabelsToLidar(
+        parseKittiLabels(readFile(labelFiles[frame])),
+        parseKittiCalibration(readFile(calibrationFiles[frame])), classIds);
+    boxIds.resize(nbPoints);
+    pointsInBoxes(framePoints, nbPoints, 4, boxes, boxIds.data(), &counts);
+    for (size_t b = 0; b < boxes.size(); ++b)
+    {
+      const BoundingBox3D &box = boxes[b];
+      const size_t count = counts[b];
+      if (count == 0 || count < minPoints)
+      {
+        continue;
+      }
+
+      // Points of overlapping boxes are kept in both objects, only points
+      // inside some box need the exact test.
+      points.clear();
+      const float cosYaw = std::cos(box.yaw);
+      const float sinYaw = std::sin(box.yaw);
+      for (size_t i = 0; i < nbPoints; ++i)
+      {
+        const float *point = framePoints + i * 4;
+        if (boxIds[i] == static_cast<int32_t>(b) ||
+            (boxIds[i] >= 0 && pointInLabelBox(box, cosYaw, sinYaw, point)))
+        {
+          points.insert(points.end(), point, point + 4);
+        }
+      }
+
+      GtObject object = {};
+      const float values[7] = {box.x,     box.y,      box.z,  box.length,
+                               box.width, box.height, box.yaw};
+      std::memcpy(object.box, values, sizeof(object.box));
+      object.classId = static_cast<int32_t>(box.classId);
+      object.frame = static_cast<uint32_t>(frame);
+      object.pointCount = static_cast<uint32_t>(points.size() / 4);
+      object.pointOffset = offset;
+      write(file, path, points.data(), points.size() * sizeof(float));
+      offset += points.size() * sizeof(float);
+      objects.emplace_back(object);
+    }
+  }
+
+  std::memcpy(header.magic, kGtDatabaseMagic, sizeof(header.magic));
+  header.version = kGtDatabaseVersion;
+  header.objectCount = static_cast<uint32_t>(objects.size());
+  header.indexOffset = offset;
+  write(file, path, objects.data(), objects.size() * sizeof(GtObject));
+
+  file.seekp(0);
+  write(file, path, &header, sizeof(header));
+  file.close();
+  if (!file)
+  {
+    throw std::runtime_error("Could not write " + path);
+  }
+  return objects.size();
+}
+
+GtDatabase::GtDatabase(const std::string &path)
+    : file_(path, MappedFile::Access::Random)
+{
+  const uint64_t fileSize = file_.size();
+  GtDatabaseHeader header;
+  if (fileSize < sizeof(header))
+  {
+    throw std::runtime_error(path + " is not a ground truth database");
+  }
+  std::memcpy(&header, file_.data(), sizeof(header));
+  if (std::memcmp(header.magic, kGtDatabaseMagic, sizeof(kGtDatabaseMagic)) !=
+      0)
+  {
+    throw std::runtime_error(path + " is not a ground truth database");
+  }
+  if (header.version != kGtDatabaseVersion)
+  {
+    throw std::runtime_error(path +
+                             " has unsupported ground truth database version " +
+                             std::to_string(header.version));
+  }
+  if (header.indexOffset % alignof(GtObject) != 0 ||
+      !inside(header.indexOffset,
+              static_cast<uint64_t>(header.objectCount) * sizeof(GtObject),
+              fileSize))
+  {
+    throw std::runtime_error(path + " has a truncated index");
+  }
+
+  index_ = reinterpret_cast<const GtObject *>(file_.data() +
+                                              header.indexOffset);
+  objectCount_ = header.objectCount;
+  for (size_t i = 0; i < objectCount_; ++i)
+  {
+    const GtObject &object = index_[i];
+    if (object.classId < 0 || object.pointOffset % alignof(float) != 0 ||
+        !inside(object.pointOffset,
+                static_cast<uint64_t>(object.pointCount) * 4 * sizeof(float),
+                fileSize))
+    {
+      throw std::runtime_error(path + " has a corrupt entry for object " +
+                               std::to_string(i));
+    }
+    if (static_cast<size_t>(object.classId) >= classes_.size())
+    {
+      classes_.resize(object.classId + 1);
+    }
+    classes_[object.classId].push_back(static_cast<uint32_t>(i));
+  }
+}
+
+const GtObject &GtDatabase::object(size_t id) const
+{
+  if (id >= objectCount_)
+  {
+    throw std::out_of_range("Object " + std::to_string(id) +
+                            " out of range, the database has " +
+                            std::to_string(objectCount_) + " objects");
+  }
+  return index_[id];
+}
+
+BoundingBox3D GtDatabase::box(size_t id) const
+{
+  const GtObject &entry = object(id);
+  BoundingBox3D box = {};
+  box.x = entry.box[0];
+  box.y = entry.box[1];
+  box.z = entry.box[2];
+  box.length = entry.box[3];
+  box.width = entry.box[4];
+  box.height = entry.box[5];
+  box.yaw = entry.box[6];
+  box.classId = entry.classId;
+  return box;
+}
+
+const float *GtDatabase::points(size_t id) const
+{
+  return reinterpret_cast<const float *>(file_.data() +
+                                         object(id).pointOffset);
+}
+
+const std::vector<uint32_t> &GtDatabase::objectsOfClass(int classId) const
+{
+  static const std::vector<uint32_t> none;
+  if (classId < 0 || static_cast<size_t>(classId) >= classes_.size())
+  {
+    return none;
+  }
+  return classes_[classId];
+}
+
+size_t sampleGroundTruth(const GtDatabase &database,
+                         const std::vector<int> &counts, uint64_t seed,
+                         std::vector<float> &points,
+                         std::vector<BoundingBox3D> &boxes)
+{
+  std::mt19937_64 engine(seed);
+
+  FrameScope frame;
+  FrameVector<PreparedBox> occupied;
+  occupied.reserve(boxes.size());
+  FrameVector<int> present(counts.size(), 0);
+  for (const auto &box : boxes)
+  {
+    occupied.emplace_back(prepareBox(box));
+    const int classId = static_cast<int>(box.classId);
+    if (classId >= 0 && static_cast<size_t>(classId) < present.size())
+    {
+      ++present[classId];
+    }
+  }
+
+  FrameVector<uint32_t> pasted;
+  FrameVector<uint32_t> candidates;
+  for (size_t classId = 0; classId < counts.size(); ++classId)
+  {
+    const std::vector<uint32_t> &pool =
+        database.objectsOfClass(static_cast<int>(classId));
+    if (counts[classId] <= present[classId] || pool.empty())
+    {
+      continue;
+    }
+
+    // Distinct candidates, drawn from the raw engine output so that they do
+    // not depend on the standard library.
+    const size_t needed = std::min(
+        static_cast<size_t>(counts[classId] - present[classId]), pool.size());
+    candidates.clear();
+    while (candidates.size() < needed)
+    {
+      const uint32_t id = pool[engine() % pool.size()];
+      if (std::find(candidates.begin(), candidates.end(), id) ==
+          candidates.end())
+      {
+        candidates.push_back(id);
+      }
+    }
+
+    for (const auto id : candidates)
+    {
+      const BoundingBox3D box = database.box(id);
+      const PreparedBox prepared = prepareBox(box);
+      bool collides = false;
+      for (const auto &other : occupied)
+      {
+        if (boxOverlap(prepared, other, IouMetric::Bev) > 0)
+        {
+          collides = true;
+          break;
+        }
+      }
+      if (collides)
+      {
+        continue;
+      }
+      occupied.emplace_back(prepared);
+      boxes.emplace_back(box);
+      pasted.push_back(id);
+    }
+  }
+
+  if (pasted.empty())
+  {
+    return 0;
+  }
+
+  FrameVector<Occluder> occluders;
+  occluders.reserve(pasted.size());
+  for (const auto id : pasted)
+  {
+    occluders.emplace_back(prepareOccluder(database.box(id)));
+  }
+  const auto hidden = [&](const float *point, size_t skipped) {
+    for (size_t j = 0; j < occluders.size(); ++j)
+    {
+      if (j != skipped && occluded(occluders[j], point))
+      {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  // Compacts the scene points in place, dropping the ones hidden by pasted
+  // boxes.
+  const size_t nbPoints = points.size() / 4;
+  size_t kept = 0;
+  for (size_t i = 0; i < nbPoints; ++i)
+  {
+    if (!hidden(&points[i * 4], occluders.size()))
+    {
+      if (kept != i)
+      {
+        std::copy(&points[i * 4], &points[i * 4] + 4, &points[kept * 4]);
+      }
+      ++kept;
+    }
+  }
+  points.resize(kept * 4);
+
+  for (size_t j = 0; j < pasted.size(); ++j)
+  {
+    const float *objectPoints = database.points(pasted[j]);
+    const uint32_t pointCount = database.object(pasted[j]).pointCount;
+    for (uint32_t i = 0; i < pointCount; ++i)
+    {
+      if (!hidden(objectPoints + i * 4, j))
+      {
+        points.insert(points.end(), objectPoints + i * 4,
+                      objectPoints + i * 4 + 4);
+      }
+    }
+  }
+  return pasted.size();
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "geometry.h"
+#include "mapped_file.h"
+#include "points_in_boxes.h"
+
+// Database of the points of every labeled object of a KITTI split, for
+// ground truth sampling (copy-paste augmentation). Layout:
+//
+//   GtDatabaseHeader
+//   per object: points inside its box, float32 (x, y, z, intensity)
+//   GtObject for every object, located through GtDatabaseHeader::indexOffset
+//
+// Points keep their lidar coordinates, so that a sampled object is pasted at
+// the position, distance and orientation it was recorded at.
+
+const uint32_t kGtDatabaseVersion = 1;
+
+struct GtDatabaseHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t objectCount;
+  uint64_t indexOffset;
+};
+
+struct GtObject
+{
+  // x, y, z, length, width, height, yaw as returned by kittiLabelsToLidar.
+  float box[7];
+  int32_t classId;
+  // Index of the velodyne file the object was extracted from.
+  uint32_t frame;
+  uint32_t pointCount;
+  uint64_t pointOffset;
+};
+
+// Extracts the objects of the given classes with at least minPoints points
+// and writes the database to path. Returns the number of objects written.
+size_t buildGtDatabase(const std::string &path,
+                       const std::vector<std::string> &lidarFiles,
+                       const std::vector<std::string> &labelFiles,
+                       const std::vector<std::string> &calibrationFiles,
+                       const std::map<std::string, int> &classIds,
+                       size_t minPoints);
+
+// Memory mapped database with the objects grouped by class.
+class GtDatabase
+{
+public:
+  explicit GtDatabase(const std::string &path);
+
+  size_t size() const { return objectCount_; }
+  const GtObject &object(size_t id) const;
+  BoundingBox3D box(size_t id) const;
+  // Row major (pointCount, 4) points of an object.
+  const float *points(size_t id) const;
+  // Ids of the objects of a class, empty for unknown classes.
+  const std::vector<uint32_t> &objectsOfClass(int classId) const;
+
+private:
+  MappedFile file_;
+  const GtObject *index_ = nullptr;
+  size_t objectCount_ = 0;
+  std::vector<std::vector<uint32_t>> classes_;
+};
+
+// Pastes objects of the database into a scene: for every class id c, objects
+// are drawn until the scene holds counts[c] objects of that class. Candidates
+// whose footprint overlaps one of the scene boxes or of the boxes pasted
+// before are dropped, as in SECOND there is no second draw. Scene points a
+// pasted box occludes from the sensor at the origin, i.e. inside the box or
+// within its azimuth and elevation footprint and beyond it, are removed, and
+// the points of the pasted objects are appended, except those occluded by
+// another pasted box. Scene boxes are kept even if their points are all
+// hidden. points are (n, 4) row major with the bottom of the boxes as z, boxes
+// get the pasted boxes appended. Returns the number of pasted objects. The
+// result only depends on the inputs and the seed.
+size_t sampleGroundTruth(const GtDatabase &database,
+                         const std::vector<int> &counts, uint64_t seed,
+                         std::vector<float> &points,
+                         std::vector<BoundingBox3D> &boxes);
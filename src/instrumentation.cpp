@@ -0,0 +1,187 @@
+#include "instrumentation.h"
+
+#include <array>
+#include <atomic>
+#include <limits>
+
+namespace
+{
+const size_t kNbStages = static_cast<size_t>(Stage::Count);
+const size_t kNbCounters = static_cast<size_t>(Counter::Count);
+
+struct StageAccumulator
+{
+  std::atomic<uint64_t> calls{0};
+  std::atomic<uint64_t> total{0};
+  std::atomic<uint64_t> min{std::numeric_limits<uint64_t>::max()};
+  std::atomic<uint64_t> max{0};
+  std::array<std::atomic<uint64_t>, kHistogramBuckets> histogram{};
+  std::atomic<uint64_t> allocatedBytes{0};
+  std::atomic<uint64_t> allocations{0};
+  std::atomic<uint64_t> peakBytes{0};
+};
+
+std::atomic<bool> enabled{false};
+std::array<StageAccumulator, kNbStages> stages;
+std::array<std::atomic<uint64_t>, kNbCounters> counters{};
+
+int bucket(uint64_t nanoseconds)
+{
+  int index = 0;
+  while (nanoseconds > 1 && index < kHistogramBuckets - 1)
+  {
+    nanoseconds >>= 1;
+    ++index;
+  }
+  return index;
+}
+
+void updateMax(std::atomic<uint64_t> &maximum, uint64_t value)
+{
+  uint64_t current = maximum.load(std::memory_order_relaxed);
+  while (value > current &&
+         !maximum.compare_exchange_weak(current, value,
+                                        std::memory_order_relaxed))
+  {
+  }
+}
+} // namespace
+
+void setInstrumentationEnabled(bool value)
+{
+  enabled.store(value, std::memory_order_relaxed);
+}
+
+bool instrumentationEnabled()
+{
+  return enabled.load(std::memory_order_relaxed);
+}
+
+void resetInstrumentation()
+{
+  for (auto &stage : stages)
+  {
+    stage.calls.store(0, std::memory_order_relaxed);
+    stage.total.store(0, std::memory_order_relaxed);
+    stage.min.store(std::numeric_limits<uint64_t>::max(),
+                    std::memory_order_relaxed);
+    stage.max.store(0, std::memory_order_relaxed);
+    for (auto &count : stage.histogram)
+      count.store(0, std::memory_order_relaxed);
+    stage.allocatedBytes.store(0, std::memory_order_relaxed);
+    stage.allocations.store(0, std::memory_order_relaxed);
+    stage.peakBytes.store(0, std::memory_order_relaxed);
+  }
+  for (auto &counter : counters)
+    counter.store(0, std::memory_order_relaxed);
+}
+
+InstrumentationReport instrumentationReport()
+{
+  InstrumentationReport report;
+  for (size_t i = 0; i < kNbStages; ++i)
+  {
+    const StageAccumulator &accumulator = stages[i];
+    StageTiming timing;
+    timing.name = stageName(static_cast<Stage>(i));
+    timing.calls = accumulator.calls.load(std::memory_order_relaxed);
+    timing.totalNanoseconds = accumulator.total.load(std::memory_order_relaxed);
+    timing.minNanoseconds =
+        timing.calls > 0 ? accumulator.min.load(std::memory_order_relaxed) : 0;
+    timing.maxNanoseconds = accumulator.max.load(std::memory_order_relaxed);
+    for (const auto &count : accumulator.histogram)
+      timing.histogram.push_back(count.load(std::memory_order_relaxed));
+    timing.allocatedBytes =
+        accumulator.allocatedBytes.load(std::memory_order_relaxed);
+    timing.allocations = accumulator.allocations.load(std::memory_order_relaxed);
+    timing.peakBytes = accumulator.peakBytes.load(std::memory_order_relaxed);
+    report.stages.emplace_back(timing);
+  }
+  for (size_t i = 0; i < kNbCounters; ++i)
+  {
+    report.counters[counterName(static_cast<Counter>(i))] =
+        counters[i].load(std::memory_order_relaxed);
+  }
+  return report;
+}
+
+const char *stageName(Stage stage)
+{
+  switch (stage)
+  {
+  case Stage::Pillars:
+    return "pillars";
+  case Stage::PillarFilter:
+    return "pillars.filter";
+  case Stage::PillarGrouping:
+    return "pillars.grouping";
+  case Stage::PillarZeroFill:
+    return "pillars.zeroFill";
+  case Stage::PillarStatistics:
+    return "pillars.statistics";
+  case Stage::PillarEmission:
+    return "pillars.emission";
+  case Stage::Target:
+    return "target";
+  case Stage::TargetZeroFill:
+    return "target.zeroFill";
+  case Stage::TargetIou:
+    return "target.iou";
+  case Stage::TargetAssignment:
+    return "target.assignment";
+  case Stage::PipelineBatch:
+    return "pipeline.batch";
+  default:
+    return "unknown";
+  }
+}
+
+const char *counterName(Counter counter)
+{
+  switch (counter)
+  {
+  case Counter::PointsInRange:
+    return "pointsInRange";
+  case Counter::PointsOutOfRange:
+    return "pointsOutOfRange";
+  case Counter::Pillars:
+    return "pillars";
+  case Counter::PillarsDropped:
+    return "pillarsDropped";
+  case Counter::PointsTruncated:
+    return "pointsTruncated";
+  default:
+    return "unknown";
+  }
+}
+
+void recordStage(Stage stage, uint64_t nanoseconds, uint64_t allocatedBytes,
+                 uint64_t allocations, uint64_t peakBytes)
+{
+  StageAccumulator &accumulator = stages[static_cast<size_t>(stage)];
+  accumulator.calls.fetch_add(1, std::memory_order_relaxed);
+  accumulator.total.fetch_add(nanoseconds, std::memory_order_relaxed);
+  uint64_t current = accumulator.min.load(std::memory_order_relaxed);
+  while (nanoseconds < current &&
+         !accumulator.min.compare_exchange_weak(current, nanoseconds,
+                                                std::memory_order_relaxed))
+  {
+  }
+  updateMax(accumulator.max, nanoseconds);
+  accumulator.histogram[bucket(nanoseconds)].fetch_add(
+      1, std::memory_order_relaxed);
+  if (kAllocationTracking)
+  {
+    accumulator.allocatedBytes.fetch_add(allocatedBytes,
+                                         std::memory_order_relaxed);
+    accumulator.allocations.fetch_add(allocations, std::memory_order_relaxed);
+    updateMax(accumulator.peakBytes, peakBytes);
+  }
+}
+
+void addCount(Counter counter, uint64_t value)
+{
+  if (instrumentationEnabled())
+    counters[static_cast<size_t>(counter)].fetch_add(
+        value, std::memory_order_relaxed);
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "allocation_tracking.h"
+#include "trace.h"
+
+// Process wide timings and counters of the native stages, accumulated over
+// all calls and threads until reset. Recording is off by default and switched
+// on at runtime; while off a timer or counter costs a relaxed atomic load.
+
+enum class Stage
+{
+  // createPillarsFromPoints as a whole and its phases
+  Pillars,
+  PillarFilter,
+  PillarGrouping,
+  PillarZeroFill,
+  PillarStatistics,
+  PillarEmission,
+  // createTarget as a whole and its phases
+  Target,
+  TargetZeroFill,
+  TargetIou,
+  TargetAssignment,
+  // A batch of the native pipeline, including its buffers
+  PipelineBatch,
+  Count
+};
+
+enum class Counter
+{
+  PointsInRange,
+  PointsOutOfRange,
+  Pillars,
+  // Pillars beyond maxPillars, and points beyond maxPointsPerPillar of the
+  // pillars that were written.
+  PillarsDropped,
+  PointsTruncated,
+  Count
+};
+
+// Duration histograms have one bucket per power of two nanoseconds: bucket i
+// counts samples in [2^i, 2^(i + 1)) ns, bucket 0 also 0 ns and the last
+// bucket everything above.
+const int kHistogramBuckets = 40;
+
+struct StageTiming
+{
+  std::string name;
+  uint64_t calls = 0;
+  uint64_t totalNanoseconds = 0;
+  uint64_t minNanoseconds = 0;
+  uint64_t maxNanoseconds = 0;
+  std::vector<uint64_t> histogram;
+  // With allocation tracking only: bytes and number of allocations summed up
+  // over all calls, and the highest growth of the allocated bytes of a thread
+  // within one call.
+  uint64_t allocatedBytes = 0;
+  uint64_t allocations = 0;
+  uint64_t peakBytes = 0;
+};
+
+struct InstrumentationReport
+{
+  std::vector<StageTiming> stages;
+  std::map<std::string, uint64_t> counters;
+};
+
+void setInstrumentationEnabled(bool enabled);
+bool instrumentationEnabled();
+void resetInstrumentation();
+InstrumentationReport instrumentationReport();
+
+const char *stageName(Stage stage);
+const char *counterName(Counter counter);
+
+void recordStage(Stage stage, uint64_t nanoseconds, uint64_t allocatedBytes = 0,
+                 uint64_t allocations = 0, uint64_t peakBytes = 0);
+void addCount(Counter counter, uint64_t value);
+
+// Measures a stage of one call. The time between start and stop is summed up
+// and recorded as a single sample when the timer goes out of scope, so a
+// stage that is interleaved with others, e.g. once per object, still counts
+// once per call. While tracing, every start and stop is also a trace event.
+// Timers may be nested, the peak of each covers the allocations of the inner
+// ones.
+class StageTimer
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit StageTimer(Stage stage, bool running = true)
+      : stage_(stage), enabled_(instrumentationEnabled()),
+        traced_(tracingEnabled())
+  {
+    if (running)
+      start();
+  }
+  ~StageTimer()
+  {
+    stop();
+    if (enabled_)
+      recordStage(stage_, elapsed_, allocatedBytes_, allocations_, peakBytes_);
+  }
+  StageTimer(const StageTimer &) = delete;
+  StageTimer &operator=(const StageTimer &) = delete;
+
+  void start()
+  {
+    if (running_ || !(enabled_ || traced_))
+      return;
+    running_ = true;
+    if (traced_)
+      traceBegin(stageName(stage_));
+    if (kAllocationTracking && enabled_)
+    {
+      AllocationCounters &counters = threadAllocations();
+      startAllocations_ = counters;
+      // The peak of this timer starts at the current level, the one of an
+      // enclosing timer is restored in stop.
+      counters.peak = counters.live;
+    }
+    if (enabled_)
+      begin_ = Clock::now();
+  }
+  void stop()
+  {
+    if (!running_)
+      return;
+    running_ = false;
+    if (enabled_)
+      elapsed_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      Clock::now() - begin_)
+                      .count();
+    if (kAllocationTracking && enabled_)
+    {
+      AllocationCounters &counters = threadAllocations();
+      allocatedBytes_ += counters.bytes - startAllocations_.bytes;
+      allocations_ += counters.allocations - startAllocations_.allocations;
+      if (counters.peak - startAllocations_.live > static_cast<int64_t>(peakBytes_))
+        peakBytes_ = counters.peak - startAllocations_.live;
+      if (startAllocations_.peak > counters.peak)
+        counters.peak = startAllocations_.peak;
+    }
+    if (traced_)
+      traceEnd(stageName(stage_));
+  }
+
+private:
+  Stage stage_;
+  bool enabled_;
+  bool traced_;
+  bool running_ = false;
+  Clock::time_point begin_;
+  uint64_t elapsed_ = 0;
+  AllocationCounters startAllocations_ = {0, 0, 0, 0};
+  uint64_t allocatedBytes_ = 0;
+  uint64_t allocations_ = 0;
+  uint64_t peakBytes_ = 0;
+};
+
+// Wall time of a whole call, for the printTime arguments of the bindings.
+class Stopwatch
+{
+public:
+  Stopwatch() : begin_(StageTimer::Clock::now()) {}
+  double seconds() const
+  {
+    return std::chrono::duration<double>(StageTimer::Clock::now() - begin_)
+        .count();
+  }
+
+private:
+  StageTimer::Clock::time_point begin_;
+};
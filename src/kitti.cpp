@@ -0,0 +1,183 @@
+#define _USE_MATH_DEFINES
+#include "kitti.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+std::string readFile(const std::string &path)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+  {
+    throw std::runtime_error("Could not open " + path);
+  }
+  std::ostringstream content;
+  content << file.rdbuf();
+  return content.str();
+}
+
+namespace
+{
+// Parses the next whitespace separated float, advancing the cursor.
+float nextFloat(const char *&cursor, const char *lineEnd)
+{
+  char *end = nullptr;
+  const float value = std::strtof(cursor, &end);
+  if (end == cursor || end > lineEnd)
+  {
+    throw std::runtime_error("Malformed KITTI line: " +
+                             std::string(cursor, lineEnd));
+  }
+  cursor = end;
+  return value;
+}
+
+const char *skipSpaces(const char *cursor, const char *lineEnd)
+{
+  while (cursor < lineEnd && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r'))
+  {
+    cursor++;
+  }
+  return cursor;
+}
+} // namespace
+
+std::vector<KittiLabel> parseKittiLabels(const std::string &content)
+{
+  std::vector<KittiLabel> labels;
+  const char *cursor = content.c_str();
+  const char *contentEnd = cursor + content.size();
+  while (cursor < contentEnd)
+  {
+    const char *lineEnd = static_cast<const char *>(
+        std::memchr(cursor, '\n', contentEnd - cursor));
+    if (lineEnd == nullptr)
+    {
+      lineEnd = contentEnd;
+    }
+
+    cursor = skipSpaces(cursor, lineEnd);
+    if (cursor < lineEnd)
+    {
+      const char *typeEnd = cursor;
+      while (typeEnd < lineEnd && *typeEnd != ' ' && *typeEnd != '\t')
+      {
+        typeEnd++;
+      }
+
+      KittiLabel label;
+      label.type.assign(cursor, typeEnd);
+      cursor = typeEnd;
+      label.truncated = nextFloat(cursor, lineEnd);
+      label.occluded = static_cast<int>(nextFloat(cursor, lineEnd));
+      label.alpha = nextFloat(cursor, lineEnd);
+      for (auto &value : label.bbox)
+        value = nextFloat(cursor, lineEnd);
+      for (auto &value : label.dimensions)
+        value = nextFloat(cursor, lineEnd);
+      for (auto &value : label.location)
+        value = nextFloat(cursor, lineEnd);
+      label.rotationY = nextFloat(cursor, lineEnd);
+
+      if (label.type != "DontCare")
+      {
+        labels.emplace_back(label);
+      }
+    }
+    cursor = lineEnd + 1;
+  }
+  return labels;
+}
+
+KittiCalibration parseKittiCalibration(const std::string &content)
+{
+  const std::string key = "Tr_velo_to_cam:";
+  const auto position = content.find(key);
+  if (position == std::string::npos)
+  {
+    throw std::runtime_error("Calibration does not contain Tr_velo_to_cam");
+  }
+
+  const char *cursor = content.c_str() + position + key.size();
+  const char *lineEnd = static_cast<const char *>(std::memchr(
+      cursor, '\n', content.size() - (position + key.size())));
+  if (lineEnd == nullptr)
+  {
+    lineEnd = content.c_str() + content.size();
+  }
+
+  KittiCalibration calibration;
+  for (int row = 0; row < 3; ++row)
+  {
+    for (int col = 0; col < 3; ++col)
+    {
+      calibration.R[row][col] = nextFloat(cursor, lineEnd);
+    }
+    calibration.t[row] = nextFloat(cursor, lineEnd);
+  }
+  return calibration;
+}
+
+std::vector<BoundingBox3D>
+kittiLabelsToLidar(const std::vector<KittiLabel> &labels,
+                   const KittiCalibration &calibration,
+                   const std::map<std::string, int> &classIds)
+{
+  // Inverse of R via the adjugate, computed once for all labels.
+  const auto &R = calibration.R;
+  const double det = R[0][0] * (R[1][1] * R[2][2] - R[1][2] * R[2][1]) -
+                     R[0][1] * (R[1][0] * R[2][2] - R[1][2] * R[2][0]) +
+                     R[0][2] * (R[1][0] * R[2][1] - R[1][1] * R[2][0]);
+  if (det == 0)
+  {
+    throw std::runtime_error("Tr_velo_to_cam rotation is singular");
+  }
+  double inverse[3][3];
+  for (int row = 0; row < 3; ++row)
+  {
+    for (int col = 0; col < 3; ++col)
+    {
+      const int r0 = (col + 1) % 3, r1 = (col + 2) % 3;
+      const int c0 = (row + 1) % 3, c1 = (row + 2) % 3;
+      inverse[row][col] = (R[r0][c0] * R[r1][c1] - R[r0][c1] * R[r1][c0]) / det;
+    }
+  }
+
+  std::vector<BoundingBox3D> boxes;
+  boxes.reserve(labels.size());
+  for (const auto &label : labels)
+  {
+    const auto classId = classIds.find(label.type);
+    if (classId == classIds.end())
+    {
+      continue;
+    }
+
+    BoundingBox3D box = {};
+    float *position[3] = {&box.x, &box.y, &box.z};
+    for (int row = 0; row < 3; ++row)
+    {
+      *position[row] = static_cast<float>(
+          inverse[row][0] * label.location[0] +
+          inverse[row][1] * label.location[1] +
+          inverse[row][2] * label.location[2] - calibration.t[row]);
+    }
+    box.length = label.dimensions[2];
+    box.width = label.dimensions[1];
+    box.height = label.dimensions[0];
+
+    float yaw = label.rotationY - M_PI / 2;
+    while (yaw < -M_PI)
+      yaw += 2 * M_PI;
+    while (yaw > M_PI)
+      yaw -= 2 * M_PI;
+    box.yaw = yaw;
+    box.classId = classId->second;
+    boxes.emplace_back(box);
+  }
+  return boxes;
+}
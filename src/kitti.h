@@ -0,0 +1,50 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "geometry.h"
+
+// One line of a KITTI label_2 file, in camera coordinates.
+struct KittiLabel
+{
+  std::string type;
+  float truncated;
+  int occluded;
+  float alpha;
+  // 2D box in the image: left, top, right, bottom.
+  float bbox[4];
+  // Height, width, length.
+  float dimensions[3];
+  // Bottom center of the box.
+  float location[3];
+  float rotationY;
+};
+
+// Rotation and translation of Tr_velo_to_cam.
+struct KittiCalibration
+{
+  float R[3][3];
+  float t[3];
+};
+
+// Reads a whole file, throws if it cannot be opened.
+std::string readFile(const std::string &path);
+
+// Parses the contents of a label_2 file. DontCare entries are skipped.
+std::vector<KittiLabel> parseKittiLabels(const std::string &content);
+
+// Parses Tr_velo_to_cam from the contents of a calib file.
+KittiCalibration parseKittiCalibration(const std::string &content);
+
+// Transforms labels into lidar boxes the same way as
+// DataProcessor.transform_labels_into_lidar_coordinates: the location is
+// multiplied by the inverse of R (inverted once per call) and shifted by -t,
+// the dimensions are reordered to length, width, height and the yaw is turned
+// by -pi/2 and wrapped into [-pi, pi]. Labels whose type is missing in
+// classIds are dropped, the others get their class id assigned.
+std::vector<BoundingBox3D>
+kittiLabelsToLidar(const std::vector<KittiLabel> &labels,
+                   const KittiCalibration &calibration,
+                   const std::map<std::string, int> &classIds);
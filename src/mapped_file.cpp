@@ -0,0 +1,82 @@
+#include "mapped_file.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <fstream>
+#include <sstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string &path, Access)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+  {
+    throw std::runtime_error("Could not open " + path);
+  }
+  std::ostringstream content;
+  content << file.rdbuf();
+  buffer_ = content.str();
+  data_ = buffer_.data();
+  size_ = buffer_.size();
+}
+
+MappedFile::~MappedFile() {}
+
+#else
+
+MappedFile::MappedFile(const std::string &path, Access access)
+{
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    throw std::runtime_error("Could not open " + path);
+  }
+
+  struct stat status;
+  if (::fstat(fd, &status) != 0)
+  {
+    ::close(fd);
+    throw std::runtime_error("Could not stat " + path);
+  }
+  size_ = static_cast<size_t>(status.st_size);
+
+  if (size_ > 0)
+  {
+    void *mapping = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED)
+    {
+      ::close(fd);
+      throw std::runtime_error("Could not map " + path);
+    }
+    if (access == Access::Sequential)
+    {
+      ::madvise(mapping, size_, MADV_SEQUENTIAL);
+      ::madvise(mapping, size_, MADV_WILLNEED);
+    }
+    else
+    {
+      ::madvise(mapping, size_, MADV_RANDOM);
+    }
+    data_ = static_cast<const char *>(mapping);
+  }
+  // The mapping stays valid after closing the descriptor.
+  ::close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+  if (data_ != nullptr)
+  {
+    ::munmap(const_cast<char *>(data_), size_);
+  }
+}
+
+#endif
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file. For sequential access the kernel
+// is advised that the pages will be needed soon, so readahead starts before
+// the first access. Random access disables readahead, which keeps lookups
+// into large files from pulling in pages that are never read. On platforms
+// without mmap the file is read into memory instead.
+class MappedFile
+{
+public:
+  enum class Access
+  {
+    Sequential,
+    Random,
+  };
+
+  explicit MappedFile(const std::string &path,
+                      Access access = Access::Sequential);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const char *data() const { return data_; }
+  size_t size() const { return size_; }
+
+private:
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+#ifdef _WIN32
+  std::string buffer_;
+#endif
+};
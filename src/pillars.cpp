@@ -0,0 +1,347 @@
+#include "pillars.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "arena.h"
+#include "cpu_dispatch.h"
+#include "instrumentation.h"
+
+namespace
+{
+struct IntPairHash
+{
+  std::size_t operator()(const std::pair<uint32_t, uint32_t> &p) const
+  {
+    assert(sizeof(std::size_t) >= 8);
+    // Shift first integer over to make room for the second integer. The two are
+    // then packed side by side.
+    return (((uint64_t)p.first) << 32) | ((uint64_t)p.second);
+  }
+};
+
+struct PillarPoint
+{
+  float x;
+  float y;
+  float z;
+  float intensity;
+  float xc;
+  float yc;
+  float zc;
+};
+
+struct PillarPointRGB
+{
+  float x;
+  float y;
+  float z;
+  float intensity;
+  float xc;
+  float yc;
+  float zc;
+  float r;
+  float g;
+  float b;
+};
+
+template <class T>
+const T &clamp(const T &v, const T &lo, const T &hi)
+{
+  assert(!(hi < lo));
+  return (v < lo) ? lo : (hi < v) ? hi
+                                  : v;
+}
+
+// The coordinates are passed separately as they may be augmented.
+void readPoint(const float *point, float x, float y, float z, PillarPoint &p)
+{
+  p = {x, y, z, clamp(point[3], 0.0f, 1.0f), 0, 0, 0};
+}
+
+void readPoint(const float *point, float x, float y, float z,
+               PillarPointRGB &p)
+{
+  p = {x, y, z, clamp(point[3], 0.0f, 1.0f), 0, 0, 0,
+       point[4], point[5], point[6]};
+}
+
+// RGB
+void writeExtraFeatures(float *, const PillarPoint &) {}
+
+void writeExtraFeatures(float *features, const PillarPointRGB &p)
+{
+  features[9] = p.r;
+  features[10] = p.g;
+  features[11] = p.b;
+}
+
+template <class Point>
+int createPillars(const float *points, size_t nbPoints, int nbChannels,
+                  int nbFeatures, int maxPointsPerPillar, int maxPillars,
+                  float xStep, float yStep, float xMin, float xMax, float yMin,
+                  float yMax, float zMin, float zMax, float minDistance,
+                  const Augmentation *augmentation, float *tensor,
+                  int *indices)
+{
+  // Range filter first, so that the grouping below only sees the points that
+  // end up in the grid.
+  StageTimer filterTimer(Stage::PillarFilter);
+  FrameVector<std::pair<uint32_t, uint32_t>> keys;
+  FrameVector<Point> kept;
+  keys.reserve(nbPoints);
+  kept.reserve(nbPoints);
+  const AugmentationTransform transform(augmentation != nullptr
+                                            ? *augmentation
+                                            : Augmentation());
+  for (size_t i = 0; i < nbPoints; ++i)
+  {
+    const float *point = points + i * nbChannels;
+    float x = point[0];
+    float y = point[1];
+    float z = point[2];
+    // Augmenting here, before the range check, saves a pass over the points.
+    if (augmentation != nullptr)
+    {
+      transform.apply(x, y, z);
+    }
+    if ((x < xMin) || (x >= xMax) || (y < yMin) || (y >= yMax) ||
+        (z < zMin) || (z >= zMax) ||
+        (minDistance > 0 &&
+         (std::pow(x, 2) + std::pow(y, 2)) < std::pow(minDistance, 2)))
+    {
+      continue;
+    }
+
+    auto xIndex = static_cast<uint32_t>(std::floor((x - xMin) / xStep));
+    auto yIndex = static_cast<uint32_t>(std::floor((y - yMin) / yStep));
+
+    Point p;
+    readPoint(point, x, y, z, p);
+    keys.emplace_back(xIndex, yIndex);
+    kept.emplace_back(p);
+  }
+  filterTimer.stop();
+  addCount(Counter::PointsInRange, kept.size());
+  addCount(Counter::PointsOutOfRange, nbPoints - kept.size());
+
+  StageTimer groupingTimer(Stage::PillarGrouping);
+  // Pillars are numbered in order of appearance, their iteration order is
+  // the one of the map. The points are then sorted by pillar with a stable
+  // counting sort, so that each pillar is a contiguous range of the arena.
+  typedef std::pair<const std::pair<uint32_t, uint32_t>, uint32_t> Pillar;
+  std::unordered_map<std::pair<uint32_t, uint32_t>, uint32_t, IntPairHash,
+                     std::equal_to<std::pair<uint32_t, uint32_t>>,
+                     ArenaAllocator<Pillar>>
+      map;
+  FrameVector<uint32_t> pillarOf(kept.size());
+  FrameVector<uint32_t> pillarStart(1, 0);
+  for (size_t i = 0; i < kept.size(); ++i)
+  {
+    auto pillar = map.find(keys[i]);
+    if (pillar == map.end())
+    {
+      pillar = map.emplace(keys[i], static_cast<uint32_t>(map.size())).first;
+      pillarStart.emplace_back(0);
+    }
+    pillarOf[i] = pillar->second;
+    ++pillarStart[pillar->second + 1];
+  }
+  for (size_t c = 1; c < pillarStart.size(); ++c)
+  {
+    pillarStart[c] += pillarStart[c - 1];
+  }
+  FrameVector<Point> grouped(kept.size());
+  {
+    FrameVector<uint32_t> next(pillarStart.begin(), pillarStart.end() - 1);
+    for (size_t i = 0; i < kept.size(); ++i)
+    {
+      grouped[next[pillarOf[i]]++] = kept[i];
+    }
+  }
+  groupingTimer.stop();
+
+  // Have to be careful about unitialized pillars if num pillars < max_pillars.
+  // All unitialized pillars will be written into (batch_id, 0, 0) as no empty
+  // pillar is known.
+  // TODO (mgier) find one random unitialized x, y pair and write all empty
+  // pillars
+  // into there.
+  // For now do zero padding on both ends.
+  StageTimer zeroFillTimer(Stage::PillarZeroFill);
+  std::fill(tensor,
+            tensor + static_cast<size_t>(maxPillars) * maxPointsPerPillar *
+                         nbFeatures,
+            0.0f);
+  std::fill(indices, indices + static_cast<size_t>(maxPillars) * 3, 0);
+  zeroFillTimer.stop();
+
+  StageTimer statisticsTimer(Stage::PillarStatistics);
+  size_t nbTruncated = 0;
+  int nbPillars = 0;
+  for (auto &pair : map)
+  {
+    if (nbPillars >= maxPillars)
+    {
+      break;
+    }
+
+    Point *const begin = grouped.data() + pillarStart[pair.second];
+    Point *const end = grouped.data() + pillarStart[pair.second + 1];
+    const size_t nbPillarPoints = end - begin;
+    float xMean = 0;
+    float yMean = 0;
+    float zMean = 0;
+    for (const Point *p = begin; p != end; ++p)
+    {
+      xMean += p->x;
+      yMean += p->y;
+      zMean += p->z;
+    }
+    xMean /= nbPillarPoints;
+    yMean /= nbPillarPoints;
+    zMean /= nbPillarPoints;
+
+    for (Point *p = begin; p != end; ++p)
+    {
+      p->xc = p->x - xMean;
+      p->yc = p->y - yMean;
+      p->zc = p->z - zMean;
+    }
+
+    indices[nbPillars * 3 + 1] =
+        static_cast<int>(std::floor((xMean - xMin) / xStep));
+    indices[nbPillars * 3 + 2] =
+        static_cast<int>(std::floor((yMean - yMin) / yStep));
+    if (nbPillarPoints > static_cast<size_t>(maxPointsPerPillar))
+    {
+      nbTruncated += nbPillarPoints - maxPointsPerPillar;
+    }
+    nbPillars++;
+  }
+  statisticsTimer.stop();
+  addCount(Counter::Pillars, nbPillars);
+  addCount(Counter::PillarsDropped, map.size() - nbPillars);
+  addCount(Counter::PointsTruncated, nbTruncated);
+
+  StageTimer emissionTimer(Stage::PillarEmission);
+  int pillarId = 0;
+  for (const auto &pair : map)
+  {
+    if (pillarId >= maxPillars)
+    {
+      break;
+    }
+
+    const int xIndex = indices[pillarId * 3 + 1];
+    const int yIndex = indices[pillarId * 3 + 2];
+    int pointId = 0;
+    for (uint32_t k = pillarStart[pair.second];
+         k < pillarStart[pair.second + 1]; ++k)
+    {
+      const Point &p = grouped[k];
+      if (pointId >= maxPointsPerPillar)
+      {
+        break;
+      }
+
+      float *features =
+          tensor +
+          (static_cast<size_t>(pillarId) * maxPointsPerPillar + pointId) *
+              nbFeatures;
+      // Chapter 2.1 https://arxiv.org/pdf/1812.05784.pdf. 9 dimensional input
+      // to network.
+      features[0] = p.x;
+      features[1] = p.y;
+      features[2] = p.z;
+      features[3] = p.intensity;
+      // Subscript c refers to the distance to the arithmetic mean of all points
+      // in the pillar.
+      features[4] = p.xc;
+      features[5] = p.yc;
+      features[6] = p.zc;
+      // Subscript p offset from pillar center in x and y.
+      features[7] = p.x - (xIndex * xStep + xMin);
+      features[8] = p.y - (yIndex * yStep + yMin);
+      writeExtraFeatures(features, p);
+      // TODO remove this as there is no pillar center -> no features learned
+      // through this.
+      // tensor.mutable_at(0, pillarId, pointId, 2) = p.z - zMid;
+
+      pointId++;
+    }
+
+    pillarId++;
+  }
+
+  return pillarId;
+}
+
+int createPillarsKernel(const float *points, size_t nbPoints, int nbChannels,
+                        int nbFeatures, int maxPointsPerPillar, int maxPillars,
+                        float xStep, float yStep, float xMin, float xMax,
+                        float yMin, float yMax, float zMin, float zMax,
+                        float minDistance, const Augmentation *augmentation,
+                        float *tensor, int *indices)
+{
+  if (nbChannels == 4)
+  {
+    return createPillars<PillarPoint>(
+        points, nbPoints, nbChannels, nbFeatures, maxPointsPerPillar,
+        maxPillars, xStep, yStep, xMin, xMax, yMin, yMax, zMin, zMax,
+        minDistance, augmentation, tensor, indices);
+  }
+  return createPillars<PillarPointRGB>(
+      points, nbPoints, nbChannels, nbFeatures, maxPointsPerPillar, maxPillars,
+      xStep, yStep, xMin, xMax, yMin, yMax, zMin, zMax, minDistance,
+      augmentation, tensor, indices);
+}
+
+POINT_PILLARS_KERNEL_VARIANTS(
+    int, createPillarsKernel,
+    (const float *points, size_t nbPoints, int nbChannels, int nbFeatures,
+     int maxPointsPerPillar, int maxPillars, float xStep, float yStep,
+     float xMin, float xMax, float yMin, float yMax, float zMin, float zMax,
+     float minDistance, const Augmentation *augmentation, float *tensor,
+     int *indices),
+    (points, nbPoints, nbChannels, nbFeatures, maxPointsPerPillar, maxPillars,
+     xStep, yStep, xMin, xMax, yMin, yMax, zMin, zMax, minDistance,
+     augmentation, tensor, indices))
+} // namespace
+
+int pillarFeatureCount(int nbChannels)
+{
+  if (nbChannels == 4)
+    return 9;
+  if (nbChannels == 7)
+    return 12;
+  return 0;
+}
+
+int createPillarsFromPoints(const float *points, size_t nbPoints,
+                            int nbChannels, int maxPointsPerPillar,
+                            int maxPillars, float xStep, float yStep,
+                            float xMin, float xMax, float yMin, float yMax,
+                            float zMin, float zMax, float minDistance,
+                            float *tensor, int *indices,
+                            const Augmentation *augmentation)
+{
+  StageTimer timer(Stage::Pillars);
+  // The grouping of the points lives in the arena of the thread.
+  FrameScope frame;
+  const int nbFeatures = pillarFeatureCount(nbChannels);
+  if (augmentation != nullptr && augmentation->identity())
+  {
+    augmentation = nullptr;
+  }
+  POINT_PILLARS_DISPATCH(
+      createPillarsKernel,
+      (points, nbPoints, nbChannels, nbFeatures, maxPointsPerPillar,
+       maxPillars, xStep, yStep, xMin, xMax, yMin, yMax, zMin, zMax,
+       minDistance, augmentation, tensor, indices))
+}
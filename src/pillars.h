@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+
+#include "augmentation.h"
+
+// Number of features per point in the pillar tensor for points with the given
+// number of channels: 4 (x, y, z, intensity) -> 9, 7 (additionally r, g, b)
+// -> 12. Returns 0 for unsupported channel counts.
+int pillarFeatureCount(int nbChannels);
+
+// Groups the row major (nbPoints, nbChannels) points into pillars and writes
+// the pillar tensor (maxPillars, maxPointsPerPillar, pillarFeatureCount) and
+// the pillar indices (maxPillars, 3) of a single sample. Both buffers are
+// overwritten entirely, unused pillars are zero. Returns the number of
+// pillars written. Points are augmented, if given, before they are filtered
+// by the grid ranges.
+int createPillarsFromPoints(const float *points, size_t nbPoints,
+                            int nbChannels, int maxPointsPerPillar,
+                            int maxPillars, float xStep, float yStep,
+                            float xMin, float xMax, float yMin, float yMax,
+                            float zMin, float zMax, float minDistance,
+                            float *tensor, int *indices,
+                            const Augmentation *augmentation = nullptr);
@@ -0,0 +1,382 @@
+#include "pipeline.h"
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+
+#include "arena.h"
+#include "instrumentation.h"
+#include "kitti.h"
+#include "pillars.h"
+#include "trace.h"
+
+KittiFileSource::KittiFileSource(
+    const std::vector<std::string> &lidarFiles,
+    const std::vector<std::string> &labelFiles,
+    const std::vector<std::string> &calibrationFiles,
+    const std::map<std::string, int> &classIds)
+    : lidarFiles_(lidarFiles), labelFiles_(labelFiles),
+      calibrationFiles_(calibrationFiles), classIds_(classIds)
+{
+  if (labelFiles.size() != calibrationFiles.size() ||
+      (!labelFiles.empty() && labelFiles.size() != lidarFiles.size()))
+  {
+    throw std::runtime_error(
+        "Label and calibration files have to be given for every velodyne file");
+  }
+}
+
+const float *KittiFileSource::load(size_t sample, SampleBuffers &buffers,
+                                   size_t &nbPoints,
+                                   std::vector<BoundingBox3D> &objects) const
+{
+  const std::string &path = lidarFiles_.at(sample);
+  buffers.file.reset();
+  buffers.file.reset(new MappedFile(path));
+  if (buffers.file->size() % (4 * sizeof(float)) != 0)
+  {
+    throw std::runtime_error(path + " is not a KITTI velodyne file");
+  }
+  nbPoints = buffers.file->size() / (4 * sizeof(float));
+
+  objects.clear();
+  if (hasLabels())
+  {
+    objects = kittiLabelsToLidar(
+        parseKittiLabels(readFile(labelFiles_[sample])),
+        parseKittiCalibration(readFile(calibrationFiles_[sample])), classIds_);
+  }
+  return reinterpret_cast<const float *>(buffers.file->data());
+}
+
+ShardSource::ShardSource(const std::string &path,
+                         const std::vector<size_t> &samples,
+                         const std::map<std::string, int> &classIds,
+                         bool labels)
+    : shard_(path), samples_(samples), classIds_(classIds), labels_(labels)
+{
+  if (samples_.empty())
+  {
+    samples_.resize(shard_.size());
+    for (size_t i = 0; i < samples_.size(); ++i)
+    {
+      samples_[i] = i;
+    }
+  }
+  for (const auto sample : samples_)
+  {
+    if (sample >= shard_.size())
+    {
+      throw std::out_of_range("Sample " + std::to_string(sample) +
+                              " out of range, the shard has " +
+                              std::to_string(shard_.size()) + " samples");
+    }
+  }
+}
+
+const float *ShardSource::load(size_t sample, SampleBuffers &buffers,
+                               size_t &nbPoints,
+                               std::vector<BoundingBox3D> &objects) const
+{
+  const size_t shardSample = samples_.at(sample);
+  nbPoints = shard_.pointCount(shardSample);
+
+  objects.clear();
+  if (labels_)
+  {
+    objects = kittiLabelsToLidar(shard_.labels(shardSample),
+                                 shard_.calibration(shardSample), classIds_);
+  }
+  return shard_.points(shardSample, buffers.decode);
+}
+
+Pipeline::Pipeline(std::shared_ptr<const SampleSource> source,
+                   const PipelineParameters &parameters)
+    : source_(std::move(source)), parameters_(parameters)
+{
+  if (parameters_.batchSize <= 0)
+  {
+    throw std::runtime_error("The batch size has to be positive");
+  }
+  const size_t batchSize = parameters_.batchSize;
+  batchesPerEpoch_ = parameters_.dropLast
+                         ? source_->size() / batchSize
+                         : (source_->size() + batchSize - 1) / batchSize;
+  if (batchesPerEpoch_ == 0)
+  {
+    throw std::runtime_error("The pipeline has " +
+                             std::to_string(source_->size()) +
+                             " samples, less than a batch");
+  }
+  if (source_->hasLabels() && parameters_.target.anchors.empty())
+  {
+    throw std::runtime_error("Anchors are required for labeled samples");
+  }
+  if (source_->hasLabels() && !parameters_.groundTruthDatabase.empty())
+  {
+    database_.reset(new GtDatabase(parameters_.groundTruthDatabase));
+  }
+  cells_ = static_cast<size_t>(parameters_.target.xSize()) *
+           parameters_.target.ySize() * parameters_.target.anchors.size();
+
+  if (parameters_.nbWorkers <= 0)
+  {
+    parameters_.nbWorkers =
+        std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  }
+  if (parameters_.prefetch <= 0)
+  {
+    parameters_.prefetch = parameters_.nbWorkers;
+  }
+
+  workers_.reserve(parameters_.nbWorkers);
+  for (int i = 0; i < parameters_.nbWorkers; ++i)
+  {
+    workers_.emplace_back(&Pipeline::work, this);
+  }
+}
+
+Pipeline::~Pipeline()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  claimable_.notify_all();
+  for (auto &worker : workers_)
+  {
+    worker.join();
+  }
+}
+
+std::unique_ptr<Batch> Pipeline::next()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (endOfEpoch_)
+  {
+    endOfEpoch_ = false;
+    return nullptr;
+  }
+
+  {
+    // Time the consumer waits for the workers.
+    TraceScope trace("pipeline.wait");
+    finished_.wait(lock, [this] { return slots_.count(nextDelivery_) != 0; });
+  }
+  auto it = slots_.find(nextDelivery_);
+  Slot slot = std::move(it->second);
+  slots_.erase(it);
+  ++nextDelivery_;
+  endOfEpoch_ = nextDelivery_ % batchesPerEpoch_ == 0;
+  lock.unlock();
+  claimable_.notify_all();
+
+  if (slot.error)
+  {
+    std::rethrow_exception(slot.error);
+  }
+  return std::move(slot.batch);
+}
+
+void Pipeline::work()
+{
+  SampleBuffers buffers;
+  std::vector<float> target;
+  std::vector<float> merged;
+  for (;;)
+  {
+    size_t number;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      claimable_.wait(lock, [this] {
+        return stopping_ ||
+               nextClaim_ < nextDelivery_ + parameters_.prefetch;
+      });
+      if (stopping_)
+      {
+        return;
+      }
+      number = nextClaim_++;
+    }
+
+    Slot slot;
+    try
+    {
+      StageTimer timer(Stage::PipelineBatch);
+      slot.batch = build(number, buffers, target, merged);
+    }
+    catch (...)
+    {
+      slot.error = std::current_exception();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      slots_[number] = std::move(slot);
+    }
+    finished_.notify_all();
+  }
+}
+
+std::vector<size_t> Pipeline::order(size_t epoch) const
+{
+  std::vector<size_t> samples(source_->size());
+  for (size_t i = 0; i < samples.size(); ++i)
+  {
+    samples[i] = i;
+  }
+  if (parameters_.shuffle)
+  {
+    // Fisher-Yates on the raw engine output, std::shuffle may differ between
+    // standard libraries.
+    std::mt19937_64 engine(parameters_.seed + epoch);
+    for (size_t i = samples.size(); i > 1; --i)
+    {
+      std::swap(samples[i - 1], samples[engine() % i]);
+    }
+  }
+  return samples;
+}
+
+std::unique_ptr<Batch> Pipeline::build(size_t number, SampleBuffers &buffers,
+                                       std::vector<float> &target,
+                                       std::vector<float> &merged) const
+{
+  const TargetParameters &grid = parameters_.target;
+  const size_t batchSize = parameters_.batchSize;
+  const std::vector<size_t> samples = order(number / batchesPerEpoch_);
+
+  std::unique_ptr<Batch> batch(new Batch());
+  batch->epoch = number / batchesPerEpoch_;
+  batch->index = number % batchesPerEpoch_;
+  const size_t begin = batch->index * batchSize;
+  batch->size = std::min(batchSize, samples.size() - begin);
+
+  const int nbFeatures = pillarFeatureCount(4);
+  const size_t pillarSize = static_cast<size_t>(parameters_.maxPillars) *
+                            parameters_.maxPointsPerPillar * nbFeatures;
+  const size_t indexSize = static_cast<size_t>(parameters_.maxPillars) * 3;
+  batch->pillars.resize(batch->size * pillarSize);
+  batch->indices.resize(batch->size * indexSize);
+
+  const bool labeled = source_->hasLabels();
+  const size_t nbClasses = grid.nbClasses;
+  if (labeled)
+  {
+    batch->occupancy.resize(batch->size * cells_);
+    batch->position.resize(batch->size * cells_ * 3);
+    batch->dimensions.resize(batch->size * cells_ * 3);
+    batch->angle.resize(batch->size * cells_);
+    batch->heading.resize(batch->size * cells_);
+    batch->classification.resize(batch->size * cells_ * nbClasses);
+  }
+
+  std::vector<BoundingBox3D> objects;
+  for (size_t i = 0; i < batch->size; ++i)
+  {
+    // The temporaries of all steps of a sample share one arena reset.
+    FrameScope frame;
+    const size_t sample = samples[begin + i];
+    size_t nbPoints = 0;
+    const float *points;
+    {
+      TraceScope trace("pipeline.load");
+      points = source_->load(sample, buffers, nbPoints, objects);
+    }
+    const uint64_t sampleSeed =
+        parameters_.seed + (static_cast<uint64_t>(batch->epoch) << 32) + sample;
+    if (database_)
+    {
+      TraceScope trace("pipeline.gtSampling");
+      buffers.scene.assign(points, points + nbPoints * 4);
+      sampleGroundTruth(*database_, parameters_.groundTruthCounts, ~sampleSeed,
+                        buffers.scene, objects);
+      points = buffers.scene.data();
+      nbPoints = buffers.scene.size() / 4;
+    }
+    if (labeled && !objects.empty() && !parameters_.objectNoise.identity())
+    {
+      TraceScope trace("pipeline.objectNoise");
+      if (!database_)
+      {
+        buffers.scene.assign(points, points + nbPoints * 4);
+        points = buffers.scene.data();
+      }
+      transformObjects(
+          buffers.scene.data(), nbPoints, 4, objects,
+          sampleObjectNoise(objects, parameters_.objectNoise,
+                            sampleSeed ^ 0x9e3779b97f4a7c15ull));
+    }
+    // Counted before the global augmentation, which keeps points inside their
+    // boxes.
+    if (labeled && !objects.empty() && parameters_.minObjectPoints > 0)
+    {
+      TraceScope trace("pipeline.pointsInBoxes");
+      buffers.boxIds.resize(nbPoints);
+      pointsInBoxes(points, nbPoints, 4, objects, buffers.boxIds.data(),
+                    &buffers.boxCounts);
+      size_t kept = 0;
+      for (size_t o = 0; o < objects.size(); ++o)
+      {
+        if (buffers.boxCounts[o] >=
+            static_cast<uint32_t>(parameters_.minObjectPoints))
+        {
+          objects[kept++] = objects[o];
+        }
+      }
+      objects.resize(kept);
+    }
+    // Objects are pasted before the augmentation, which moves them along with
+    // the scene.
+    const Augmentation augmentation =
+        sampleAugmentation(parameters_.augmentation, sampleSeed);
+    createPillarsFromPoints(points, nbPoints, 4, parameters_.maxPointsPerPillar,
+                            parameters_.maxPillars, grid.xStep, grid.yStep,
+                            grid.xMin, grid.xMax, grid.yMin, grid.yMax,
+                            grid.zMin, grid.zMax, parameters_.minDistance,
+                            batch->pillars.data() + i * pillarSize,
+                            batch->indices.data() + i * indexSize,
+                            &augmentation);
+
+    // Samples without objects keep an all zero target, including the
+    // classification, as DataProcessor.empty_ground_truth.
+    if (!labeled || objects.empty())
+    {
+      continue;
+    }
+
+    if (!augmentation.identity())
+    {
+      objects = augmentBoxes(objects, augmentation);
+    }
+    target.resize(grid.targetSize(objects.size()));
+    const TargetStatistics statistics =
+        createTarget(objects, grid, target.data());
+    batch->positives += statistics.positives;
+    batch->negatives += statistics.negatives;
+
+    TraceScope trace("pipeline.merge");
+    merged.resize(cells_ * 10);
+    selectBestAnchors(target.data(), objects.size(), cells_, merged.data());
+    for (size_t c = 0; c < cells_; ++c)
+    {
+      const float *cell = &merged[c * 10];
+      const size_t offset = i * cells_ + c;
+      batch->occupancy[offset] = cell[0];
+      std::copy(cell + 1, cell + 4, &batch->position[offset * 3]);
+      std::copy(cell + 4, cell + 7, &batch->dimensions[offset * 3]);
+      batch->angle[offset] = cell[7];
+      batch->heading[offset] = cell[8];
+
+      const int classId = static_cast<int>(cell[9]);
+      if (classId < 0 || static_cast<size_t>(classId) >= nbClasses)
+      {
+        throw std::runtime_error("Class id " + std::to_string(classId) +
+                                 " out of range for " +
+                                 std::to_string(nbClasses) + " classes");
+      }
+      batch->classification[offset * nbClasses + classId] = 1.0;
+    }
+  }
+  return batch;
+}
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "augmentation.h"
+#include "geometry.h"
+#include "gt_database.h"
+#include "mapped_file.h"
+#include "point_codec.h"
+#include "points_in_boxes.h"
+#include "shard.h"
+#include "target.h"
+
+// Per worker buffers of a SampleSource, the points of a sample stay valid
+// until the next call with the same buffers.
+struct SampleBuffers
+{
+  std::unique_ptr<MappedFile> file;
+  PointDecodeBuffer decode;
+  // Points of a sample with pasted or moved ground truth objects.
+  std::vector<float> scene;
+  std::vector<int32_t> boxIds;
+  std::vector<uint32_t> boxCounts;
+};
+
+// Random access to the (n, 4) points and the lidar boxes of samples. Sources
+// are shared by all pipeline workers, so load has to be thread safe.
+class SampleSource
+{
+public:
+  virtual ~SampleSource() = default;
+
+  virtual size_t size() const = 0;
+  virtual bool hasLabels() const = 0;
+  // Returns the points of a sample and stores their number in nbPoints. The
+  // objects are only filled for labeled sources.
+  virtual const float *load(size_t sample, SampleBuffers &buffers,
+                            size_t &nbPoints,
+                            std::vector<BoundingBox3D> &objects) const = 0;
+};
+
+// KITTI velodyne files, optionally with their label_2 and calib files.
+class KittiFileSource : public SampleSource
+{
+public:
+  KittiFileSource(const std::vector<std::string> &lidarFiles,
+                  const std::vector<std::string> &labelFiles,
+                  const std::vector<std::string> &calibrationFiles,
+                  const std::map<std::string, int> &classIds);
+
+  size_t size() const override { return lidarFiles_.size(); }
+  bool hasLabels() const override { return !labelFiles_.empty(); }
+  const float *load(size_t sample, SampleBuffers &buffers, size_t &nbPoints,
+                    std::vector<BoundingBox3D> &objects) const override;
+
+private:
+  std::vector<std::string> lidarFiles_;
+  std::vector<std::string> labelFiles_;
+  std::vector<std::string> calibrationFiles_;
+  std::map<std::string, int> classIds_;
+};
+
+// Samples of a shard, all of them if samples is empty.
+class ShardSource : public SampleSource
+{
+public:
+  ShardSource(const std::string &path, const std::vector<size_t> &samples,
+              const std::map<std::string, int> &classIds, bool labels);
+
+  size_t size() const override { return samples_.size(); }
+  bool hasLabels() const override { return labels_; }
+  const float *load(size_t sample, SampleBuffers &buffers, size_t &nbPoints,
+                    std::vector<BoundingBox3D> &objects) const override;
+
+private:
+  ShardReader shard_;
+  std::vector<size_t> samples_;
+  std::map<std::string, int> classIds_;
+  bool labels_;
+};
+
+struct PipelineParameters
+{
+  int maxPointsPerPillar = 100;
+  int maxPillars = 12000;
+  float minDistance = -1.0f;
+  // Anchors, thresholds and the grid, which is used for the pillars as well.
+  TargetParameters target;
+
+  int batchSize = 4;
+  // 0 uses one worker per hardware thread.
+  int nbWorkers = 0;
+  // Number of batches that are prepared ahead of the consumer, 0 uses the
+  // number of workers. Bounds the memory of the pipeline: every batch holds
+  // its dense pillar tensor (about 43 MB per sample with the defaults).
+  int prefetch = 0;
+  // Samples are permuted every epoch, the permutation only depends on seed
+  // and the epoch number.
+  bool shuffle = false;
+  uint64_t seed = 0;
+  // Skips the last batch of an epoch if it is incomplete, as the keras
+  // Sequences of processors.py do.
+  bool dropLast = true;
+  // Every sample gets its own augmentation, drawn from the seed, the epoch
+  // and the sample number.
+  AugmentationRange augmentation;
+  // Ground truth database to paste objects from into labeled samples, filling
+  // every class id c up to groundTruthCounts[c] objects. Empty to disable.
+  std::string groundTruthDatabase;
+  std::vector<int> groundTruthCounts;
+  // Every object of a labeled sample is rotated and moved on its own, after
+  // the ground truth sampling and before the global augmentation.
+  ObjectNoiseRange objectNoise;
+  // Objects with fewer points inside their box get no target, as they cannot
+  // be detected.
+  int minObjectPoints = 0;
+};
+
+// A ready batch, laid out as the outputs of SimpleDataGenerator:
+// pillars (B, maxPillars, maxPointsPerPillar, 9), indices (B, maxPillars, 3)
+// and, for labeled sources, occupancy (B, X, Y, A), position and size
+// (B, X, Y, A, 3), angle and heading (B, X, Y, A) and the one hot
+// classification (B, X, Y, A, classes) in double precision.
+struct Batch
+{
+  size_t epoch = 0;
+  size_t index = 0;
+  size_t size = 0;
+  std::vector<float> pillars;
+  std::vector<int> indices;
+  std::vector<float> occupancy;
+  std::vector<float> position;
+  std::vector<float> dimensions;
+  std::vector<float> angle;
+  std::vector<float> heading;
+  std::vector<double> classification;
+  // Summed over the samples of the batch.
+  int positives = 0;
+  int negatives = 0;
+};
+
+// Builds batches with a pool of worker threads. Workers claim the next batch
+// number as long as it is less than prefetch batches ahead of the consumer,
+// so the batches are computed in parallel but handed out in order, and the
+// output does not depend on the number of workers. Epochs follow each other
+// without a gap: the first batches of an epoch are prepared while the last
+// ones of the previous epoch are consumed.
+class Pipeline
+{
+public:
+  Pipeline(std::shared_ptr<const SampleSource> source,
+           const PipelineParameters &parameters);
+  ~Pipeline();
+
+  Pipeline(const Pipeline &) = delete;
+  Pipeline &operator=(const Pipeline &) = delete;
+
+  size_t batchesPerEpoch() const { return batchesPerEpoch_; }
+  const PipelineParameters &parameters() const { return parameters_; }
+  bool hasLabels() const { return source_->hasLabels(); }
+
+  // Blocks until the next batch is ready. Returns nullptr once after the last
+  // batch of every epoch, the following call starts the next epoch. Errors of
+  // the workers are rethrown here, for the batch they occurred in.
+  std::unique_ptr<Batch> next();
+
+private:
+  struct Slot
+  {
+    std::unique_ptr<Batch> batch;
+    std::exception_ptr error;
+  };
+
+  void work();
+  std::unique_ptr<Batch> build(size_t number, SampleBuffers &buffers,
+                               std::vector<float> &target,
+                               std::vector<float> &merged) const;
+  std::vector<size_t> order(size_t epoch) const;
+
+  std::shared_ptr<const SampleSource> source_;
+  PipelineParameters parameters_;
+  std::unique_ptr<GtDatabase> database_;
+  size_t batchesPerEpoch_;
+  size_t cells_;
+
+  std::mutex mutex_;
+  std::condition_variable claimable_;
+  std::condition_variable finished_;
+  // Batches are numbered across epochs.
+  size_t nextClaim_ = 0;
+  size_t nextDelivery_ = 0;
+  bool endOfEpoch_ = false;
+  bool stopping_ = false;
+  std::map<size_t, Slot> slots_;
+  std::vector<std::thread> workers_;
+};
@@ -0,0 +1,300 @@
+#include "point_codec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include "cpu_dispatch.h"
+
+namespace
+{
+// The scales are applied in double precision, so that the only errors are the
+// quantisation and the rounding of the decoded value to float.
+const double kCoordinateScale = 1000.0;
+const double kIntensityScale = 65535.0;
+// Quantised coordinates have to fit into int32.
+const float kMaxCoordinate = 2e6f;
+
+const int kHashBits = 14;
+const size_t kMinMatch = 4;
+const size_t kMaxOffset = 65535;
+
+uint32_t read32(const uint8_t *p)
+{
+  uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+void writeLength(size_t length, std::vector<uint8_t> &out)
+{
+  for (; length >= 255; length -= 255)
+  {
+    out.push_back(255);
+  }
+  out.push_back(static_cast<uint8_t>(length));
+}
+
+size_t readLength(const uint8_t *&ip, const uint8_t *end)
+{
+  size_t length = 0;
+  uint8_t byte;
+  do
+  {
+    if (ip >= end)
+    {
+      throw std::runtime_error("Corrupt LZ block: truncated length");
+    }
+    byte = *ip++;
+    length += byte;
+  } while (byte == 255);
+  return length;
+}
+
+void writeSequence(const uint8_t *literals, size_t nbLiterals, size_t offset,
+                   size_t matchLength, std::vector<uint8_t> &out)
+{
+  const size_t matchCode = matchLength == 0 ? 0 : matchLength - kMinMatch;
+  out.push_back(static_cast<uint8_t>((std::min<size_t>(nbLiterals, 15) << 4) |
+                                     std::min<size_t>(matchCode, 15)));
+  if (nbLiterals >= 15)
+  {
+    writeLength(nbLiterals - 15, out);
+  }
+  out.insert(out.end(), literals, literals + nbLiterals);
+  if (matchLength == 0)
+  {
+    return;
+  }
+  out.push_back(static_cast<uint8_t>(offset & 0xff));
+  out.push_back(static_cast<uint8_t>(offset >> 8));
+  if (matchCode >= 15)
+  {
+    writeLength(matchCode - 15, out);
+  }
+}
+
+uint32_t zigzag(uint32_t delta)
+{
+  return (delta << 1) ^ static_cast<uint32_t>(static_cast<int32_t>(delta) >> 31);
+}
+
+uint32_t unzigzag(uint32_t value) { return (value >> 1) ^ (0u - (value & 1)); }
+} // namespace
+
+void lzCompress(const uint8_t *src, size_t size, std::vector<uint8_t> &out)
+{
+  std::vector<uint32_t> table(size_t(1) << kHashBits, 0);
+  size_t anchor = 0;
+  size_t i = 0;
+  while (i + kMinMatch <= size)
+  {
+    const uint32_t sequence = read32(src + i);
+    const uint32_t hash = (sequence * 2654435761u) >> (32 - kHashBits);
+    const size_t candidate = table[hash];
+    table[hash] = static_cast<uint32_t>(i);
+
+    if (candidate < i && i - candidate <= kMaxOffset &&
+        read32(src + candidate) == sequence)
+    {
+      size_t matchLength = kMinMatch;
+      while (i + matchLength < size &&
+             src[candidate + matchLength] == src[i + matchLength])
+      {
+        matchLength++;
+      }
+      writeSequence(src + anchor, i - anchor, i - candidate, matchLength, out);
+      i += matchLength;
+      anchor = i;
+    }
+    else
+    {
+      // Skip faster through data that does not compress.
+      i += 1 + ((i - anchor) >> 6);
+    }
+  }
+  writeSequence(src + anchor, size - anchor, 0, 0, out);
+}
+
+void lzDecompress(const uint8_t *src, size_t size, uint8_t *dst,
+                  size_t dstSize)
+{
+  const uint8_t *ip = src;
+  const uint8_t *const end = src + size;
+  uint8_t *op = dst;
+  uint8_t *const oend = dst + dstSize;
+
+  while (true)
+  {
+    if (ip >= end)
+    {
+      throw std::runtime_error("Corrupt LZ block: missing token");
+    }
+    const uint8_t token = *ip++;
+
+    size_t nbLiterals = token >> 4;
+    if (nbLiterals == 15)
+    {
+      nbLiterals += readLength(ip, end);
+    }
+    if (nbLiterals > static_cast<size_t>(end - ip) ||
+        nbLiterals > static_cast<size_t>(oend - op))
+    {
+      throw std::runtime_error("Corrupt LZ block: literals out of bounds");
+    }
+    std::memcpy(op, ip, nbLiterals);
+    ip += nbLiterals;
+    op += nbLiterals;
+    if (ip == end)
+    {
+      break;
+    }
+
+    if (end - ip < 2)
+    {
+      throw std::runtime_error("Corrupt LZ block: truncated offset");
+    }
+    const size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+    ip += 2;
+    size_t matchLength = (token & 15) + kMinMatch;
+    if ((token & 15) == 15)
+    {
+      matchLength += readLength(ip, end);
+    }
+    if (offset == 0 || offset > static_cast<size_t>(op - dst) ||
+        matchLength > static_cast<size_t>(oend - op))
+    {
+      throw std::runtime_error("Corrupt LZ block: match out of bounds");
+    }
+
+    const uint8_t *match = op - offset;
+    if (offset >= matchLength)
+    {
+      std::memcpy(op, match, matchLength);
+      op += matchLength;
+    }
+    else
+    {
+      // Overlapping match, repeats the last offset bytes.
+      for (size_t k = 0; k < matchLength; ++k)
+      {
+        *op++ = *match++;
+      }
+    }
+  }
+
+  if (op != oend)
+  {
+    throw std::runtime_error("Corrupt LZ block: size mismatch");
+  }
+}
+
+void encodePoints(const float *points, size_t nbPoints,
+                  std::vector<uint8_t> &out)
+{
+  if (nbPoints > UINT32_MAX)
+  {
+    throw std::runtime_error("Too many points to encode");
+  }
+
+  // Byte plane (channel * 4 + byte) holds that byte of all points.
+  std::vector<uint8_t> planes(nbPoints * 16);
+  uint32_t previous[4] = {0, 0, 0, 0};
+  for (size_t i = 0; i < nbPoints; ++i)
+  {
+    const float *point = points + i * 4;
+    uint32_t quantised[4];
+    for (int c = 0; c < 3; ++c)
+    {
+      if (!(std::fabs(point[c]) < kMaxCoordinate))
+      {
+        throw std::runtime_error("Point coordinate cannot be encoded: " +
+                                 std::to_string(point[c]));
+      }
+      quantised[c] = static_cast<uint32_t>(
+          static_cast<int32_t>(std::lround(point[c] * kCoordinateScale)));
+    }
+    const float intensity =
+        std::isnan(point[3]) ? 0.0f : std::min(std::max(point[3], 0.0f), 1.0f);
+    quantised[3] = static_cast<uint32_t>(std::lround(intensity * kIntensityScale));
+
+    for (int c = 0; c < 4; ++c)
+    {
+      // Unsigned arithmetic wraps, the decoder's prefix sum wraps back.
+      const uint32_t value = zigzag(quantised[c] - previous[c]);
+      previous[c] = quantised[c];
+      for (int b = 0; b < 4; ++b)
+      {
+        planes[(c * 4 + b) * nbPoints + i] = static_cast<uint8_t>(value >> (8 * b));
+      }
+    }
+  }
+
+  const size_t headerOffset = out.size();
+  out.resize(headerOffset + 8);
+  lzCompress(planes.data(), planes.size(), out);
+
+  const uint32_t header[2] = {static_cast<uint32_t>(nbPoints),
+                              static_cast<uint32_t>(out.size() - headerOffset - 8)};
+  std::memcpy(out.data() + headerOffset, header, sizeof(header));
+}
+
+size_t encodedPointCount(const uint8_t *data, size_t size)
+{
+  if (size < 8)
+  {
+    throw std::runtime_error("Encoded points are truncated");
+  }
+  return read32(data);
+}
+
+namespace
+{
+void decodePointsKernel(const uint8_t *data, size_t size,
+                        PointDecodeBuffer &buffer)
+{
+  const size_t nbPoints = encodedPointCount(data, size);
+  const size_t blockSize = read32(data + 4);
+  // A byte of the LZ block expands to at most 255 bytes, which bounds the
+  // allocation below for corrupt point counts.
+  if (blockSize != size - 8 || nbPoints * 16 > blockSize * 255 + 255)
+  {
+    throw std::runtime_error("Encoded points are truncated");
+  }
+
+  std::vector<uint8_t> &planes = buffer.planes;
+  planes.resize(nbPoints * 16);
+  lzDecompress(data + 8, blockSize, planes.data(), planes.size());
+
+  buffer.points.resize(nbPoints * 4);
+  const double scales[4] = {1.0 / kCoordinateScale, 1.0 / kCoordinateScale,
+                            1.0 / kCoordinateScale, 1.0 / kIntensityScale};
+  for (int c = 0; c < 4; ++c)
+  {
+    const uint8_t *plane0 = planes.data() + (c * 4 + 0) * nbPoints;
+    const uint8_t *plane1 = planes.data() + (c * 4 + 1) * nbPoints;
+    const uint8_t *plane2 = planes.data() + (c * 4 + 2) * nbPoints;
+    const uint8_t *plane3 = planes.data() + (c * 4 + 3) * nbPoints;
+    float *channel = buffer.points.data() + c;
+    uint32_t value = 0;
+    for (size_t i = 0; i < nbPoints; ++i)
+    {
+      value += unzigzag(plane0[i] | (plane1[i] << 8) | (plane2[i] << 16) |
+                        (static_cast<uint32_t>(plane3[i]) << 24));
+      channel[i * 4] =
+          static_cast<float>(static_cast<int32_t>(value) * scales[c]);
+    }
+  }
+}
+
+POINT_PILLARS_KERNEL_VARIANTS(void, decodePointsKernel,
+                              (const uint8_t *data, size_t size,
+                               PointDecodeBuffer &buffer),
+                              (data, size, buffer))
+} // namespace
+
+void decodePoints(const uint8_t *data, size_t size, PointDecodeBuffer &buffer)
+{
+  POINT_PILLARS_DISPATCH(decodePointsKernel, (data, size, buffer))
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Compressed storage of (n, 4) float32 points (x, y, z, intensity).
+//
+// Coordinates are quantised to millimetres and intensities to 1/65535 (after
+// clamping into [0, 1] as createPillars does anyway). Decoding reproduces
+// every coordinate up to 0.5 mm plus the rounding of the result to float32,
+// which is at most half its spacing (4 um within 128 m). Each channel is delta coded in scan order
+// and zigzag mapped, which leaves small unsigned integers for neighbouring
+// points of a sweep. The integers are split into byte planes (all lowest
+// bytes, then all second bytes, ...) so that the mostly zero high bytes form
+// long runs, and the planes are compressed with a small LZ77 block coder in
+// the style of LZ4.
+//
+// Layout: uint32 point count, uint32 compressed plane size, LZ block.
+
+// Appends the encoding of the points to out. Throws for non-finite points or
+// coordinates beyond +-2000 km.
+void encodePoints(const float *points, size_t nbPoints,
+                  std::vector<uint8_t> &out);
+
+// Number of points of an encoded block, throws if it is truncated.
+size_t encodedPointCount(const uint8_t *data, size_t size);
+
+// Buffers of decodePoints, kept across calls to avoid reallocations.
+struct PointDecodeBuffer
+{
+  // Decoded (n, 4) points.
+  std::vector<float> points;
+  std::vector<uint8_t> planes;
+};
+
+// Decodes a block into buffer.points. Throws if the block is corrupt.
+void decodePoints(const uint8_t *data, size_t size, PointDecodeBuffer &buffer);
+
+// LZ77 block coder used for the byte planes. The format follows LZ4
+// sequences: a token with the literal length in the high and the match length
+// minus 4 in the low nibble, extension bytes for lengths of 15 and more, the
+// literals and a little endian 16 bit match offset. The last sequence only has
+// literals.
+void lzCompress(const uint8_t *src, size_t size, std::vector<uint8_t> &out);
+// Decompresses into exactly dstSize bytes, throws if the block is corrupt.
+void lzDecompress(const uint8_t *src, size_t size, uint8_t *dst,
+                  size_t dstSize);
@@ -3,885 +3,1379 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 #include <algorithm>
-#include <chrono>
 #include <cmath>
 #include <cstdint>
 #include <iostream>
-
-struct IntPairHash
-{
-  std::size_t operator()(const std::pair<uint32_t, uint32_t> &p) const
-  {
-    assert(sizeof(std::size_t) >= 8);
-    // Shift first integer over to make room for the second integer. The two are
-    // then packed side by side.
-    return (((uint64_t)p.first) << 32) | ((uint64_t)p.second);
-  }
-};
-
-struct PillarPoint
+#include <limits>
+#include <map>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+#include "arena.h"
+#include "augmentation.h"
+#include "cpu_dispatch.h"
+#include "evaluation.h"
+#include "geometry.h"
+#include "gt_database.h"
+#include "instrumentation.h"
+#include "kitti.h"
+#include "mapped_file.h"
+#include "pillars.h"
+#include "pipeline.h"
+#include "point_codec.h"
+#include "points_in_boxes.h"
+#include "shard.h"
+#include "synthetic_scene.h"
+#include "target.h"
+#include "trace.h"
+#include "voxel_cache.h"
+
+// Allocates the pillar tensor (batch, maxPillars, maxPointsPerPillar,
+// features) and the indices (batch, maxPillars, 3).
+std::pair<pybind11::array_t<float>, pybind11::array_t<int>>
+allocatePillars(int batchSize, int maxPointsPerPillar, int maxPillars,
+                int nbFeatures)
 {
-  float x;
-  float y;
-  float z;
-  float intensity;
-  float xc;
-  float yc;
-  float zc;
-};
-
-struct PillarPointRGB
-{
-  float x;
-  float y;
-  float z;
-  float intensity;
-  float xc;
-  float yc;
-  float zc;
-  float r;
-  float g;
-  float b;
-}; 
+  pybind11::array_t<float> tensor;
+  pybind11::array_t<int> indices;
+  tensor.resize({batchSize, maxPillars, maxPointsPerPillar, nbFeatures});
+  indices.resize({batchSize, maxPillars, 3});
+  return {tensor, indices};
+}
 
-template <class T>
-const T &clamp(const T &v, const T &lo, const T &hi)
+// Kept for the printTime arguments, instrumentationReport has the stages.
+void printDuration(const char *name, const Stopwatch &stopwatch)
 {
-  assert(!(hi < lo));
-  return (v < lo) ? lo : (hi < v) ? hi
-                                  : v;
+  std::cout << name << " took: " << stopwatch.seconds() << " seconds"
+            << std::endl;
 }
 
-pybind11::tuple createPillars(pybind11::array_t<float> points,
-                              int maxPointsPerPillar, int maxPillars,
-                              float xStep, float yStep, float xMin, float xMax,
-                              float yMin, float yMax, float zMin, float zMax,
-                              bool printTime, float minDistance)
+pybind11::tuple createPillars(
+    pybind11::array_t<float, pybind11::array::c_style | pybind11::array::forcecast> points,
+    int maxPointsPerPillar, int maxPillars, float xStep, float yStep,
+    float xMin, float xMax, float yMin, float yMax, float zMin, float zMax,
+    bool printTime, float minDistance, const Augmentation &augmentation)
 {
-  std::chrono::high_resolution_clock::time_point t1 =
-      std::chrono::high_resolution_clock::now();
+  const Stopwatch stopwatch;
 
-  if (points.shape()[1] == 4)
+  if (points.ndim() != 2 || pillarFeatureCount(points.shape()[1]) == 0)
   {
+    throw std::runtime_error(
+        "numpy array with shape (n, 4) or (n, 7) expected (n being the number "
+        "of points)");
+  }
 
-    if (points.ndim() != 2 || points.shape()[1] != 4)
-    {
-      throw std::runtime_error(
-          "numpy array with shape (n, 4) expected (n being the number of "
-          "points)");
-    }
+  const int nbChannels = points.shape()[1];
+  auto pillars = allocatePillars(1, maxPointsPerPillar, maxPillars,
+                                 pillarFeatureCount(nbChannels));
+  createPillarsFromPoints(points.data(), points.shape()[0], nbChannels,
+                          maxPointsPerPillar, maxPillars, xStep, yStep, xMin,
+                          xMax, yMin, yMax, zMin, zMax, minDistance,
+                          pillars.first.mutable_data(),
+                          pillars.second.mutable_data(), &augmentation);
 
-    std::unordered_map<std::pair<uint32_t, uint32_t>, std::vector<PillarPoint>,
-                       IntPairHash>
-        map;
+  if (printTime)
+    printDuration("createPillars", stopwatch);
 
-    for (int i = 0; i < points.shape()[0]; ++i)
-    {
-      if ((points.at(i, 0) < xMin) || (points.at(i, 0) >= xMax) ||
-          (points.at(i, 1) < yMin) || (points.at(i, 1) >= yMax) ||
-          (points.at(i, 2) < zMin) || (points.at(i, 2) >= zMax) ||
-          minDistance > 0 && (std::pow(points.at(i, 0), 2) + std::pow(points.at(i, 1), 2)) < std::pow(minDistance, 2))
-      {
-        continue;
-      }
+  return pybind11::make_tuple(pillars.first, pillars.second);
+}
 
-      auto xIndex =
-          static_cast<uint32_t>(std::floor((points.at(i, 0) - xMin) / xStep));
-      auto yIndex =
-          static_cast<uint32_t>(std::floor((points.at(i, 1) - yMin) / yStep));
-
-      PillarPoint p = {
-          points.at(i, 0),
-          points.at(i, 1),
-          points.at(i, 2),
-          clamp(points.at(i, 3), 0.0f, 1.0f),
-          0,
-          0,
-          0,
-      };
-
-      map[{xIndex, yIndex}].emplace_back(p);
-    }
+// Voxelizes KITTI velodyne .bin files (float32 x, y, z, intensity) straight
+// from their memory mapping. Each file becomes one entry of the batch
+// dimension; as for createPillars the batch column of the indices is zero.
+// Augmentations are either empty or given for every file.
+pybind11::tuple createPillarsFromFiles(
+    const std::vector<std::string> &paths, int maxPointsPerPillar,
+    int maxPillars, float xStep, float yStep, float xMin, float xMax,
+    float yMin, float yMax, float zMin, float zMax, bool printTime,
+    float minDistance, const std::vector<Augmentation> &augmentations)
+{
+  const Stopwatch stopwatch;
 
-    pybind11::array_t<float> tensor;
-    pybind11::array_t<int> indices;
-
-    tensor.resize({1, maxPillars, maxPointsPerPillar, 9});
-    // Have to be careful about unitialized pillars if num pillars < max_pillars.
-    // All unitialized pillars will be written into (batch_id, 0, 0) as no empty
-    // pillar is known.
-    // TODO (mgier) find one random unitialized x, y pair and write all empty
-    // pillars
-    // into there.
-    indices.resize({1, maxPillars, 3});
-    // For now do zero padding on both ends.
-    // Pillar tensor.
-    pybind11::buffer_info tensor_buffer = tensor.request();
-    float *ptr_tensor = (float *)tensor_buffer.ptr;
-    for (size_t idx = 0; idx < 1 * maxPillars * maxPointsPerPillar * 9; idx++)
-    {
-      ptr_tensor[idx] = 0.0;
-    }
-    // Indices.
-    pybind11::buffer_info indices_buffer = indices.request();
-    int *ptr_indices = (int *)indices_buffer.ptr;
-    for (size_t idx = 0; idx < 1 * maxPillars * 3; idx++)
-    {
-      ptr_indices[idx] = 0;
-    }
+  if (!augmentations.empty() && augmentations.size() != paths.size())
+  {
+    throw std::runtime_error("One augmentation per file expected");
+  }
 
-    int pillarId = 0;
-    for (auto &pair : map)
+  const int nbFeatures = pillarFeatureCount(4);
+  auto pillars = allocatePillars(paths.size(), maxPointsPerPillar, maxPillars,
+                                 nbFeatures);
+  float *tensor = pillars.first.mutable_data();
+  int *indices = pillars.second.mutable_data();
+  {
+    pybind11::gil_scoped_release release;
+    for (size_t i = 0; i < paths.size(); ++i)
     {
-      if (pillarId >= maxPillars)
+      const std::string &path = paths[i];
+      const MappedFile file(path);
+      if (file.size() % (4 * sizeof(float)) != 0)
       {
-        break;
+        throw std::runtime_error(path + " is not a KITTI velodyne file");
       }
 
-      float xMean = 0;
-      float yMean = 0;
-      float zMean = 0;
-      for (const auto &p : pair.second)
-      {
-        xMean += p.x;
-        yMean += p.y;
-        zMean += p.z;
-      }
-      xMean /= pair.second.size();
-      yMean /= pair.second.size();
-      zMean /= pair.second.size();
-
-      for (auto &p : pair.second)
-      {
-        p.xc = p.x - xMean;
-        p.yc = p.y - yMean;
-        p.zc = p.z - zMean;
-      }
-
-      auto xIndex = static_cast<int>(std::floor((xMean - xMin) / xStep));
-      auto yIndex = static_cast<int>(std::floor((yMean - yMin) / yStep));
-      indices.mutable_at(0, pillarId, 1) = xIndex;
-      indices.mutable_at(0, pillarId, 2) = yIndex;
-
-      int pointId = 0;
-      for (const auto &p : pair.second)
-      {
-        if (pointId >= maxPointsPerPillar)
-        {
-          break;
-        }
-
-        // Chapter 2.1 https://arxiv.org/pdf/1812.05784.pdf. 9 dimensional input
-        // to network.
-        tensor.mutable_at(0, pillarId, pointId, 0) = p.x;
-        tensor.mutable_at(0, pillarId, pointId, 1) = p.y;
-        tensor.mutable_at(0, pillarId, pointId, 2) = p.z;
-        tensor.mutable_at(0, pillarId, pointId, 3) = p.intensity;
-        // Subscript c refers to the distance to the arithmetic mean of all points
-        // in the pillar.
-        tensor.mutable_at(0, pillarId, pointId, 4) = p.xc;
-        tensor.mutable_at(0, pillarId, pointId, 5) = p.yc;
-        tensor.mutable_at(0, pillarId, pointId, 6) = p.zc;
-        // Subscript p offset from pillar center in x and y.
-        tensor.mutable_at(0, pillarId, pointId, 7) =
-            p.x - (xIndex * xStep + xMin);
-        tensor.mutable_at(0, pillarId, pointId, 8) =
-            p.y - (yIndex * yStep + yMin);
-        // TODO remove this as there is no pillar center -> no features learned
-        // through this.
-        // tensor.mutable_at(0, pillarId, pointId, 2) = p.z - zMid;
-
-        pointId++;
-      }
-
-      pillarId++;
+      createPillarsFromPoints(reinterpret_cast<const float *>(file.data()),
+                              file.size() / (4 * sizeof(float)), 4,
+                              maxPointsPerPillar, maxPillars, xStep, yStep,
+                              xMin, xMax, yMin, yMax, zMin, zMax, minDistance,
+                              tensor, indices,
+                              augmentations.empty() ? nullptr
+                                                    : &augmentations[i]);
+      tensor += static_cast<size_t>(maxPillars) * maxPointsPerPillar * nbFeatures;
+      indices += static_cast<size_t>(maxPillars) * 3;
     }
+  }
 
-    pybind11::tuple result = pybind11::make_tuple(tensor, indices);
+  if (printTime)
+    printDuration("createPillarsFromFiles", stopwatch);
 
-    std::chrono::high_resolution_clock::time_point t2 =
-        std::chrono::high_resolution_clock::now();
-    auto duration =
-        std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
-    if (printTime)
-      std::cout << "createPillars took: " << static_cast<float>(duration) / 1e6
-                << " seconds" << std::endl;
+  return pybind11::make_tuple(pillars.first, pillars.second);
+}
 
-    return result;
-  }
-  else if (points.shape()[1] == 7)
+pybind11::bytes compressPoints(
+    const pybind11::array_t<float, pybind11::array::c_style | pybind11::array::forcecast> &points)
+{
+  if (points.ndim() != 2 || points.shape()[1] != 4)
   {
-    if (points.ndim() != 2 || points.shape()[1] != 7)
-    {
-      throw std::runtime_error(
-          "numpy array with shape (n, 7) expected (n being the number of "
-          "points)");
-    }
+    throw std::runtime_error(
+        "numpy array with shape (n, 4) expected (n being the number of points)");
+  }
 
-    std::unordered_map<std::pair<uint32_t, uint32_t>, std::vector<PillarPointRGB>,
-                       IntPairHash>
-        map;
+  std::vector<uint8_t> encoded;
+  encodePoints(points.data(), points.shape()[0], encoded);
+  return pybind11::bytes(reinterpret_cast<const char *>(encoded.data()),
+                         encoded.size());
+}
 
-    for (int i = 0; i < points.shape()[0]; ++i)
-    {
-      if ((points.at(i, 0) < xMin) || (points.at(i, 0) >= xMax) ||
-          (points.at(i, 1) < yMin) || (points.at(i, 1) >= yMax) ||
-          (points.at(i, 2) < zMin) || (points.at(i, 2) >= zMax))
-      {
-        continue;
-      }
+pybind11::array_t<float> decompressPoints(const pybind11::bytes &data)
+{
+  const std::string content = data;
+  PointDecodeBuffer buffer;
+  decodePoints(reinterpret_cast<const uint8_t *>(content.data()),
+               content.size(), buffer);
+
+  const auto nbPoints = static_cast<pybind11::ssize_t>(buffer.points.size() / 4);
+  return pybind11::array_t<float>({nbPoints, static_cast<pybind11::ssize_t>(4)},
+                                  buffer.points.data());
+}
 
-      auto xIndex =
-          static_cast<uint32_t>(std::floor((points.at(i, 0) - xMin) / xStep));
-      auto yIndex =
-          static_cast<uint32_t>(std::floor((points.at(i, 1) - yMin) / yStep));
-
-      PillarPointRGB p = {
-          points.at(i, 0),
-          points.at(i, 1),
-          points.at(i, 2),
-          clamp(points.at(i, 3), 0.0f, 1.0f),
-          0,
-          0,
-          0,
-          points.at(i, 4),
-          points.at(i, 5),
-          points.at(i, 6),
-      };
-
-      map[{xIndex, yIndex}].emplace_back(p);
-    }
+// Voxelizes a batch of samples of a shard, in the given order.
+pybind11::tuple createPillarsFromShard(
+    const ShardReader &shard, const std::vector<size_t> &samples,
+    int maxPointsPerPillar, int maxPillars, float xStep, float yStep,
+    float xMin, float xMax, float yMin, float yMax, float zMin, float zMax,
+    bool printTime, float minDistance,
+    const std::vector<Augmentation> &augmentations)
+{
+  const Stopwatch stopwatch;
 
-    pybind11::array_t<float> tensor;
-    pybind11::array_t<int> indices;
-
-    tensor.resize({1, maxPillars, maxPointsPerPillar, 12});
-
-    // Have to be careful about unitialized pillars if num pillars < max_pillars.
-    // All unitialized pillars will be written into (batch_id, 0, 0) as no empty
-    // pillar is known.
-    // TODO (mgier) find one random unitialized x, y pair and write all empty
-    // pillars
-    // into there.
-    indices.resize({1, maxPillars, 3});
-    // For now do zero padding on both ends.
-    // Pillar tensor.
-    pybind11::buffer_info tensor_buffer = tensor.request();
-    float *ptr_tensor = (float *)tensor_buffer.ptr;
-    for (size_t idx = 0; idx < 1 * maxPillars * maxPointsPerPillar * 12; idx++)
-    {
-      ptr_tensor[idx] = 0.0;
-    }
-    // Indices.
-    pybind11::buffer_info indices_buffer = indices.request();
-    int *ptr_indices = (int *)indices_buffer.ptr;
-    for (size_t idx = 0; idx < 1 * maxPillars * 3; idx++)
+  if (!augmentations.empty() && augmentations.size() != samples.size())
+  {
+    throw std::runtime_error("One augmentation per sample expected");
+  }
+
+  const int nbFeatures = pillarFeatureCount(4);
+  auto pillars = allocatePillars(samples.size(), maxPointsPerPillar,
+                                 maxPillars, nbFeatures);
+  float *tensor = pillars.first.mutable_data();
+  int *indices = pillars.second.mutable_data();
+  {
+    pybind11::gil_scoped_release release;
+    PointDecodeBuffer buffer;
+    for (size_t i = 0; i < samples.size(); ++i)
     {
-      ptr_indices[idx] = 0;
+      const size_t sample = samples[i];
+      const float *points = shard.points(sample, buffer);
+      createPillarsFromPoints(points, shard.pointCount(sample), 4,
+                              maxPointsPerPillar, maxPillars, xStep, yStep,
+                              xMin, xMax, yMin, yMax, zMin, zMax, minDistance,
+                              tensor, indices,
+                              augmentations.empty() ? nullptr
+                                                    : &augmentations[i]);
+      tensor += static_cast<size_t>(maxPillars) * maxPointsPerPillar * nbFeatures;
+      indices += static_cast<size_t>(maxPillars) * 3;
     }
+  }
 
-    int pillarId = 0;
-    for (auto &pair : map)
-    {
-      if (pillarId >= maxPillars)
-      {
-        break;
-      }
+  if (printTime)
+    printDuration("createPillarsFromShard", stopwatch);
 
-      float xMean = 0;
-      float yMean = 0;
-      float zMean = 0;
-      for (const auto &p : pair.second)
-      {
-        xMean += p.x;
-        yMean += p.y;
-        zMean += p.z;
-      }
-      xMean /= pair.second.size();
-      yMean /= pair.second.size();
-      zMean /= pair.second.size();
+  return pybind11::make_tuple(pillars.first, pillars.second);
+}
 
-      for (auto &p : pair.second)
-      {
-        p.xc = p.x - xMean;
-        p.yc = p.y - yMean;
-        p.zc = p.z - zMean;
-      }
+pybind11::tuple createPillarsFromFile(const std::string &path,
+                                      int maxPointsPerPillar, int maxPillars,
+                                      float xStep, float yStep, float xMin,
+                                      float xMax, float yMin, float yMax,
+                                      float zMin, float zMax, bool printTime,
+                                      float minDistance,
+                                      const Augmentation &augmentation)
+{
+  return createPillarsFromFiles({path}, maxPointsPerPillar, maxPillars, xStep,
+                                yStep, xMin, xMax, yMin, yMax, zMin, zMax,
+                                printTime, minDistance, {augmentation});
+}
 
-      auto xIndex = static_cast<int>(std::floor((xMean - xMin) / xStep));
-      auto yIndex = static_cast<int>(std::floor((yMean - yMin) / yStep));
-      indices.mutable_at(0, pillarId, 1) = xIndex;
-      indices.mutable_at(0, pillarId, 2) = yIndex;
+// parse numpy arrays
+std::vector<BoundingBox3D> parseAnchors(
+    const pybind11::array_t<float> &anchorDimensions,
+    const pybind11::array_t<float> &anchorZHeights,
+    const pybind11::array_t<float> &anchorYaws,
+    const std::vector<int> &anchorClassIds)
+{
+  const int nbAnchors = anchorDimensions.shape()[0];
 
-      int pointId = 0;
-      for (const auto &p : pair.second)
-      {
-        if (pointId >= maxPointsPerPillar)
-        {
-          break;
-        }
+  if (nbAnchors <= 0)
+  {
+    throw std::runtime_error("Anchor length is zero");
+  }
 
-        // Chapter 2.1 https://arxiv.org/pdf/1812.05784.pdf. 9 dimensional input
-        // to network.
-        tensor.mutable_at(0, pillarId, pointId, 0) = p.x;
-        tensor.mutable_at(0, pillarId, pointId, 1) = p.y;
-        tensor.mutable_at(0, pillarId, pointId, 2) = p.z;
-        tensor.mutable_at(0, pillarId, pointId, 3) = p.intensity;
-        // Subscript c refers to the distance to the arithmetic mean of all points
-        // in the pillar.
-        tensor.mutable_at(0, pillarId, pointId, 4) = p.xc;
-        tensor.mutable_at(0, pillarId, pointId, 5) = p.yc;
-        tensor.mutable_at(0, pillarId, pointId, 6) = p.zc;
-        // Subscript p offset from pillar center in x and y.
-        tensor.mutable_at(0, pillarId, pointId, 7) =
-            p.x - (xIndex * xStep + xMin);
-        tensor.mutable_at(0, pillarId, pointId, 8) =
-            p.y - (yIndex * yStep + yMin);
-        //RGB
-        tensor.mutable_at(0, pillarId, pointId, 9) = p.r;
-        tensor.mutable_at(0, pillarId, pointId, 10) = p.g;
-        tensor.mutable_at(0, pillarId, pointId, 11) = p.b;
-
-        // TODO remove this as there is no pillar center -> no features learned
-        // through this.
-        // tensor.mutable_at(0, pillarId, pointId, 2) = p.z - zMid;
-
-        pointId++;
-      }
+  if (!anchorClassIds.empty() &&
+      static_cast<int>(anchorClassIds.size()) != nbAnchors)
+  {
+    throw std::runtime_error(
+        "anchorClassIds must be empty or contain one class id per anchor");
+  }
 
-      pillarId++;
-    }
-    pybind11::tuple result = pybind11::make_tuple(tensor, indices);
+  std::vector<BoundingBox3D> anchorBoxes = {};
+  for (int i = 0; i < nbAnchors; ++i)
+  {
+    BoundingBox3D anchorBox = {};
+    anchorBox.x = 0;
+    anchorBox.y = 0;
+    anchorBox.length = anchorDimensions.at(i, 0);
+    anchorBox.width = anchorDimensions.at(i, 1);
+    anchorBox.height = anchorDimensions.at(i, 2);
+    anchorBox.z = anchorZHeights.at(i);
+    anchorBox.yaw = anchorYaws.at(i);
+    anchorBox.base_yaw = anchorBox.yaw;
+    anchorBox.classId = anchorClassIds.empty() ? -1 : anchorClassIds[i];
+    anchorBoxes.emplace_back(anchorBox);
+  }
+  return anchorBoxes;
+}
 
-    std::chrono::high_resolution_clock::time_point t2 =
-        std::chrono::high_resolution_clock::now();
-    auto duration =
-        std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
-    if (printTime)
-      std::cout << "createPillars took: " << static_cast<float>(duration) / 1e6
-                << " seconds" << std::endl;
+std::vector<BoundingBox3D> parseObjects(
+    const pybind11::array_t<float> &objectPositions,
+    const pybind11::array_t<float> &objectDimensions,
+    const pybind11::array_t<float> &objectYaws,
+    const pybind11::array_t<int> &objectClassIds)
+{
+  const int nbObjects = objectDimensions.shape()[0];
+  if (nbObjects <= 0)
+  {
+    throw std::runtime_error("Object length is zero");
+  }
 
-    return result;
+  std::vector<BoundingBox3D> objects = {};
+  for (int i = 0; i < nbObjects; ++i)
+  {
+    BoundingBox3D labelBox = {};
+    labelBox.x = objectPositions.at(i, 0);
+    labelBox.y = objectPositions.at(i, 1);
+    labelBox.z = objectPositions.at(i, 2);
+    labelBox.length = objectDimensions.at(i, 0);
+    labelBox.width = objectDimensions.at(i, 1);
+    labelBox.height = objectDimensions.at(i, 2);
+    labelBox.yaw = objectYaws.at(i);
+    labelBox.classId = objectClassIds.at(i);
+    objects.emplace_back(labelBox);
   }
+  return objects;
 }
 
-struct BoundingBox3D
+// Creates the target tensor of shape (objects, x, y, anchors, 10) and the
+// assignment statistics. An empty object list results in an empty tensor. The
+// objects are augmented before the assignment, the same way as the points by
+// createPillars.
+pybind11::tuple createPillarsTargetFromBoxes(
+    const std::vector<BoundingBox3D> &objects,
+    const std::vector<BoundingBox3D> &anchorBoxes, float defaultPositiveThreshold,
+    float defaultNegativeThreshold, float angle_threshold, int nbClasses,
+    int downscalingFactor, float xStep, float yStep, float xMin, float xMax,
+    float yMin, float yMax, float zMin, float zMax, bool printTime,
+    bool verbose, const std::vector<AssignmentMode> &classAssignmentModes,
+    float centerMinOverlap, int centerMinRadius,
+    const std::vector<float> &classPositiveThresholds,
+    const std::vector<float> &classNegativeThresholds,
+    const Augmentation &augmentation, float centerPositiveThreshold,
+    float centerNegativeThreshold)
 {
-  float x;
-  float y;
-  float z;
-  float length;
-  float width;
-  float height;
-  float yaw;
-  // For anchors only!
-  float base_yaw = 0.0;
-  float classId;
-};
+  const Stopwatch stopwatch;
+
+  TargetParameters parameters;
+  parameters.anchors = anchorBoxes;
+  parameters.positiveThreshold = defaultPositiveThreshold;
+  parameters.negativeThreshold = defaultNegativeThreshold;
+  parameters.angleThreshold = angle_threshold;
+  parameters.nbClasses = nbClasses;
+  parameters.downscalingFactor = downscalingFactor;
+  parameters.xStep = xStep;
+  parameters.yStep = yStep;
+  parameters.xMin = xMin;
+  parameters.xMax = xMax;
+  parameters.yMin = yMin;
+  parameters.yMax = yMax;
+  parameters.zMin = zMin;
+  parameters.zMax = zMax;
+  parameters.classAssignmentModes = classAssignmentModes;
+  parameters.centerMinOverlap = centerMinOverlap;
+  parameters.centerMinRadius = centerMinRadius;
+  parameters.classPositiveThresholds = classPositiveThresholds;
+  parameters.classNegativeThresholds = classNegativeThresholds;
+  parameters.centerPositiveThreshold = centerPositiveThreshold;
+  parameters.centerNegativeThreshold = centerNegativeThreshold;
 
-struct Point2D
-{
-  float x;
-  float y;
-};
+  pybind11::array_t<float> tensor;
+  tensor.resize({static_cast<pybind11::ssize_t>(objects.size()),
+                 static_cast<pybind11::ssize_t>(parameters.xSize()),
+                 static_cast<pybind11::ssize_t>(parameters.ySize()),
+                 static_cast<pybind11::ssize_t>(anchorBoxes.size()),
+                 static_cast<pybind11::ssize_t>(10)});
+
+  // Per object messages are collected here and written out at once, so the
+  // assignment loop never blocks on the console.
+  std::ostringstream log;
+  const TargetStatistics statistics = createTarget(
+      augmentation.identity() ? objects : augmentBoxes(objects, augmentation),
+      parameters, tensor.mutable_data(), verbose ? &log : nullptr);
+
+  if (verbose)
+  {
+    std::cout << log.str() << std::flush;
+  }
 
-typedef std::vector<Point2D> Polyline2D;
+  if (printTime)
+    printDuration("createPillarsTarget", stopwatch);
 
-// Returns x-value of point of intersection of two lines
-float xIntersect(float x1, float y1, float x2, float y2, float x3, float y3,
-                 float x4, float y4)
-{
-  float num = (x1 * y2 - y1 * x2) * (x3 - x4) - (x1 - x2) * (x3 * y4 - y3 * x4);
-  float den = (x1 - x2) * (y3 - y4) - (y1 - y2) * (x3 - x4);
-  return num / den;
+  return pybind11::make_tuple(tensor, statistics);
 }
 
-// Returns y-value of point of intersection of two lines
-float yIntersect(float x1, float y1, float x2, float y2, float x3, float y3,
-                 float x4, float y4)
+pybind11::tuple createPillarsTarget(
+    const pybind11::array_t<float> &objectPositions,
+    const pybind11::array_t<float> &objectDimensions,
+    const pybind11::array_t<float> &objectYaws,
+    const pybind11::array_t<int> &objectClassIds,
+    const pybind11::array_t<float> &anchorDimensions,
+    const pybind11::array_t<float> &anchorZHeights,
+    const pybind11::array_t<float> &anchorYaws, float positiveThreshold,
+    float negativeThreshold, float angle_threshold, int nbClasses,
+    int downscalingFactor, float xStep, float yStep, float xMin, float xMax,
+    float yMin, float yMax, float zMin, float zMax, bool printTime = false,
+    bool verbose = false,
+    const std::vector<AssignmentMode> &classAssignmentModes = {},
+    float centerMinOverlap = 0.1, int centerMinRadius = 2,
+    const std::vector<int> &anchorClassIds = {},
+    const std::vector<float> &classPositiveThresholds = {},
+    const std::vector<float> &classNegativeThresholds = {},
+    const Augmentation &augmentation = Augmentation(),
+    float centerPositiveThreshold = 0.5, float centerNegativeThreshold = 0.1)
 {
-  float num = (x1 * y2 - y1 * x2) * (y3 - y4) - (y1 - y2) * (x3 * y4 - y3 * x4);
-  float den = (x1 - x2) * (y3 - y4) - (y1 - y2) * (x3 - x4);
-  return num / den;
+  const auto anchorBoxes = parseAnchors(anchorDimensions, anchorZHeights,
+                                        anchorYaws, anchorClassIds);
+  const auto objects = parseObjects(objectPositions, objectDimensions,
+                                    objectYaws, objectClassIds);
+
+  return createPillarsTargetFromBoxes(
+      objects, anchorBoxes, positiveThreshold, negativeThreshold,
+      angle_threshold, nbClasses, downscalingFactor, xStep, yStep, xMin, xMax,
+      yMin, yMax, zMin, zMax, printTime, verbose, classAssignmentModes,
+      centerMinOverlap, centerMinRadius, classPositiveThresholds,
+      classNegativeThresholds, augmentation, centerPositiveThreshold,
+      centerNegativeThreshold);
 }
 
-// Returns area of polygon using the shoelace method
-float polygonArea(const Polyline2D &polygon)
+// KITTI inputs are either given as file path or as the file contents (bytes).
+std::string kittiContent(const pybind11::object &source)
 {
-  float area = 0.0;
-
-  size_t j = polygon.size() - 1;
-  for (size_t i = 0; i < polygon.size(); i++)
+  if (pybind11::isinstance<pybind11::bytes>(source))
   {
-    area += (polygon[j].x + polygon[i].x) * (polygon[j].y - polygon[i].y);
-    j = i; // j is previous vertex to i
+    return source.cast<std::string>();
   }
-
-  return std::abs(area / 2.0); // Return absolute value
+  return readFile(pybind11::str(source).cast<std::string>());
 }
 
-float rotatedX(float x, float y, float angle)
+pybind11::tuple createPillarsTargetFromKitti(
+    const pybind11::object &label, const pybind11::object &calibration,
+    const std::map<std::string, int> &classIds,
+    const pybind11::array_t<float> &anchorDimensions,
+    const pybind11::array_t<float> &anchorZHeights,
+    const pybind11::array_t<float> &anchorYaws, float positiveThreshold,
+    float negativeThreshold, float angle_threshold, int nbClasses,
+    int downscalingFactor, float xStep, float yStep, float xMin, float xMax,
+    float yMin, float yMax, float zMin, float zMax, bool printTime = false,
+    bool verbose = false,
+    const std::vector<AssignmentMode> &classAssignmentModes = {},
+    float centerMinOverlap = 0.1, int centerMinRadius = 2,
+    const std::vector<int> &anchorClassIds = {},
+    const std::vector<float> &classPositiveThresholds = {},
+    const std::vector<float> &classNegativeThresholds = {},
+    const Augmentation &augmentation = Augmentation(),
+    float centerPositiveThreshold = 0.5, float centerNegativeThreshold = 0.1)
 {
-  return x * std::cos(angle) - y * std::sin(angle);
+  const auto anchorBoxes = parseAnchors(anchorDimensions, anchorZHeights,
+                                        anchorYaws, anchorClassIds);
+  const auto objects = kittiLabelsToLidar(
+      parseKittiLabels(kittiContent(label)),
+      parseKittiCalibration(kittiContent(calibration)), classIds);
+
+  return createPillarsTargetFromBoxes(
+      objects, anchorBoxes, positiveThreshold, negativeThreshold,
+      angle_threshold, nbClasses, downscalingFactor, xStep, yStep, xMin, xMax,
+      yMin, yMax, zMin, zMax, printTime, verbose, classAssignmentModes,
+      centerMinOverlap, centerMinRadius, classPositiveThresholds,
+      classNegativeThresholds, augmentation, centerPositiveThreshold,
+      centerNegativeThreshold);
 }
 
-float rotatedY(float x, float y, float angle)
+pybind11::tuple createPillarsTargetFromShard(
+    const ShardReader &shard, size_t sample,
+    const std::map<std::string, int> &classIds,
+    const pybind11::array_t<float> &anchorDimensions,
+    const pybind11::array_t<float> &anchorZHeights,
+    const pybind11::array_t<float> &anchorYaws, float positiveThreshold,
+    float negativeThreshold, float angle_threshold, int nbClasses,
+    int downscalingFactor, float xStep, float yStep, float xMin, float xMax,
+    float yMin, float yMax, float zMin, float zMax, bool printTime = false,
+    bool verbose = false,
+    const std::vector<AssignmentMode> &classAssignmentModes = {},
+    float centerMinOverlap = 0.1, int centerMinRadius = 2,
+    const std::vector<int> &anchorClassIds = {},
+    const std::vector<float> &classPositiveThresholds = {},
+    const std::vector<float> &classNegativeThresholds = {},
+    const Augmentation &augmentation = Augmentation(),
+    float centerPositiveThreshold = 0.5, float centerNegativeThreshold = 0.1)
 {
-  return x * std::sin(angle) + y * std::cos(angle);
+  const auto anchorBoxes = parseAnchors(anchorDimensions, anchorZHeights,
+                                        anchorYaws, anchorClassIds);
+  const auto objects = kittiLabelsToLidar(
+      shard.labels(sample), shard.calibration(sample), classIds);
+
+  return createPillarsTargetFromBoxes(
+      objects, anchorBoxes, positiveThreshold, negativeThreshold,
+      angle_threshold, nbClasses, downscalingFactor, xStep, yStep, xMin, xMax,
+      yMin, yMax, zMin, zMax, printTime, verbose, classAssignmentModes,
+      centerMinOverlap, centerMinRadius, classPositiveThresholds,
+      classNegativeThresholds, augmentation, centerPositiveThreshold,
+      centerNegativeThreshold);
 }
 
-// Construct bounding box in 2D, coordinates are returned in clockwise order
-Polyline2D boundingBox3DToTopDown(const BoundingBox3D &box1)
+pybind11::object loadCachedPillars(const VoxelCache &cache, uint64_t key)
 {
-  Polyline2D box;
-  box.push_back(
-      {rotatedX(-0.5 * box1.length, 0.5 * box1.width, box1.yaw) + box1.x,
-       rotatedY(-0.5 * box1.length, 0.5 * box1.width, box1.yaw) + box1.y});
-
-  box.push_back(
-      {rotatedX(0.5 * box1.length, 0.5 * box1.width, box1.yaw) + box1.x,
-       rotatedY(0.5 * box1.length, 0.5 * box1.width, box1.yaw) + box1.y});
+  SparsePillars sparse;
+  if (!cache.loadPillars(key, sparse))
+  {
+    return pybind11::none();
+  }
 
-  box.push_back(
-      {rotatedX(0.5 * box1.length, -0.5 * box1.width, box1.yaw) + box1.x,
-       rotatedY(0.5 * box1.length, -0.5 * box1.width, box1.yaw) + box1.y});
+  auto pillars = allocatePillars(1, sparse.maxPointsPerPillar,
+                                 sparse.maxPillars, sparse.nbFeatures);
+  expandPillars(sparse, pillars.first.mutable_data(),
+                pillars.second.mutable_data());
+  return pybind11::make_tuple(pillars.first, pillars.second);
+}
 
-  box.push_back(
-      {rotatedX(-0.5 * box1.length, -0.5 * box1.width, box1.yaw) + box1.x,
-       rotatedY(-0.5 * box1.length, -0.5 * box1.width, box1.yaw) + box1.y});
+void storeCachedPillars(
+    const VoxelCache &cache, uint64_t key,
+    const pybind11::array_t<float, pybind11::array::c_style | pybind11::array::forcecast> &pillars,
+    const pybind11::array_t<int, pybind11::array::c_style | pybind11::array::forcecast> &indices)
+{
+  if (pillars.ndim() != 4 || pillars.shape()[0] != 1 || indices.ndim() != 3 ||
+      indices.shape()[0] != 1 || indices.shape()[1] != pillars.shape()[1] ||
+      indices.shape()[2] != 3)
+  {
+    throw std::runtime_error(
+        "pillars of shape (1, maxPillars, maxPointsPerPillar, features) and "
+        "indices of shape (1, maxPillars, 3) expected");
+  }
 
-  return box;
+  cache.storePillars(key, sparsifyPillars(pillars.data(), indices.data(),
+                                          pillars.shape()[1],
+                                          pillars.shape()[2],
+                                          pillars.shape()[3]));
 }
 
-// This functions clips all the edges w.r.t one Clip edge of clipping area
-// Returns a clipped polygon...
-Polyline2D clip(const Polyline2D &poly_points, float x1, float y1, float x2,
-                float y2)
+pybind11::object loadCachedTarget(const VoxelCache &cache, uint64_t key)
 {
-  Polyline2D new_points;
-
-  for (size_t i = 0; i < poly_points.size(); i++)
+  SparseTarget sparse;
+  TargetStatistics statistics;
+  if (!cache.loadTarget(key, sparse, statistics))
   {
-    // (ix,iy),(kx,ky) are the co-ordinate values of the points
-    // i and k form a line in polygon
-    size_t k = (i + 1) % poly_points.size();
-    float ix = poly_points[i].x, iy = poly_points[i].y;
-    float kx = poly_points[k].x, ky = poly_points[k].y;
+    return pybind11::none();
+  }
 
-    // Calculating position of first point w.r.t. clipper line
-    float i_pos = (x2 - x1) * (iy - y1) - (y2 - y1) * (ix - x1);
+  pybind11::array_t<float> tensor;
+  tensor.resize({sparse.shape[0], sparse.shape[1], sparse.shape[2],
+                 sparse.shape[3], 10});
+  expandTarget(sparse, tensor.mutable_data());
+  return pybind11::make_tuple(tensor, statistics);
+}
 
-    // Calculating position of second point w.r.t. clipper line
-    float k_pos = (x2 - x1) * (ky - y1) - (y2 - y1) * (kx - x1);
+void storeCachedTarget(
+    const VoxelCache &cache, uint64_t key,
+    const pybind11::array_t<float, pybind11::array::c_style | pybind11::array::forcecast> &target,
+    const TargetStatistics &statistics)
+{
+  if (target.ndim() != 5 || target.shape()[4] != 10)
+  {
+    throw std::runtime_error(
+        "target of shape (objects, X, Y, anchors, 10) expected");
+  }
 
-    // Case 1 : When both points are inside
-    if (i_pos < 0 && k_pos < 0)
-    {
-      // Only second point is added
-      new_points.push_back({kx, ky});
-    }
+  const std::array<int32_t, 4> shape = {
+      {static_cast<int32_t>(target.shape()[0]),
+       static_cast<int32_t>(target.shape()[1]),
+       static_cast<int32_t>(target.shape()[2]),
+       static_cast<int32_t>(target.shape()[3])}};
+  cache.storeTarget(key, sparsifyTarget(target.data(), shape), statistics);
+}
 
-    // Case 2: When only first point is outside
-    else if (i_pos >= 0 && k_pos < 0)
-    {
-      // Point of intersection with edge
-      // and the second point is added
-      new_points.push_back({xIntersect(x1, y1, x2, y2, ix, iy, kx, ky),
-                            yIntersect(x1, y1, x2, y2, ix, iy, kx, ky)});
-      new_points.push_back({kx, ky});
+// Pastes objects of a ground truth database into a scene of (n, 4) points
+// with (m, 7) boxes (x, y, z, length, width, height, yaw) and their class ids.
+// Returns the new points, boxes and class ids.
+pybind11::tuple sampleGroundTruthObjects(
+    const GtDatabase &database,
+    const pybind11::array_t<float, pybind11::array::c_style | pybind11::array::forcecast> &points,
+    const pybind11::array_t<float, pybind11::array::c_style | pybind11::array::forcecast> &boxes,
+    const pybind11::array_t<int, pybind11::array::c_style | pybind11::array::forcecast> &classIds,
+    const std::vector<int> &counts, uint64_t seed)
+{
+  if (points.ndim() != 2 || points.shape()[1] != 4 || boxes.ndim() != 2 ||
+      boxes.shape()[1] != 7 || classIds.ndim() != 1 ||
+      classIds.shape()[0] != boxes.shape()[0])
+  {
+    throw std::runtime_error(
+        "points of shape (n, 4), boxes of shape (m, 7) and m class ids "
+        "expected");
+  }
 
-    }
+  std::vector<float> scene(points.data(), points.data() + points.size());
+  std::vector<BoundingBox3D> objects;
+  for (pybind11::ssize_t i = 0; i < boxes.shape()[0]; ++i)
+  {
+    BoundingBox3D box = {};
+    box.x = boxes.at(i, 0);
+    box.y = boxes.at(i, 1);
+    box.z = boxes.at(i, 2);
+    box.length = boxes.at(i, 3);
+    box.width = boxes.at(i, 4);
+    box.height = boxes.at(i, 5);
+    box.yaw = boxes.at(i, 6);
+    box.classId = classIds.at(i);
+    objects.emplace_back(box);
+  }
+  sampleGroundTruth(database, counts, seed, scene, objects);
 
-    // Case 3: When only second point is outside
-    else if (i_pos < 0 && k_pos >= 0)
-    {
-      // Only point of intersection with edge is added
-      new_points.push_back({xIntersect(x1, y1, x2, y2, ix, iy, kx, ky),
-                            yIntersect(x1, y1, x2, y2, ix, iy, kx, ky)});
+  const auto nbObjects = static_cast<pybind11::ssize_t>(objects.size());
+  pybind11::array_t<float> sampledBoxes({nbObjects, static_cast<pybind11::ssize_t>(7)});
+  pybind11::array_t<int> sampledClassIds({nbObjects});
+  for (pybind11::ssize_t i = 0; i < nbObjects; ++i)
+  {
+    const BoundingBox3D &box = objects[i];
+    const float values[7] = {box.x,     box.y,      box.z,  box.length,
+                             box.width, box.height, box.yaw};
+    std::copy(values, values + 7, sampledBoxes.mutable_data(i, 0));
+    sampledClassIds.mutable_at(i) = static_cast<int>(box.classId);
+  }
+  pybind11::array_t<float> sampledPoints(
+      {static_cast<pybind11::ssize_t>(scene.size() / 4),
+       static_cast<pybind11::ssize_t>(4)},
+      scene.data());
+  return pybind11::make_tuple(sampledPoints, sampledBoxes, sampledClassIds);
+}
 
-    }
-    // Case 4: When both points are outside
-    else
-    {
-      // No points are added
-    }
+// Hands a batch to numpy without copying: all arrays share a capsule which
+// owns the batch. Returns [pillars, indices] and, for labeled pipelines, the
+// targets as second element, like SimpleDataGenerator.__getitem__.
+pybind11::object batchToPython(std::unique_ptr<Batch> batch,
+                               const Pipeline &pipeline)
+{
+  using Shape = std::vector<pybind11::ssize_t>;
+  const PipelineParameters &parameters = pipeline.parameters();
+  const pybind11::ssize_t size = batch->size;
+  const pybind11::ssize_t xSize = parameters.target.xSize();
+  const pybind11::ssize_t ySize = parameters.target.ySize();
+  const pybind11::ssize_t nbAnchors = parameters.target.anchors.size();
+  const pybind11::ssize_t nbClasses = parameters.target.nbClasses;
+
+  Batch *owned = batch.release();
+  const pybind11::capsule base(
+      owned, [](void *batch) { delete static_cast<Batch *>(batch); });
+
+  pybind11::list inputs;
+  inputs.append(pybind11::array_t<float>(
+      Shape{size, parameters.maxPillars, parameters.maxPointsPerPillar,
+            pillarFeatureCount(4)},
+      owned->pillars.data(), base));
+  inputs.append(pybind11::array_t<int>(Shape{size, parameters.maxPillars, 3},
+                                       owned->indices.data(), base));
+  if (!pipeline.hasLabels())
+  {
+    return std::move(inputs);
   }
 
-  return new_points;
+  const Shape cells = {size, xSize, ySize, nbAnchors};
+  const Shape vectors = {size, xSize, ySize, nbAnchors, 3};
+  pybind11::list outputs;
+  outputs.append(
+      pybind11::array_t<float>(cells, owned->occupancy.data(), base));
+  outputs.append(
+      pybind11::array_t<float>(vectors, owned->position.data(), base));
+  outputs.append(
+      pybind11::array_t<float>(vectors, owned->dimensions.data(), base));
+  outputs.append(pybind11::array_t<float>(cells, owned->angle.data(), base));
+  outputs.append(pybind11::array_t<float>(cells, owned->heading.data(), base));
+  outputs.append(pybind11::array_t<double>(
+      Shape{size, xSize, ySize, nbAnchors, nbClasses},
+      owned->classification.data(), base));
+  return pybind11::make_tuple(inputs, outputs);
 }
 
-// Implements Sutherland–Hodgman algorithm
-// Returns a polygon with the intersection between two polygons.
-Polyline2D sutherlandHodgmanClip(const Polyline2D &poly_points_vector,
-                                 const Polyline2D &clipper_points)
+// Parses boxes given as (n, 7) array of x, y, z, length, width, height, yaw.
+std::vector<BoundingBox3D> parseBoxes(const pybind11::array_t<float> &boxes)
 {
-  Polyline2D clipped_poly_points_vector = poly_points_vector;
-  for (size_t i = 0; i < clipper_points.size(); i++)
+  if (boxes.ndim() != 2 || boxes.shape()[1] != 7)
   {
-    size_t k =
-        (i + 1) % clipper_points.size(); // i and k are two consecutive indexes
+    throw std::runtime_error(
+        "numpy array with shape (n, 7) expected (n being the number of "
+        "boxes)");
+  }
 
-    // We pass the current array of vertices, and the end points of the selected
-    // clipper line
-    clipped_poly_points_vector =
-        clip(clipped_poly_points_vector, clipper_points[i].x,
-             clipper_points[i].y, clipper_points[k].x, clipper_points[k].y);
+  std::vector<BoundingBox3D> parsed;
+  parsed.reserve(boxes.shape()[0]);
+  for (int i = 0; i < boxes.shape()[0]; ++i)
+  {
+    BoundingBox3D box = {};
+    box.x = boxes.at(i, 0);
+    box.y = boxes.at(i, 1);
+    box.z = boxes.at(i, 2);
+    box.length = boxes.at(i, 3);
+    box.width = boxes.at(i, 4);
+    box.height = boxes.at(i, 5);
+    box.yaw = boxes.at(i, 6);
+    parsed.emplace_back(box);
   }
-  return clipped_poly_points_vector;
+  return parsed;
 }
 
-// Calculates the IOU between two bounding boxes.
-float iou(const BoundingBox3D &box1, const BoundingBox3D &box2)
+// Inverse of parseBoxes.
+pybind11::array_t<float> boxesToArray(const std::vector<BoundingBox3D> &boxes)
 {
-  const auto &box_as_vector = boundingBox3DToTopDown(box1);
-  const auto &box_as_vector_2 = boundingBox3DToTopDown(box2);
-  const auto &clipped_vector =
-      sutherlandHodgmanClip(box_as_vector, box_as_vector_2);
-
-  float area_poly1 = polygonArea(box_as_vector);
-  float area_poly2 = polygonArea(box_as_vector_2);
-  float area_overlap = polygonArea(clipped_vector);
-
-  return area_overlap / (area_poly1 + area_poly2 - area_overlap);
+  pybind11::array_t<float> array({static_cast<pybind11::ssize_t>(boxes.size()),
+                                  static_cast<pybind11::ssize_t>(7)});
+  for (size_t i = 0; i < boxes.size(); ++i)
+  {
+    const BoundingBox3D &box = boxes[i];
+    const float values[7] = {box.x,     box.y,      box.z,  box.length,
+                             box.width, box.height, box.yaw};
+    std::copy(values, values + 7, array.mutable_data(i, 0));
+  }
+  return array;
 }
 
-int clip(int n, int lower, int upper)
+std::vector<PreparedBox> prepareBoxes(const pybind11::array_t<float> &boxes)
 {
-  return std::max(lower, std::min(n, upper));
+  std::vector<PreparedBox> prepared;
+  for (const auto &box : parseBoxes(boxes))
+  {
+    prepared.emplace_back(prepareBox(box));
+  }
+  return prepared;
 }
 
-pybind11::array_t<float> createPillarsTarget(
-    const pybind11::array_t<float> &objectPositions,
-    const pybind11::array_t<float> &objectDimensions,
-    const pybind11::array_t<float> &objectYaws,
-    const pybind11::array_t<int> &objectClassIds,
-    const pybind11::array_t<float> &anchorDimensions,
-    const pybind11::array_t<float> &anchorZHeights,
-    const pybind11::array_t<float> &anchorYaws, float positiveThreshold,
-    float negativeThreshold, float angle_threshold, int nbClasses,
-    int downscalingFactor, float xStep, float yStep, float xMin, float xMax,
-    float yMin, float yMax, float zMin, float zMax, bool printTime = false)
+pybind11::array_t<float> boxIouMatrix(const pybind11::array_t<float> &boxes1,
+                                      const pybind11::array_t<float> &boxes2,
+                                      IouMetric metric)
 {
-  std::chrono::high_resolution_clock::time_point t1 =
-      std::chrono::high_resolution_clock::now();
-
-  const auto xSize =
-      static_cast<int>(std::floor((xMax - xMin) / (xStep * downscalingFactor)));
-  const auto ySize =
-      static_cast<int>(std::floor((yMax - yMin) / (yStep * downscalingFactor)));
-
-  const int nbAnchors = anchorDimensions.shape()[0];
+  const auto prepared1 = prepareBoxes(boxes1);
+  const auto prepared2 = prepareBoxes(boxes2);
+
+  pybind11::array_t<float> result;
+  result.resize({static_cast<pybind11::ssize_t>(prepared1.size()),
+                 static_cast<pybind11::ssize_t>(prepared2.size())});
+  boxOverlapMatrix(prepared1.data(), prepared1.size(), prepared2.data(),
+                   prepared2.size(), metric, result.mutable_data());
+  return result;
+}
 
-  if (nbAnchors <= 0)
+pybind11::array_t<float> boxIouPairwise(const pybind11::array_t<float> &boxes1,
+                                        const pybind11::array_t<float> &boxes2,
+                                        IouMetric metric)
+{
+  const auto prepared1 = prepareBoxes(boxes1);
+  const auto prepared2 = prepareBoxes(boxes2);
+  if (prepared1.size() != prepared2.size())
   {
-    throw std::runtime_error("Anchor length is zero");
+    throw std::runtime_error("Pairwise overlaps require equal box counts");
   }
 
-  const int nbObjects = objectDimensions.shape()[0];
-  if (nbObjects <= 0)
+  pybind11::array_t<float> result;
+  result.resize({static_cast<pybind11::ssize_t>(prepared1.size())});
+  float *ptr = result.mutable_data();
+  for (size_t i = 0; i < prepared1.size(); ++i)
   {
-    throw std::runtime_error("Object length is zero");
+    ptr[i] = boxOverlap(prepared1[i], prepared2[i], metric);
   }
+  return result;
+}
 
-  // parse numpy arrays
-  std::vector<BoundingBox3D> anchorBoxes = {};
-  std::vector<float> anchorDiagonals;
-  for (int i = 0; i < nbAnchors; ++i)
+OccupancyCheck checkPredictedOccupancy(
+    const pybind11::array_t<float, pybind11::array::c_style | pybind11::array::forcecast> &target,
+    const pybind11::array_t<float, pybind11::array::c_style | pybind11::array::forcecast> &predicted,
+    long nbPredictions, const std::vector<float> &thresholds)
+{
+  if (target.ndim() != predicted.ndim() ||
+      !std::equal(target.shape(), target.shape() + target.ndim(),
+                  predicted.shape()))
   {
-    BoundingBox3D anchorBox = {};
-    anchorBox.x = 0;
-    anchorBox.y = 0;
-    anchorBox.length = anchorDimensions.at(i, 0);
-    anchorBox.width = anchorDimensions.at(i, 1);
-    anchorBox.height = anchorDimensions.at(i, 2);
-    anchorBox.z = anchorZHeights.at(i);
-    anchorBox.yaw = anchorYaws.at(i);
-    anchorBox.base_yaw = anchorBox.yaw;
-    anchorBoxes.emplace_back(anchorBox);
+    throw std::runtime_error(
+        "Target and predicted occupancy have to be of the same shape");
+  }
+  pybind11::gil_scoped_release release;
+  return checkOccupancy(target.data(), predicted.data(), target.size(),
+                        nbPredictions, thresholds);
+}
 
-    anchorDiagonals.emplace_back(std::sqrt(std::pow(anchorBox.width, 2) +
-                                           std::pow(anchorBox.length, 2)));
+// Evaluates per frame (n, 9) detections (x, y, z, length, width, height, yaw,
+// class id, score) against KITTI labels, given as paths or file contents.
+std::vector<ClassAveragePrecision> evaluateDetections(
+    const std::vector<pybind11::object> &labels,
+    const std::vector<pybind11::object> &calibrations,
+    const std::vector<pybind11::array_t<float, pybind11::array::c_style | pybind11::array::forcecast>> &detections,
+    const std::vector<EvaluationClass> &classes, int nbThreads)
+{
+  if (calibrations.size() != labels.size() ||
+      detections.size() != labels.size())
+  {
+    throw std::runtime_error(
+        "Labels, calibrations and detections have to be given for every "
+        "frame");
   }
 
-  std::vector<BoundingBox3D> labelBoxes = {};
-  for (int i = 0; i < nbObjects; ++i)
+  std::vector<EvaluationFrame> frames(labels.size());
+  for (size_t f = 0; f < frames.size(); ++f)
   {
-    float x = objectPositions.at(i, 0);
-    float y = objectPositions.at(i, 1);
-    // Exclude equality on max values since this does not find into the
-    // discretized grid.
-    if (x < xMin | x >= xMax | y < yMin | y >= yMax)
+    const auto &boxes = detections[f];
+    if (boxes.ndim() != 2 || boxes.shape()[1] != 9)
     {
-      continue;
+      throw std::runtime_error(
+          "detections of shape (n, 9) expected: x, y, z, length, width, "
+          "height, yaw, class id, score");
+    }
+    EvaluationFrame &frame = frames[f];
+    frame.labels = parseKittiLabels(kittiContent(labels[f]));
+    frame.calibration = parseKittiCalibration(kittiContent(calibrations[f]));
+    for (pybind11::ssize_t i = 0; i < boxes.shape()[0]; ++i)
+    {
+      BoundingBox3D box = {};
+      box.x = boxes.at(i, 0);
+      box.y = boxes.at(i, 1);
+      box.z = boxes.at(i, 2);
+      box.length = boxes.at(i, 3);
+      box.width = boxes.at(i, 4);
+      box.height = boxes.at(i, 5);
+      box.yaw = boxes.at(i, 6);
+      box.classId = boxes.at(i, 7);
+      frame.detections.emplace_back(box);
+      frame.scores.push_back(boxes.at(i, 8));
     }
-    BoundingBox3D labelBox = {};
-    labelBox.x = x;
-    labelBox.y = y;
-    labelBox.z = objectPositions.at(i, 2);
-    labelBox.length = objectDimensions.at(i, 0);
-    labelBox.width = objectDimensions.at(i, 1);
-    labelBox.height = objectDimensions.at(i, 2);
-    labelBox.yaw = objectYaws.at(i);
-    labelBox.classId = objectClassIds.at(i);
-    labelBoxes.emplace_back(labelBox);
   }
 
-  pybind11::array_t<float> tensor;
-  tensor.resize({nbObjects, xSize, ySize, nbAnchors, 10});
+  pybind11::gil_scoped_release release;
+  return evaluateKitti(frames, classes, nbThreads);
+}
 
-  pybind11::buffer_info tensor_buffer = tensor.request();
-  float *ptr1 = (float *)tensor_buffer.ptr;
-  for (size_t idx = 0; idx < nbObjects * xSize * ySize * nbAnchors * 10;
-       idx++)
+void checkPoints(const pybind11::array_t<float, pybind11::array::c_style | pybind11::array::forcecast> &points)
+{
+  if (points.ndim() != 2 || points.shape()[1] < 3)
   {
-    ptr1[idx] = 0;
+    throw std::runtime_error(
+        "numpy array with shape (n, c) expected, c >= 3 being x, y, z and "
+        "further channels");
   }
+}
 
-  int objectCount = 0;
-  if (printTime)
+// Returns the index of the first box containing each point (-1 for none) and
+// the number of points inside each box.
+pybind11::tuple labelPointsInBoxes(
+    const pybind11::array_t<float, pybind11::array::c_style | pybind11::array::forcecast> &points,
+    const pybind11::array_t<float> &boxes)
+{
+  checkPoints(points);
+  const std::vector<BoundingBox3D> parsed = parseBoxes(boxes);
+
+  pybind11::array_t<int32_t> boxIds({points.shape()[0]});
+  std::vector<uint32_t> counts;
+  pointsInBoxes(points.data(), points.shape()[0], points.shape()[1], parsed,
+                boxIds.mutable_data(), &counts);
+  pybind11::array_t<uint32_t> boxCounts(
+      {static_cast<pybind11::ssize_t>(counts.size())}, counts.data());
+  return pybind11::make_tuple(boxIds, boxCounts);
+}
+
+// Applies one transform per box to a copy of the points and boxes, returns
+// the moved points and boxes.
+pybind11::tuple transformObjectPoints(
+    const pybind11::array_t<float, pybind11::array::c_style | pybind11::array::forcecast> &points,
+    const pybind11::array_t<float> &boxes,
+    const std::vector<Augmentation> &transforms)
+{
+  checkPoints(points);
+  std::vector<BoundingBox3D> parsed = parseBoxes(boxes);
+  if (transforms.size() != parsed.size())
   {
-    std::cout << "Received " << labelBoxes.size() << " objects" << std::endl;
-  }
-  for (const auto &labelBox : labelBoxes)
-  {
-    // zone-in on potential spatial area of interest
-    float objectDiameter =
-        std::sqrt(std::pow(labelBox.width, 2) + std::pow(labelBox.length, 2));
-    const auto offset = static_cast<int>(
-        std::ceil(objectDiameter / (xStep * downscalingFactor)));
-    const auto xC = static_cast<int>(
-        std::floor((labelBox.x - xMin) / (xStep * downscalingFactor)));
-    const auto xStart = clip(xC - offset, 0, xSize);
-    const auto xEnd = clip(xC + offset, 0, xSize);
-    const auto yC = static_cast<int>(
-        std::floor((labelBox.y - yMin) / (yStep * downscalingFactor)));
-    const auto yStart = clip(yC - offset, 0, ySize);
-    const auto yEnd = clip(yC + offset, 0, ySize);
-
-    float maxIou = 0;
-    BoundingBox3D bestAnchor = {};
-    int bestAnchorId = 0;
-    for (int xId = xStart; xId < xEnd; xId++)
-    {
-      const float x = xId * xStep * downscalingFactor + xMin;
+    throw std::runtime_error("One transform per box expected");
+  }
 
-      for (int yId = yStart; yId < yEnd; yId++)
-      {
-        const float y = yId * yStep * downscalingFactor + yMin;
-        int anchorCount = 0;
-        for (auto &anchorBox : anchorBoxes)
-        {
-          anchorBox.x = x;
-          anchorBox.y = y;
-
-          // If the angle is within the allowed threshold, rotate it.
-          const float delta_yaw_no =
-              std::fmod(labelBox.yaw - anchorBox.base_yaw, M_PI);
-          if (std::abs(delta_yaw_no) < angle_threshold ||
-              (M_PI - std::abs(delta_yaw_no)) < angle_threshold)
-          {
-            // Override the anchor yaw to "label yaw" in order to sufficiently
-            // cover roated boxes between anchors.
-            anchorBox.yaw = labelBox.yaw;
-          }
-          else
-          {
-            // Otherwise make sure the anchor rotation is set to baseline yaw.
-            anchorBox.yaw = anchorBox.base_yaw;
-          }
-
-          const float iouOverlap = iou(anchorBox, labelBox);
-
-          if (maxIou < iouOverlap)
-          {
-            maxIou = iouOverlap;
-            bestAnchor = anchorBox;
-            bestAnchorId = anchorCount;
-          }
-
-          if (iouOverlap > positiveThreshold)
-          {
-            tensor.mutable_at(objectCount, xId, yId, anchorCount, 0) = 1;
-
-            auto diag = anchorDiagonals[anchorCount];
-            tensor.mutable_at(objectCount, xId, yId, anchorCount, 1) =
-                (labelBox.x - anchorBox.x) / diag;
-            tensor.mutable_at(objectCount, xId, yId, anchorCount, 2) =
-                (labelBox.y - anchorBox.y) / diag;
-            tensor.mutable_at(objectCount, xId, yId, anchorCount, 3) =
-                (labelBox.z - anchorBox.z) / anchorBox.height;
-
-            tensor.mutable_at(objectCount, xId, yId, anchorCount, 4) =
-                std::log(labelBox.length / anchorBox.length);
-            tensor.mutable_at(objectCount, xId, yId, anchorCount, 5) =
-                std::log(labelBox.width / anchorBox.width);
-            tensor.mutable_at(objectCount, xId, yId, anchorCount, 6) =
-                std::log(labelBox.height / anchorBox.height);
-
-            // Reduce angle to an interval of [-pi/2, pi/2] so that
-            // the sine is invertible. The angle is the delta angle
-            // of a *not oriented* box.
-            tensor.mutable_at(objectCount, xId, yId, anchorCount, 7) = std::sin(
-                std::abs(delta_yaw_no) > M_PI_2 ? -delta_yaw_no : delta_yaw_no);
-            // Encode whether the heading of the vehicle has to be
-            // flipped around. The heading must be flipped if
-            // delta angle > 90 and < 270. The angle is an oriented
-            // angle.
-            // TODO (gier) can this be easier? just take the delta_yaw_no?
-            const float delta_yaw_o =
-                std::fmod(labelBox.yaw - anchorBox.base_yaw, 2 * M_PI);
-            if (std::abs(delta_yaw_o) < M_PI_2 &&
-                std::abs(delta_yaw_o) > 1.5 * M_PI)
-            {
-              tensor.mutable_at(objectCount, xId, yId, anchorCount, 8) = 1;
-            }
-            else
-            {
-              tensor.mutable_at(objectCount, xId, yId, anchorCount, 8) = 0;
-            }
-
-            tensor.mutable_at(objectCount, xId, yId, anchorCount, 9) =
-                labelBox.classId;
-          }
-          else if (iouOverlap < negativeThreshold)
-          {
-            tensor.mutable_at(objectCount, xId, yId, anchorCount, 0) = 0;
-          }
-          else
-          {
-            tensor.mutable_at(objectCount, xId, yId, anchorCount, 0) = -1;
-          }
-
-          anchorCount++;
-        }
-      }
-    }
+  pybind11::array_t<float> moved({points.shape()[0], points.shape()[1]},
+                                 points.data());
+  transformObjects(moved.mutable_data(), points.shape()[0], points.shape()[1],
+                   parsed, transforms);
+  return pybind11::make_tuple(moved, boxesToArray(parsed));
+}
 
-    if (maxIou < positiveThreshold)
-    {
-      if (printTime)
-      {
-        std::cout << "\nThere was no sufficiently overlapping anchor anywhere "
-                     "for object "
-                  << objectCount << std::endl;
-        std::cout << "Best IOU was " << maxIou
-                  << ". Adding the best location regardless of threshold."
-                  << std::endl;
-      }
+// Ray casts a synthetic frame, returns the points, the (m, 7) label boxes and
+// their class ids.
+pybind11::tuple generateSyntheticScene(const LidarParameters &lidar,
+                                       const SceneParameters &scene, uint64_t seed)
+{
+  const SyntheticFrame frame = generateScene(lidar, scene, seed);
 
-      const auto xId_0 = static_cast<int>(
-          std::floor((labelBox.x - xMin) / (xStep * downscalingFactor)));
-      const auto yId_0 = static_cast<int>(
-          std::floor((labelBox.y - yMin) / (yStep * downscalingFactor)));
+  const auto nbObjects = static_cast<pybind11::ssize_t>(frame.objects.size());
+  pybind11::array_t<float> boxes({nbObjects, static_cast<pybind11::ssize_t>(7)});
+  pybind11::array_t<int> classIds({nbObjects});
+  for (pybind11::ssize_t i = 0; i < nbObjects; ++i)
+  {
+    const BoundingBox3D &box = frame.objects[i];
+    const float values[7] = {box.x,     box.y,      box.z,  box.length,
+                             box.width, box.height, box.yaw};
+    std::copy(values, values + 7, boxes.mutable_data(i, 0));
+    classIds.mutable_at(i) = static_cast<int>(box.classId);
+  }
+  pybind11::array_t<float> points(
+      {static_cast<pybind11::ssize_t>(frame.points.size() / frame.nbChannels),
+       static_cast<pybind11::ssize_t>(frame.nbChannels)},
+      frame.points.data());
+  return pybind11::make_tuple(points, boxes, classIds);
+}
 
-      for (int dx = -2; dx <= 2; ++dx)
-      {
-        for (int dy = -2; dy <= 2; ++dy)
-        {
-          // Get current x and y id from xId_0 and yId_0.
-          const auto xId = clip(xId_0 + dx, 0, xSize - 1);
-          const auto yId = clip(yId_0 + dy, 0, ySize - 1);
-
-          if (dx == 0 && dy == 0)
-          {
-            // Set as occupied for the actual best anchor.
-
-            const float diag = std::sqrt(std::pow(bestAnchor.width, 2) +
-                                         std::pow(bestAnchor.length, 2));
-            // The best anchor can be at various locations in case the object is
-            // large and covering multiple boxes completely (e.g. bus).
-            // Assume that the best anchor is still the one with the right shape
-            // at this location.
-            const float x = xId * xStep * downscalingFactor + xMin;
-            const float y = yId * yStep * downscalingFactor + yMin;
-
-            tensor.mutable_at(objectCount, xId, yId, bestAnchorId, 0) = 1;
-
-            tensor.mutable_at(objectCount, xId, yId, bestAnchorId, 1) =
-                (labelBox.x - x) / diag;
-            tensor.mutable_at(objectCount, xId, yId, bestAnchorId, 2) =
-                (labelBox.y - y) / diag;
-            tensor.mutable_at(objectCount, xId, yId, bestAnchorId, 3) =
-                (labelBox.z - bestAnchor.z) / bestAnchor.height;
-
-            tensor.mutable_at(objectCount, xId, yId, bestAnchorId, 4) =
-                std::log(labelBox.length / bestAnchor.length);
-            tensor.mutable_at(objectCount, xId, yId, bestAnchorId, 5) =
-                std::log(labelBox.width / bestAnchor.width);
-            tensor.mutable_at(objectCount, xId, yId, bestAnchorId, 6) =
-                std::log(labelBox.height / bestAnchor.height);
-
-            // Reduce angle to an interval of [-pi/2, pi/2] so that
-            // the sine is invertible. The angle is the delta angle
-            // of a not oriented box.
-            const float delta_yaw_no =
-                std::fmod(labelBox.yaw - bestAnchor.base_yaw, M_PI);
-            tensor.mutable_at(objectCount, xId, yId, bestAnchorId, 7) =
-                std::sin(std::abs(delta_yaw_no) > M_PI_2 ? -delta_yaw_no
-                                                         : delta_yaw_no);
-            // Encode whether the heading of the vehicle has to be
-            // flipped around. The heading must be flipped if
-            // delta angle > 90 and < 270. The angle is an oriented angle.
-            const float delta_yaw_o =
-                std::fmod(labelBox.yaw - bestAnchor.base_yaw, 2 * M_PI);
-            if (std::abs(delta_yaw_o) < M_PI_2 &&
-                std::abs(delta_yaw_o) > 1.5 * M_PI)
-            {
-              tensor.mutable_at(objectCount, xId, yId, bestAnchorId, 8) = 1;
-            }
-            else
-            {
-              tensor.mutable_at(objectCount, xId, yId, bestAnchorId, 8) = 0;
-            }
-            tensor.mutable_at(objectCount, xId, yId, bestAnchorId, 9) =
-                labelBox.classId;
-          }
-          else if (xId_0 + dx >= 0 && xId_0 + dx < xSize && yId_0 + dy >= 0 &&
-                   yId_0 + dy < ySize)
-          {
-            // Make sure the the neighboring field would still be in the range.
-            // Otherwise the clipped value could override
-            // the positive anchor.
-
-            // Set to -1 in order to do not penalize for scores in the
-            // surrounding of the object.
-            tensor.mutable_at(objectCount, xId, yId, bestAnchorId, 0) = -1;
-          }
-        }
-      }
-    }
-    else
-    {
-      if (printTime)
-      {
-        std::cout << "\nAt least 1 anchor was positively matched for object "
-                  << objectCount << std::endl;
-        std::cout << "Best IOU was " << maxIou << "." << std::endl;
-      }
-    }
+// A trace span around Python code, e.g. the NMS of a frame, so that it shows
+// up next to the native stages.
+class TraceSpan
+{
+public:
+  explicit TraceSpan(const std::string &name) : name_(internTraceName(name)) {}
 
-    objectCount++;
+  void enter()
+  {
+    active_ = tracingEnabled();
+    if (active_)
+      traceBegin(name_);
+  }
+  void exit()
+  {
+    if (active_)
+      traceEnd(name_);
+    active_ = false;
   }
 
-  std::chrono::high_resolution_clock::time_point t2 =
-      std::chrono::high_resolution_clock::now();
-  auto duration =
-      std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
-  if (printTime)
-    std::cout << "createPillarsTarget took: "
-              << static_cast<float>(duration) / 1e6 << " seconds" << std::endl;
-
-  return tensor;
-}
+private:
+  const char *name_;
+  bool active_ = false;
+};
 
 PYBIND11_MODULE(point_pillars, m)
 {
+  // Selects the kernel variants at import, an invalid
+  // POINT_PILLARS_CPU_TARGET fails the import.
+  cpuTarget();
+
+  // Registered first, since the other functions use it as default argument.
+  pybind11::class_<Augmentation>(m, "Augmentation")
+      .def(pybind11::init([](float yaw, float scale, bool flipY,
+                             const std::array<float, 3> &translation) {
+             Augmentation augmentation;
+             augmentation.yaw = yaw;
+             augmentation.scale = scale;
+             augmentation.flipY = flipY;
+             augmentation.translation = translation;
+             return augmentation;
+           }),
+           "Global augmentation: mirroring along y, rotation around z, uniform "
+           "scaling and translation, in this order",
+           pybind11::arg("yaw") = 0.0f, pybind11::arg("scale") = 1.0f,
+           pybind11::arg("flipY") = false,
+           pybind11::arg("translation") = std::array<float, 3>{{0.0f, 0.0f, 0.0f}})
+      .def_readwrite("yaw", &Augmentation::yaw)
+      .def_readwrite("scale", &Augmentation::scale)
+      .def_readwrite("flipY", &Augmentation::flipY)
+      .def_readwrite("translation", &Augmentation::translation);
+  pybind11::class_<AugmentationRange>(m, "AugmentationRange")
+      .def(pybind11::init<>())
+      .def_readwrite("maxYaw", &AugmentationRange::maxYaw)
+      .def_readwrite("minScale", &AugmentationRange::minScale)
+      .def_readwrite("maxScale", &AugmentationRange::maxScale)
+      .def_readwrite("flipProbability", &AugmentationRange::flipProbability)
+      .def_readwrite("translationStd", &AugmentationRange::translationStd);
+  pybind11::class_<ObjectNoiseRange>(m, "ObjectNoiseRange")
+      .def(pybind11::init<>())
+      .def_readwrite("maxYaw", &ObjectNoiseRange::maxYaw)
+      .def_readwrite("translationStd", &ObjectNoiseRange::translationStd)
+      .def_readwrite("attempts", &ObjectNoiseRange::attempts);
   m.def("createPillars", &createPillars,
         "Runs function to create point pillars input tensors",
         pybind11::arg("points"), pybind11::arg("maxPointsPerPillar"), pybind11::arg("maxPillars"),
         pybind11::arg("xStep"), pybind11::arg("yStep"), pybind11::arg("xMin"), pybind11::arg("xMax"),
         pybind11::arg("yMin"), pybind11::arg("yMax"), pybind11::arg("zMin"), pybind11::arg("zMax"),
-        pybind11::arg("printTime") = false, pybind11::arg("minDistance") = -1.0);
+        pybind11::arg("printTime") = false, pybind11::arg("minDistance") = -1.0,
+        pybind11::arg("augmentation") = Augmentation());
+  m.def("createPillarsFromFile", &createPillarsFromFile,
+        "Creates point pillars input tensors from a memory mapped KITTI velodyne file",
+        pybind11::arg("path"), pybind11::arg("maxPointsPerPillar"), pybind11::arg("maxPillars"),
+        pybind11::arg("xStep"), pybind11::arg("yStep"), pybind11::arg("xMin"), pybind11::arg("xMax"),
+        pybind11::arg("yMin"), pybind11::arg("yMax"), pybind11::arg("zMin"), pybind11::arg("zMax"),
+        pybind11::arg("printTime") = false, pybind11::arg("minDistance") = -1.0,
+        pybind11::arg("augmentation") = Augmentation());
+  m.def("createPillarsFromFiles", &createPillarsFromFiles,
+        "Creates a batch of point pillars input tensors from memory mapped KITTI velodyne files",
+        pybind11::arg("paths"), pybind11::arg("maxPointsPerPillar"), pybind11::arg("maxPillars"),
+        pybind11::arg("xStep"), pybind11::arg("yStep"), pybind11::arg("xMin"), pybind11::arg("xMax"),
+        pybind11::arg("yMin"), pybind11::arg("yMax"), pybind11::arg("zMin"), pybind11::arg("zMax"),
+        pybind11::arg("printTime") = false, pybind11::arg("minDistance") = -1.0,
+        pybind11::arg("augmentations") = std::vector<Augmentation>());
+  pybind11::enum_<AssignmentMode>(m, "AssignmentMode")
+      .value("Iou", AssignmentMode::Iou)
+      .value("Center", AssignmentMode::Center);
+  pybind11::class_<TargetStatistics>(m, "TargetStatistics")
+      .def_readonly("positives", &TargetStatistics::positives)
+      .def_readonly("negatives", &TargetStatistics::negatives)
+      .def_readonly("ignored", &TargetStatistics::ignored)
+      .def_readonly("forcedMatches", &TargetStatistics::forcedMatches)
+      .def_readonly("unassigned", &TargetStatistics::unassigned)
+      .def_readonly("objectIds", &TargetStatistics::objectIds)
+      .def_readonly("bestIou", &TargetStatistics::bestIou)
+      .def_readonly("bestAnchorIds", &TargetStatistics::bestAnchorIds);
   m.def("createPillarsTarget", &createPillarsTarget,
-        "Runs function to create point pillars output ground truth");
+        "Runs function to create point pillars output ground truth",
+        pybind11::arg("objectPositions"), pybind11::arg("objectDimensions"),
+        pybind11::arg("objectYaws"), pybind11::arg("objectClassIds"),
+        pybind11::arg("anchorDimensions"), pybind11::arg("anchorZHeights"),
+        pybind11::arg("anchorYaws"), pybind11::arg("positiveThreshold"),
+        pybind11::arg("negativeThreshold"), pybind11::arg("angle_threshold"),
+        pybind11::arg("nbClasses"), pybind11::arg("downscalingFactor"),
+        pybind11::arg("xStep"), pybind11::arg("yStep"), pybind11::arg("xMin"), pybind11::arg("xMax"),
+        pybind11::arg("yMin"), pybind11::arg("yMax"), pybind11::arg("zMin"), pybind11::arg("zMax"),
+        pybind11::arg("printTime") = false, pybind11::arg("verbose") = false,
+        pybind11::arg("classAssignmentModes") = std::vector<AssignmentMode>(),
+        pybind11::arg("centerMinOverlap") = 0.1, pybind11::arg("centerMinRadius") = 2,
+        pybind11::arg("anchorClassIds") = std::vector<int>(),
+        pybind11::arg("classPositiveThresholds") = std::vector<float>(),
+        pybind11::arg("classNegativeThresholds") = std::vector<float>(),
+        pybind11::arg("augmentation") = Augmentation(),
+        pybind11::arg("centerPositiveThreshold") = 0.5, pybind11::arg("centerNegativeThreshold") = 0.1);
+  m.def("createPillarsTargetFromKitti", &createPillarsTargetFromKitti,
+        "Creates the point pillars ground truth directly from a KITTI label_2 "
+        "and calib file (paths or file contents as bytes). Objects are "
+        "transformed into lidar coordinates and filtered by the classes dict; "
+        "frames without objects yield an empty first dimension",
+        pybind11::arg("label"), pybind11::arg("calibration"), pybind11::arg("classes"),
+        pybind11::arg("anchorDimensions"), pybind11::arg("anchorZHeights"),
+        pybind11::arg("anchorYaws"), pybind11::arg("positiveThreshold"),
+        pybind11::arg("negativeThreshold"), pybind11::arg("angle_threshold"),
+        pybind11::arg("nbClasses"), pybind11::arg("downscalingFactor"),
+        pybind11::arg("xStep"), pybind11::arg("yStep"), pybind11::arg("xMin"), pybind11::arg("xMax"),
+        pybind11::arg("yMin"), pybind11::arg("yMax"), pybind11::arg("zMin"), pybind11::arg("zMax"),
+        pybind11::arg("printTime") = false, pybind11::arg("verbose") = false,
+        pybind11::arg("classAssignmentModes") = std::vector<AssignmentMode>(),
+        pybind11::arg("centerMinOverlap") = 0.1, pybind11::arg("centerMinRadius") = 2,
+        pybind11::arg("anchorClassIds") = std::vector<int>(),
+        pybind11::arg("classPositiveThresholds") = std::vector<float>(),
+        pybind11::arg("classNegativeThresholds") = std::vector<float>(),
+        pybind11::arg("augmentation") = Augmentation(),
+        pybind11::arg("centerPositiveThreshold") = 0.5, pybind11::arg("centerNegativeThreshold") = 0.1);
+  pybind11::class_<VoxelCache>(m, "VoxelCache")
+      .def(pybind11::init<const std::string &, const std::string &>(),
+           pybind11::arg("directory"), pybind11::arg("parameters"))
+      .def("key", &VoxelCache::key,
+           "Content hash of the input files an entry is computed from",
+           pybind11::arg("inputFiles"))
+      .def("loadPillars", &loadCachedPillars,
+           "Pillar tensor and indices of an entry, None if it is not cached",
+           pybind11::arg("key"))
+      .def("storePillars", &storeCachedPillars, pybind11::arg("key"),
+           pybind11::arg("pillars"), pybind11::arg("indices"))
+      .def("loadTarget", &loadCachedTarget,
+           "Target tensor and statistics of an entry, None if it is not cached",
+           pybind11::arg("key"))
+      .def("storeTarget", &storeCachedTarget, pybind11::arg("key"),
+           pybind11::arg("target"), pybind11::arg("statistics"));
+  pybind11::enum_<PointEncoding>(m, "PointEncoding")
+      .value("Raw", PointEncoding::Raw)
+      .value("Compressed", PointEncoding::Compressed);
+  m.def("compressPoints", &compressPoints,
+        "Encodes (n, 4) points with millimetre precision into compressed bytes",
+        pybind11::arg("points"));
+  m.def("decompressPoints", &decompressPoints,
+        "Decodes bytes of compressPoints into (n, 4) points", pybind11::arg("data"));
+  m.def("writeKittiShard", &writeKittiShard,
+        "Packs KITTI velodyne, label_2 and calib files into a single shard file. "
+        "Label and calibration files may be omitted for unlabeled data",
+        pybind11::arg("path"), pybind11::arg("lidarFiles"),
+        pybind11::arg("labelFiles") = std::vector<std::string>(),
+        pybind11::arg("calibrationFiles") = std::vector<std::string>(),
+        pybind11::arg("encoding") = PointEncoding::Raw);
+  pybind11::class_<ShardReader>(m, "Shard")
+      .def(pybind11::init<const std::string &>(), pybind11::arg("path"))
+      .def("__len__", &ShardReader::size)
+      .def("points",
+           [](const pybind11::object &self, size_t sample) {
+             const auto &shard = self.cast<const ShardReader &>();
+             const std::vector<pybind11::ssize_t> shape = {
+                 static_cast<pybind11::ssize_t>(shard.pointCount(sample)), 4};
+             PointDecodeBuffer buffer;
+             const float *data = shard.points(sample, buffer);
+             if (shard.pointEncoding(sample) != PointEncoding::Raw)
+             {
+               return pybind11::array_t<float>(shape, data);
+             }
+             // Read-only view into the mapping, keeping the shard alive.
+             pybind11::array_t<float> points(shape, data, self);
+             points.attr("setflags")(pybind11::arg("write") = false);
+             return points;
+           },
+           "(n, 4) points of a sample, raw points are not copied",
+           pybind11::arg("sample"))
+      .def("calibration",
+           [](const ShardReader &shard, size_t sample) {
+             const auto &calibration = shard.calibration(sample);
+             pybind11::array_t<float> R({3, 3});
+             pybind11::array_t<float> t({3});
+             std::copy(&calibration.R[0][0], &calibration.R[0][0] + 9,
+                       R.mutable_data());
+             std::copy(calibration.t, calibration.t + 3, t.mutable_data());
+             return pybind11::make_tuple(R, t);
+           },
+           "R and t of Tr_velo_to_cam of a sample", pybind11::arg("sample"));
+  m.def("createPillarsFromShard", &createPillarsFromShard,
+        "Creates a batch of point pillars input tensors from samples of a shard",
+        pybind11::arg("shard"), pybind11::arg("samples"), pybind11::arg("maxPointsPerPillar"),
+        pybind11::arg("maxPillars"), pybind11::arg("xStep"), pybind11::arg("yStep"),
+        pybind11::arg("xMin"), pybind11::arg("xMax"), pybind11::arg("yMin"), pybind11::arg("yMax"),
+        pybind11::arg("zMin"), pybind11::arg("zMax"),
+        pybind11::arg("printTime") = false, pybind11::arg("minDistance") = -1.0,
+        pybind11::arg("augmentations") = std::vector<Augmentation>());
+  m.def("createPillarsTargetFromShard", &createPillarsTargetFromShard,
+        "Creates the point pillars ground truth from the labels and "
+        "calibration of a shard sample, see createPillarsTargetFromKitti",
+        pybind11::arg("shard"), pybind11::arg("sample"), pybind11::arg("classes"),
+        pybind11::arg("anchorDimensions"), pybind11::arg("anchorZHeights"),
+        pybind11::arg("anchorYaws"), pybind11::arg("positiveThreshold"),
+        pybind11::arg("negativeThreshold"), pybind11::arg("angle_threshold"),
+        pybind11::arg("nbClasses"), pybind11::arg("downscalingFactor"),
+        pybind11::arg("xStep"), pybind11::arg("yStep"), pybind11::arg("xMin"), pybind11::arg("xMax"),
+        pybind11::arg("yMin"), pybind11::arg("yMax"), pybind11::arg("zMin"), pybind11::arg("zMax"),
+        pybind11::arg("printTime") = false, pybind11::arg("verbose") = false,
+        pybind11::arg("classAssignmentModes") = std::vector<AssignmentMode>(),
+        pybind11::arg("centerMinOverlap") = 0.1, pybind11::arg("centerMinRadius") = 2,
+        pybind11::arg("anchorClassIds") = std::vector<int>(),
+        pybind11::arg("classPositiveThresholds") = std::vector<float>(),
+        pybind11::arg("classNegativeThresholds") = std::vector<float>(),
+        pybind11::arg("augmentation") = Augmentation(),
+        pybind11::arg("centerPositiveThreshold") = 0.5, pybind11::arg("centerNegativeThreshold") = 0.1);
+  m.attr("targetFormatVersion") = kTargetFormatVersion;
+  pybind11::class_<TargetParameters>(m, "TargetParameters")
+      .def(pybind11::init<>())
+      .def("setAnchors",
+           [](TargetParameters &parameters,
+              const pybind11::array_t<float> &anchorDimensions,
+              const pybind11::array_t<float> &anchorZHeights,
+              const pybind11::array_t<float> &anchorYaws,
+              const std::vector<int> &anchorClassIds) {
+             parameters.anchors = parseAnchors(anchorDimensions, anchorZHeights,
+                                               anchorYaws, anchorClassIds);
+           },
+           pybind11::arg("anchorDimensions"), pybind11::arg("anchorZHeights"),
+           pybind11::arg("anchorYaws"),
+           pybind11::arg("anchorClassIds") = std::vector<int>())
+      .def_readwrite("positiveThreshold", &TargetParameters::positiveThreshold)
+      .def_readwrite("negativeThreshold", &TargetParameters::negativeThreshold)
+      .def_readwrite("angleThreshold", &TargetParameters::angleThreshold)
+      .def_readwrite("nbClasses", &TargetParameters::nbClasses)
+      .def_readwrite("downscalingFactor", &TargetParameters::downscalingFactor)
+      .def_readwrite("xStep", &TargetParameters::xStep)
+      .def_readwrite("yStep", &TargetParameters::yStep)
+      .def_readwrite("xMin", &TargetParameters::xMin)
+      .def_readwrite("xMax", &TargetParameters::xMax)
+      .def_readwrite("yMin", &TargetParameters::yMin)
+      .def_readwrite("yMax", &TargetParameters::yMax)
+      .def_readwrite("zMin", &TargetParameters::zMin)
+      .def_readwrite("zMax", &TargetParameters::zMax)
+      .def_readwrite("classAssignmentModes", &TargetParameters::classAssignmentModes)
+      .def_readwrite("centerMinOverlap", &TargetParameters::centerMinOverlap)
+      .def_readwrite("centerMinRadius", &TargetParameters::centerMinRadius)
+      .def_readwrite("classPositiveThresholds", &TargetParameters::classPositiveThresholds)
+      .def_readwrite("classNegativeThresholds", &TargetParameters::classNegativeThresholds)
+      .def_readwrite("centerPositiveThreshold", &TargetParameters::centerPositiveThreshold)
+      .def_readwrite("centerNegativeThreshold", &TargetParameters::centerNegativeThreshold);
+  pybind11::class_<PipelineParameters>(m, "PipelineParameters")
+      .def(pybind11::init<>())
+      .def_readwrite("maxPointsPerPillar", &PipelineParameters::maxPointsPerPillar)
+      .def_readwrite("maxPillars", &PipelineParameters::maxPillars)
+      .def_readwrite("minDistance", &PipelineParameters::minDistance)
+      .def_readwrite("target", &PipelineParameters::target)
+      .def_readwrite("batchSize", &PipelineParameters::batchSize)
+      .def_readwrite("nbWorkers", &PipelineParameters::nbWorkers)
+      .def_readwrite("prefetch", &PipelineParameters::prefetch)
+      .def_readwrite("shuffle", &PipelineParameters::shuffle)
+      .def_readwrite("seed", &PipelineParameters::seed)
+      .def_readwrite("dropLast", &PipelineParameters::dropLast)
+      .def_readwrite("augmentation", &PipelineParameters::augmentation)
+      .def_readwrite("groundTruthDatabase", &PipelineParameters::groundTruthDatabase)
+      .def_readwrite("groundTruthCounts", &PipelineParameters::groundTruthCounts)
+      .def_readwrite("objectNoise", &PipelineParameters::objectNoise)
+      .def_readwrite("minObjectPoints", &PipelineParameters::minObjectPoints);
+  pybind11::class_<Pipeline>(m, "Pipeline")
+      .def(pybind11::init([](const PipelineParameters &parameters,
+                             const std::vector<std::string> &lidarFiles,
+                             const std::vector<std::string> &labelFiles,
+                             const std::vector<std::string> &calibrationFiles,
+                             const std::map<std::string, int> &classIds) {
+             return std::unique_ptr<Pipeline>(new Pipeline(
+                 std::make_shared<KittiFileSource>(lidarFiles, labelFiles,
+                                                   calibrationFiles, classIds),
+                 parameters));
+           }),
+           "Prepares batches of KITTI files in background threads. Iterating "
+           "yields the batches of one epoch, each further iteration the next "
+           "epoch",
+           pybind11::arg("parameters"), pybind11::arg("lidarFiles"),
+           pybind11::arg("labelFiles") = std::vector<std::string>(),
+           pybind11::arg("calibrationFiles") = std::vector<std::string>(),
+           pybind11::arg("classes") = std::map<std::string, int>())
+      .def_static("fromShard",
+                  [](const PipelineParameters &parameters,
+                     const std::string &path, const std::vector<size_t> &samples,
+                     const std::map<std::string, int> &classIds, bool labels) {
+                    return std::unique_ptr<Pipeline>(new Pipeline(
+                        std::make_shared<ShardSource>(path, samples, classIds,
+                                                      labels),
+                        parameters));
+                  },
+                  "Prepares batches of samples of a shard, all of them if "
+                  "samples is empty",
+                  pybind11::arg("parameters"), pybind11::arg("path"),
+                  pybind11::arg("samples") = std::vector<size_t>(),
+                  pybind11::arg("classes") = std::map<std::string, int>(),
+                  pybind11::arg("labels") = true)
+      .def("__len__", &Pipeline::batchesPerEpoch)
+      .def("__iter__", [](const pybind11::object &self) { return self; })
+      .def("__next__", [](Pipeline &pipeline) {
+        std::unique_ptr<Batch> batch;
+        {
+          pybind11::gil_scoped_release release;
+          batch = pipeline.next();
+        }
+        if (!batch)
+        {
+          throw pybind11::stop_iteration();
+        }
+        return batchToPython(std::move(batch), pipeline);
+      });
+  m.def("buildGtDatabase", &buildGtDatabase,
+        "Extracts the points inside every labeled box of the given classes "
+        "into a ground truth database, returns the number of objects",
+        pybind11::arg("path"), pybind11::arg("lidarFiles"), pybind11::arg("labelFiles"),
+        pybind11::arg("calibrationFiles"), pybind11::arg("classes"),
+        pybind11::arg("minPoints") = 5);
+  pybind11::class_<GtDatabase>(m, "GtDatabase")
+      .def(pybind11::init<const std::string &>(), pybind11::arg("path"))
+      .def("__len__", &GtDatabase::size)
+      .def("points",
+           [](const GtDatabase &database, size_t id) {
+             return pybind11::array_t<float>(
+                 {static_cast<pybind11::ssize_t>(database.object(id).pointCount),
+                  static_cast<pybind11::ssize_t>(4)},
+                 database.points(id));
+           },
+           "(n, 4) points of an object", pybind11::arg("id"))
+      .def("box",
+           [](const GtDatabase &database, size_t id) {
+             return pybind11::array_t<float>({static_cast<pybind11::ssize_t>(7)},
+                                             database.object(id).box);
+           },
+           "x, y, z, length, width, height, yaw of an object", pybind11::arg("id"))
+      .def("classId",
+           [](const GtDatabase &database, size_t id) {
+             return database.object(id).classId;
+           },
+           pybind11::arg("id"));
+  m.def("sampleGroundTruth", &sampleGroundTruthObjects,
+        "Pastes objects of a ground truth database into a scene until every "
+        "class id c has counts[c] objects, skipping objects that overlap in "
+        "BEV. Returns the points, boxes and class ids of the new scene",
+        pybind11::arg("database"), pybind11::arg("points"), pybind11::arg("boxes"),
+        pybind11::arg("classIds"), pybind11::arg("counts"), pybind11::arg("seed") = 0);
+  m.def("pointsInBoxes", &labelPointsInBoxes,
+        "Classifies (n, c) points against (m, 7) label boxes whose z is the "
+        "bottom of the box. Returns the index of the first box containing "
+        "each point (-1 for none) and the number of points per box",
+        pybind11::arg("points"), pybind11::arg("boxes"));
+  m.def("transformObjects", &transformObjectPoints,
+        "Rotates every box with its points around the box center by the yaw "
+        "of its transform and moves it by the translation. Returns the new "
+        "points and boxes",
+        pybind11::arg("points"), pybind11::arg("boxes"), pybind11::arg("transforms"));
+  m.def("augmentBoxes",
+        [](const pybind11::array_t<float> &boxes, const Augmentation &augmentation) {
+          return boxesToArray(augmentBoxes(parseBoxes(boxes), augmentation));
+        },
+        "Applies a global augmentation to (n, 7) boxes, as createPillarsTarget "
+        "does with its objects",
+        pybind11::arg("boxes"), pybind11::arg("augmentation"));
+  m.def("sampleObjectNoise",
+        [](const pybind11::array_t<float> &boxes, const ObjectNoiseRange &range,
+           uint64_t seed) {
+          return sampleObjectNoise(parseBoxes(boxes), range, seed);
+        },
+        "Draws one transform per box such that the moved boxes do not overlap "
+        "in BEV",
+        pybind11::arg("boxes"), pybind11::arg("range"), pybind11::arg("seed") = 0);
+  pybind11::class_<StageTiming>(m, "StageTiming")
+      .def_readonly("name", &StageTiming::name)
+      .def_readonly("calls", &StageTiming::calls)
+      .def_readonly("totalNanoseconds", &StageTiming::totalNanoseconds)
+      .def_readonly("minNanoseconds", &StageTiming::minNanoseconds)
+      .def_readonly("maxNanoseconds", &StageTiming::maxNanoseconds)
+      .def_readonly("histogram", &StageTiming::histogram)
+      .def_readonly("allocatedBytes", &StageTiming::allocatedBytes)
+      .def_readonly("allocations", &StageTiming::allocations)
+      .def_readonly("peakBytes", &StageTiming::peakBytes);
+  pybind11::class_<InstrumentationReport>(m, "InstrumentationReport")
+      .def_readonly("stages", &InstrumentationReport::stages)
+      .def_readonly("counters", &InstrumentationReport::counters);
+  m.def("setInstrumentationEnabled", &setInstrumentationEnabled,
+        "Switches recording of the stage timings and counters on or off for "
+        "all threads",
+        pybind11::arg("enabled") = true);
+  m.def("instrumentationEnabled", &instrumentationEnabled);
+  m.def("allocationTracking", [] { return kAllocationTracking; },
+        "Whether the module was built with POINT_PILLARS_ALLOCATION_TRACKING, "
+        "i.e. whether the stage timings include allocations");
+  m.def("resetInstrumentation", &resetInstrumentation,
+        "Clears the accumulated stage timings and counters");
+  m.def("instrumentationReport", &instrumentationReport,
+        "Stage timings and counters accumulated since the last reset. Each "
+        "call of a stage is one sample of its histogram, bucket i counts the "
+        "samples of 2^i to 2^(i + 1) nanoseconds");
+  m.def("setTracingEnabled", &setTracingEnabled,
+        "Switches recording of begin/end events of the native stages on or "
+        "off. Threads get ring buffers of capacity events on their first "
+        "event while tracing",
+        pybind11::arg("enabled") = true, pybind11::arg("capacity") = kDefaultTraceCapacity);
+  m.def("tracingEnabled", &tracingEnabled);
+  m.def("clearTrace", &clearTrace,
+        "Drops the recorded events and the buffers of finished threads");
+  m.def("chromeTrace", &chromeTrace,
+        "The recorded events as Chrome trace JSON, for chrome://tracing or "
+        "ui.perfetto.dev");
+  pybind11::class_<TraceSpan>(m, "TraceSpan")
+      .def(pybind11::init<const std::string &>(),
+           "Context manager recording a span of Python code while tracing",
+           pybind11::arg("name"))
+      .def("__enter__", &TraceSpan::enter)
+      .def("__exit__", [](TraceSpan &span, const pybind11::object &,
+                          const pybind11::object &,
+                          const pybind11::object &) { span.exit(); });
+  m.def("setFrameArenaCapacity", &setFrameArenaCapacity,
+        "Bytes reserved up front by the per-thread arenas holding the "
+        "temporaries of the kernels, so that the first frames do not grow "
+        "them. The arenas of other threads pick it up on their next frame",
+        pybind11::arg("capacity"));
+  m.def("frameArenaCapacity", &frameArenaCapacity);
+  m.def("cpuTarget", [] { return std::string(cpuTargetName(cpuTarget())); },
+        "Instruction set the kernels run with, the best one supported by the "
+        "CPU unless lowered with the environment variable "
+        "POINT_PILLARS_CPU_TARGET");
+  m.def("supportedCpuTargets", &supportedCpuTargets,
+        "Instruction sets the kernels can run with on this machine");
+  pybind11::class_<LidarParameters>(m, "LidarParameters")
+      .def(pybind11::init<>())
+      .def_readwrite("beams", &LidarParameters::beams)
+      .def_readwrite("minElevation", &LidarParameters::minElevation)
+      .def_readwrite("maxElevation", &LidarParameters::maxElevation)
+      .def_readwrite("azimuthResolution", &LidarParameters::azimuthResolution)
+      .def_readwrite("minRange", &LidarParameters::minRange)
+      .def_readwrite("maxRange", &LidarParameters::maxRange)
+      .def_readwrite("mountHeight", &LidarParameters::mountHeight)
+      .def_readwrite("rangeNoise", &LidarParameters::rangeNoise)
+      .def_readwrite("dropProbability", &LidarParameters::dropProbability)
+      .def_readwrite("groundReflectivity", &LidarParameters::groundReflectivity)
+      .def_readwrite("rangeFalloff", &LidarParameters::rangeFalloff)
+      .def_readwrite("intensityNoise", &LidarParameters::intensityNoise);
+  pybind11::class_<SceneParameters>(m, "SceneParameters")
+      .def(pybind11::init<>())
+      .def_readwrite("objectCounts", &SceneParameters::objectCounts)
+      .def_readwrite("xMin", &SceneParameters::xMin)
+      .def_readwrite("xMax", &SceneParameters::xMax)
+      .def_readwrite("yMin", &SceneParameters::yMin)
+      .def_readwrite("yMax", &SceneParameters::yMax)
+      .def_readwrite("colors", &SceneParameters::colors);
+  m.def("generateScene", &generateSyntheticScene,
+        "Ray casts a spinning lidar against a flat ground and seeded, non "
+        "overlapping objects. Returns (n, 4) or, with colors, (n, 7) points, "
+        "(m, 7) label boxes with z at the bottom and m class ids",
+        pybind11::arg("lidar") = LidarParameters(),
+        pybind11::arg("scene") = SceneParameters(), pybind11::arg("seed") = 0);
+  pybind11::class_<OccupancyCheck>(m, "OccupancyCheck")
+      .def_readonly("threshold", &OccupancyCheck::threshold)
+      .def_readonly("matched", &OccupancyCheck::matched)
+      .def_readonly("unmatchedTargets", &OccupancyCheck::unmatchedTargets)
+      .def_readonly("unmatchedPredictions", &OccupancyCheck::unmatchedPredictions)
+      .def_readonly("targetPositives", &OccupancyCheck::targetPositives)
+      .def_readonly("thresholds", &OccupancyCheck::thresholds)
+      .def_readonly("truePositives", &OccupancyCheck::truePositives)
+      .def_readonly("predictedPositives", &OccupancyCheck::predictedPositives);
+  m.def("checkOccupancy", &checkPredictedOccupancy,
+        "Matches the nbPredictions highest predicted cells (as many as there "
+        "are positives if negative) against the positives (1) of the target "
+        "occupancy, and counts true and predicted positives at each threshold",
+        pybind11::arg("target"), pybind11::arg("predicted"),
+        pybind11::arg("nbPredictions") = -1,
+        pybind11::arg("thresholds") = std::vector<float>());
+  pybind11::class_<EvaluationClass>(m, "EvaluationClass")
+      .def(pybind11::init([](const std::string &name, int classId,
+                             float minOverlap) {
+             return EvaluationClass{name, classId, minOverlap};
+           }),
+           pybind11::arg("name"), pybind11::arg("classId"),
+           pybind11::arg("minOverlap"))
+      .def_readwrite("name", &EvaluationClass::name)
+      .def_readwrite("classId", &EvaluationClass::classId)
+      .def_readwrite("minOverlap", &EvaluationClass::minOverlap);
+  pybind11::class_<ClassAveragePrecision>(m, "ClassAveragePrecision")
+      .def_readonly("name", &ClassAveragePrecision::name)
+      .def_readonly("bev", &ClassAveragePrecision::bev)
+      .def_readonly("iou3D", &ClassAveragePrecision::iou3D)
+      .def_readonly("orientation", &ClassAveragePrecision::orientation)
+      .def_readonly("groundTruth", &ClassAveragePrecision::groundTruth);
+  m.def("evaluateKitti", &evaluateDetections,
+        "KITTI AP_R40 in BEV and 3D and the orientation similarity for easy, "
+        "moderate and hard, per class. Detections are (n, 9) arrays per frame: "
+        "x, y, z, length, width, height, yaw, class id, score",
+        pybind11::arg("labels"), pybind11::arg("calibrations"), pybind11::arg("detections"),
+        pybind11::arg("classes"), pybind11::arg("threads") = 0);
+  pybind11::enum_<IouMetric>(m, "IouMetric")
+      .value("Bev", IouMetric::Bev)
+      .value("Iou3D", IouMetric::Iou3D)
+      .value("GIou3D", IouMetric::GIou3D)
+      .value("DIou3D", IouMetric::DIou3D);
+  m.def("boxIouMatrix", &boxIouMatrix,
+        "Overlaps between all pairs of two sets of (n, 7) boxes "
+        "(x, y, z, length, width, height, yaw), returns an (n, m) matrix",
+        pybind11::arg("boxes1"), pybind11::arg("boxes2"),
+        pybind11::arg("metric") = IouMetric::Iou3D);
+  m.def("boxIouPairwise", &boxIouPairwise,
+        "Overlaps between corresponding rows of two sets of (n, 7) boxes",
+        pybind11::arg("boxes1"), pybind11::arg("boxes2"),
+        pybind11::arg("metric") = IouMetric::Iou3D);
 }
@@ -0,0 +1,390 @@
+#include "point_pillars_c.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "cpu_dispatch.h"
+#include "geometry.h"
+#include "pillars.h"
+#include "points_in_boxes.h"
+#include "target.h"
+
+namespace
+{
+thread_local std::string lastError;
+
+// Exceptions must not cross the C boundary, they end up in ppLastError.
+template <class Function>
+int guarded(Function function)
+{
+  try
+  {
+    function();
+    return 0;
+  }
+  catch (const std::exception &error)
+  {
+    lastError = error.what();
+  }
+  catch (...)
+  {
+    lastError = "Unknown error";
+  }
+  return -1;
+}
+
+void checkNotNull(const void *pointer, const char *name)
+{
+  if (pointer == nullptr)
+  {
+    throw std::runtime_error(std::string(name) + " must not be NULL");
+  }
+}
+
+// Sizes of the parameter structs in ABI version 1, the smallest accepted.
+const size_t kPillarParametersV1Size =
+    offsetof(ppPillarParameters, minDistance) + sizeof(float);
+const size_t kTargetParametersV1Size =
+    offsetof(ppTargetParameters, centerNegativeThreshold) + sizeof(float);
+
+// Copies the fields of defaults the caller knows of into parameters.
+template <class Parameters>
+void writeDefaults(const Parameters &defaults, Parameters *parameters)
+{
+  if (parameters == nullptr)
+  {
+    return;
+  }
+  const size_t size =
+      std::min<size_t>(parameters->structSize, sizeof(Parameters));
+  const size_t begin = sizeof(parameters->structSize);
+  if (size > begin)
+  {
+    std::memcpy(reinterpret_cast<char *>(parameters) + begin,
+                reinterpret_cast<const char *>(&defaults) + begin,
+                size - begin);
+  }
+}
+
+// The parameters of the caller, with defaults for the fields it does not
+// know of.
+template <class Parameters>
+Parameters readParameters(const Parameters *parameters,
+                          const Parameters &defaults, size_t minimumSize)
+{
+  checkNotNull(parameters, "parameters");
+  if (parameters->structSize < minimumSize)
+  {
+    throw std::runtime_error(
+        "parameters->structSize is " +
+        std::to_string(parameters->structSize) + ", expected at least " +
+        std::to_string(minimumSize) +
+        " (set it to the sizeof the parameter struct)");
+  }
+  Parameters read = defaults;
+  std::memcpy(&read, parameters,
+              std::min<size_t>(parameters->structSize, sizeof(Parameters)));
+  read.structSize = sizeof(Parameters);
+  return read;
+}
+
+ppPillarParameters defaultPillarParameters()
+{
+  ppPillarParameters parameters = {};
+  parameters.structSize = sizeof(ppPillarParameters);
+  parameters.maxPointsPerPillar = 100;
+  parameters.maxPillars = 12000;
+  parameters.xStep = 0.16f;
+  parameters.yStep = 0.16f;
+  parameters.xMin = 0.0f;
+  parameters.xMax = 80.64f;
+  parameters.yMin = -40.32f;
+  parameters.yMax = 40.32f;
+  // Same grid as the target defaults and config.py.
+  parameters.zMin = -1.0f;
+  parameters.zMax = 3.0f;
+  parameters.minDistance = -1.0f;
+  return parameters;
+}
+
+ppTargetParameters defaultTargetParameters()
+{
+  const TargetParameters defaults;
+  ppTargetParameters parameters = {};
+  parameters.structSize = sizeof(ppTargetParameters);
+  parameters.positiveThreshold = defaults.positiveThreshold;
+  parameters.negativeThreshold = defaults.negativeThreshold;
+  parameters.angleThreshold = defaults.angleThreshold;
+  parameters.nbClasses = defaults.nbClasses;
+  parameters.downscalingFactor = defaults.downscalingFactor;
+  parameters.xStep = defaults.xStep;
+  parameters.yStep = defaults.yStep;
+  parameters.xMin = defaults.xMin;
+  parameters.xMax = defaults.xMax;
+  parameters.yMin = defaults.yMin;
+  parameters.yMax = defaults.yMax;
+  parameters.zMin = defaults.zMin;
+  parameters.zMax = defaults.zMax;
+  parameters.centerMinOverlap = defaults.centerMinOverlap;
+  parameters.centerMinRadius = defaults.centerMinRadius;
+  parameters.centerPositiveThreshold = defaults.centerPositiveThreshold;
+  parameters.centerNegativeThreshold = defaults.centerNegativeThreshold;
+  return parameters;
+}
+
+BoundingBox3D toBoundingBox(const ppBox &box)
+{
+  BoundingBox3D converted = {};
+  converted.x = box.x;
+  converted.y = box.y;
+  converted.z = box.z;
+  converted.length = box.length;
+  converted.width = box.width;
+  converted.height = box.height;
+  converted.yaw = box.yaw;
+  converted.base_yaw = box.yaw;
+  converted.classId = static_cast<float>(box.classId);
+  return converted;
+}
+
+std::vector<BoundingBox3D> toBoundingBoxes(const ppBox *boxes, size_t nbBoxes)
+{
+  if (nbBoxes > 0)
+  {
+    checkNotNull(boxes, "boxes");
+  }
+  std::vector<BoundingBox3D> converted;
+  converted.reserve(nbBoxes);
+  for (size_t i = 0; i < nbBoxes; ++i)
+  {
+    converted.emplace_back(toBoundingBox(boxes[i]));
+  }
+  return converted;
+}
+
+TargetParameters toTargetParameters(const ppTargetParameters *given)
+{
+  const ppTargetParameters read = readParameters(
+      given, defaultTargetParameters(), kTargetParametersV1Size);
+  const ppTargetParameters *parameters = &read;
+  if (parameters->nbAnchors == 0)
+  {
+    throw std::runtime_error("Anchor length is zero");
+  }
+
+  TargetParameters converted;
+  converted.anchors =
+      toBoundingBoxes(parameters->anchors, parameters->nbAnchors);
+  for (auto &anchor : converted.anchors)
+  {
+    anchor.x = 0;
+    anchor.y = 0;
+  }
+  converted.positiveThreshold = parameters->positiveThreshold;
+  converted.negativeThreshold = parameters->negativeThreshold;
+  converted.angleThreshold = parameters->angleThreshold;
+  converted.nbClasses = parameters->nbClasses;
+  converted.downscalingFactor = parameters->downscalingFactor;
+  converted.xStep = parameters->xStep;
+  converted.yStep = parameters->yStep;
+  converted.xMin = parameters->xMin;
+  converted.xMax = parameters->xMax;
+  converted.yMin = parameters->yMin;
+  converted.yMax = parameters->yMax;
+  converted.zMin = parameters->zMin;
+  converted.zMax = parameters->zMax;
+  converted.centerMinOverlap = parameters->centerMinOverlap;
+  converted.centerMinRadius = parameters->centerMinRadius;
+  converted.centerPositiveThreshold = parameters->centerPositiveThreshold;
+  converted.centerNegativeThreshold = parameters->centerNegativeThreshold;
+
+  const size_t nbClasses = std::max(parameters->nbClasses, 0);
+  if (parameters->classAssignmentModes != nullptr)
+  {
+    for (size_t i = 0; i < nbClasses; ++i)
+    {
+      const int32_t mode = parameters->classAssignmentModes[i];
+      if (mode != ppAssignmentIou && mode != ppAssignmentCenter)
+      {
+        throw std::runtime_error("Unknown assignment mode " +
+                                 std::to_string(mode));
+      }
+      converted.classAssignmentModes.emplace_back(
+          static_cast<AssignmentMode>(mode));
+    }
+  }
+  if (parameters->classPositiveThresholds != nullptr)
+  {
+    converted.classPositiveThresholds.assign(
+        parameters->classPositiveThresholds,
+        parameters->classPositiveThresholds + nbClasses);
+  }
+  if (parameters->classNegativeThresholds != nullptr)
+  {
+    converted.classNegativeThresholds.assign(
+        parameters->classNegativeThresholds,
+        parameters->classNegativeThresholds + nbClasses);
+  }
+  return converted;
+}
+} // namespace
+
+int ppAbiVersion(void)
+{
+  return POINT_PILLARS_C_ABI_VERSION;
+}
+
+const char *ppLastError(void)
+{
+  return lastError.c_str();
+}
+
+const char *ppCpuTarget(void)
+{
+  const char *name = nullptr;
+  guarded([&] { name = cpuTargetName(cpuTarget()); });
+  return name;
+}
+
+int ppPillarFeatureCount(int nbChannels)
+{
+  return pillarFeatureCount(nbChannels);
+}
+
+void ppDefaultPillarParameters(ppPillarParameters *parameters)
+{
+  writeDefaults(defaultPillarParameters(), parameters);
+}
+
+int ppCreatePillars(const float *points, size_t nbPoints, int nbChannels,
+                    const ppPillarParameters *given, float *tensor,
+                    int32_t *indices, int *nbPillars)
+{
+  return guarded([&] {
+    const ppPillarParameters read = readParameters(
+        given, defaultPillarParameters(), kPillarParametersV1Size);
+    const ppPillarParameters *parameters = &read;
+    checkNotNull(tensor, "tensor");
+    checkNotNull(indices, "indices");
+    if (nbPoints > 0)
+    {
+      checkNotNull(points, "points");
+    }
+    if (pillarFeatureCount(nbChannels) == 0)
+    {
+      throw std::runtime_error("Points need 4 or 7 channels, got " +
+                               std::to_string(nbChannels));
+    }
+    const int written = createPillarsFromPoints(
+        points, nbPoints, nbChannels, parameters->maxPointsPerPillar,
+        parameters->maxPillars, parameters->xStep, parameters->yStep,
+        parameters->xMin, parameters->xMax, parameters->yMin, parameters->yMax,
+        parameters->zMin, parameters->zMax, parameters->minDistance, tensor,
+        indices);
+    if (nbPillars != nullptr)
+    {
+      *nbPillars = written;
+    }
+  });
+}
+
+void ppDefaultTargetParameters(ppTargetParameters *parameters)
+{
+  writeDefaults(defaultTargetParameters(), parameters);
+}
+
+int ppTargetGridSize(const ppTargetParameters *parameters, int *xSize,
+                     int *ySize)
+{
+  return guarded([&] {
+    checkNotNull(xSize, "xSize");
+    checkNotNull(ySize, "ySize");
+    const TargetParameters converted = toTargetParameters(parameters);
+    *xSize = converted.xSize();
+    *ySize = converted.ySize();
+  });
+}
+
+int ppCreateTarget(const ppBox *objects, size_t nbObjects,
+                   const ppTargetParameters *parameters, float *tensor)
+{
+  return guarded([&] {
+    const TargetParameters converted = toTargetParameters(parameters);
+    if (nbObjects > 0)
+    {
+      checkNotNull(tensor, "tensor");
+    }
+    createTarget(toBoundingBoxes(objects, nbObjects), converted, tensor);
+  });
+}
+
+int ppSelectBestAnchors(const float *target, size_t nbObjects, size_t nbCells,
+                        float *merged)
+{
+  return guarded([&] {
+    checkNotNull(merged, "merged");
+    if (nbObjects > 0)
+    {
+      checkNotNull(target, "target");
+    }
+    selectBestAnchors(target, nbObjects, nbCells, merged);
+  });
+}
+
+int ppBoxOverlaps(const ppBox *boxes1, size_t nbBoxes1, const ppBox *boxes2,
+                  size_t nbBoxes2, int metric, float *overlaps)
+{
+  return guarded([&] {
+    if (metric < ppIouBev || metric > ppDIou3D)
+    {
+      throw std::runtime_error("Unknown overlap metric " +
+                               std::to_string(metric));
+    }
+    if (nbBoxes1 > 0 && nbBoxes2 > 0)
+    {
+      checkNotNull(overlaps, "overlaps");
+    }
+    std::vector<PreparedBox> prepared1;
+    for (const auto &box : toBoundingBoxes(boxes1, nbBoxes1))
+    {
+      prepared1.emplace_back(prepareBox(box));
+    }
+    std::vector<PreparedBox> prepared2;
+    for (const auto &box : toBoundingBoxes(boxes2, nbBoxes2))
+    {
+      prepared2.emplace_back(prepareBox(box));
+    }
+    boxOverlapMatrix(prepared1.data(), prepared1.size(), prepared2.data(),
+                     prepared2.size(), static_cast<IouMetric>(metric),
+                     overlaps);
+  });
+}
+
+int ppPointsInBoxes(const float *points, size_t nbPoints, int nbChannels,
+                    const ppBox *boxes, size_t nbBoxes, int32_t *boxIds,
+                    uint32_t *counts)
+{
+  return guarded([&] {
+    if (nbPoints > 0)
+    {
+      checkNotNull(points, "points");
+      checkNotNull(boxIds, "boxIds");
+    }
+    if (nbChannels < 3)
+    {
+      throw std::runtime_error("Points need at least 3 channels");
+    }
+    std::vector<uint32_t> boxCounts;
+    pointsInBoxes(points, nbPoints, nbChannels,
+                  toBoundingBoxes(boxes, nbBoxes), boxIds,
+                  counts != nullptr ? &boxCounts : nullptr);
+    if (counts != nullptr)
+    {
+      std::copy(boxCounts.begin(), boxCounts.end(), counts);
+    }
+  });
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+// C interface of the point_pillars core library (libpoint_pillars_c), for
+// applications that neither embed Python nor want to depend on the C++
+// types. All buffers are row major and owned by the caller, every shape is
+// passed explicitly.
+//
+// The interface is kept stable: functions are never changed or removed
+// within an ABI version, and parameter structs only grow at their end. Their
+// leading structSize holds the sizeof the caller was compiled with, the
+// library reads and writes only that many bytes. Callers set structSize and
+// fill the struct with the matching ppDefault... function first:
+//
+//   ppPillarParameters parameters;
+//   parameters.structSize = sizeof(parameters);
+//   ppDefaultPillarParameters(&parameters);
+//
+// A library newer than the caller uses the defaults for the fields beyond
+// structSize, an older one ignores them. Sizes below the one of ABI version 1
+// are rejected.
+//
+// Functions returning int return 0 on success and -1 on failure, in which
+// case ppLastError() describes the error. Calls from different threads are
+// independent.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#if defined(POINT_PILLARS_C_BUILD)
+#define POINT_PILLARS_C_API __declspec(dllexport)
+#else
+#define POINT_PILLARS_C_API __declspec(dllimport)
+#endif
+#else
+#define POINT_PILLARS_C_API __attribute__((visibility("default")))
+#endif
+
+#define POINT_PILLARS_C_ABI_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A 3D box. z is the center for the target, the bottom for ppPointsInBoxes
+// (see the C++ headers of the respective functions). classId is ignored
+// where it does not apply, anchors of classId -1 match every class.
+typedef struct ppBox
+{
+  float x;
+  float y;
+  float z;
+  float length;
+  float width;
+  float height;
+  float yaw;
+  int32_t classId;
+} ppBox;
+
+typedef struct ppPillarParameters
+{
+  uint32_t structSize;
+  int32_t maxPointsPerPillar;
+  int32_t maxPillars;
+  float xStep;
+  float yStep;
+  float xMin;
+  float xMax;
+  float yMin;
+  float yMax;
+  float zMin;
+  float zMax;
+  // Points closer to the sensor are dropped, 0 keeps all.
+  float minDistance;
+} ppPillarParameters;
+
+enum
+{
+  ppAssignmentIou = 0,
+  ppAssignmentCenter = 1,
+};
+
+typedef struct ppTargetParameters
+{
+  uint32_t structSize;
+  const ppBox *anchors;
+  size_t nbAnchors;
+  float positiveThreshold;
+  float negativeThreshold;
+  float angleThreshold;
+  int32_t nbClasses;
+  int32_t downscalingFactor;
+  float xStep;
+  float yStep;
+  float xMin;
+  float xMax;
+  float yMin;
+  float yMax;
+  float zMin;
+  float zMax;
+  // Optional per class overrides with nbClasses entries each, or NULL.
+  const int32_t *classAssignmentModes;
+  const float *classPositiveThresholds;
+  const float *classNegativeThresholds;
+  float centerMinOverlap;
+  int32_t centerMinRadius;
+  // Gaussian weight thresholds of the classes using center assignment, the
+  // thresholds above apply to IoU assignment.
+  float centerPositiveThreshold;
+  float centerNegativeThreshold;
+} ppTargetParameters;
+
+enum
+{
+  ppIouBev = 0,
+  ppIou3D = 1,
+  ppGIou3D = 2,
+  ppDIou3D = 3,
+};
+
+// POINT_PILLARS_C_ABI_VERSION of the loaded library.
+POINT_PILLARS_C_API int ppAbiVersion(void);
+
+// Message of the last failed call of the calling thread.
+POINT_PILLARS_C_API const char *ppLastError(void);
+
+// Instruction set the kernels run with, see cpu_dispatch.h.
+POINT_PILLARS_C_API const char *ppCpuTarget(void);
+
+// Features per point of the pillar tensor, 0 for unsupported channel counts.
+POINT_PILLARS_C_API int ppPillarFeatureCount(int nbChannels);
+
+// Writes the defaults into the first parameters->structSize bytes, except for
+// structSize itself.
+POINT_PILLARS_C_API void ppDefaultPillarParameters(
+    ppPillarParameters *parameters);
+
+// Writes the pillar tensor (maxPillars, maxPointsPerPillar,
+// ppPillarFeatureCount(nbChannels)) and the pillar indices (maxPillars, 3) of
+// the (nbPoints, nbChannels) points, see createPillarsFromPoints.
+// nbPillars, if not NULL, gets the number of pillars written.
+POINT_PILLARS_C_API int ppCreatePillars(const float *points, size_t nbPoints,
+                                        int nbChannels,
+                                        const ppPillarParameters *parameters,
+                                        float *tensor, int32_t *indices,
+                                        int *nbPillars);
+
+// Same as ppDefaultPillarParameters, anchors is NULL.
+POINT_PILLARS_C_API void ppDefaultTargetParameters(
+    ppTargetParameters *parameters);
+
+// Size of the target grid.
+POINT_PILLARS_C_API int ppTargetGridSize(const ppTargetParameters *parameters,
+                                         int *xSize, int *ySize);
+
+// Writes the target tensor (nbObjects, xSize, ySize, nbAnchors, 10) of the
+// objects, see createTarget.
+POINT_PILLARS_C_API int ppCreateTarget(const ppBox *objects, size_t nbObjects,
+                                       const ppTargetParameters *parameters,
+                                       float *tensor);
+
+// Merges the object slices of a target into one (nbCells, 10) target, with
+// nbCells = xSize * ySize * nbAnchors, see selectBestAnchors.
+POINT_PILLARS_C_API int ppSelectBestAnchors(const float *target,
+                                            size_t nbObjects, size_t nbCells,
+                                            float *merged);
+
+// Writes the (nbBoxes1, nbBoxes2) matrix of the overlaps of the boxes
+// according to metric (ppIou...), boxes with their center as z.
+POINT_PILLARS_C_API int ppBoxOverlaps(const ppBox *boxes1, size_t nbBoxes1,
+                                      const ppBox *boxes2, size_t nbBoxes2,
+                                      int metric, float *overlaps);
+
+// Writes the index of the first box containing each point, or -1, and, if
+// counts is not NULL, the number of points inside each box.
+POINT_PILLARS_C_API int ppPointsInBoxes(const float *points, size_t nbPoints,
+                                        int nbChannels, const ppBox *boxes,
+                                        size_t nbBoxes, int32_t *boxIds,
+                                        uint32_t *counts);
+
+#ifdef __cplusplus
+}
+#endif
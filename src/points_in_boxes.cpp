@@ -0,0 +1,299 @@
+#define _USE_MATH_DEFINES
+#include "points_in_boxes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+#include "arena.h"
+
+namespace
+{
+// Edge length of the BEV cells points are binned into. Large enough that most
+// boxes touch only a few cells, small enough that a box does not visit many
+// points of its surroundings.
+const float kCellSize = 2.0f;
+
+struct LabelBox
+{
+  float x;
+  float y;
+  float cosYaw;
+  float sinYaw;
+  float halfLength;
+  float halfWidth;
+  float zMin;
+  float zMax;
+  // Axis aligned bounds of the footprint.
+  float xMin;
+  float xMax;
+  float yMin;
+  float yMax;
+};
+
+LabelBox prepareLabelBox(const BoundingBox3D &box)
+{
+  LabelBox prepared;
+  prepared.x = box.x;
+  prepared.y = box.y;
+  prepared.cosYaw = std::cos(box.yaw);
+  prepared.sinYaw = std::sin(box.yaw);
+  prepared.halfLength = 0.5f * box.length;
+  prepared.halfWidth = 0.5f * box.width;
+  prepared.zMin = box.z;
+  prepared.zMax = box.z + box.height;
+  const float xExtent = std::abs(prepared.cosYaw) * prepared.halfLength +
+                        std::abs(prepared.sinYaw) * prepared.halfWidth;
+  const float yExtent = std::abs(prepared.sinYaw) * prepared.halfLength +
+                        std::abs(prepared.cosYaw) * prepared.halfWidth;
+  prepared.xMin = box.x - xExtent;
+  prepared.xMax = box.x + xExtent;
+  prepared.yMin = box.y - yExtent;
+  prepared.yMax = box.y + yExtent;
+  return prepared;
+}
+
+float wrapYaw(float yaw)
+{
+  while (yaw < -M_PI)
+    yaw += 2 * M_PI;
+  while (yaw > M_PI)
+    yaw -= 2 * M_PI;
+  return yaw;
+}
+} // namespace
+
+bool pointInLabelBox(const BoundingBox3D &box, float cosYaw, float sinYaw,
+                     const float *point)
+{
+  if (point[2] < box.z || point[2] >= box.z + box.height)
+  {
+    return false;
+  }
+  const float dx = point[0] - box.x;
+  const float dy = point[1] - box.y;
+  const float along = dx * cosYaw + dy * sinYaw;
+  const float across = -dx * sinYaw + dy * cosYaw;
+  return std::abs(along) <= 0.5f * box.length &&
+         std::abs(across) <= 0.5f * box.width;
+}
+
+void pointsInBoxes(const float *points, size_t nbPoints, int nbChannels,
+                   const std::vector<BoundingBox3D> &boxes, int32_t *boxIds,
+                   std::vector<uint32_t> *counts)
+{
+  std::fill(boxIds, boxIds + nbPoints, -1);
+  if (counts != nullptr)
+  {
+    counts->assign(boxes.size(), 0);
+  }
+  if (boxes.empty() || nbPoints == 0)
+  {
+    return;
+  }
+
+  FrameScope frame;
+  FrameVector<LabelBox> prepared;
+  prepared.reserve(boxes.size());
+  float xMin = std::numeric_limits<float>::max();
+  float yMin = std::numeric_limits<float>::max();
+  float xMax = std::numeric_limits<float>::lowest();
+  float yMax = std::numeric_limits<float>::lowest();
+  for (const auto &box : boxes)
+  {
+    prepared.emplace_back(prepareLabelBox(box));
+    xMin = std::min(xMin, prepared.back().xMin);
+    xMax = std::max(xMax, prepared.back().xMax);
+    yMin = std::min(yMin, prepared.back().yMin);
+    yMax = std::max(yMax, prepared.back().yMax);
+  }
+
+  // The grid only covers the footprints, points outside cannot be in a box.
+  const int xCells = static_cast<int>((xMax - xMin) / kCellSize) + 1;
+  const int yCells = static_cast<int>((yMax - yMin) / kCellSize) + 1;
+  const auto cellOf = [&](float x, float y) {
+    if (!(x >= xMin && x <= xMax && y >= yMin && y <= yMax))
+    {
+      return -1;
+    }
+    const int xCell =
+        std::min(static_cast<int>((x - xMin) / kCellSize), xCells - 1);
+    const int yCell =
+        std::min(static_cast<int>((y - yMin) / kCellSize), yCells - 1);
+    return yCell * xCells + xCell;
+  };
+
+  // Counting sort of the points by cell.
+  FrameVector<int32_t> cells(nbPoints);
+  FrameVector<uint32_t> cellStart(static_cast<size_t>(xCells) * yCells + 1, 0);
+  for (size_t i = 0; i < nbPoints; ++i)
+  {
+    const float *point = points + i * nbChannels;
+    cells[i] = cellOf(point[0], point[1]);
+    if (cells[i] >= 0)
+    {
+      ++cellStart[cells[i] + 1];
+    }
+  }
+  for (size_t c = 1; c < cellStart.size(); ++c)
+  {
+    cellStart[c] += cellStart[c - 1];
+  }
+
+  const size_t nbBinned = cellStart.back();
+  FrameVector<float> xs(nbBinned);
+  FrameVector<float> ys(nbBinned);
+  FrameVector<float> zs(nbBinned);
+  FrameVector<uint32_t> pointIds(nbBinned);
+  FrameVector<int32_t> hits(nbBinned, -1);
+  {
+    FrameVector<uint32_t> next(cellStart.begin(), cellStart.end() - 1);
+    for (size_t i = 0; i < nbPoints; ++i)
+    {
+      if (cells[i] < 0)
+      {
+        continue;
+      }
+      const float *point = points + i * nbChannels;
+      const uint32_t slot = next[cells[i]]++;
+      xs[slot] = point[0];
+      ys[slot] = point[1];
+      zs[slot] = point[2];
+      pointIds[slot] = static_cast<uint32_t>(i);
+    }
+  }
+
+  for (size_t b = 0; b < prepared.size(); ++b)
+  {
+    const LabelBox &box = prepared[b];
+    const int boxId = static_cast<int>(b);
+    const int xFirst = static_cast<int>((box.xMin - xMin) / kCellSize);
+    const int xLast =
+        std::min(static_cast<int>((box.xMax - xMin) / kCellSize), xCells - 1);
+    const int yFirst = static_cast<int>((box.yMin - yMin) / kCellSize);
+    const int yLast =
+        std::min(static_cast<int>((box.yMax - yMin) / kCellSize), yCells - 1);
+
+    uint32_t count = 0;
+    for (int yCell = yFirst; yCell <= yLast; ++yCell)
+    {
+      // Cells of a row are stored one after the other.
+      const uint32_t begin = cellStart[yCell * xCells + xFirst];
+      const uint32_t end = cellStart[yCell * xCells + xLast + 1];
+      for (uint32_t k = begin; k < end; ++k)
+      {
+        const float dx = xs[k] - box.x;
+        const float dy = ys[k] - box.y;
+        const float along = dx * box.cosYaw + dy * box.sinYaw;
+        const float across = dy * box.cosYaw - dx * box.sinYaw;
+        // Bitwise ands, short circuits would keep the loop from vectorising.
+        const int inside = (std::abs(along) <= box.halfLength) &
+                           (std::abs(across) <= box.halfWidth) &
+                           (zs[k] >= box.zMin) & (zs[k] < box.zMax);
+        hits[k] = (inside & (hits[k] < 0)) ? boxId : hits[k];
+        count += inside;
+      }
+    }
+    if (counts != nullptr)
+    {
+      (*counts)[b] = count;
+    }
+  }
+
+  for (size_t k = 0; k < nbBinned; ++k)
+  {
+    boxIds[pointIds[k]] = hits[k];
+  }
+}
+
+void transformObjects(float *points, size_t nbPoints, int nbChannels,
+                      std::vector<BoundingBox3D> &boxes,
+                      const std::vector<Augmentation> &transforms)
+{
+  FrameScope frame;
+  FrameVector<int32_t> boxIds(nbPoints);
+  pointsInBoxes(points, nbPoints, nbChannels, boxes, boxIds.data());
+
+  FrameVector<float> cosYaws;
+  FrameVector<float> sinYaws;
+  for (const auto &transform : transforms)
+  {
+    cosYaws.push_back(std::cos(transform.yaw));
+    sinYaws.push_back(std::sin(transform.yaw));
+  }
+
+  for (size_t i = 0; i < nbPoints; ++i)
+  {
+    const int32_t boxId = boxIds[i];
+    if (boxId < 0)
+    {
+      continue;
+    }
+    const BoundingBox3D &box = boxes[boxId];
+    const Augmentation &transform = transforms[boxId];
+    float *point = points + i * nbChannels;
+    const float dx = point[0] - box.x;
+    const float dy = point[1] - box.y;
+    point[0] = box.x + cosYaws[boxId] * dx - sinYaws[boxId] * dy +
+               transform.translation[0];
+    point[1] = box.y + sinYaws[boxId] * dx + cosYaws[boxId] * dy +
+               transform.translation[1];
+    point[2] += transform.translation[2];
+  }
+
+  for (size_t b = 0; b < boxes.size(); ++b)
+  {
+    boxes[b].x += transforms[b].translation[0];
+    boxes[b].y += transforms[b].translation[1];
+    boxes[b].z += transforms[b].translation[2];
+    boxes[b].yaw = wrapYaw(boxes[b].yaw + transforms[b].yaw);
+  }
+}
+
+std::vector<Augmentation>
+sampleObjectNoise(const std::vector<BoundingBox3D> &boxes,
+                  const ObjectNoiseRange &range, uint64_t seed)
+{
+  AugmentationRange draw;
+  draw.maxYaw = range.maxYaw;
+  draw.translationStd = range.translationStd;
+
+  std::mt19937_64 engine(seed);
+  std::vector<BoundingBox3D> moved = boxes;
+  std::vector<PreparedBox> footprints;
+  for (const auto &box : moved)
+  {
+    footprints.emplace_back(prepareBox(box));
+  }
+
+  std::vector<Augmentation> transforms(boxes.size());
+  for (size_t b = 0; b < boxes.size(); ++b)
+  {
+    for (int attempt = 0; attempt < range.attempts; ++attempt)
+    {
+      const Augmentation transform = sampleAugmentation(draw, engine());
+      BoundingBox3D candidate = boxes[b];
+      candidate.x += transform.translation[0];
+      candidate.y += transform.translation[1];
+      candidate.z += transform.translation[2];
+      candidate.yaw = wrapYaw(candidate.yaw + transform.yaw);
+      const PreparedBox footprint = prepareBox(candidate);
+
+      bool collides = false;
+      for (size_t other = 0; other < footprints.size() && !collides; ++other)
+      {
+        collides = other != b &&
+                   boxOverlap(footprint, footprints[other], IouMetric::Bev) > 0;
+      }
+      if (!collides)
+      {
+        transforms[b] = transform;
+        moved[b] = candidate;
+        footprints[b] = footprint;
+        break;
+      }
+    }
+  }
+  return transforms;
+}
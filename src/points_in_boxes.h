@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "augmentation.h"
+#include "geometry.h"
+
+// Boxes of kittiLabelsToLidar keep the bottom center of the KITTI label as z,
+// a point is inside if it lies within the footprint and z <= pz < z + height.
+bool pointInLabelBox(const BoundingBox3D &box, float cosYaw, float sinYaw,
+                     const float *point);
+
+// Classifies row major (nbPoints, nbChannels) points against label boxes.
+// boxIds gets the index of the first box containing each point, -1 for points
+// outside of all boxes. If counts is given it gets the number of points inside
+// each box (a point inside two boxes counts for both).
+//
+// The points are binned into a BEV grid and copied into coordinate arrays in
+// cell order, so that each box only visits the rows of cells its footprint
+// touches, and the test runs branch free over contiguous floats, which the
+// compiler vectorises.
+void pointsInBoxes(const float *points, size_t nbPoints, int nbChannels,
+                   const std::vector<BoundingBox3D> &boxes, int32_t *boxIds,
+                   std::vector<uint32_t> *counts = nullptr);
+
+// Per object augmentation: a rotation around the box center and a
+// translation. Only yaw and translation of the Augmentation are used.
+//
+// Moves the points of every box (see pointsInBoxes) and the box itself.
+// transforms has one entry per box.
+void transformObjects(float *points, size_t nbPoints, int nbChannels,
+                      std::vector<BoundingBox3D> &boxes,
+                      const std::vector<Augmentation> &transforms);
+
+// Ranges per object transforms are drawn from.
+struct ObjectNoiseRange
+{
+  // Rotation uniform in [-maxYaw, maxYaw].
+  float maxYaw = 0.0f;
+  // Standard deviation of the normal distributed translation along x, y, z.
+  std::array<float, 3> translationStd = {{0.0f, 0.0f, 0.0f}};
+  // Draws per box until the moved box does not overlap any other box in BEV,
+  // the box stays in place if all of them collide.
+  int attempts = 100;
+
+  bool identity() const
+  {
+    return maxYaw == 0.0f && translationStd[0] == 0.0f &&
+           translationStd[1] == 0.0f && translationStd[2] == 0.0f;
+  }
+};
+
+// Draws collision free transforms for the boxes, see ObjectNoiseRange. The
+// result only depends on the boxes, the range and the seed.
+std::vector<Augmentation>
+sampleObjectNoise(const std::vector<BoundingBox3D> &boxes,
+                  const ObjectNoiseRange &range, uint64_t seed);
@@ -0,0 +1,317 @@
+#include "shard.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+#include "trace.h"
+
+namespace
+{
+const char kShardMagic[8] = {'P', 'P', 'S', 'H', 'A', 'R', 'D', '\0'};
+
+static_assert(std::is_trivially_copyable<ShardHeader>::value &&
+                  std::is_trivially_copyable<ShardEntry>::value &&
+                  std::is_trivially_copyable<ShardLabel>::value,
+              "shard records are written as raw bytes");
+static_assert(sizeof(ShardHeader) == 24 && sizeof(ShardEntry) == 88 &&
+                  sizeof(ShardLabel) == 72,
+              "shard records must not contain padding");
+
+ShardLabel toShardLabel(const KittiLabel &label)
+{
+  ShardLabel packed = {};
+  if (label.type.size() >= sizeof(packed.type))
+  {
+    throw std::runtime_error("Label type too long for a shard: " + label.type);
+  }
+  std::memcpy(packed.type, label.type.c_str(), label.type.size());
+  packed.truncated = label.truncated;
+  packed.occluded = label.occluded;
+  packed.alpha = label.alpha;
+  std::memcpy(packed.bbox, label.bbox, sizeof(packed.bbox));
+  std::memcpy(packed.dimensions, label.dimensions, sizeof(packed.dimensions));
+  std::memcpy(packed.location, label.location, sizeof(packed.location));
+  packed.rotationY = label.rotationY;
+  return packed;
+}
+
+KittiLabel fromShardLabel(const ShardLabel &packed)
+{
+  KittiLabel label;
+  label.type.assign(packed.type, strnlen(packed.type, sizeof(packed.type)));
+  label.truncated = packed.truncated;
+  label.occluded = packed.occluded;
+  label.alpha = packed.alpha;
+  std::memcpy(label.bbox, packed.bbox, sizeof(label.bbox));
+  std::memcpy(label.dimensions, packed.dimensions, sizeof(label.dimensions));
+  std::memcpy(label.location, packed.location, sizeof(label.location));
+  label.rotationY = packed.rotationY;
+  return label;
+}
+
+bool inside(uint64_t offset, uint64_t size, uint64_t fileSize)
+{
+  return offset <= fileSize && size <= fileSize - offset;
+}
+} // namespace
+
+ShardWriter::ShardWriter(const std::string &path, PointEncoding encoding)
+    : path_(path), encoding_(encoding),
+      file_(path, std::ios::binary | std::ios::trunc)
+{
+  if (!file_)
+  {
+    throw std::runtime_error("Could not create " + path);
+  }
+  // Placeholder, rewritten by finish() once the index offset is known.
+  const ShardHeader header = {};
+  write(&header, sizeof(header));
+}
+
+ShardWriter::~ShardWriter()
+{
+  // Reached without finish() when writing failed part-way. Writing the index
+  // now would leave a valid shard with only the samples added so far.
+  if (!finished_)
+  {
+    file_.close();
+    std::remove(path_.c_str());
+  }
+}
+
+void ShardWriter::write(const void *data, size_t size)
+{
+  file_.write(static_cast<const char *>(data), size);
+  if (!file_)
+  {
+    throw std::runtime_error("Could not write " + path_);
+  }
+  offset_ += size;
+}
+
+void ShardWriter::align()
+{
+  static const char padding[kShardAlignment] = {};
+  const uint64_t remainder = offset_ % kShardAlignment;
+  if (remainder != 0)
+  {
+    write(padding, kShardAlignment - remainder);
+  }
+}
+
+void ShardWriter::add(const float *points, size_t nbPoints,
+                      const std::vector<KittiLabel> &labels,
+                      const KittiCalibration &calibration)
+{
+  if (finished_)
+  {
+    throw std::runtime_error("Shard " + path_ + " is already finished");
+  }
+
+  ShardEntry entry = {};
+  align();
+  entry.pointOffset = offset_;
+  entry.pointCount = nbPoints;
+  entry.pointEncoding = encoding_;
+  if (encoding_ == PointEncoding::Compressed)
+  {
+    encoded_.clear();
+    encodePoints(points, nbPoints, encoded_);
+    entry.pointBytes = encoded_.size();
+    write(encoded_.data(), encoded_.size());
+  }
+  else
+  {
+    entry.pointBytes = nbPoints * 4 * sizeof(float);
+    write(points, entry.pointBytes);
+  }
+
+  align();
+  entry.labelOffset = offset_;
+  entry.labelCount = static_cast<uint32_t>(labels.size());
+  for (const auto &label : labels)
+  {
+    const ShardLabel packed = toShardLabel(label);
+    write(&packed, sizeof(packed));
+  }
+
+  entry.calibration = calibration;
+  entries_.emplace_back(entry);
+}
+
+void ShardWriter::finish()
+{
+  if (finished_)
+  {
+    return;
+  }
+  finished_ = true;
+
+  align();
+  ShardHeader header = {};
+  std::memcpy(header.magic, kShardMagic, sizeof(header.magic));
+  header.version = kShardVersion;
+  header.sampleCount = static_cast<uint32_t>(entries_.size());
+  header.indexOffset = offset_;
+  write(entries_.data(), entries_.size() * sizeof(ShardEntry));
+
+  file_.seekp(0);
+  file_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file_.close();
+  if (!file_)
+  {
+    throw std::runtime_error("Could not write " + path_);
+  }
+}
+
+ShardReader::ShardReader(const std::string &path)
+    : file_(path, MappedFile::Access::Random)
+{
+  const uint64_t fileSize = file_.size();
+  ShardHeader header;
+  if (fileSize < sizeof(header))
+  {
+    throw std::runtime_error(path + " is not a shard");
+  }
+  std::memcpy(&header, file_.data(), sizeof(header));
+  if (std::memcmp(header.magic, kShardMagic, sizeof(kShardMagic)) != 0)
+  {
+    throw std::runtime_error(path + " is not a shard");
+  }
+  if (header.version != kShardVersion)
+  {
+    throw std::runtime_error(path + " has unsupported shard version " +
+                             std::to_string(header.version));
+  }
+  if (header.indexOffset % alignof(ShardEntry) != 0 ||
+      !inside(header.indexOffset,
+              static_cast<uint64_t>(header.sampleCount) * sizeof(ShardEntry),
+              fileSize))
+  {
+    throw std::runtime_error(path + " has a truncated index");
+  }
+
+  index_ = reinterpret_cast<const ShardEntry *>(file_.data() +
+                                                header.indexOffset);
+  sampleCount_ = header.sampleCount;
+  for (size_t i = 0; i < sampleCount_; ++i)
+  {
+    const ShardEntry &sample = index_[i];
+    const bool raw = sample.pointEncoding == PointEncoding::Raw;
+    if ((!raw && sample.pointEncoding != PointEncoding::Compressed) ||
+        sample.pointOffset % alignof(float) != 0 ||
+        sample.labelOffset % alignof(ShardLabel) != 0 ||
+        (raw && sample.pointBytes != sample.pointCount * 4 * sizeof(float)) ||
+        !inside(sample.pointOffset, sample.pointBytes, fileSize) ||
+        !inside(sample.labelOffset,
+                static_cast<uint64_t>(sample.labelCount) * sizeof(ShardLabel),
+                fileSize))
+    {
+      throw std::runtime_error(path + " has a corrupt entry for sample " +
+                               std::to_string(i));
+    }
+  }
+}
+
+const ShardEntry &ShardReader::entry(size_t sample) const
+{
+  if (sample >= sampleCount_)
+  {
+    throw std::out_of_range("Sample " + std::to_string(sample) +
+                            " out of range, the shard has " +
+                            std::to_string(sampleCount_) + " samples");
+  }
+  return index_[sample];
+}
+
+const float *ShardReader::points(size_t sample,
+                                PointDecodeBuffer &buffer) const
+{
+  const ShardEntry &sampleEntry = entry(sample);
+  const char *data = file_.data() + sampleEntry.pointOffset;
+  if (sampleEntry.pointEncoding == PointEncoding::Raw)
+  {
+    return reinterpret_cast<const float *>(data);
+  }
+
+  const auto *encoded = reinterpret_cast<const uint8_t *>(data);
+  if (encodedPointCount(encoded, sampleEntry.pointBytes) !=
+      sampleEntry.pointCount)
+  {
+    throw std::runtime_error("Corrupt points of sample " +
+                             std::to_string(sample));
+  }
+  TraceScope trace("shard.decode");
+  decodePoints(encoded, sampleEntry.pointBytes, buffer);
+  return buffer.points.data();
+}
+
+PointEncoding ShardReader::pointEncoding(size_t sample) const
+{
+  return entry(sample).pointEncoding;
+}
+
+size_t ShardReader::pointCount(size_t sample) const
+{
+  return entry(sample).pointCount;
+}
+
+std::vector<KittiLabel> ShardReader::labels(size_t sample) const
+{
+  const ShardEntry &sampleEntry = entry(sample);
+  const auto *packed = reinterpret_cast<const ShardLabel *>(
+      file_.data() + sampleEntry.labelOffset);
+
+  std::vector<KittiLabel> labels;
+  labels.reserve(sampleEntry.labelCount);
+  for (uint32_t i = 0; i < sampleEntry.labelCount; ++i)
+  {
+    labels.emplace_back(fromShardLabel(packed[i]));
+  }
+  return labels;
+}
+
+const KittiCalibration &ShardReader::calibration(size_t sample) const
+{
+  return entry(sample).calibration;
+}
+
+void writeKittiShard(const std::string &path,
+                     const std::vector<std::string> &lidarFiles,
+                     const std::vector<std::string> &labelFiles,
+                     const std::vector<std::string> &calibrationFiles,
+                     PointEncoding encoding)
+{
+  if ((!labelFiles.empty() && labelFiles.size() != lidarFiles.size()) ||
+      (!calibrationFiles.empty() &&
+       calibrationFiles.size() != lidarFiles.size()))
+  {
+    throw std::runtime_error(
+        "Label and calibration files have to be given for every velodyne file");
+  }
+
+  ShardWriter writer(path, encoding);
+  for (size_t i = 0; i < lidarFiles.size(); ++i)
+  {
+    const MappedFile lidar(lidarFiles[i]);
+    if (lidar.size() % (4 * sizeof(float)) != 0)
+    {
+      throw std::runtime_error(lidarFiles[i] +
+                               " is not a KITTI velodyne file");
+    }
+
+    const std::vector<KittiLabel> labels =
+        labelFiles.empty() ? std::vector<KittiLabel>()
+                           : parseKittiLabels(readFile(labelFiles[i]));
+    const KittiCalibration calibration =
+        calibrationFiles.empty()
+            ? KittiCalibration{{{1, 0, 0}, {0, 1, 0}, {0, 0, 1}}, {0, 0, 0}}
+            : parseKittiCalibration(readFile(calibrationFiles[i]));
+
+    writer.add(reinterpret_cast<const float *>(lidar.data()),
+               lidar.size() / (4 * sizeof(float)), labels, calibration);
+  }
+  writer.finish();
+}
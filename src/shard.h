@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "kitti.h"
+#include "mapped_file.h"
+#include "point_codec.h"
+
+// A shard packs many KITTI samples into one file so that a training epoch
+// opens a single file instead of three per sample. Layout:
+//
+//   ShardHeader
+//   per sample: points, labels (ShardLabel)
+//   ShardEntry for every sample, located through ShardHeader::indexOffset
+//
+// Points are stored either as raw float32 (x, y, z, intensity) or encoded
+// with encodePoints, see ShardEntry::pointEncoding. Every block starts at a
+// multiple of kShardAlignment. All values are stored in the byte order of the
+// machine that wrote the shard (little endian on every platform we train on).
+
+const uint32_t kShardVersion = 1;
+const uint64_t kShardAlignment = 64;
+
+enum class PointEncoding : uint32_t
+{
+  Raw = 0,
+  // Millimetre quantised, see point_codec.h.
+  Compressed = 1,
+};
+
+struct ShardHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t sampleCount;
+  uint64_t indexOffset;
+};
+
+struct ShardEntry
+{
+  uint64_t pointOffset;
+  uint64_t pointBytes;
+  uint64_t pointCount;
+  uint64_t labelOffset;
+  uint32_t labelCount;
+  PointEncoding pointEncoding;
+  KittiCalibration calibration;
+};
+
+// KittiLabel with the type stored inline, zero terminated.
+struct ShardLabel
+{
+  char type[16];
+  float truncated;
+  int32_t occluded;
+  float alpha;
+  float bbox[4];
+  float dimensions[3];
+  float location[3];
+  float rotationY;
+};
+
+// Appends samples to a new shard. The index is written by finish(), the file
+// of a writer destroyed before, e.g. by an exception, is removed.
+class ShardWriter
+{
+public:
+  explicit ShardWriter(const std::string &path,
+                       PointEncoding encoding = PointEncoding::Raw);
+  ~ShardWriter();
+
+  ShardWriter(const ShardWriter &) = delete;
+  ShardWriter &operator=(const ShardWriter &) = delete;
+
+  // Points are row major (nbPoints, 4).
+  void add(const float *points, size_t nbPoints,
+           const std::vector<KittiLabel> &labels,
+           const KittiCalibration &calibration);
+  void finish();
+
+private:
+  void write(const void *data, size_t size);
+  void align();
+
+  std::string path_;
+  PointEncoding encoding_;
+  std::ofstream file_;
+  std::vector<uint8_t> encoded_;
+  uint64_t offset_ = 0;
+  std::vector<ShardEntry> entries_;
+  bool finished_ = false;
+};
+
+// Random access to the samples of a shard through a memory mapping. The
+// header and the index are validated when opening, afterwards every lookup is
+// O(1) and only touches the pages of the requested sample.
+class ShardReader
+{
+public:
+  explicit ShardReader(const std::string &path);
+
+  size_t size() const { return sampleCount_; }
+
+  // Row major (pointCount, 4) points of a sample. Raw points are returned
+  // straight from the mapping, compressed ones are decoded into the buffer.
+  const float *points(size_t sample, PointDecodeBuffer &buffer) const;
+  size_t pointCount(size_t sample) const;
+  PointEncoding pointEncoding(size_t sample) const;
+
+  std::vector<KittiLabel> labels(size_t sample) const;
+  const KittiCalibration &calibration(size_t sample) const;
+
+private:
+  const ShardEntry &entry(size_t sample) const;
+
+  MappedFile file_;
+  const ShardEntry *index_ = nullptr;
+  size_t sampleCount_ = 0;
+};
+
+// Packs the given KITTI files into a shard. Label and calibration files may be
+// omitted (empty lists), e.g. for the testing split; otherwise there has to be
+// one per velodyne file.
+void writeKittiShard(const std::string &path,
+                     const std::vector<std::string> &lidarFiles,
+                     const std::vector<std::string> &labelFiles,
+                     const std::vector<std::string> &calibrationFiles,
+                     PointEncoding encoding = PointEncoding::Raw);
@@ -0,0 +1,313 @@
+#define _USE_MATH_DEFINES
+#include "synthetic_scene.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <stdexcept>
+
+namespace
+{
+// Draws per object before it is left out.
+const int kPlacementAttempts = 100;
+
+// Length, width, height of cars, pedestrians and cyclists, and the range
+// of their reflectivity.
+const float kObjectSizes[3][3] = {{3.9f, 1.6f, 1.56f},
+                                  {0.8f, 0.6f, 1.73f},
+                                  {1.76f, 0.6f, 1.73f}};
+const float kObjectReflectivity[3][2] = {{0.3f, 0.9f}, {0.2f, 0.5f},
+                                         {0.3f, 0.7f}};
+const float kGroundColor = 0.4f;
+
+// Uniform in [0, 1) from the upper 53 bits.
+double uniform(std::mt19937_64 &engine)
+{
+  return (engine() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Box-Muller, the first uniform is moved into (0, 1] to avoid log(0).
+double normal(std::mt19937_64 &engine)
+{
+  const double u1 = 1.0 - uniform(engine);
+  const double u2 = uniform(engine);
+  return std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * M_PI * u2);
+}
+
+float wrapAngle(float angle)
+{
+  while (angle < -M_PI)
+    angle += 2 * M_PI;
+  while (angle > M_PI)
+    angle -= 2 * M_PI;
+  return angle;
+}
+
+// An object prepared for ray casting.
+struct SceneObject
+{
+  float x;
+  float y;
+  // Center, not bottom.
+  float z;
+  float cosYaw;
+  float sinYaw;
+  float halfExtents[3];
+  // Azimuths under which the lidar sees the object.
+  float azimuth;
+  float halfSpan;
+  float reflectivity;
+  float color[3];
+};
+
+SceneObject prepareObject(const BoundingBox3D &box, float reflectivity,
+                          const float color[3])
+{
+  SceneObject object;
+  object.x = box.x;
+  object.y = box.y;
+  object.z = box.z + 0.5f * box.height;
+  object.cosYaw = std::cos(box.yaw);
+  object.sinYaw = std::sin(box.yaw);
+  object.halfExtents[0] = 0.5f * box.length;
+  object.halfExtents[1] = 0.5f * box.width;
+  object.halfExtents[2] = 0.5f * box.height;
+  object.azimuth = std::atan2(box.y, box.x);
+  object.halfSpan = static_cast<float>(M_PI);
+  const float radius = std::hypot(object.halfExtents[0], object.halfExtents[1]);
+  if (std::hypot(box.x, box.y) > radius)
+  {
+    // The corners bound the azimuths of the footprint.
+    object.halfSpan = 0.0f;
+    for (int corner = 0; corner < 4; ++corner)
+    {
+      const float along = (corner & 1 ? 1 : -1) * object.halfExtents[0];
+      const float across = (corner & 2 ? 1 : -1) * object.halfExtents[1];
+      const float azimuth =
+          std::atan2(box.y + object.sinYaw * along + object.cosYaw * across,
+                     box.x + object.cosYaw * along - object.sinYaw * across);
+      object.halfSpan = std::max(object.halfSpan,
+                                 std::abs(wrapAngle(azimuth - object.azimuth)));
+    }
+    object.halfSpan += 1e-4f;
+  }
+  object.reflectivity = reflectivity;
+  std::copy(color, color + 3, object.color);
+  return object;
+}
+
+// Slab test in the frame of the object for a ray from the origin. Returns the
+// distance to the entry point, or infinity, and the cosine between the ray and
+// the normal of the face that is hit.
+float intersectObject(const SceneObject &object, const float direction[3],
+                      float &cosIncidence)
+{
+  const float origin[3] = {
+      -object.cosYaw * object.x - object.sinYaw * object.y,
+      object.sinYaw * object.x - object.cosYaw * object.y, -object.z};
+  const float rotated[3] = {
+      object.cosYaw * direction[0] + object.sinYaw * direction[1],
+      -object.sinYaw * direction[0] + object.cosYaw * direction[1],
+      direction[2]};
+
+  float near = -std::numeric_limits<float>::infinity();
+  float far = std::numeric_limits<float>::infinity();
+  int face = 0;
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    const float halfExtent = object.halfExtents[axis];
+    if (rotated[axis] == 0.0f)
+    {
+      if (std::abs(origin[axis]) > halfExtent)
+        return std::numeric_limits<float>::infinity();
+      continue;
+    }
+    float t1 = (-halfExtent - origin[axis]) / rotated[axis];
+    float t2 = (halfExtent - origin[axis]) / rotated[axis];
+    if (t1 > t2)
+      std::swap(t1, t2);
+    if (t1 > near)
+    {
+      near = t1;
+      face = axis;
+    }
+    far = std::min(far, t2);
+  }
+  // Rays starting inside an object are not returned.
+  if (near > far || near <= 0.0f)
+    return std::numeric_limits<float>::infinity();
+  cosIncidence = std::abs(rotated[face]);
+  return near;
+}
+
+std::vector<BoundingBox3D> placeObjects(const SceneParameters &scene,
+                                        float ground, std::mt19937_64 &engine,
+                                        std::vector<SceneObject> &prepared)
+{
+  std::vector<BoundingBox3D> objects;
+  std::vector<PreparedBox> footprints;
+  std::vector<float> radii;
+  for (size_t classId = 0; classId < scene.objectCounts.size(); ++classId)
+  {
+    for (int i = 0; i < scene.objectCounts[classId]; ++i)
+    {
+      for (int attempt = 0; attempt < kPlacementAttempts; ++attempt)
+      {
+        BoundingBox3D box = {};
+        box.x = static_cast<float>(scene.xMin +
+                                   uniform(engine) * (scene.xMax - scene.xMin));
+        box.y = static_cast<float>(scene.yMin +
+                                   uniform(engine) * (scene.yMax - scene.yMin));
+        box.yaw = static_cast<float>(M_PI * (2 * uniform(engine) - 1));
+        // Sizes vary by 10% around the class mean.
+        box.length = static_cast<float>(kObjectSizes[classId][0] *
+                                        (0.95 + 0.1 * uniform(engine)));
+        box.width = static_cast<float>(kObjectSizes[classId][1] *
+                                       (0.95 + 0.1 * uniform(engine)));
+        box.height = static_cast<float>(kObjectSizes[classId][2] *
+                                        (0.95 + 0.1 * uniform(engine)));
+        box.z = ground;
+        box.classId = static_cast<float>(classId);
+        const float reflectivity = static_cast<float>(
+            kObjectReflectivity[classId][0] +
+            uniform(engine) *
+                (kObjectReflectivity[classId][1] - kObjectReflectivity[classId][0]));
+        float color[3];
+        for (auto &channel : color)
+          channel = static_cast<float>(uniform(engine));
+
+        // Keep a metre between the lidar and the objects.
+        const float radius = 0.5f * std::hypot(box.length, box.width);
+        if (std::hypot(box.x, box.y) < radius + 1.0f)
+          continue;
+        const PreparedBox footprint = prepareBox(box);
+        bool collides = false;
+        for (size_t other = 0; other < footprints.size() && !collides; ++other)
+        {
+          collides =
+              std::hypot(box.x - objects[other].x, box.y - objects[other].y) <
+                  radius + radii[other] &&
+              boxOverlap(footprint, footprints[other], IouMetric::Bev) > 0;
+        }
+        if (collides)
+          continue;
+        objects.emplace_back(box);
+        footprints.emplace_back(footprint);
+        radii.push_back(radius);
+        prepared.emplace_back(prepareObject(box, reflectivity, color));
+        break;
+      }
+    }
+  }
+  return objects;
+}
+} // namespace
+
+SyntheticFrame generateScene(const LidarParameters &lidar,
+                             const SceneParameters &scene, uint64_t seed)
+{
+  if (lidar.beams < 0 || !(lidar.azimuthResolution > 0) ||
+      !(lidar.maxRange > lidar.minRange))
+  {
+    throw std::runtime_error("Invalid lidar parameters");
+  }
+  if (scene.objectCounts.size() > 3 || !(scene.xMax >= scene.xMin) ||
+      !(scene.yMax >= scene.yMin))
+  {
+    throw std::runtime_error("Invalid scene parameters");
+  }
+
+  // Objects and returns draw from separate engines, so the objects only
+  // depend on the scene parameters and the seed.
+  std::mt19937_64 objectEngine(seed);
+  std::mt19937_64 rayEngine(seed ^ 0x9e3779b97f4a7c15ull);
+
+  const float ground = -lidar.mountHeight;
+  SyntheticFrame frame;
+  frame.nbChannels = scene.colors ? 7 : 4;
+  std::vector<SceneObject> objects;
+  frame.objects = placeObjects(scene, ground, objectEngine, objects);
+
+  std::vector<float> cosElevations(lidar.beams);
+  std::vector<float> sinElevations(lidar.beams);
+  for (int beam = 0; beam < lidar.beams; ++beam)
+  {
+    const float elevation =
+        lidar.beams > 1 ? lidar.minElevation +
+                              beam * (lidar.maxElevation - lidar.minElevation) /
+                                  (lidar.beams - 1)
+                        : lidar.minElevation;
+    cosElevations[beam] = std::cos(elevation);
+    sinElevations[beam] = std::sin(elevation);
+  }
+  const int nbColumns =
+      static_cast<int>(std::ceil(2 * M_PI / lidar.azimuthResolution));
+  frame.points.reserve(static_cast<size_t>(nbColumns) * lidar.beams *
+                       frame.nbChannels);
+
+  std::vector<const SceneObject *> candidates;
+  for (int column = 0; column < nbColumns; ++column)
+  {
+    const float azimuth =
+        static_cast<float>(-M_PI + column * lidar.azimuthResolution);
+    const float cosAzimuth = std::cos(azimuth);
+    const float sinAzimuth = std::sin(azimuth);
+    candidates.clear();
+    for (const auto &object : objects)
+    {
+      if (std::abs(wrapAngle(azimuth - object.azimuth)) <= object.halfSpan)
+        candidates.push_back(&object);
+    }
+
+    for (int beam = 0; beam < lidar.beams; ++beam)
+    {
+      const float direction[3] = {cosElevations[beam] * cosAzimuth,
+                                  cosElevations[beam] * sinAzimuth,
+                                  sinElevations[beam]};
+      float range = std::numeric_limits<float>::infinity();
+      float cosIncidence = 0.0f;
+      const SceneObject *hit = nullptr;
+      if (direction[2] < 0.0f)
+      {
+        range = ground / direction[2];
+        cosIncidence = -direction[2];
+      }
+      for (const SceneObject *object : candidates)
+      {
+        float objectCosIncidence = 0.0f;
+        const float objectRange =
+            intersectObject(*object, direction, objectCosIncidence);
+        if (objectRange < range)
+        {
+          range = objectRange;
+          cosIncidence = objectCosIncidence;
+          hit = object;
+        }
+      }
+      if (range < lidar.minRange || range > lidar.maxRange)
+        continue;
+
+      const double rangeError = normal(rayEngine);
+      const double intensityError = normal(rayEngine);
+      if (lidar.dropProbability > 0 && uniform(rayEngine) < lidar.dropProbability)
+        continue;
+
+      const float reflectivity = hit ? hit->reflectivity : lidar.groundReflectivity;
+      const float intensity = static_cast<float>(
+          reflectivity * cosIncidence *
+              (1 - lidar.rangeFalloff * range / lidar.maxRange) +
+          lidar.intensityNoise * intensityError);
+      range += static_cast<float>(lidar.rangeNoise * rangeError);
+      for (const float coordinate : direction)
+        frame.points.push_back(range * coordinate);
+      frame.points.push_back(std::min(std::max(intensity, 0.0f), 1.0f));
+      if (scene.colors)
+      {
+        for (int channel = 0; channel < 3; ++channel)
+          frame.points.push_back(hit ? hit->color[channel] : kGroundColor);
+      }
+    }
+  }
+  return frame;
+}
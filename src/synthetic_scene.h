@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "geometry.h"
+
+// Synthetic lidar frames for tests and benchmarks without a dataset: a
+// spinning lidar is ray cast against a flat ground and a seeded set of
+// rotated boxes standing on it.
+
+// A spinning lidar at the origin of the lidar coordinates, the defaults are
+// close to the Velodyne HDL-64E of KITTI.
+struct LidarParameters
+{
+  int beams = 64;
+  // Elevations of the lowest and highest beam in rad, the beams are spread
+  // evenly in between.
+  float minElevation = -0.4328f;
+  float maxElevation = 0.0349f;
+  // Angle between two firings of a beam in rad, the lidar turns once.
+  float azimuthResolution = 0.0015f;
+  float minRange = 1.0f;
+  float maxRange = 120.0f;
+  // Height of the lidar above the ground, which is at z = -mountHeight.
+  float mountHeight = 1.73f;
+  // Standard deviation of the range error in m.
+  float rangeNoise = 0.02f;
+  // Probability that a return gets lost.
+  float dropProbability = 0.0f;
+  // Intensity is reflectivity * |cos(incidence)| * (1 - rangeFalloff *
+  // range / maxRange) plus normal noise, clamped to [0, 1].
+  float groundReflectivity = 0.15f;
+  float rangeFalloff = 0.3f;
+  float intensityNoise = 0.02f;
+};
+
+struct SceneParameters
+{
+  // Number of cars, pedestrians and cyclists, which get the class ids 0, 1
+  // and 2 as in config.py.
+  std::vector<int> objectCounts = {15, 6, 4};
+  // Area the object centers are drawn from. Objects do not overlap in BEV,
+  // objects that do not fit after a number of draws are left out.
+  float xMin = 2.0f;
+  float xMax = 70.0f;
+  float yMin = -35.0f;
+  float yMax = 35.0f;
+  // Adds r, g, b channels, i.e. points of 7 instead of 4 channels.
+  bool colors = false;
+};
+
+struct SyntheticFrame
+{
+  int nbChannels = 4;
+  // Row major (n, nbChannels) points: x, y, z, intensity and optionally r,
+  // g, b.
+  std::vector<float> points;
+  // Label boxes as returned by kittiLabelsToLidar: z is the bottom of the box
+  // and classId is set.
+  std::vector<BoundingBox3D> objects;
+};
+
+// Ray casts one frame. Every beam is fired at each azimuth step and returns
+// the closest hit within the range limits, if any. The result only depends
+// on the parameters and the seed.
+SyntheticFrame generateScene(const LidarParameters &lidar,
+                             const SceneParameters &scene, uint64_t seed);
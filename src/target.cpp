@@ -0,0 +1,630 @@
+#define _USE_MATH_DEFINES
+#include "target.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "arena.h"
+#include "instrumentation.h"
+
+namespace
+{
+int clip(int n, int lower, int upper)
+{
+  return std::max(lower, std::min(n, upper));
+}
+
+// Writes the regression channels of a positive target which do not depend on
+// the cell position (channels 3 to 9).
+void encodeTarget(float *target, const BoundingBox3D &labelBox,
+                  const BoundingBox3D &anchorBox)
+{
+  target[3] = (labelBox.z - anchorBox.z) / anchorBox.height;
+
+  target[4] = std::log(labelBox.length / anchorBox.length);
+  target[5] = std::log(labelBox.width / anchorBox.width);
+  target[6] = std::log(labelBox.height / anchorBox.height);
+
+  // Reduce angle to an interval of [-pi/2, pi/2] so that
+  // the sine is invertible. The angle is the delta angle
+  // of a *not oriented* box.
+  const float delta_yaw_no =
+      std::fmod(labelBox.yaw - anchorBox.base_yaw, M_PI);
+  target[7] = std::sin(std::abs(delta_yaw_no) > M_PI_2 ? -delta_yaw_no
+                                                       : delta_yaw_no);
+  // Encode whether the heading of the vehicle has to be
+  // flipped around. The heading must be flipped if
+  // delta angle > 90 and < 270. The angle is an oriented
+  // angle.
+  const float delta_yaw_o =
+      std::fmod(labelBox.yaw - anchorBox.base_yaw, 2 * M_PI);
+  if (std::abs(delta_yaw_o) > M_PI_2 && std::abs(delta_yaw_o) < 1.5 * M_PI)
+  {
+    target[8] = 1;
+  }
+  else
+  {
+    target[8] = 0;
+  }
+
+  target[9] = labelBox.classId;
+}
+
+// An anchor prepared for matching against one particular object. Everything
+// that only depends on the object/anchor pair is computed once and shared by
+// all cells of the search window.
+struct AnchorMatch
+{
+  // Corners relative to the cell position, rotated by the effective yaw.
+  Rectangle2D offsets;
+  float area = 0;
+  float diag = 0;
+  // Occupancy and cell independent regression channels.
+  float target[10] = {};
+};
+
+// Writes a positive target of an anchor located at (x, y).
+void writePositiveTarget(float *target, const AnchorMatch &match,
+                         const BoundingBox3D &labelBox, float x, float y)
+{
+  std::copy(match.target, match.target + 10, target);
+  target[1] = (labelBox.x - x) / match.diag;
+  target[2] = (labelBox.y - y) / match.diag;
+}
+
+// Radius (in cells) of the Gaussian such that a box shifted by it still has
+// at least minOverlap IoU with the object, cf. CornerNet / CenterPoint.
+float gaussianRadius(float length, float width, float minOverlap)
+{
+  const float b1 = length + width;
+  const float c1 = width * length * (1 - minOverlap) / (1 + minOverlap);
+  const float r1 = (b1 + std::sqrt(b1 * b1 - 4 * c1)) / 2;
+
+  const float b2 = 2 * (length + width);
+  const float c2 = (1 - minOverlap) * width * length;
+  const float r2 = (b2 + std::sqrt(b2 * b2 - 16 * c2)) / 2;
+
+  const float a3 = 4 * minOverlap;
+  const float b3 = -2 * minOverlap * (length + width);
+  const float c3 = (minOverlap - 1) * width * length;
+  const float r3 = (b3 + std::sqrt(b3 * b3 - 4 * a3 * c3)) / 2;
+
+  return std::min(r1, std::min(r2, r3));
+}
+
+// Anchors bound to a class (classId >= 0) are only matched against objects of
+// that class, unbound anchors (classId < 0) against every object.
+bool anchorMatchesClass(const BoundingBox3D &anchorBox, int classId)
+{
+  return anchorBox.classId < 0 || static_cast<int>(anchorBox.classId) == classId;
+}
+
+// Returns the anchor whose (not oriented) yaw is closest to the object yaw.
+// Anchors of equal orientation are ranked by how well their footprint fits.
+// Returns -1 if no anchor is available for the class of the object.
+int bestAlignedAnchor(const BoundingBox3D &labelBox,
+                      const std::vector<BoundingBox3D> &anchorBoxes)
+{
+  int bestId = -1;
+  float bestDelta = std::numeric_limits<float>::max();
+  float bestSize = std::numeric_limits<float>::max();
+  for (size_t i = 0; i < anchorBoxes.size(); ++i)
+  {
+    if (!anchorMatchesClass(anchorBoxes[i], static_cast<int>(labelBox.classId)))
+    {
+      continue;
+    }
+    const float delta_yaw_no = std::abs(
+        std::fmod(labelBox.yaw - anchorBoxes[i].base_yaw, M_PI));
+    const float delta = std::min<float>(delta_yaw_no, M_PI - delta_yaw_no);
+    const float size = std::abs(
+        std::log((labelBox.length * labelBox.width) /
+                 (anchorBoxes[i].length * anchorBoxes[i].width)));
+    if (delta < bestDelta - 1e-3f ||
+        (delta < bestDelta + 1e-3f && size < bestSize))
+    {
+      bestId = static_cast<int>(i);
+      bestDelta = std::min(delta, bestDelta);
+      bestSize = size;
+    }
+  }
+  return bestId;
+}
+
+} // namespace
+
+int TargetParameters::xSize() const
+{
+  return static_cast<int>(std::floor((xMax - xMin) / (xStep * downscalingFactor)));
+}
+
+int TargetParameters::ySize() const
+{
+  return static_cast<int>(std::floor((yMax - yMin) / (yStep * downscalingFactor)));
+}
+
+size_t TargetParameters::targetSize(size_t nbObjects) const
+{
+  return nbObjects * xSize() * ySize() * anchors.size() * 10;
+}
+
+TargetStatistics createTarget(const std::vector<BoundingBox3D> &objects,
+                              const TargetParameters &parameters,
+                              float *tensor, std::ostream *log)
+{
+  StageTimer timer(Stage::Target);
+  FrameScope frame;
+  const auto &anchorBoxes = parameters.anchors;
+  const float defaultPositiveThreshold = parameters.positiveThreshold;
+  const float defaultNegativeThreshold = parameters.negativeThreshold;
+  const float angle_threshold = parameters.angleThreshold;
+  const int downscalingFactor = parameters.downscalingFactor;
+  const float xStep = parameters.xStep;
+  const float yStep = parameters.yStep;
+  const float xMin = parameters.xMin;
+  const float xMax = parameters.xMax;
+  const float yMin = parameters.yMin;
+  const float yMax = parameters.yMax;
+  const auto &classAssignmentModes = parameters.classAssignmentModes;
+  const float centerMinOverlap = parameters.centerMinOverlap;
+  const int centerMinRadius = parameters.centerMinRadius;
+  const auto &classPositiveThresholds = parameters.classPositiveThresholds;
+  const auto &classNegativeThresholds = parameters.classNegativeThresholds;
+  const bool verbose = log != nullptr;
+
+  const int xSize = parameters.xSize();
+  const int ySize = parameters.ySize();
+
+  const int nbAnchors = anchorBoxes.size();
+  const int nbObjects = objects.size();
+
+  FrameVector<float> anchorDiagonals;
+  FrameVector<float> anchorCos;
+  FrameVector<float> anchorSin;
+  for (const auto &anchorBox : anchorBoxes)
+  {
+    anchorDiagonals.emplace_back(std::sqrt(std::pow(anchorBox.width, 2) +
+                                           std::pow(anchorBox.length, 2)));
+    anchorCos.emplace_back(std::cos(anchorBox.base_yaw));
+    anchorSin.emplace_back(std::sin(anchorBox.base_yaw));
+  }
+  FrameVector<AnchorMatch> anchorMatches(nbAnchors);
+
+  TargetStatistics statistics;
+
+  FrameVector<BoundingBox3D> labelBoxes;
+  for (int i = 0; i < nbObjects; ++i)
+  {
+    float x = objects[i].x;
+    float y = objects[i].y;
+    // Exclude equality on max values since this does not find into the
+    // discretized grid.
+    if (x < xMin || x >= xMax || y < yMin || y >= yMax)
+    {
+      continue;
+    }
+    labelBoxes.emplace_back(objects[i]);
+    statistics.objectIds.emplace_back(i);
+  }
+
+  {
+    StageTimer zeroFillTimer(Stage::TargetZeroFill);
+    std::fill(tensor, tensor + parameters.targetSize(nbObjects), 0.0f);
+  }
+  // Channels of an anchor cell of the tensor.
+  const auto cell = [&](int objectId, int xId, int yId, int anchorId)
+  {
+    return tensor +
+           (((static_cast<size_t>(objectId) * xSize + xId) * ySize + yId) *
+                nbAnchors +
+            anchorId) *
+               10;
+  };
+
+  // Overlaps of the search window of an object, scored before they are
+  // assigned so that both phases are timed separately.
+  FrameVector<float> overlaps;
+  StageTimer iouTimer(Stage::TargetIou, false);
+  StageTimer assignmentTimer(Stage::TargetAssignment, false);
+
+  int objectCount = 0;
+  if (verbose)
+  {
+    *log << "Received " << labelBoxes.size() << " objects" << std::endl;
+  }
+  for (const auto &labelBox : labelBoxes)
+  {
+    const auto classId = static_cast<int>(labelBox.classId);
+    const bool centerAssignment =
+        classId >= 0 &&
+        classId < static_cast<int>(classAssignmentModes.size()) &&
+        classAssignmentModes[classId] == AssignmentMode::Center;
+    // Center assignment scores Gaussian weights instead of IoUs, which have
+    // thresholds of their own.
+    float positiveThreshold = parameters.centerPositiveThreshold;
+    float negativeThreshold = parameters.centerNegativeThreshold;
+    if (!centerAssignment)
+    {
+      positiveThreshold =
+          classId >= 0 && classId < static_cast<int>(classPositiveThresholds.size())
+              ? classPositiveThresholds[classId]
+              : defaultPositiveThreshold;
+      negativeThreshold =
+          classId >= 0 && classId < static_cast<int>(classNegativeThresholds.size())
+              ? classNegativeThresholds[classId]
+              : defaultNegativeThreshold;
+    }
+
+    const int alignedAnchorId = bestAlignedAnchor(labelBox, anchorBoxes);
+    if (alignedAnchorId < 0)
+    {
+      statistics.unassigned++;
+      statistics.bestIou.emplace_back(0);
+      statistics.bestAnchorIds.emplace_back(-1);
+      if (verbose)
+      {
+        *log << "\nNo anchor is bound to class " << classId << " of object "
+            << objectCount << ", skipping it." << std::endl;
+      }
+      objectCount++;
+      continue;
+    }
+
+    const auto xC = static_cast<int>(
+        std::floor((labelBox.x - xMin) / (xStep * downscalingFactor)));
+    const auto yC = static_cast<int>(
+        std::floor((labelBox.y - yMin) / (yStep * downscalingFactor)));
+
+    iouTimer.start();
+    // Resolve the anchor orientation, footprint and regression channels once
+    // per object/anchor pair instead of once per cell.
+    const float labelCos = std::cos(labelBox.yaw);
+    const float labelSin = std::sin(labelBox.yaw);
+    const auto labelPolygon = translated(
+        footprintOffsets(labelBox.length, labelBox.width, labelCos, labelSin),
+        labelBox.x, labelBox.y);
+    const float labelArea =
+        polygonArea(labelPolygon.data(), labelPolygon.size());
+    for (int anchorId = 0; anchorId < nbAnchors; ++anchorId)
+    {
+      const auto &anchorBox = anchorBoxes[anchorId];
+      auto &match = anchorMatches[anchorId];
+      if (!anchorMatchesClass(anchorBox, classId))
+      {
+        continue;
+      }
+
+      // If the angle is within the allowed threshold, rotate it onto the
+      // "label yaw" in order to sufficiently cover rotated boxes between
+      // anchors. Otherwise keep the baseline yaw.
+      const float delta_yaw_no =
+          std::fmod(labelBox.yaw - anchorBox.base_yaw, M_PI);
+      const bool rotate = std::abs(delta_yaw_no) < angle_threshold ||
+                          (M_PI - std::abs(delta_yaw_no)) < angle_threshold;
+      const float cosYaw = rotate ? labelCos : anchorCos[anchorId];
+      const float sinYaw = rotate ? labelSin : anchorSin[anchorId];
+
+      match.offsets =
+          footprintOffsets(anchorBox.length, anchorBox.width, cosYaw, sinYaw);
+      match.area = polygonArea(match.offsets.data(), match.offsets.size());
+      match.diag = anchorDiagonals[anchorId];
+      match.target[0] = 1;
+      encodeTarget(match.target, labelBox, anchorBox);
+    }
+
+    int xStart, xEnd, yStart, yEnd;
+    float sigma = 0;
+    if (centerAssignment)
+    {
+      // Only the cells covered by the Gaussian around the object center are
+      // visited, and only the anchor best aligned with the object is scored.
+      const int radius = std::max(
+          centerMinRadius,
+          static_cast<int>(gaussianRadius(
+              labelBox.length / (xStep * downscalingFactor),
+              labelBox.width / (yStep * downscalingFactor), centerMinOverlap)));
+      sigma = (2 * radius + 1) / 6.0f;
+
+      xStart = clip(xC - radius, 0, xSize);
+      xEnd = clip(xC + radius + 1, 0, xSize);
+      yStart = clip(yC - radius, 0, ySize);
+      yEnd = clip(yC + radius + 1, 0, ySize);
+    }
+    else
+    {
+      // zone-in on potential spatial area of interest
+      float objectDiameter =
+          std::sqrt(std::pow(labelBox.width, 2) + std::pow(labelBox.length, 2));
+      const auto offset = static_cast<int>(
+          std::ceil(objectDiameter / (xStep * downscalingFactor)));
+      xStart = clip(xC - offset, 0, xSize);
+      xEnd = clip(xC + offset, 0, xSize);
+      yStart = clip(yC - offset, 0, ySize);
+      yEnd = clip(yC + offset, 0, ySize);
+    }
+
+    const int windowHeight = std::max(yEnd - yStart, 0);
+    overlaps.assign(
+        static_cast<size_t>(std::max(xEnd - xStart, 0)) * windowHeight * nbAnchors,
+        0.0f);
+    for (int xId = xStart; xId < xEnd; xId++)
+    {
+      const float x = xId * xStep * downscalingFactor + xMin;
+
+      for (int yId = yStart; yId < yEnd; yId++)
+      {
+        const float y = yId * yStep * downscalingFactor + yMin;
+        float *cellOverlaps =
+            overlaps.data() +
+            (static_cast<size_t>(xId - xStart) * windowHeight + (yId - yStart)) *
+                nbAnchors;
+        for (int anchorCount = 0; anchorCount < nbAnchors; anchorCount++)
+        {
+          if (!anchorMatchesClass(anchorBoxes[anchorCount], classId))
+          {
+            continue;
+          }
+          const auto &match = anchorMatches[anchorCount];
+
+          if (!centerAssignment)
+          {
+            const float overlap = intersectionArea(
+                translated(match.offsets, x, y), labelPolygon);
+            cellOverlaps[anchorCount] =
+                overlap / (match.area + labelArea - overlap);
+          }
+          else if (anchorCount == alignedAnchorId)
+          {
+            // Gaussian weight of the distance between anchor and object center,
+            // measured in output cells.
+            const float dx = (labelBox.x - x) / (xStep * downscalingFactor);
+            const float dy = (labelBox.y - y) / (yStep * downscalingFactor);
+            cellOverlaps[anchorCount] =
+                std::exp(-(dx * dx + dy * dy) / (2 * sigma * sigma));
+          }
+        }
+      }
+    }
+    iouTimer.stop();
+
+    assignmentTimer.start();
+    float maxIou = 0;
+    int bestAnchorId = alignedAnchorId;
+    for (int xId = xStart; xId < xEnd; xId++)
+    {
+      const float x = xId * xStep * downscalingFactor + xMin;
+
+      for (int yId = yStart; yId < yEnd; yId++)
+      {
+        const float y = yId * yStep * downscalingFactor + yMin;
+        const float *cellOverlaps =
+            overlaps.data() +
+            (static_cast<size_t>(xId - xStart) * windowHeight + (yId - yStart)) *
+                nbAnchors;
+        for (int anchorCount = 0; anchorCount < nbAnchors; anchorCount++)
+        {
+          // Pairs of different classes are left at the zero initialized
+          // (negative) occupancy without being scored.
+          if (!anchorMatchesClass(anchorBoxes[anchorCount], classId))
+          {
+            continue;
+          }
+          const auto &match = anchorMatches[anchorCount];
+          const float iouOverlap = cellOverlaps[anchorCount];
+
+          if (maxIou < iouOverlap)
+          {
+            maxIou = iouOverlap;
+            bestAnchorId = anchorCount;
+          }
+
+          if (iouOverlap > positiveThreshold)
+          {
+            statistics.positives++;
+            writePositiveTarget(
+                cell(objectCount, xId, yId, anchorCount), match,
+                labelBox, x, y);
+          }
+          else if (iouOverlap < negativeThreshold)
+          {
+            statistics.negatives++;
+            cell(objectCount, xId, yId, anchorCount)[0] = 0;
+          }
+          else
+          {
+            statistics.ignored++;
+            cell(objectCount, xId, yId, anchorCount)[0] = -1;
+          }
+        }
+      }
+    }
+
+    statistics.bestIou.emplace_back(maxIou);
+    statistics.bestAnchorIds.emplace_back(bestAnchorId);
+
+    // Overrides the occupancy of an anchor inside the object slice while
+    // keeping the counters consistent. Cells outside of the search window were
+    // never counted in the first place.
+    const auto setOccupancy = [&](int xId, int yId, int anchorId, float value)
+    {
+      auto &occupancy = cell(objectCount, xId, yId, anchorId)[0];
+      if (xId >= xStart && xId < xEnd && yId >= yStart && yId < yEnd)
+      {
+        statistics.count(occupancy, -1);
+      }
+      statistics.count(value, 1);
+      occupancy = value;
+    };
+
+    if (maxIou < positiveThreshold)
+    {
+      statistics.forcedMatches++;
+      if (verbose)
+      {
+        *log << "\nThere was no sufficiently overlapping anchor anywhere "
+               "for object "
+            << objectCount << std::endl;
+        *log << "Best IOU was " << maxIou
+            << ". Adding the best location regardless of threshold."
+            << std::endl;
+      }
+
+      if (maxIou == 0)
+      {
+        // No anchor overlapped at all (e.g. the window was clipped away
+        // entirely), fall back to the anchor best aligned with the object.
+        bestAnchorId = alignedAnchorId;
+        statistics.bestAnchorIds.back() = bestAnchorId;
+      }
+
+      const auto xId_0 = xC;
+      const auto yId_0 = yC;
+
+      for (int dx = -2; dx <= 2; ++dx)
+      {
+        for (int dy = -2; dy <= 2; ++dy)
+        {
+          // Get current x and y id from xId_0 and yId_0.
+          const auto xId = clip(xId_0 + dx, 0, xSize - 1);
+          const auto yId = clip(yId_0 + dy, 0, ySize - 1);
+
+          if (dx == 0 && dy == 0)
+          {
+            // Set as occupied for the actual best anchor.
+
+            // The best anchor can be at various locations in case the object is
+            // large and covering multiple boxes completely (e.g. bus).
+            // Assume that the best anchor is still the one with the right shape
+            // at this location.
+            const float x = xId * xStep * downscalingFactor + xMin;
+            const float y = yId * yStep * downscalingFactor + yMin;
+
+            setOccupancy(xId, yId, bestAnchorId, 1);
+            writePositiveTarget(
+                cell(objectCount, xId, yId, bestAnchorId),
+                anchorMatches[bestAnchorId], labelBox, x, y);
+          }
+          else if (xId_0 + dx >= 0 && xId_0 + dx < xSize && yId_0 + dy >= 0 &&
+                   yId_0 + dy < ySize)
+          {
+            // Make sure the the neighboring field would still be in the range.
+            // Otherwise the clipped value could override
+            // the positive anchor.
+
+            // Set to -1 in order to do not penalize for scores in the
+            // surrounding of the object.
+            setOccupancy(xId, yId, bestAnchorId, -1);
+          }
+        }
+      }
+    }
+    else
+    {
+      if (verbose)
+      {
+        *log << "\nAt least 1 anchor was positively matched for object "
+            << objectCount << std::endl;
+        *log << "Best IOU was " << maxIou << "." << std::endl;
+      }
+    }
+    assignmentTimer.stop();
+
+    objectCount++;
+  }
+
+  return statistics;
+}
+
+
+void selectBestAnchors(const float *target, size_t nbObjects, size_t nbCells,
+                       float *merged)
+{
+  if (nbObjects == 0)
+  {
+    std::fill(merged, merged + nbCells * 10, 0.0f);
+    return;
+  }
+
+  const size_t objectSize = nbCells * 10;
+  for (size_t cell = 0; cell < nbCells; ++cell)
+  {
+    const float *best = target + cell * 10;
+    for (size_t objectId = 1; objectId < nbObjects; ++objectId)
+    {
+      const float *candidate = target + objectId * objectSize + cell * 10;
+      if (candidate[0] > best[0])
+      {
+        best = candidate;
+      }
+    }
+    std::copy(best, best + 10, merged + cell * 10);
+  }
+}
+
+OccupancyCheck checkOccupancy(const float *target, const float *predicted,
+                              size_t size, long nbPredictions,
+                              const std::vector<float> &thresholds)
+{
+  OccupancyCheck check;
+  for (size_t i = 0; i < size; ++i)
+  {
+    check.targetPositives += target[i] == 1.0f;
+  }
+
+  const size_t nbSelected = std::min(
+      size, nbPredictions < 0 ? check.targetPositives
+                              : static_cast<size_t>(nbPredictions));
+  if (nbSelected == 0)
+  {
+    check.threshold = std::numeric_limits<float>::infinity();
+  }
+  else
+  {
+    std::vector<float> values(predicted, predicted + size);
+    const auto nth = values.begin() + (size - nbSelected);
+    std::nth_element(values.begin(), nth, values.end());
+    check.threshold = *nth;
+  }
+
+  // Thresholds are counted in ascending order: a cell is above all thresholds
+  // before its upper bound.
+  check.thresholds = thresholds;
+  std::sort(check.thresholds.begin(), check.thresholds.end());
+  const size_t nbThresholds = check.thresholds.size();
+  std::vector<size_t> truePositives(nbThresholds + 1, 0);
+  std::vector<size_t> predictedPositives(nbThresholds + 1, 0);
+
+  size_t nbPredicted = 0;
+  for (size_t i = 0; i < size; ++i)
+  {
+    const bool positive = target[i] == 1.0f;
+    const bool selected = predicted[i] >= check.threshold;
+    nbPredicted += selected;
+    check.matched += positive && selected;
+
+    const size_t above = std::upper_bound(check.thresholds.begin(),
+                                          check.thresholds.end(),
+                                          predicted[i]) -
+                         check.thresholds.begin();
+    predictedPositives[above] += 1;
+    truePositives[above] += positive;
+  }
+  check.unmatchedTargets = check.targetPositives - check.matched;
+  check.unmatchedPredictions = nbPredicted - check.matched;
+
+  // Cells above threshold t are the ones counted at t + 1 and later.
+  check.truePositives.assign(nbThresholds, 0);
+  check.predictedPositives.assign(nbThresholds, 0);
+  size_t tp = 0;
+  size_t predictedCount = 0;
+  for (size_t t = nbThresholds; t-- > 0;)
+  {
+    tp += truePositives[t + 1];
+    predictedCount += predictedPositives[t + 1];
+    check.truePositives[t] = tp;
+    check.predictedPositives[t] = predictedCount;
+  }
+  return check;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+#include "geometry.h"
+
+// How anchors are matched to the objects of a class.
+enum class AssignmentMode
+{
+  // Rotated BEV IoU between anchor and object (original PointPillars).
+  Iou = 0,
+  // Gaussian weight of the BEV center distance (CenterPoint style).
+  Center = 1,
+};
+
+// Assignment diagnostics gathered while createPillarsTarget fills the target
+// tensor. Counts refer to the anchors evaluated inside the search windows of
+// the objects, i.e. one count per (object, cell, anchor) triple that was
+// visited.
+struct TargetStatistics
+{
+  int positives = 0;
+  int negatives = 0;
+  int ignored = 0;
+  // Number of objects without any anchor above the positive threshold which
+  // were matched to their best anchor regardless.
+  int forcedMatches = 0;
+  // Number of objects left without target since no anchor is bound to their
+  // class.
+  int unassigned = 0;
+  // Per object entries, aligned with the first dimension of the target tensor.
+  std::vector<int> objectIds;
+  // Best matching score, i.e. the IoU or, for center assignment, the Gaussian
+  // weight of the best anchor.
+  std::vector<float> bestIou;
+  std::vector<int> bestAnchorIds;
+
+  void count(float occupancy, int delta)
+  {
+    if (occupancy > 0)
+      positives += delta;
+    else if (occupancy < 0)
+      ignored += delta;
+    else
+      negatives += delta;
+  }
+};
+
+// Raised whenever the meaning of the target channels changes, so that targets
+// cached under an older meaning are recomputed. 2: heading channel.
+const int kTargetFormatVersion = 2;
+
+// Everything the target of a sample depends on apart from its objects.
+struct TargetParameters
+{
+  std::vector<BoundingBox3D> anchors;
+  float positiveThreshold = 0.6f;
+  float negativeThreshold = 0.3f;
+  float angleThreshold = 0.3f;
+  int nbClasses = 1;
+  int downscalingFactor = 2;
+  float xStep = 0.16f;
+  float yStep = 0.16f;
+  float xMin = 0.0f;
+  float xMax = 80.64f;
+  float yMin = -40.32f;
+  float yMax = 40.32f;
+  float zMin = -1.0f;
+  float zMax = 3.0f;
+  // Per class overrides, classes without entry use IoU assignment and the
+  // global thresholds.
+  std::vector<AssignmentMode> classAssignmentModes;
+  float centerMinOverlap = 0.1f;
+  int centerMinRadius = 2;
+  // IoU thresholds of the classes using IoU assignment.
+  std::vector<float> classPositiveThresholds;
+  std::vector<float> classNegativeThresholds;
+  // Gaussian weight thresholds of the classes using center assignment. With
+  // the minimum radius (sigma of 5/6 cells), weights above 0.5 are within
+  // about one output cell of the object center, weights below 0.1 farther
+  // than 1.8 cells.
+  float centerPositiveThreshold = 0.5f;
+  float centerNegativeThreshold = 0.1f;
+
+  // Size of the output grid.
+  int xSize() const;
+  int ySize() const;
+  // Number of floats of the target of nbObjects objects.
+  size_t targetSize(size_t nbObjects) const;
+};
+
+// Fills the target tensor (objects.size(), xSize, ySize, anchors, 10):
+// channel 0 is the occupancy (1 positive, 0 negative, -1 ignored), 1 to 3 the
+// position, 4 to 6 the log size ratios, 7 the angle, 8 the heading (1 if the
+// object faces more than 90 degrees away from the anchor) and 9 the class.
+// Objects outside of the grid keep an all zero slice at the end of the
+// tensor. Per object messages are written to log if given.
+TargetStatistics createTarget(const std::vector<BoundingBox3D> &objects,
+                              const TargetParameters &parameters,
+                              float *tensor, std::ostream *log = nullptr);
+
+// Merges the object slices of a target into one (xSize, ySize, anchors, 10)
+// target by picking, per anchor cell, the slice of the highest occupancy (the
+// first one on ties), as select_best_anchors in processors.py does.
+void selectBestAnchors(const float *target, size_t nbObjects, size_t nbCells,
+                       float *merged);
+
+// Agreement of a predicted occupancy map with its target, as reported by
+// focal_loss_checker in inference_utils.py.
+struct OccupancyCheck
+{
+  // Predictions are the cells at or above threshold, the value of the
+  // nbPredictions-th highest cell.
+  float threshold = 0.0f;
+  size_t matched = 0;
+  size_t unmatchedTargets = 0;
+  size_t unmatchedPredictions = 0;
+  // Counts for the requested thresholds, so that frames can be summed up.
+  size_t targetPositives = 0;
+  std::vector<float> thresholds;
+  std::vector<size_t> truePositives;
+  std::vector<size_t> predictedPositives;
+};
+
+// Compares size cells of a target occupancy (positives are 1) with the
+// predicted occupancy. nbPredictions < 0 takes as many predictions as there
+// are positives. Runs in linear time: the threshold is found by selection
+// instead of a sort, and all thresholds are counted in one pass.
+OccupancyCheck checkOccupancy(const float *target, const float *predicted,
+                              size_t size, long nbPredictions,
+                              const std::vector<float> &thresholds);
@@ -0,0 +1,240 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace
+{
+// A slot of a ring buffer. The fields are written by the owning thread only
+// and read by chromeTrace at any time; sequence is zero while a write is in
+// progress and the event number plus one afterwards, a seqlock per slot.
+struct TraceSlot
+{
+  std::atomic<uint64_t> sequence{0};
+  std::atomic<const char *> name{nullptr};
+  std::atomic<uint64_t> timestamp{0};
+  std::atomic<char> phase{0};
+};
+
+struct ThreadBuffer
+{
+  ThreadBuffer(size_t capacity, int threadId)
+      : slots(new TraceSlot[capacity]), mask(capacity - 1), threadId(threadId)
+  {
+  }
+
+  std::unique_ptr<TraceSlot[]> slots;
+  const size_t mask;
+  const int threadId;
+  // Number of events written.
+  std::atomic<uint64_t> head{0};
+  // Events before this one were cleared.
+  std::atomic<uint64_t> cleared{0};
+};
+
+struct TraceEvent
+{
+  const char *name;
+  uint64_t timestamp;
+  char phase;
+};
+
+const std::chrono::steady_clock::time_point epoch =
+    std::chrono::steady_clock::now();
+
+std::atomic<bool> tracing{false};
+std::atomic<size_t> traceCapacity{kDefaultTraceCapacity};
+
+std::mutex registryMutex;
+std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+int nextThreadId = 0;
+
+ThreadBuffer &threadBuffer()
+{
+  thread_local std::shared_ptr<ThreadBuffer> buffer;
+  if (!buffer)
+  {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    buffer = std::make_shared<ThreadBuffer>(
+        traceCapacity.load(std::memory_order_relaxed), nextThreadId++);
+    buffers.push_back(buffer);
+  }
+  return *buffer;
+}
+
+void record(const char *name, char phase)
+{
+  const uint64_t timestamp =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - epoch)
+          .count();
+  ThreadBuffer &buffer = threadBuffer();
+  const uint64_t index = buffer.head.load(std::memory_order_relaxed);
+  TraceSlot &slot = buffer.slots[index & buffer.mask];
+  slot.sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.name.store(name, std::memory_order_relaxed);
+  slot.timestamp.store(timestamp, std::memory_order_relaxed);
+  slot.phase.store(phase, std::memory_order_relaxed);
+  slot.sequence.store(index + 1, std::memory_order_release);
+  buffer.head.store(index + 1, std::memory_order_release);
+}
+
+// The events still in the buffer, oldest first. Slots that are rewritten
+// while they are read are skipped.
+std::vector<TraceEvent> readEvents(const ThreadBuffer &buffer)
+{
+  const uint64_t head = buffer.head.load(std::memory_order_acquire);
+  const uint64_t capacity = buffer.mask + 1;
+  const uint64_t begin = std::max(buffer.cleared.load(std::memory_order_relaxed),
+                                  head > capacity ? head - capacity : 0);
+  std::vector<TraceEvent> events;
+  events.reserve(head - begin);
+  for (uint64_t index = begin; index < head; ++index)
+  {
+    const TraceSlot &slot = buffer.slots[index & buffer.mask];
+    const uint64_t before = slot.sequence.load(std::memory_order_acquire);
+    TraceEvent event;
+    event.name = slot.name.load(std::memory_order_relaxed);
+    event.timestamp = slot.timestamp.load(std::memory_order_relaxed);
+    event.phase = slot.phase.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t after = slot.sequence.load(std::memory_order_relaxed);
+    if (before == index + 1 && after == index + 1)
+    {
+      events.push_back(event);
+    }
+  }
+  return events;
+}
+
+void appendEscaped(std::string &json, const char *text)
+{
+  for (const char *c = text; *c != '\0'; ++c)
+  {
+    if (*c == '"' || *c == '\\')
+    {
+      json += '\\';
+      json += *c;
+    }
+    else if (static_cast<unsigned char>(*c) < 0x20)
+    {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", *c);
+      json += escaped;
+    }
+    else
+    {
+      json += *c;
+    }
+  }
+}
+} // namespace
+
+void setTracingEnabled(bool enabled, size_t capacity)
+{
+  size_t rounded = 2;
+  while (rounded < capacity)
+    rounded <<= 1;
+  traceCapacity.store(rounded, std::memory_order_relaxed);
+  tracing.store(enabled, std::memory_order_relaxed);
+}
+
+bool tracingEnabled()
+{
+  return tracing.load(std::memory_order_relaxed);
+}
+
+void traceBegin(const char *name)
+{
+  record(name, 'B');
+}
+
+void traceEnd(const char *name)
+{
+  record(name, 'E');
+}
+
+const char *internTraceName(const std::string &name)
+{
+  static std::mutex mutex;
+  static std::set<std::string> names;
+  std::lock_guard<std::mutex> lock(mutex);
+  return names.insert(name).first->c_str();
+}
+
+void clearTrace()
+{
+  std::lock_guard<std::mutex> lock(registryMutex);
+  // Only the registry holds the buffers of finished threads.
+  buffers.erase(std::remove_if(buffers.begin(), buffers.end(),
+                               [](const std::shared_ptr<ThreadBuffer> &buffer) {
+                                 return buffer.use_count() == 1;
+                               }),
+                buffers.end());
+  for (const auto &buffer : buffers)
+  {
+    buffer->cleared.store(buffer->head.load(std::memory_order_acquire),
+                          std::memory_order_relaxed);
+  }
+}
+
+std::string chromeTrace()
+{
+  std::vector<std::shared_ptr<ThreadBuffer>> snapshot;
+  {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    snapshot = buffers;
+  }
+
+  std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  char number[64];
+  for (const auto &buffer : snapshot)
+  {
+    const std::vector<TraceEvent> events = readEvents(*buffer);
+    if (events.empty())
+      continue;
+
+    std::snprintf(number, sizeof(number), "%d", buffer->threadId);
+    json += first ? "" : ",";
+    first = false;
+    json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":";
+    json += number;
+    json += ",\"args\":{\"name\":\"native thread ";
+    json += number;
+    json += "\"}}";
+
+    int depth = 0;
+    for (const TraceEvent &event : events)
+    {
+      if (event.phase == 'E')
+      {
+        // The begin of this span was overwritten or cleared.
+        if (depth == 0)
+          continue;
+        --depth;
+      }
+      else
+      {
+        ++depth;
+      }
+      json += ",{\"name\":\"";
+      appendEscaped(json, event.name);
+      json += "\",\"ph\":\"";
+      json += event.phase;
+      std::snprintf(number, sizeof(number), "\",\"pid\":0,\"tid\":%d,\"ts\":%.3f}",
+                    buffer->threadId, event.timestamp / 1000.0);
+      json += number;
+    }
+  }
+  json += "]}";
+  return json;
+}
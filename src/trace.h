@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Begin/end events of the native stages for the Chrome trace viewer
+// (chrome://tracing, ui.perfetto.dev). Every thread writes into its own ring
+// buffer without locks, the oldest events are overwritten once it is full.
+// Buffers of finished threads are kept until the trace is cleared, so the
+// events of pipeline workers survive their pipeline.
+
+// Events per thread of the buffers created while tracing is on, rounded up to
+// a power of two.
+const size_t kDefaultTraceCapacity = 1 << 16;
+
+void setTracingEnabled(bool enabled, size_t capacity = kDefaultTraceCapacity);
+
+bool tracingEnabled();
+
+// Name must outlive the trace, e.g. a string literal or internTraceName.
+void traceBegin(const char *name);
+void traceEnd(const char *name);
+
+// Copy of a name for the lifetime of the process, for names that are not
+// literals. Takes a lock, equal names share one copy.
+const char *internTraceName(const std::string &name);
+
+// Drops the events recorded so far and the buffers of finished threads.
+void clearTrace();
+
+// The trace in the JSON object format of the Chrome trace viewer, timestamps
+// in microseconds since the module was loaded. End events whose
+// begin was overwritten are left out.
+std::string chromeTrace();
+
+// A span from construction to destruction, if tracing was on at construction.
+class TraceScope
+{
+public:
+  explicit TraceScope(const char *name)
+      : name_(tracingEnabled() ? name : nullptr)
+  {
+    if (name_)
+      traceBegin(name_);
+  }
+  ~TraceScope()
+  {
+    if (name_)
+      traceEnd(name_);
+  }
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+  const char *name_;
+};
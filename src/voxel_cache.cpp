@@ -0,0 +1,444 @@
+#include "voxel_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "mapped_file.h"
+
+namespace
+{
+const char kCacheMagic[8] = {'P', 'P', 'C', 'A', 'C', 'H', 'E', '\0'};
+// Raised whenever the meaning of cached outputs changes, entries of other
+// versions are misses. 2: heading channel of the targets.
+const uint32_t kCacheVersion = 2;
+const uint32_t kPillarKind = 1;
+const uint32_t kTargetKind = 2;
+const int kTargetChannels = 10;
+
+uint64_t rotateLeft(uint64_t value, int bits)
+{
+  return (value << bits) | (value >> (64 - bits));
+}
+
+uint64_t finalize(uint64_t h)
+{
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+class BinaryWriter
+{
+public:
+  template <class T>
+  void put(const T &value)
+  {
+    buffer_.append(reinterpret_cast<const char *>(&value), sizeof(T));
+  }
+
+  template <class T>
+  void putVector(const std::vector<T> &values)
+  {
+    put<uint64_t>(values.size());
+    if (!values.empty())
+    {
+      buffer_.append(reinterpret_cast<const char *>(values.data()),
+                     values.size() * sizeof(T));
+    }
+  }
+
+  const std::string &buffer() const { return buffer_; }
+
+private:
+  std::string buffer_;
+};
+
+class BinaryReader
+{
+public:
+  explicit BinaryReader(const std::string &content)
+      : cursor_(content.data()), end_(content.data() + content.size())
+  {
+  }
+
+  template <class T>
+  T get()
+  {
+    T value;
+    take(&value, sizeof(T));
+    return value;
+  }
+
+  template <class T>
+  void getVector(std::vector<T> &values)
+  {
+    const uint64_t size = get<uint64_t>();
+    if (size > static_cast<uint64_t>(end_ - cursor_) / sizeof(T))
+    {
+      throw std::runtime_error("Truncated cache entry");
+    }
+    values.resize(size);
+    if (size > 0)
+    {
+      take(values.data(), size * sizeof(T));
+    }
+  }
+
+  bool finished() const { return cursor_ == end_; }
+
+private:
+  void take(void *destination, size_t size)
+  {
+    if (size > static_cast<size_t>(end_ - cursor_))
+    {
+      throw std::runtime_error("Truncated cache entry");
+    }
+    std::memcpy(destination, cursor_, size);
+    cursor_ += size;
+  }
+
+  const char *cursor_;
+  const char *end_;
+};
+
+void putHeader(BinaryWriter &writer, uint32_t kind, uint64_t key,
+               uint64_t parameterHash)
+{
+  for (const char c : kCacheMagic)
+    writer.put(c);
+  writer.put(kCacheVersion);
+  writer.put(kind);
+  writer.put(key);
+  writer.put(parameterHash);
+}
+
+bool readHeader(BinaryReader &reader, uint32_t kind, uint64_t key,
+                uint64_t parameterHash)
+{
+  char magic[sizeof(kCacheMagic)];
+  for (char &c : magic)
+    c = reader.get<char>();
+  return std::memcmp(magic, kCacheMagic, sizeof(magic)) == 0 &&
+         reader.get<uint32_t>() == kCacheVersion &&
+         reader.get<uint32_t>() == kind && reader.get<uint64_t>() == key &&
+         reader.get<uint64_t>() == parameterHash;
+}
+
+bool readEntry(const std::string &path, std::string &content)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+  {
+    return false;
+  }
+  std::ostringstream stream;
+  stream << file.rdbuf();
+  content = stream.str();
+  return true;
+}
+
+// Writes next to the destination and renames, so that readers never see a
+// partially written entry.
+void writeEntry(const std::string &path, const std::string &content)
+{
+  std::random_device random;
+  const std::string temporary =
+      path + "." +
+      std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()) ^
+                     random()) +
+      ".tmp";
+  {
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    file.write(content.data(), content.size());
+    if (!file)
+    {
+      std::remove(temporary.c_str());
+      throw std::runtime_error("Could not write " + temporary);
+    }
+  }
+  if (std::rename(temporary.c_str(), path.c_str()) != 0)
+  {
+    std::remove(temporary.c_str());
+    throw std::runtime_error("Could not rename " + temporary + " to " + path);
+  }
+}
+} // namespace
+
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed)
+{
+  const uint64_t kMultiplier1 = 0x87c37b91114253d5ULL;
+  const uint64_t kMultiplier2 = 0x4cf5ad432745937fULL;
+  const auto *bytes = static_cast<const uint8_t *>(data);
+
+  uint64_t h = seed ^ (size * kMultiplier2);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8)
+  {
+    uint64_t word;
+    std::memcpy(&word, bytes + i, sizeof(word));
+    h ^= rotateLeft(word * kMultiplier1, 31) * kMultiplier2;
+    h = rotateLeft(h, 27) * 5 + 0x52dce729;
+  }
+  uint64_t tail = 0;
+  if (i < size)
+  {
+    std::memcpy(&tail, bytes + i, size - i);
+  }
+  h ^= rotateLeft(tail * kMultiplier1, 31) * kMultiplier2;
+  return finalize(h);
+}
+
+uint64_t hashFiles(const std::vector<std::string> &paths)
+{
+  uint64_t h = 0;
+  for (const auto &path : paths)
+  {
+    const MappedFile file(path);
+    h = hashBytes(file.data(), file.size(), h);
+  }
+  return h;
+}
+
+SparsePillars sparsifyPillars(const float *tensor, const int *indices,
+                              int maxPillars, int maxPointsPerPillar,
+                              int nbFeatures)
+{
+  SparsePillars pillars;
+  pillars.maxPillars = maxPillars;
+  pillars.maxPointsPerPillar = maxPointsPerPillar;
+  pillars.nbFeatures = nbFeatures;
+
+  const size_t pillarSize = static_cast<size_t>(maxPointsPerPillar) * nbFeatures;
+  std::vector<uint32_t> pointCounts(maxPillars, 0);
+  int nbPillars = 0;
+  for (int pillar = 0; pillar < maxPillars; ++pillar)
+  {
+    const float *features = tensor + pillar * pillarSize;
+    const float *lastNonZero = std::find_if(
+        std::reverse_iterator<const float *>(features + pillarSize),
+        std::reverse_iterator<const float *>(features),
+        [](float value) { return value != 0; }).base();
+    pointCounts[pillar] = static_cast<uint32_t>(
+        (lastNonZero - features + nbFeatures - 1) / nbFeatures);
+    if (pointCounts[pillar] > 0 || indices[pillar * 3 + 1] != 0 ||
+        indices[pillar * 3 + 2] != 0)
+    {
+      nbPillars = pillar + 1;
+    }
+  }
+
+  for (int pillar = 0; pillar < nbPillars; ++pillar)
+  {
+    const float *features = tensor + pillar * pillarSize;
+    pillars.indices.push_back(indices[pillar * 3 + 1]);
+    pillars.indices.push_back(indices[pillar * 3 + 2]);
+    pillars.pointCounts.push_back(pointCounts[pillar]);
+    pillars.features.insert(pillars.features.end(), features,
+                            features + pointCounts[pillar] * nbFeatures);
+  }
+  return pillars;
+}
+
+void expandPillars(const SparsePillars &pillars, float *tensor, int *indices)
+{
+  const size_t pillarSize =
+      static_cast<size_t>(pillars.maxPointsPerPillar) * pillars.nbFeatures;
+  std::fill(tensor, tensor + pillars.maxPillars * pillarSize, 0.0f);
+  std::fill(indices, indices + static_cast<size_t>(pillars.maxPillars) * 3, 0);
+
+  const float *features = pillars.features.data();
+  for (size_t pillar = 0; pillar < pillars.pointCounts.size(); ++pillar)
+  {
+    indices[pillar * 3 + 1] = pillars.indices[pillar * 2];
+    indices[pillar * 3 + 2] = pillars.indices[pillar * 2 + 1];
+    const size_t size = pillars.pointCounts[pillar] * pillars.nbFeatures;
+    std::copy(features, features + size, tensor + pillar * pillarSize);
+    features += size;
+  }
+}
+
+SparseTarget sparsifyTarget(const float *target,
+                            const std::array<int32_t, 4> &shape)
+{
+  SparseTarget sparse;
+  sparse.shape = shape;
+  const size_t nbCells = static_cast<size_t>(shape[0]) * shape[1] * shape[2] *
+                         shape[3];
+  for (size_t cell = 0; cell < nbCells; ++cell)
+  {
+    const float *values = target + cell * kTargetChannels;
+    if (std::any_of(values, values + kTargetChannels,
+                    [](float value) { return value != 0; }))
+    {
+      sparse.cells.push_back(static_cast<uint32_t>(cell));
+      sparse.values.insert(sparse.values.end(), values,
+                           values + kTargetChannels);
+    }
+  }
+  return sparse;
+}
+
+void expandTarget(const SparseTarget &target, float *dense)
+{
+  const size_t nbCells = static_cast<size_t>(target.shape[0]) *
+                         target.shape[1] * target.shape[2] * target.shape[3];
+  std::fill(dense, dense + nbCells * kTargetChannels, 0.0f);
+  for (size_t i = 0; i < target.cells.size(); ++i)
+  {
+    std::copy(target.values.begin() + i * kTargetChannels,
+              target.values.begin() + (i + 1) * kTargetChannels,
+              dense + static_cast<size_t>(target.cells[i]) * kTargetChannels);
+  }
+}
+
+VoxelCache::VoxelCache(const std::string &directory,
+                       const std::string &parameters)
+    : directory_(directory),
+      parameterHash_(hashBytes(parameters.data(), parameters.size()))
+{
+}
+
+uint64_t VoxelCache::key(const std::vector<std::string> &inputFiles) const
+{
+  return hashFiles(inputFiles);
+}
+
+std::string VoxelCache::path(uint64_t key, const char *kind) const
+{
+  char name[64];
+  std::snprintf(name, sizeof(name), "%016llx-%016llx.%s",
+                static_cast<unsigned long long>(key),
+                static_cast<unsigned long long>(parameterHash_), kind);
+  return directory_ + "/" + name;
+}
+
+bool VoxelCache::loadPillars(uint64_t key, SparsePillars &pillars) const
+{
+  std::string content;
+  if (!readEntry(path(key, "pillars"), content))
+  {
+    return false;
+  }
+
+  // Corrupt or foreign entries are treated as misses and get overwritten.
+  try
+  {
+    BinaryReader reader(content);
+    if (!readHeader(reader, kPillarKind, key, parameterHash_))
+    {
+      return false;
+    }
+    pillars.maxPillars = reader.get<int32_t>();
+    pillars.maxPointsPerPillar = reader.get<int32_t>();
+    pillars.nbFeatures = reader.get<int32_t>();
+    reader.getVector(pillars.indices);
+    reader.getVector(pillars.pointCounts);
+    reader.getVector(pillars.features);
+
+    size_t nbFeatures = 0;
+    for (const auto count : pillars.pointCounts)
+    {
+      if (count > static_cast<uint32_t>(pillars.maxPointsPerPillar))
+        return false;
+      nbFeatures += count * pillars.nbFeatures;
+    }
+    return reader.finished() &&
+           pillars.pointCounts.size() <=
+               static_cast<size_t>(pillars.maxPillars) &&
+           pillars.indices.size() == 2 * pillars.pointCounts.size() &&
+           pillars.features.size() == nbFeatures;
+  }
+  catch (const std::runtime_error &)
+  {
+    return false;
+  }
+}
+
+void VoxelCache::storePillars(uint64_t key, const SparsePillars &pillars) const
+{
+  BinaryWriter writer;
+  putHeader(writer, kPillarKind, key, parameterHash_);
+  writer.put<int32_t>(pillars.maxPillars);
+  writer.put<int32_t>(pillars.maxPointsPerPillar);
+  writer.put<int32_t>(pillars.nbFeatures);
+  writer.putVector(pillars.indices);
+  writer.putVector(pillars.pointCounts);
+  writer.putVector(pillars.features);
+  writeEntry(path(key, "pillars"), writer.buffer());
+}
+
+bool VoxelCache::loadTarget(uint64_t key, SparseTarget &target,
+                            TargetStatistics &statistics) const
+{
+  std::string content;
+  if (!readEntry(path(key, "target"), content))
+  {
+    return false;
+  }
+
+  try
+  {
+    BinaryReader reader(content);
+    if (!readHeader(reader, kTargetKind, key, parameterHash_))
+    {
+      return false;
+    }
+    size_t nbCells = 1;
+    for (auto &extent : target.shape)
+    {
+      extent = reader.get<int32_t>();
+      if (extent < 0)
+        return false;
+      nbCells *= extent;
+    }
+    reader.getVector(target.cells);
+    reader.getVector(target.values);
+    statistics.positives = reader.get<int32_t>();
+    statistics.negatives = reader.get<int32_t>();
+    statistics.ignored = reader.get<int32_t>();
+    statistics.forcedMatches = reader.get<int32_t>();
+    statistics.unassigned = reader.get<int32_t>();
+    reader.getVector(statistics.objectIds);
+    reader.getVector(statistics.bestIou);
+    reader.getVector(statistics.bestAnchorIds);
+
+    return reader.finished() &&
+           target.values.size() == target.cells.size() * kTargetChannels &&
+           std::all_of(target.cells.begin(), target.cells.end(),
+                       [nbCells](uint32_t cell) { return cell < nbCells; });
+  }
+  catch (const std::runtime_error &)
+  {
+    return false;
+  }
+}
+
+void VoxelCache::storeTarget(uint64_t key, const SparseTarget &target,
+                             const TargetStatistics &statistics) const
+{
+  BinaryWriter writer;
+  putHeader(writer, kTargetKind, key, parameterHash_);
+  for (const auto extent : target.shape)
+    writer.put<int32_t>(extent);
+  writer.putVector(target.cells);
+  writer.putVector(target.values);
+  writer.put<int32_t>(statistics.positives);
+  writer.put<int32_t>(statistics.negatives);
+  writer.put<int32_t>(statistics.ignored);
+  writer.put<int32_t>(statistics.forcedMatches);
+  writer.put<int32_t>(statistics.unassigned);
+  writer.putVector(statistics.objectIds);
+  writer.putVector(statistics.bestIou);
+  writer.putVector(statistics.bestAnchorIds);
+  writeEntry(path(key, "target"), writer.buffer());
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "target.h"
+
+// 64 bit hash of a byte range, not cryptographic.
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed = 0);
+
+// Hash of the contents of the given files, in order.
+uint64_t hashFiles(const std::vector<std::string> &paths);
+
+// Pillar tensor and indices of a single sample without the zero padding:
+// only the used pillars are kept, each with its points up to the last
+// non-zero one.
+struct SparsePillars
+{
+  int maxPillars = 0;
+  int maxPointsPerPillar = 0;
+  int nbFeatures = 0;
+  // x and y index of every kept pillar.
+  std::vector<int32_t> indices;
+  std::vector<uint32_t> pointCounts;
+  std::vector<float> features;
+};
+
+SparsePillars sparsifyPillars(const float *tensor, const int *indices,
+                              int maxPillars, int maxPointsPerPillar,
+                              int nbFeatures);
+// Writes the dense (maxPillars, maxPointsPerPillar, nbFeatures) tensor and the
+// (maxPillars, 3) indices.
+void expandPillars(const SparsePillars &pillars, float *tensor, int *indices);
+
+// Target tensor (objects, X, Y, anchors, 10) with only the anchor cells that
+// have a non-zero channel.
+struct SparseTarget
+{
+  std::array<int32_t, 4> shape = {{0, 0, 0, 0}};
+  // Flat (object, x, y, anchor) index of every kept cell.
+  std::vector<uint32_t> cells;
+  std::vector<float> values;
+};
+
+SparseTarget sparsifyTarget(const float *target,
+                            const std::array<int32_t, 4> &shape);
+void expandTarget(const SparseTarget &target, float *dense);
+
+// On-disk cache of pillar and target outputs. Entries are keyed by the content
+// hash of the input files and a hash of the parameters they were computed
+// with, so that changing either never returns stale data. Entries are written
+// to a temporary file and renamed, which makes concurrent workers safe.
+class VoxelCache
+{
+public:
+  // The parameters string has to describe everything the outputs depend on
+  // apart from the input files (grid, anchors, thresholds, ...).
+  VoxelCache(const std::string &directory, const std::string &parameters);
+
+  uint64_t key(const std::vector<std::string> &inputFiles) const;
+
+  bool loadPillars(uint64_t key, SparsePillars &pillars) const;
+  void storePillars(uint64_t key, const SparsePillars &pillars) const;
+
+  bool loadTarget(uint64_t key, SparseTarget &target,
+                  TargetStatistics &statistics) const;
+  void storeTarget(uint64_t key, const SparseTarget &target,
+                   const TargetStatistics &statistics) const;
+
+private:
+  std::string path(uint64_t key, const char *kind) const;
+
+  std::string directory_;
+  uint64_t parameterHash_;
+};
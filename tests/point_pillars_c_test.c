@@ -0,0 +1,185 @@
+// Calls the C interface the way a C application does, linked against the
+// shared point_pillars_c library. Run by ctest.
+
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "point_pillars_c.h"
+
+static int failures = 0;
+
+#define CHECK(condition)                                                       \
+  do                                                                           \
+  {                                                                            \
+    if (!(condition))                                                          \
+    {                                                                          \
+      fprintf(stderr, "%s:%d: %s failed (last error: %s)\n", __FILE__,         \
+              __LINE__, #condition, ppLastError());                            \
+      ++failures;                                                              \
+    }                                                                          \
+  } while (0)
+
+static void testPillars(void)
+{
+  const float points[3][4] = {
+      {10.0f, 0.0f, 0.0f, 0.5f},
+      {10.05f, 0.05f, -0.5f, 0.3f},
+      {20.0f, 5.0f, -1.0f, 0.1f},
+  };
+  ppPillarParameters parameters;
+  parameters.structSize = sizeof(parameters);
+  ppDefaultPillarParameters(&parameters);
+  CHECK(parameters.structSize == sizeof(parameters));
+  CHECK(parameters.maxPointsPerPillar == 100 && parameters.xStep == 0.16f);
+  parameters.maxPillars = 4;
+
+  const int features = ppPillarFeatureCount(4);
+  CHECK(features == 9);
+  float *tensor = calloc((size_t)4 * 100 * features, sizeof(float));
+  int32_t indices[4 * 3];
+  int nbPillars = -1;
+  CHECK(ppCreatePillars(&points[0][0], 3, 4, &parameters, tensor, indices,
+                        &nbPillars) == 0);
+  CHECK(nbPillars == 2);
+  // One pillar holds both points of the cell at x = 10, y = 0.
+  int found = 0;
+  for (int i = 0; i < nbPillars; ++i)
+  {
+    if (indices[i * 3 + 1] == 62 && indices[i * 3 + 2] == 252)
+    {
+      const float *pillar = tensor + (size_t)i * 100 * features;
+      CHECK(pillar[0] == 10.0f && pillar[features] == 10.05f);
+      CHECK(pillar[2 * features] == 0.0f);
+      ++found;
+    }
+  }
+  CHECK(found == 1);
+
+  CHECK(ppCreatePillars(&points[0][0], 3, 5, &parameters, tensor, indices,
+                        &nbPillars) == -1);
+
+  // A caller compiled against a later version with a larger struct.
+  struct
+  {
+    ppPillarParameters parameters;
+    float added;
+  } larger;
+  larger.parameters.structSize = sizeof(larger);
+  larger.added = 42.0f;
+  ppDefaultPillarParameters(&larger.parameters);
+  CHECK(larger.parameters.structSize == sizeof(larger) && larger.added == 42.0f);
+  larger.parameters.maxPillars = 4;
+  CHECK(ppCreatePillars(&points[0][0], 3, 4, &larger.parameters, tensor,
+                        indices, &nbPillars) == 0);
+  CHECK(nbPillars == 2);
+
+  // Sizes below the one of the first ABI version are rejected.
+  parameters.structSize = offsetof(ppPillarParameters, minDistance);
+  CHECK(ppCreatePillars(&points[0][0], 3, 4, &parameters, tensor, indices,
+                        &nbPillars) == -1);
+  parameters.structSize = 0;
+  CHECK(ppCreatePillars(&points[0][0], 3, 4, &parameters, tensor, indices,
+                        &nbPillars) == -1);
+  free(tensor);
+}
+
+// Pillars and targets built with the defaults share their grid.
+static void testDefaults(void)
+{
+  ppPillarParameters pillars;
+  pillars.structSize = sizeof(pillars);
+  ppDefaultPillarParameters(&pillars);
+  ppTargetParameters target;
+  target.structSize = sizeof(target);
+  ppDefaultTargetParameters(&target);
+  CHECK(pillars.xStep == target.xStep && pillars.yStep == target.yStep);
+  CHECK(pillars.xMin == target.xMin && pillars.xMax == target.xMax);
+  CHECK(pillars.yMin == target.yMin && pillars.yMax == target.yMax);
+  CHECK(pillars.zMin == target.zMin && pillars.zMax == target.zMax);
+}
+
+static void testTarget(void)
+{
+  const ppBox anchor = {0.0f, 0.0f, -1.0f, 3.9f, 1.6f, 1.56f, 0.0f, -1};
+  const ppBox objects[2] = {
+      {20.0f, 0.0f, -1.0f, 3.9f, 1.6f, 1.56f, 0.0f, 0},
+      {100.0f, 0.0f, -1.0f, 3.9f, 1.6f, 1.56f, 0.0f, 0},
+  };
+  ppTargetParameters parameters;
+  parameters.structSize = sizeof(parameters);
+  ppDefaultTargetParameters(&parameters);
+  CHECK(parameters.anchors == NULL && parameters.positiveThreshold == 0.6f);
+  CHECK(parameters.centerPositiveThreshold == 0.5f);
+  parameters.anchors = &anchor;
+  parameters.nbAnchors = 1;
+
+  int xSize = 0;
+  int ySize = 0;
+  CHECK(ppTargetGridSize(&parameters, &xSize, &ySize) == 0);
+  CHECK(xSize == 252 && ySize == 252);
+  const size_t nbCells = (size_t)xSize * ySize;
+  float *tensor = calloc(2 * nbCells * 10, sizeof(float));
+  CHECK(ppCreateTarget(objects, 2, &parameters, tensor) == 0);
+  int positives = 0;
+  for (size_t i = 0; i < nbCells; ++i)
+  {
+    positives += tensor[i * 10] == 1.0f;
+  }
+  CHECK(positives > 0);
+  // The second object is outside of the grid.
+  size_t nonZero = 0;
+  for (size_t i = nbCells * 10; i < 2 * nbCells * 10; ++i)
+  {
+    nonZero += tensor[i] != 0.0f;
+  }
+  CHECK(nonZero == 0);
+
+  parameters.structSize = sizeof(uint32_t);
+  CHECK(ppCreateTarget(objects, 2, &parameters, tensor) == -1);
+  CHECK(ppTargetGridSize(&parameters, &xSize, &ySize) == -1);
+  free(tensor);
+}
+
+static void testOverlaps(void)
+{
+  const ppBox boxes[2] = {
+      {0.0f, 0.0f, 0.0f, 4.0f, 2.0f, 1.5f, 0.0f, 0},
+      {2.0f, 0.0f, 0.0f, 4.0f, 2.0f, 1.5f, 0.0f, 0},
+  };
+  float overlaps[4];
+  CHECK(ppBoxOverlaps(boxes, 2, boxes, 2, ppIouBev, overlaps) == 0);
+  CHECK(fabsf(overlaps[0] - 1.0f) < 1e-5f && fabsf(overlaps[3] - 1.0f) < 1e-5f);
+  CHECK(fabsf(overlaps[1] - 1.0f / 3.0f) < 1e-5f);
+  CHECK(fabsf(overlaps[2] - 1.0f / 3.0f) < 1e-5f);
+  CHECK(ppBoxOverlaps(boxes, 2, boxes, 2, 7, overlaps) == -1);
+
+  // Zero area boxes overlap nothing, even themselves.
+  const ppBox empty[2] = {
+      {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0},
+      {0.0f, 0.0f, 0.0f, 4.0f, 0.0f, 1.5f, 0.0f, 0},
+  };
+  CHECK(ppBoxOverlaps(empty, 2, empty, 2, ppIouBev, overlaps) == 0);
+  CHECK(overlaps[0] == 0.0f && overlaps[1] == 0.0f && overlaps[2] == 0.0f &&
+        overlaps[3] == 0.0f);
+  CHECK(ppBoxOverlaps(empty, 2, empty, 2, ppIou3D, overlaps) == 0);
+  CHECK(overlaps[0] == 0.0f && overlaps[1] == 0.0f && overlaps[2] == 0.0f &&
+        overlaps[3] == 0.0f);
+}
+
+int main(void)
+{
+  CHECK(ppAbiVersion() == POINT_PILLARS_C_ABI_VERSION);
+  testPillars();
+  testDefaults();
+  testTarget();
+  testOverlaps();
+  if (failures > 0)
+  {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+  printf("All checks passed\n");
+  return 0;
+}